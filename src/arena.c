@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+#if !defined(ARENA_BLOCK_SIZE)
+#define ARENA_BLOCK_SIZE 4096
+#endif
+
+#if !defined(ARENA_KEEP_SIZE)
+#define ARENA_KEEP_SIZE (64 * 1024)
+#endif
+
+#define ALIGNMENT alignof(max_align_t)
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+/**
+ * @brief Structure of a block of the arena
+ *
+ */
+struct arena_block {
+    arena_block_t *next;
+    size_t size; /* size of data */
+    size_t used; /* used bytes of data */
+    alignas(max_align_t) char data[];
+};
+
+/**********************/
+/*** PUBLIC METHODS ***/
+/**********************/
+
+/* see arena.h */
+void init_arena(arena_t *arena) {
+    arena->blocks = NULL;
+    arena->current = NULL;
+    arena->used = 0;
+    arena->size = 0;
+}
+
+/* see arena.h */
+void free_arena(arena_t *arena) {
+    arena_block_t *block;
+
+    while ((block = arena->blocks) != NULL) {
+        arena->blocks = block->next;
+        free(block);
+    }
+    init_arena(arena);
+}
+
+/* see arena.h */
+void arena_reset(arena_t *arena) {
+    arena_block_t **prev = &arena->blocks, *block;
+
+    arena->size = 0;
+    while ((block = *prev) != NULL) {
+        if (arena->size + block->size > ARENA_KEEP_SIZE) {
+            *prev = block->next;
+            free(block);
+        } else {
+            arena->size += block->size;
+            block->used = 0;
+            prev = &block->next;
+        }
+    }
+    arena->current = arena->blocks;
+    arena->used = 0;
+}
+
+/* see arena.h */
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *block;
+
+    size = ALIGN(size);
+
+    /* search room in the current block or the next ones */
+    for (block = arena->current; block != NULL; block = block->next) {
+        if (block->size - block->used >= size)
+            break;
+    }
+
+    if (block == NULL) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(*block) + block_size);
+        if (block == NULL) {
+            ERROR("malloc arena block");
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = 0;
+
+        /* append it to keep the order of the blocks */
+        arena_block_t **prev = arena->current ? &arena->current->next : &arena->blocks;
+        while (*prev != NULL) prev = &(*prev)->next;
+        block->next = NULL;
+        *prev = block;
+        arena->size += block_size;
+    }
+
+    /* a big allocation doesn't make the current block skip its room */
+    if (arena->current == NULL || size <= ARENA_BLOCK_SIZE)
+        arena->current = block;
+
+    void *ptr = &block->data[block->used];
+    block->used += size;
+    arena->used += size;
+    return ptr;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+#ifndef SEC_LSM_MANAGER_ARENA_H
+#define SEC_LSM_MANAGER_ARENA_H
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+typedef struct arena_block arena_block_t;
+
+/**
+ * @brief Structure of arena
+ * An arena hands out memory from big blocks. Its allocations are never
+ * freed one by one: they are all released at once when it is reset.
+ *
+ */
+typedef struct arena {
+    arena_block_t *blocks;  /* list of the blocks */
+    arena_block_t *current; /* block of the next allocations */
+    size_t used;            /* bytes given since the last reset */
+    size_t size;            /* bytes held by the blocks */
+} arena_t;
+
+/**
+ * @brief Initialize an empty arena
+ *
+ * @param[in] arena arena handler
+ */
+extern void init_arena(arena_t *arena) __nonnull();
+
+/**
+ * @brief Free all the blocks of the arena
+ * The pointer is not free
+ *
+ * @param[in] arena arena handler
+ */
+extern void free_arena(arena_t *arena) __nonnull();
+
+/**
+ * @brief Release all the allocations of the arena at once
+ * Blocks are kept, up to ARENA_KEEP_SIZE bytes, for the next allocations
+ *
+ * @param[in] arena arena handler
+ */
+extern void arena_reset(arena_t *arena) __nonnull();
+
+/**
+ * @brief Allocate memory in the arena
+ * The memory is suitably aligned for any type
+ *
+ * @param[in] arena arena handler
+ * @param[in] size The size to allocate
+ * @return the allocated memory or NULL on error
+ */
+extern void *arena_alloc(arena_t *arena, size_t size) __wur __nonnull();
+
+#endif
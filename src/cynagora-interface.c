@@ -35,15 +35,127 @@
 #define CYNAGORA_AUTHORIZED "yes"
 #endif
 
+/** default seconds before closing an unused connection to cynagora */
+#if !defined(CYNAGORA_IDLE_TIMEOUT)
+#define CYNAGORA_IDLE_TIMEOUT 30
+#endif
+
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "limits.h"
 #include "log.h"
 
+typedef struct policy_key policy_key_t;
+
+/** a policy of the label to drop */
+struct policy_key {
+    /** next policy to drop */
+    policy_key_t *next;
+
+    /** session of the policy */
+    char *session;
+
+    /** user of the policy */
+    char *user;
+
+    /** permission of the policy */
+    char permission[];
+};
+
+/** the difference between the policies of a label and its permissions */
+typedef struct policy_diff {
+    /** the permissions to grant */
+    const permission_set_t *permission_set;
+
+    /** the permissions already granted */
+    permission_set_t granted;
+
+    /** the policies to drop */
+    policy_key_t *stale;
+
+    /** first error met */
+    int rc;
+} policy_diff_t;
+
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Sort a policy of the label: granted if it is exactly what
+ * cynagora_set_policies would set for a permission to grant, stale otherwise
+ *
+ * @param[in] closure the policy_diff_t
+ * @param[in] key the key of the policy
+ * @param[in] value the value of the policy
+ */
+static void diff_policy(void *closure, const cynagora_key_t *key, const cynagora_value_t *value) {
+    policy_diff_t *diff = closure;
+    if (diff->rc < 0)
+        return;
+
+    if (!strcmp(key->session, CYNAGORA_INSERT_ALL) && !strcmp(key->user, CYNAGORA_INSERT_ALL) &&
+        !strcmp(value->value, CYNAGORA_AUTHORIZED) && value->expire == 0 &&
+        permission_set_has_permission(diff->permission_set, key->permission, false)) {
+        diff->rc = permission_set_add_permission(&diff->granted, key->permission);
+        if (diff->rc < 0) {
+            ERROR("permission_set_add_permission : %d %s", -diff->rc, strerror(-diff->rc));
+        }
+        return;
+    }
+
+    size_t len_permission = strlen(key->permission) + 1;
+    size_t len_session = strlen(key->session) + 1;
+    policy_key_t *stale = malloc(sizeof(*stale) + len_permission + len_session + strlen(key->user) + 1);
+    if (stale == NULL) {
+        ERROR("malloc policy_key_t");
+        diff->rc = -ENOMEM;
+        return;
+    }
+    memcpy(stale->permission, key->permission, len_permission);
+    stale->session = stale->permission + len_permission;
+    memcpy(stale->session, key->session, len_session);
+    stale->user = stale->session + len_session;
+    strcpy(stale->user, key->user);
+    stale->next = diff->stale;
+    diff->stale = stale;
+}
+
 /**********************/
 /*** PUBLIC METHODS ***/
 /**********************/
 
+/* see cynagora-interface.h */
+int get_cynagora_idle_timeout(const char *value) {
+    char *end;
+    long timeout;
+
+    value = value ?: secure_getenv("CYNAGORA_IDLE_TIMEOUT");
+    if (value != NULL) {
+        timeout = strtol(value, &end, 10);
+        if (*value != '\0' && *end == '\0' && timeout >= 0 && timeout <= INT_MAX / 1000)
+            return (int)timeout;
+        ERROR("invalid cynagora idle timeout %s", value);
+    }
+    return CYNAGORA_IDLE_TIMEOUT;
+}
+
+/* see cynagora-interface.h */
+bool cynagora_link_error(int rc) {
+    switch (-rc) {
+        case EPIPE:
+        case ECONNRESET:
+        case ECONNABORTED:
+        case ECONNREFUSED:
+        case ENOTCONN:
+            return true;
+        default:
+            return false;
+    }
+}
+
 /* see cynagora-interface.h */
 int cynagora_set_policies(cynagora_t *cynagora, const char *label, const permission_set_t *permission_set) {
     // enter to modify policies cynagora
@@ -83,6 +195,78 @@ int cynagora_set_policies(cynagora_t *cynagora, const char *label, const permiss
     return rc;
 }
 
+/* see cynagora-interface.h */
+int cynagora_update_policies(cynagora_t *cynagora, const char *label, const permission_set_t *permission_set) {
+    policy_diff_t diff = {.permission_set = permission_set, .stale = NULL, .rc = 0};
+    policy_key_t *stale;
+    size_t changes = 0;
+    init_permission_set(&diff.granted);
+
+    // enter to modify policies cynagora
+    int rc = cynagora_enter(cynagora);
+    if (rc < 0) {
+        ERROR("cynagora_enter : %d %s", -rc, strerror(-rc));
+        return rc;
+    }
+
+    cynagora_key_t key = {
+        .client = label,
+        .session = CYNAGORA_SELECT_ALL,
+        .user = CYNAGORA_SELECT_ALL,
+        .permission = CYNAGORA_SELECT_ALL};
+    rc = cynagora_get(cynagora, &key, diff_policy, &diff);
+    if (rc < 0) {
+        ERROR("cynagora_get : %d %s", -rc, strerror(-rc));
+    } else {
+        rc = diff.rc;
+    }
+
+    // drop the policies not matching a permission
+    for (stale = diff.stale; rc == 0 && stale != NULL; stale = stale->next) {
+        key.session = stale->session;
+        key.user = stale->user;
+        key.permission = stale->permission;
+        rc = cynagora_drop(cynagora, &key);
+        if (rc < 0) {
+            ERROR("cynagora_drop : %d %s", -rc, strerror(-rc));
+        }
+        changes++;
+    }
+
+    // set the permissions not granted yet
+    key.session = CYNAGORA_INSERT_ALL;
+    key.user = CYNAGORA_INSERT_ALL;
+    cynagora_value_t value = {
+        .value = CYNAGORA_AUTHORIZED,
+        .expire = 0 /* infinite */};
+    for (size_t i = 0; rc == 0 && i < permission_set->size; i++) {
+        if (!permission_set_has_permission(&diff.granted, permission_set->permissions[i], false)) {
+            key.permission = permission_set->permissions[i];
+            rc = cynagora_set(cynagora, &key, &value);
+            if (rc < 0) {
+                ERROR("cynagora_set : %d %s", -rc, strerror(-rc));
+            }
+            changes++;
+        }
+    }
+
+    // leave and apply modification, if any
+    int rc2 = cynagora_leave(cynagora, rc == 0 && changes > 0);
+    if (rc2 < 0)
+        ERROR("cynagora_leave : %d %s", -rc2, strerror(-rc2));
+    if (rc == 0)
+        rc = rc2;
+
+    DEBUG("%zu cynagora policies changed for %s", changes, label);
+
+    while ((stale = diff.stale) != NULL) {
+        diff.stale = stale->next;
+        free(stale);
+    }
+    free_permission_set(&diff.granted);
+    return rc;
+}
+
 /* see cynagora-interface.h */
 int cynagora_drop_policies(cynagora_t *cynagora, const char *label) {
     // enter to modify policies cynagora
@@ -24,6 +24,8 @@
 #ifndef SEC_LSM_MANAGER_CYNAGORA_INTERFACE_H
 #define SEC_LSM_MANAGER_CYNAGORA_INTERFACE_H
 
+#include <stdbool.h>
+
 #include "permissions.h"
 
 #ifndef SIMULATE_CYNAGORA
@@ -32,6 +34,22 @@
 #include "simulation/cynagora/cynagora.h"
 #endif
 
+/**
+ * @brief Get the time after which an unused connection to cynagora is closed
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the timeout in seconds (0 closes it when the last client leaves)
+ */
+extern int get_cynagora_idle_timeout(const char *value) __wur;
+
+/**
+ * @brief Check if an error of cynagora comes from a broken connection
+ *
+ * @param[in] rc the negative -errno value returned by cynagora
+ * @return true if the connection must be opened again
+ */
+extern bool cynagora_link_error(int rc) __wur;
+
 /**
  * @brief Define new permissions in cynagora
  *
@@ -43,6 +61,19 @@
 extern int cynagora_set_policies(cynagora_t *cynagora, const char *label, const permission_set_t *permission_set)
     __wur __nonnull();
 
+/**
+ * @brief Make the policies of cynagora for a label exactly its permissions
+ * The current policies of the label are read and only the differences are
+ * written, in one transaction. Nothing is committed if nothing changes.
+ *
+ * @param[in] cynagora cynagora admin client
+ * @param[in] label label of the application
+ * @param[in] permission_set the permissions of the application
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int cynagora_update_policies(cynagora_t *cynagora, const char *label, const permission_set_t *permission_set)
+    __wur __nonnull();
+
 /**
  * @brief Drop old policies of cynagora for a label (client)
  *
@@ -0,0 +1,635 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "limits.h"
+#include "log.h"
+#include "utils.h"
+
+#if !defined(SEC_LSM_MANAGER_STATEDIR)
+#define SEC_LSM_MANAGER_STATEDIR "/var/lib/sec-lsm-manager"
+#endif
+
+/** default file of the journal */
+#if !defined(SEC_LSM_MANAGER_JOURNAL_FILE)
+#define SEC_LSM_MANAGER_JOURNAL_FILE SEC_LSM_MANAGER_STATEDIR "/journal"
+#endif
+
+/** size above which the journal is emptied when no operation is running */
+#if !defined(JOURNAL_COMPACT_SIZE)
+#define JOURNAL_COMPACT_SIZE (1024 * 1024)
+#endif
+
+/** magic of the records */
+#define JOURNAL_MAGIC 0x4c4e524aU
+
+/** kinds of the records */
+enum record_kind { record_begin = 1, record_stage = 2, record_end = 3 };
+
+/** a record, followed by its payload */
+typedef struct journal_record {
+    uint32_t magic; /* JOURNAL_MAGIC */
+    uint32_t kind;  /* the kind of the record */
+    uint32_t seq;   /* the sequence number of the operation */
+    uint32_t value; /* the operation of a begin or the stage of a stage record */
+    uint32_t size;  /* size of the payload */
+    uint32_t sum;   /* checksum of kind, seq, value, size and the payload */
+} journal_record_t;
+
+/** an operation found in the journal at recovery */
+typedef struct journal_intent {
+    uint32_t seq;        /* the sequence number */
+    uint32_t op;         /* the operation */
+    const char *payload; /* the application */
+    uint32_t size;       /* size of the payload */
+    unsigned stage;      /* the last stage completed */
+    bool ended;          /* is ended */
+} journal_intent_t;
+
+/** the journal */
+struct journal {
+    /** protects the journal */
+    pthread_mutex_t mutex;
+
+    /** signals the end of a flush */
+    pthread_cond_t cond;
+
+    /** the file */
+    int fd;
+
+    /** size of the records written */
+    uint64_t size;
+
+    /** size of the records flushed to the disk */
+    uint64_t synced;
+
+    /** is a flush running? */
+    bool syncing;
+
+    /** are there operations not recovered? (the journal must be kept) */
+    bool keep;
+
+    /** count of operations begun and not ended */
+    unsigned active;
+
+    /** next sequence number */
+    uint32_t next_seq;
+
+    /** the counters */
+    journal_stats_t stats;
+
+    /** the file of the journal */
+    char file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+};
+
+const char default_journal_file[] = SEC_LSM_MANAGER_JOURNAL_FILE;
+
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Compute the checksum of a record
+ *
+ * @param[in] record the record
+ * @param[in] payload the payload of the record
+ * @return the checksum
+ */
+__nonnull() __wur static uint32_t checksum(const journal_record_t *record, const char *payload) {
+    size_t hash = hash_string((const char *)&record->kind, 4 * sizeof(uint32_t), false);
+    return (uint32_t)(hash * 31 + hash_string(payload, record->size, false));
+}
+
+/**
+ * @brief Append a record to the journal
+ * The mutex must be held. On error, the journal is truncated to its previous size.
+ *
+ * @param[in] journal the journal
+ * @param[in] kind the kind of the record
+ * @param[in] seq the sequence number of the operation
+ * @param[in] value the value of the record
+ * @param[in] payload the payload
+ * @param[in] size the size of the payload
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int append_record(journal_t *journal, enum record_kind kind, uint32_t seq, uint32_t value,
+                                           const char *payload, uint32_t size) {
+    journal_record_t record = {.magic = JOURNAL_MAGIC, .kind = kind, .seq = seq, .value = value, .size = size};
+    size_t total = sizeof(record) + size;
+    size_t pos = 0;
+    ssize_t len;
+    int rc = 0;
+
+    char *buffer = malloc(total);
+    if (buffer == NULL) {
+        ERROR("malloc failed");
+        return -ENOMEM;
+    }
+    record.sum = checksum(&record, payload);
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), payload, size);
+
+    while (pos < total) {
+        len = write(journal->fd, buffer + pos, total - pos);
+        if (len < 0 && errno != EINTR) {
+            rc = -errno;
+            ERROR("write %s : %d %s", journal->file, -rc, strerror(-rc));
+            break;
+        }
+        if (len > 0)
+            pos += (size_t)len;
+    }
+    free(buffer);
+
+    if (rc < 0) {
+        /* don't leave a torn record hiding the next ones */
+        if (ftruncate(journal->fd, (off_t)journal->size) < 0) {
+            ERROR("ftruncate %s : %d %s", journal->file, errno, strerror(errno));
+        }
+        return rc;
+    }
+
+    journal->size += total;
+    journal->stats.records++;
+    return 0;
+}
+
+/**
+ * @brief Flush the journal to the disk up to 'size'
+ * The mutex must be held. The records written while a flush is running are
+ * flushed together by the next one.
+ *
+ * @param[in] journal the journal
+ * @param[in] size the size to flush
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int sync_journal(journal_t *journal, uint64_t size) {
+    while (journal->synced < size) {
+        if (journal->syncing) {
+            pthread_cond_wait(&journal->cond, &journal->mutex);
+            continue;
+        }
+
+        uint64_t target = journal->size;
+        journal->syncing = true;
+        pthread_mutex_unlock(&journal->mutex);
+        int rc = fdatasync(journal->fd) < 0 ? -errno : 0;
+        pthread_mutex_lock(&journal->mutex);
+        journal->syncing = false;
+        pthread_cond_broadcast(&journal->cond);
+        if (rc < 0) {
+            ERROR("fdatasync %s : %d %s", journal->file, -rc, strerror(-rc));
+            return rc;
+        }
+        journal->stats.syncs++;
+        if (journal->synced < target)
+            journal->synced = target;
+    }
+    return 0;
+}
+
+/**
+ * @brief Empty the journal
+ * The mutex must be held and no flush running
+ *
+ * @param[in] journal the journal
+ */
+__nonnull() static void empty_journal(journal_t *journal) {
+    if (ftruncate(journal->fd, 0) < 0) {
+        ERROR("ftruncate %s : %d %s", journal->file, errno, strerror(errno));
+        return;
+    }
+    journal->size = 0;
+    journal->synced = 0;
+    journal->next_seq = 1;
+}
+
+/**
+ * @brief Append a string to a payload
+ *
+ * @param[in] buffer the payload
+ * @param[in,out] size the size of the payload
+ * @param[in] string the string
+ */
+__nonnull() static void put_string(char *buffer, uint32_t *size, const char *string) {
+    size_t len = strlen(string) + 1;
+    memcpy(buffer + *size, string, len);
+    *size += (uint32_t)len;
+}
+
+/**
+ * @brief Get the next string of a payload
+ *
+ * @param[in,out] payload the current position in the payload
+ * @param[in] end the end of the payload, preceded by a NUL
+ * @return the string or NULL at the end
+ */
+__nonnull() __wur static const char *next_string(const char **payload, const char *end) {
+    const char *string = *payload;
+    if (string >= end)
+        return NULL;
+    *payload += strlen(string) + 1;
+    return string;
+}
+
+/**
+ * @brief Encode the application of an operation
+ * The payload is made of strings: the id, the count of paths, the paths
+ * followed by their type and the permissions.
+ *
+ * @param[in] secure_app the application
+ * @param[out] payload the allocated payload
+ * @param[out] size the size of the payload
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int encode_app(const secure_app_t *secure_app, char **payload, uint32_t *size) {
+    char count[24];
+    size_t total;
+    char *buffer;
+
+    snprintf(count, sizeof(count), "%zu", secure_app->path_set.size);
+    total = strlen(secure_app->id) + 1 + strlen(count) + 1;
+    for (size_t i = 0; i < secure_app->path_set.size; i++) {
+        const path_t *path = secure_app->path_set.paths[i];
+        total += strlen(path->path) + 1 + strlen(get_path_type_string(path->path_type)) + 1;
+    }
+    for (size_t i = 0; i < secure_app->permission_set.size; i++)
+        total += strlen(secure_app->permission_set.permissions[i]) + 1;
+
+    if (total > UINT32_MAX / 2) {
+        ERROR("application too big");
+        return -EFBIG;
+    }
+
+    buffer = malloc(total);
+    if (buffer == NULL) {
+        ERROR("malloc failed");
+        return -ENOMEM;
+    }
+
+    *size = 0;
+    put_string(buffer, size, secure_app->id);
+    put_string(buffer, size, count);
+    for (size_t i = 0; i < secure_app->path_set.size; i++) {
+        const path_t *path = secure_app->path_set.paths[i];
+        put_string(buffer, size, path->path);
+        put_string(buffer, size, get_path_type_string(path->path_type));
+    }
+    for (size_t i = 0; i < secure_app->permission_set.size; i++)
+        put_string(buffer, size, secure_app->permission_set.permissions[i]);
+
+    *payload = buffer;
+    return 0;
+}
+
+/**
+ * @brief Decode the application of an operation
+ *
+ * @param[in] payload the payload
+ * @param[in] size the size of the payload
+ * @param[out] secure_app the created application
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int decode_app(const char *payload, uint32_t size, secure_app_t **secure_app) {
+    const char *end = payload + size;
+    const char *id, *number, *path, *type, *permission;
+    unsigned long count;
+    char *tail;
+
+    if (size == 0 || end[-1] != '\0')
+        return -EINVAL;
+
+    id = next_string(&payload, end);
+    number = next_string(&payload, end);
+    if (number == NULL)
+        return -EINVAL;
+    count = strtoul(number, &tail, 10);
+    if (*tail != '\0')
+        return -EINVAL;
+
+    int rc = create_secure_app(secure_app);
+    if (rc < 0)
+        return rc;
+
+    rc = secure_app_set_id(*secure_app, id);
+    for (unsigned long i = 0; rc >= 0 && i < count; i++) {
+        path = next_string(&payload, end);
+        type = next_string(&payload, end);
+        rc = type == NULL ? -EINVAL : secure_app_add_path(*secure_app, path, get_path_type(type));
+    }
+    while (rc >= 0 && (permission = next_string(&payload, end)) != NULL)
+        rc = secure_app_add_permission(*secure_app, permission);
+
+    if (rc < 0) {
+        destroy_secure_app(*secure_app);
+        *secure_app = NULL;
+    }
+    return rc;
+}
+
+/**
+ * @brief Get the operation of a sequence number
+ * The operations usually end in the order they begin: search from the last
+ *
+ * @param[in] intents the operations
+ * @param[in] count the count of operations
+ * @param[in] seq the sequence number
+ * @return the operation or NULL if not found
+ */
+__wur static journal_intent_t *find_intent(journal_intent_t *intents, size_t count, uint32_t seq) {
+    while (count > 0) {
+        if (intents[--count].seq == seq)
+            return &intents[count];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Read the operations of the journal
+ * The reading stops at the first invalid record: the one torn by a crash.
+ * The journal is truncated there, so that the next records follow the last
+ * valid one.
+ *
+ * @param[in] journal the journal
+ * @param[in] image the content of the journal
+ * @param[out] intents the allocated array of the operations
+ * @param[out] count the count of operations
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int read_intents(journal_t *journal, const char *image, journal_intent_t **intents,
+                                          size_t *count) {
+    journal_intent_t *array = NULL, *intent;
+    size_t capacity = 0;
+    uint64_t pos = 0;
+    journal_record_t record;
+
+    *count = 0;
+    while (pos + sizeof(record) <= journal->size) {
+        memcpy(&record, image + pos, sizeof(record));
+        const char *payload = image + pos + sizeof(record);
+        if (record.magic != JOURNAL_MAGIC || record.size > journal->size - pos - sizeof(record) ||
+            record.sum != checksum(&record, payload)) {
+            ERROR("journal %s truncated at %lu", journal->file, (unsigned long)pos);
+            break;
+        }
+        pos += sizeof(record) + record.size;
+        if (record.seq >= journal->next_seq)
+            journal->next_seq = record.seq + 1;
+
+        if (record.kind == record_begin) {
+            if (*count == capacity) {
+                capacity = capacity ? 2 * capacity : 16;
+                intent = realloc(array, capacity * sizeof(*array));
+                if (intent == NULL) {
+                    ERROR("realloc failed");
+                    free(array);
+                    return -ENOMEM;
+                }
+                array = intent;
+            }
+            intent = &array[(*count)++];
+            intent->seq = record.seq;
+            intent->op = record.value;
+            intent->payload = payload;
+            intent->size = record.size;
+            intent->stage = 0;
+            intent->ended = false;
+        } else if ((intent = find_intent(array, *count, record.seq)) != NULL) {
+            if (record.kind == record_stage && record.value > intent->stage)
+                intent->stage = record.value;
+            else if (record.kind == record_end)
+                intent->ended = true;
+        }
+    }
+
+    if (pos < journal->size) {
+        if (ftruncate(journal->fd, (off_t)pos) < 0) {
+            int rc = -errno;
+            ERROR("ftruncate %s : %d %s", journal->file, -rc, strerror(-rc));
+            free(array);
+            return rc;
+        }
+        journal->size = journal->synced = pos;
+    }
+
+    *intents = array;
+    return 0;
+}
+
+/**********************/
+/*** PUBLIC METHODS ***/
+/**********************/
+
+/* see journal.h */
+const char *get_journal_file(const char *value) {
+    value = value ?: secure_getenv("SEC_LSM_MANAGER_JOURNAL") ?: default_journal_file;
+    if (strlen(value) >= SEC_LSM_MANAGER_MAX_SIZE_PATH) {
+        ERROR("journal file too long, using default");
+        value = default_journal_file;
+    }
+    return value;
+}
+
+/* see journal.h */
+int journal_open(journal_t **journal, const char *file) {
+    struct stat st;
+    int rc;
+
+    if (strlen(file) >= SEC_LSM_MANAGER_MAX_SIZE_PATH) {
+        ERROR("journal file too long : %s", file);
+        return -EINVAL;
+    }
+
+    journal_t *result = calloc(1, sizeof(*result));
+    if (result == NULL) {
+        ERROR("calloc failed");
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&result->mutex, NULL);
+    pthread_cond_init(&result->cond, NULL);
+    secure_strncpy(result->file, file, sizeof(result->file));
+    result->next_seq = 1;
+
+    result->fd = open(file, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (result->fd < 0) {
+        rc = -errno;
+        ERROR("open %s : %d %s", file, -rc, strerror(-rc));
+        goto error;
+    }
+
+    if (fstat(result->fd, &st) < 0) {
+        rc = -errno;
+        ERROR("fstat %s : %d %s", file, -rc, strerror(-rc));
+        goto error;
+    }
+    result->size = result->synced = (uint64_t)st.st_size;
+
+    *journal = result;
+    return 0;
+
+error:
+    journal_close(result);
+    return rc;
+}
+
+/* see journal.h */
+void journal_close(journal_t *journal) {
+    if (journal->fd >= 0)
+        close(journal->fd);
+    pthread_cond_destroy(&journal->cond);
+    pthread_mutex_destroy(&journal->mutex);
+    free(journal);
+}
+
+/* see journal.h */
+int journal_recover(journal_t *journal, journal_recover_cb_t cb, void *closure) {
+    journal_intent_t *intents = NULL;
+    secure_app_t *secure_app;
+    size_t count = 0, size = (size_t)journal->size;
+    void *image;
+    int rc, failed = 0;
+
+    if (size == 0)
+        return 0;
+
+    image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, journal->fd, 0);
+    if (image == MAP_FAILED) {
+        rc = -errno;
+        ERROR("mmap %s : %d %s", journal->file, -rc, strerror(-rc));
+        return rc;
+    }
+
+    rc = read_intents(journal, image, &intents, &count);
+    if (rc < 0)
+        goto end;
+
+    for (size_t i = 0; i < count; i++) {
+        if (intents[i].ended)
+            continue;
+
+        rc = decode_app(intents[i].payload, intents[i].size, &secure_app);
+        if (rc < 0) {
+            ERROR("invalid operation %u in journal %s : %d %s", intents[i].seq, journal->file, -rc, strerror(-rc));
+        } else {
+            LOG("recover %s of %s after stage %u", intents[i].op == journal_install ? "install" : "uninstall",
+                secure_app->id, intents[i].stage);
+            rc = cb(closure, (enum journal_op)intents[i].op, secure_app, intents[i].stage);
+            destroy_secure_app(secure_app);
+        }
+
+        if (rc >= 0) {
+            pthread_mutex_lock(&journal->mutex);
+            rc = append_record(journal, record_end, intents[i].seq, 0, "", 0);
+            pthread_mutex_unlock(&journal->mutex);
+        }
+        if (rc < 0)
+            failed++;
+    }
+
+    /* keep the operations not recovered for the next start */
+    pthread_mutex_lock(&journal->mutex);
+    if (failed == 0)
+        empty_journal(journal);
+    else
+        journal->keep = true;
+    pthread_mutex_unlock(&journal->mutex);
+    rc = failed;
+
+end:
+    free(intents);
+    munmap(image, size);
+    return rc;
+}
+
+/* see journal.h */
+int journal_begin(journal_t *journal, enum journal_op op, const secure_app_t *secure_app, uint32_t *seq) {
+    char *payload;
+    uint32_t size;
+
+    int rc = encode_app(secure_app, &payload, &size);
+    if (rc < 0)
+        return rc;
+
+    pthread_mutex_lock(&journal->mutex);
+    *seq = journal->next_seq++;
+    if (journal->next_seq == 0)
+        journal->next_seq = 1;
+    rc = append_record(journal, record_begin, *seq, op, payload, size);
+    if (rc >= 0) {
+        journal->active++;
+        rc = sync_journal(journal, journal->size);
+        if (rc < 0)
+            journal->active--;
+    }
+    pthread_mutex_unlock(&journal->mutex);
+
+    free(payload);
+    return rc;
+}
+
+/* see journal.h */
+void journal_stage(journal_t *journal, uint32_t seq, unsigned stage) {
+    if (seq == 0)
+        return;
+
+    pthread_mutex_lock(&journal->mutex);
+    if (append_record(journal, record_stage, seq, stage, "", 0) < 0) {
+        ERROR("cannot record stage %u of operation %u", stage, seq);
+    }
+    pthread_mutex_unlock(&journal->mutex);
+}
+
+/* see journal.h */
+void journal_end(journal_t *journal, uint32_t seq) {
+    if (seq == 0)
+        return;
+
+    pthread_mutex_lock(&journal->mutex);
+    if (append_record(journal, record_end, seq, 0, "", 0) < 0) {
+        ERROR("cannot record end of operation %u", seq);
+    }
+    journal->active--;
+    if (journal->active == 0 && !journal->keep && !journal->syncing && journal->size >= JOURNAL_COMPACT_SIZE)
+        empty_journal(journal);
+    pthread_mutex_unlock(&journal->mutex);
+}
+
+/* see journal.h */
+void journal_get_stats(journal_t *journal, journal_stats_t *stats) {
+    pthread_mutex_lock(&journal->mutex);
+    memcpy(stats, &journal->stats, sizeof(*stats));
+    pthread_mutex_unlock(&journal->mutex);
+}
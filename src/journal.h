@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#ifndef SEC_LSM_MANAGER_JOURNAL_H
+#define SEC_LSM_MANAGER_JOURNAL_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#include "secure-app.h"
+
+typedef struct journal journal_t;
+
+/**
+ * @brief Operations recorded in the journal
+ */
+enum journal_op { journal_install = 1, journal_uninstall = 2 };
+
+/**
+ * @brief Counters of a journal
+ */
+typedef struct journal_stats {
+    unsigned long records; /* records written */
+    unsigned long syncs;   /* flushes of the records to the disk */
+} journal_stats_t;
+
+/**
+ * @brief Function recovering an operation left incomplete
+ *
+ * @param[in] closure the closure given to journal_recover
+ * @param[in] op the operation
+ * @param[in] secure_app the application of the operation
+ * @param[in] stage the last stage completed (0 if none)
+ * @return 0 in case of success or a negative -errno value
+ */
+typedef int (*journal_recover_cb_t)(void *closure, enum journal_op op, secure_app_t *secure_app, unsigned stage);
+
+/**
+ * @brief Get the file of the journal
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the path of the file of the journal
+ */
+extern const char *get_journal_file(const char *value) __wur;
+
+/**
+ * @brief Open the journal, creating its file if needed
+ *
+ * @param[out] journal where to store the handler of the journal
+ * @param[in] file the file of the journal
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int journal_open(journal_t **journal, const char *file) __wur __nonnull();
+
+/**
+ * @brief Close the journal
+ *
+ * @param[in] journal the journal
+ */
+extern void journal_close(journal_t *journal) __nonnull();
+
+/**
+ * @brief Recover the operations left incomplete by a previous run
+ * 'cb' is called for each begun operation not ended. The ones recovered are
+ * ended and, when all are, the journal is emptied.
+ *
+ * @param[in] journal the journal
+ * @param[in] cb the function recovering an operation
+ * @param[in] closure the closure of 'cb'
+ * @return the count of operations not recovered or a negative -errno value
+ */
+extern int journal_recover(journal_t *journal, journal_recover_cb_t cb, void *closure) __wur __nonnull((1, 2));
+
+/**
+ * @brief Record the beginning of an operation
+ * The record is on the disk when the function returns. The concurrent
+ * operations share the flushes to the disk.
+ *
+ * @param[in] journal the journal
+ * @param[in] op the operation
+ * @param[in] secure_app the application of the operation
+ * @param[out] seq the sequence number of the operation
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int journal_begin(journal_t *journal, enum journal_op op, const secure_app_t *secure_app, uint32_t *seq) __wur
+    __nonnull();
+
+/**
+ * @brief Record that a stage of an operation is completed
+ * The record isn't flushed: if lost, the stage is done again at recovery.
+ *
+ * @param[in] journal the journal
+ * @param[in] seq the sequence number of the operation or 0 for nothing
+ * @param[in] stage the stage completed (not 0)
+ */
+extern void journal_stage(journal_t *journal, uint32_t seq, unsigned stage) __nonnull();
+
+/**
+ * @brief Record the end of an operation, successful or rolled back
+ * The record isn't flushed: if lost, the operation is done again at recovery.
+ *
+ * @param[in] journal the journal
+ * @param[in] seq the sequence number of the operation or 0 for nothing
+ */
+extern void journal_end(journal_t *journal, uint32_t seq) __nonnull();
+
+/**
+ * @brief Get the counters of a journal
+ *
+ * @param[in] journal the journal
+ * @param[out] stats the counters
+ */
+extern void journal_get_stats(journal_t *journal, journal_stats_t *stats) __nonnull();
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#include "label-tree.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "limits.h"
+#include "log.h"
+
+/** default comma separated list of the path types labelled recursively */
+#if !defined(LABEL_TREE_PATH_TYPES)
+#define LABEL_TREE_PATH_TYPES ""
+#endif
+
+/** default count of threads labelling a tree */
+#if !defined(LABEL_TREE_JOBS)
+#define LABEL_TREE_JOBS 4
+#endif
+
+typedef struct label_dir label_dir_t;
+
+/** a directory waiting to be scanned */
+struct label_dir {
+    /** next directory to scan */
+    label_dir_t *next;
+
+    /** device of the directory when it was labelled */
+    dev_t dev;
+
+    /** inode of the directory when it was labelled */
+    ino_t ino;
+
+    /** path of the directory relative to the top of the tree */
+    char path[];
+};
+
+/** the state of a walk shared by its threads */
+typedef struct label_walk {
+    /** protects the fields below */
+    pthread_mutex_t mutex;
+
+    /** signals new directories or the end of the walk */
+    pthread_cond_t cond;
+
+    /** descriptor of the top of the tree */
+    int fd;
+
+    /** the directories to scan */
+    label_dir_t *dirs;
+
+    /** count of directories being scanned */
+    unsigned busy;
+
+    /** first error met */
+    int rc;
+
+    /** the function labelling the files */
+    label_tree_fn_t fn;
+
+    /** closure of fn */
+    void *closure;
+
+    /** counters of the walk */
+    label_tree_stats_t stats;
+} label_walk_t;
+
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Queue a directory to scan
+ * Only its path is queued, so that the count of open descriptors does not
+ * grow with the count of waiting directories.
+ *
+ * @param[in] walk the walk
+ * @param[in] parent the path of the parent directory or NULL for the top
+ * @param[in] name the name of the directory in its parent
+ * @param[in] st the status of the directory
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull((1, 3, 4)) __wur
+static int push_dir(label_walk_t *walk, const char *parent, const char *name, const struct stat *st) {
+    size_t length = parent == NULL ? strlen(name) : strlen(parent) + 1 + strlen(name);
+    if (length >= SEC_LSM_MANAGER_MAX_SIZE_PATH) {
+        ERROR("path too long %s/%s", parent == NULL ? "" : parent, name);
+        return -ENAMETOOLONG;
+    }
+
+    label_dir_t *dir = malloc(sizeof(*dir) + length + 1);
+    if (dir == NULL) {
+        ERROR("malloc label_dir_t");
+        return -ENOMEM;
+    }
+
+    if (parent == NULL) {
+        memcpy(dir->path, name, length + 1);
+    } else {
+        size_t offset = strlen(parent);
+        memcpy(dir->path, parent, offset);
+        dir->path[offset++] = '/';
+        memcpy(dir->path + offset, name, length + 1 - offset);
+    }
+    dir->dev = st->st_dev;
+    dir->ino = st->st_ino;
+    pthread_mutex_lock(&walk->mutex);
+    dir->next = walk->dirs;
+    walk->dirs = dir;
+    pthread_cond_signal(&walk->cond);
+    pthread_mutex_unlock(&walk->mutex);
+    return 0;
+}
+
+/**
+ * @brief Open and label an entry of a directory
+ * Symbolic links and special files are skipped. The entry is checked again
+ * once opened, in case it was replaced since its status was read.
+ *
+ * @param[in] walk the walk
+ * @param[in] dirfd the descriptor of the directory
+ * @param[in] dirpath the path of the directory relative to the top
+ * @param[in] name the name of the entry
+ * @param[in,out] stats the counters of the scan
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int label_entry(label_walk_t *walk, int dirfd, const char *dirpath, const char *name,
+                                         label_tree_stats_t *stats) {
+    struct stat st, opened;
+    int fd, rc;
+
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+        rc = -errno;
+        ERROR("fstatat %s : %d %s", name, -rc, strerror(-rc));
+        return rc;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    } else if (S_ISREG(st.st_mode)) {
+        fd = openat(dirfd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    } else {
+        DEBUG("skip %s", name);
+        stats->skipped++;
+        return 0;
+    }
+
+    if (fd < 0) {
+        rc = -errno;
+        ERROR("openat %s : %d %s", name, -rc, strerror(-rc));
+        return rc;
+    }
+
+    if (fstat(fd, &opened) < 0 || opened.st_dev != st.st_dev || opened.st_ino != st.st_ino) {
+        DEBUG("%s changed while labelling", name);
+        stats->skipped++;
+        close(fd);
+        return 0;
+    }
+
+    rc = walk->fn(fd, name, &opened, walk->closure);
+    close(fd);
+    if (rc < 0) {
+        ERROR("label %s : %d %s", name, -rc, strerror(-rc));
+        return rc;
+    }
+
+    stats->files++;
+    if (S_ISDIR(opened.st_mode)) {
+        return push_dir(walk, dirpath, name, &opened);
+    }
+
+    stats->bytes += (uint64_t)opened.st_size;
+    return 0;
+}
+
+/**
+ * @brief Label the entries of a directory and queue its subdirectories
+ * The directory is opened again from the top of the tree and skipped if it
+ * is not the one queued anymore.
+ *
+ * @param[in] walk the walk
+ * @param[in] queued the queued directory
+ * @param[in,out] stats the counters of the scan
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int scan_dir(label_walk_t *walk, const label_dir_t *queued, label_tree_stats_t *stats) {
+    struct dirent *entry;
+    struct stat st;
+    int rc = 0;
+
+    int fd = openat(walk->fd, queued->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        rc = -errno;
+        ERROR("openat %s : %d %s", queued->path, -rc, strerror(-rc));
+        return rc;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_dev != queued->dev || st.st_ino != queued->ino) {
+        DEBUG("%s changed while labelling", queued->path);
+        stats->skipped++;
+        close(fd);
+        return 0;
+    }
+
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        rc = -errno;
+        ERROR("fdopendir : %d %s", -rc, strerror(-rc));
+        close(fd);
+        return rc;
+    }
+
+    while (rc >= 0) {
+        errno = 0;
+        entry = readdir(dir);
+        if (entry == NULL) {
+            if (errno != 0) {
+                rc = -errno;
+                ERROR("readdir : %d %s", -rc, strerror(-rc));
+            }
+            break;
+        }
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+            rc = label_entry(walk, dirfd(dir), queued->path, entry->d_name, stats);
+        }
+    }
+
+    closedir(dir);
+    return rc;
+}
+
+/**
+ * @brief Scan the queued directories until the walk ends
+ *
+ * @param[in] arg the walk
+ * @return NULL
+ */
+__nonnull() static void *walker(void *arg) {
+    label_walk_t *walk = arg;
+    label_tree_stats_t stats;
+    label_dir_t *dir;
+    int rc;
+
+    pthread_mutex_lock(&walk->mutex);
+    for (;;) {
+        while (walk->dirs == NULL && walk->busy > 0 && walk->rc == 0)
+            pthread_cond_wait(&walk->cond, &walk->mutex);
+        if (walk->dirs == NULL || walk->rc < 0)
+            break;
+
+        dir = walk->dirs;
+        walk->dirs = dir->next;
+        walk->busy++;
+        pthread_mutex_unlock(&walk->mutex);
+
+        memset(&stats, 0, sizeof(stats));
+        rc = scan_dir(walk, dir, &stats);
+        free(dir);
+
+        pthread_mutex_lock(&walk->mutex);
+        walk->busy--;
+        walk->stats.files += stats.files;
+        walk->stats.skipped += stats.skipped;
+        walk->stats.bytes += stats.bytes;
+        if (rc < 0 && walk->rc == 0)
+            walk->rc = rc;
+        if (walk->busy == 0 || walk->rc < 0)
+            pthread_cond_broadcast(&walk->cond);
+    }
+    pthread_mutex_unlock(&walk->mutex);
+    return NULL;
+}
+
+/**********************/
+/*** PUBLIC METHODS ***/
+/**********************/
+
+/* see label-tree.h */
+const char *get_label_tree_path_types(const char *value) {
+    return value ?: secure_getenv("LABEL_TREE_PATH_TYPES") ?: LABEL_TREE_PATH_TYPES;
+}
+
+/* see label-tree.h */
+unsigned get_label_tree_jobs(const char *value) {
+    char *end;
+    unsigned long jobs;
+
+    value = value ?: secure_getenv("LABEL_TREE_JOBS");
+    if (value != NULL) {
+        jobs = strtoul(value, &end, 10);
+        if (*value != '\0' && *end == '\0' && jobs > 0 && jobs <= SEC_LSM_MANAGER_MAX_LABEL_JOBS)
+            return (unsigned)jobs;
+        ERROR("invalid label tree jobs %s", value);
+    }
+    return LABEL_TREE_JOBS;
+}
+
+/* see label-tree.h */
+bool is_label_tree_path_type(enum path_type path_type) {
+    const char *name = get_path_type_string(path_type);
+    const char *types = get_label_tree_path_types(NULL);
+    size_t length = strlen(name);
+
+    while (*types != '\0') {
+        size_t span = strcspn(types, ",");
+        if (span == length && !strncmp(types, name, length))
+            return true;
+        types += span;
+        types += *types == ',';
+    }
+    return false;
+}
+
+/* see label-tree.h */
+int label_tree(const char *path, label_tree_fn_t fn, void *closure, label_tree_stats_t *stats) {
+    pthread_t threads[SEC_LSM_MANAGER_MAX_LABEL_JOBS];
+    unsigned count = 0;
+    unsigned jobs = get_label_tree_jobs(NULL);
+    struct timespec start, end;
+    label_dir_t *dir;
+    struct stat st;
+    int rc;
+
+    label_walk_t walk = {.mutex = PTHREAD_MUTEX_INITIALIZER,
+                         .cond = PTHREAD_COND_INITIALIZER,
+                         .fd = -1,
+                         .dirs = NULL,
+                         .busy = 0,
+                         .rc = 0,
+                         .fn = fn,
+                         .closure = closure,
+                         .stats = {.files = 0, .skipped = 0, .bytes = 0, .elapsed_us = 0}};
+
+    if (stats != NULL)
+        *stats = walk.stats;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // like the top entry labelled with lsetxattr, a symbolic link is not followed
+    walk.fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (walk.fd < 0) {
+        rc = -errno;
+        if (rc == -ENOTDIR || rc == -ELOOP)
+            return 0;
+        ERROR("open %s : %d %s", path, -rc, strerror(-rc));
+        return rc;
+    }
+
+    if (fstat(walk.fd, &st) < 0) {
+        rc = -errno;
+        ERROR("fstat %s : %d %s", path, -rc, strerror(-rc));
+        close(walk.fd);
+        return rc;
+    }
+
+    rc = push_dir(&walk, NULL, ".", &st);
+    if (rc < 0) {
+        ERROR("push_dir : %d %s", -rc, strerror(-rc));
+        close(walk.fd);
+        return rc;
+    }
+
+    // the calling thread walks too
+    while (count + 1 < jobs && pthread_create(&threads[count], NULL, walker, &walk) == 0)
+        count++;
+    walker(&walk);
+    while (count > 0)
+        pthread_join(threads[--count], NULL);
+
+    // directories left by an error
+    while ((dir = walk.dirs) != NULL) {
+        walk.dirs = dir->next;
+        free(dir);
+    }
+    close(walk.fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    walk.stats.elapsed_us = (uint64_t)((end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+    if (stats != NULL)
+        *stats = walk.stats;
+
+    DEBUG("label %s : %lu file(s), %lu skipped, %llu byte(s) in %llu us (%llu files/s)", path, walk.stats.files,
+          walk.stats.skipped, (unsigned long long)walk.stats.bytes, (unsigned long long)walk.stats.elapsed_us,
+          (unsigned long long)(walk.stats.files * 1000000ULL / (walk.stats.elapsed_us ?: 1)));
+
+    pthread_mutex_destroy(&walk.mutex);
+    pthread_cond_destroy(&walk.cond);
+    return walk.rc;
+}
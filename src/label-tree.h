@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#ifndef SEC_LSM_MANAGER_LABEL_TREE_H
+#define SEC_LSM_MANAGER_LABEL_TREE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/stat.h>
+
+#include "paths.h"
+
+/**
+ * @brief Counters of a labelled tree
+ */
+typedef struct label_tree_stats {
+    unsigned long files;   /* files and directories labelled */
+    unsigned long skipped; /* symbolic links and special files left untouched */
+    uint64_t bytes;        /* size of the regular files labelled */
+    uint64_t elapsed_us;   /* duration of the walk in microseconds */
+} label_tree_stats_t;
+
+/**
+ * @brief Function labelling one file of a tree
+ *
+ * @param[in] fd an open file descriptor of the file (regular file or directory)
+ * @param[in] name the name of the file in its directory
+ * @param[in] st the status of the file
+ * @param[in] closure the closure given to label_tree
+ * @return 0 in case of success or a negative -errno value
+ */
+typedef int (*label_tree_fn_t)(int fd, const char *name, const struct stat *st, void *closure);
+
+/**
+ * @brief Get the path types labelled recursively
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the comma separated list of the path types labelled recursively
+ */
+extern const char *get_label_tree_path_types(const char *value) __wur;
+
+/**
+ * @brief Get the count of threads labelling a tree
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the count of threads
+ */
+extern unsigned get_label_tree_jobs(const char *value) __wur;
+
+/**
+ * @brief Check if the paths of a type are labelled recursively
+ *
+ * @param[in] path_type the path type
+ * @return true if the content of the paths of this type is labelled
+ */
+extern bool is_label_tree_path_type(enum path_type path_type) __wur;
+
+/**
+ * @brief Label the content of a directory
+ * The directory itself is not labelled. The tree is walked with descriptors
+ * relative to the top directory by get_label_tree_jobs() threads, symbolic links
+ * are never followed nor labelled and special files are left untouched.
+ * Only the paths of the directories waiting to be scanned are kept, each one is
+ * opened again and checked when it is scanned.
+ * Nothing is done if 'path' is not a directory or is a symbolic link.
+ *
+ * @param[in] path the directory
+ * @param[in] fn the function labelling each file
+ * @param[in] closure the closure of 'fn'
+ * @param[out] stats the counters of the walk or NULL
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int label_tree(const char *path, label_tree_fn_t fn, void *closure, label_tree_stats_t *stats) __wur
+    __nonnull((1, 2));
+
+#endif
@@ -40,6 +40,13 @@
 // permissions
 #define SEC_LSM_MANAGER_MAX_SIZE_PERMISSION 1024
 
+// bulk requests (items per 'paths' or 'permissions' record)
+#define SEC_LSM_MANAGER_MAX_BULK_ITEMS 1000
+
+// concurrent selinux module compilations
+#define SEC_LSM_MANAGER_MAX_COMPILE_JOBS 64
+#define SEC_LSM_MANAGER_MAX_LABEL_JOBS 64
+
 // line module
 #define SEC_LSM_MANAGER_MAX_SIZE_LINE_MODULE (SEC_LSM_MANAGER_MAX_SIZE_PATH + SEC_LSM_MANAGER_MAX_SIZE_LABEL + 50)
 
@@ -40,13 +40,15 @@
 
 #define _ECHO_ 'e'
 #define _HELP_ 'h'
+#define _PIPELINE_ 'p'
 #define _SOCKET_ 's'
 #define _VERSION_ 'v'
 
-static const char shortopts[] = "c:ehs:v";
+static const char shortopts[] = "c:ehps:v";
 
 static const struct option longopts[] = {{"echo", 0, NULL, _ECHO_},
                                          {"help", 0, NULL, _HELP_},
+                                         {"pipeline", 0, NULL, _PIPELINE_},
                                          {"socket", 1, NULL, _SOCKET_},
                                          {"version", 0, NULL, _VERSION_},
                                          {NULL, 0, NULL, 0}};
@@ -58,6 +60,7 @@ static const char helptxt[] =
     "otpions:\n"
     "    -s, --socket xxx      set the base xxx for sockets\n"
     "    -e, --echo            print the evaluated command\n"
+    "    -p, --pipeline        pipeline the requests until the next sync point\n"
     "    -h, --help            print this help and exit\n"
     "    -v, --version         print the version and exit\n"
     "\n"
@@ -94,6 +97,33 @@ static const char help_display_text[] =
     "Display current state\n"
     "\n";
 
+static const char help_list_text[] =
+    "\n"
+    "Command: list\n"
+    "\n"
+    "List the installed applications with their label\n"
+    "\n";
+
+static const char help_query_text[] =
+    "\n"
+    "Command: query app_id\n"
+    "\n"
+    "Display the paths and permissions of an installed application\n"
+    "The application can also be given by its label\n"
+    "\n"
+    "Example : query agl-service-can-low-level\n"
+    "\n";
+
+static const char help_owner_text[] =
+    "\n"
+    "Command: owner path\n"
+    "\n"
+    "Display the installed application owning a file\n"
+    "The owner is the application of the path or of its nearest parent directory\n"
+    "\n"
+    "Example : owner /var/local/lib/afm/applications/app/data/file\n"
+    "\n";
+
 static const char help_id_text[] =
     "\n"
     "Command: id app_id\n"
@@ -122,6 +152,17 @@ static const char help_path_text[] =
     "Example : path /tmp/file data\n"
     "\n";
 
+static const char help_paths_text[] =
+    "\n"
+    "Command: paths path path_type [path path_type]...\n"
+    "\n"
+    "Add several paths for the application in one request\n"
+    "Either all the paths are added or none of them\n"
+    "See 'help path' for the path type values\n"
+    "\n"
+    "Example : paths /tmp/file data /tmp/bin exec\n"
+    "\n";
+
 static const char help_permission_text[] =
     "\n"
     "Command: permission permission\n"
@@ -131,6 +172,16 @@ static const char help_permission_text[] =
     "Example : permission urn:AGL:permission::partner:scope-platform\n"
     "\n";
 
+static const char help_permissions_text[] =
+    "\n"
+    "Command: permissions permission [permission]...\n"
+    "\n"
+    "Add several permissions for the application in one request\n"
+    "Either all the permissions are added or none of them\n"
+    "\n"
+    "Example : permissions urn:AGL:permission::partner:scope-platform urn:AGL:permission::public:hidden\n"
+    "\n";
+
 static const char help_install_text[] =
     "\n"
     "Command: install\n"
@@ -147,9 +198,18 @@ static const char help_uninstall_text[] =
     "WARNING : You need to set id before\n"
     "\n";
 
+static const char help_sync_text[] =
+    "\n"
+    "Command: sync\n"
+    "\n"
+    "Send the pipelined requests and wait for their replies\n"
+    "Reports the first failed request, if any\n"
+    "\n";
+
 static const char help__text[] =
     "\n"
-    "Commands are: log, clear, display, id, path, permission, install, uninstall, quit, help\n"
+    "Commands are: log, clear, display, id, path, paths, permission, permissions, install, uninstall, sync, list,\n"
+    "query, owner, quit, help\n"
     "Type 'help command' to get help on the command\n"
     "\n"
     "Example 'help log' to get help on log\n"
@@ -168,7 +228,8 @@ static const char help_help_text[] =
     "\n"
     "Gives help on the command.\n"
     "\n"
-    "Available commands: log, clear, display, id, path, permission, install, uninstall, quit, help\n"
+    "Available commands: log, clear, display, id, path, paths, permission, permissions, install, uninstall, sync,\n"
+    "list, query, owner, quit, help\n"
     "\n";
 
 static sec_lsm_manager_t *sec_lsm_manager = NULL;
@@ -321,6 +382,72 @@ static int do_permission(int ac, char **av) {
     return uc;
 }
 
+static int do_paths(int ac, char **av) {
+    int uc, rc;
+    int n = plink(ac, av, &uc, ac);
+
+    if (n < 3) {
+        ERROR("not enough arguments");
+        last_status = -EINVAL;
+        return uc;
+    }
+
+    if (n % 2 == 0) {
+        ERROR("missing path type for %s", av[n - 1]);
+        last_status = -EINVAL;
+        return uc;
+    }
+
+    size_t count = (size_t)(n / 2);
+    const char **paths = malloc(count * sizeof(*paths));
+    const char **path_types = malloc(count * sizeof(*path_types));
+    if (paths == NULL || path_types == NULL) {
+        ERROR("malloc paths");
+        last_status = -ENOMEM;
+        goto end;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        paths[i] = av[2 * i + 1];
+        path_types[i] = av[2 * i + 2];
+    }
+
+    last_status = rc = sec_lsm_manager_add_paths(sec_lsm_manager, count, paths, path_types);
+
+    if (rc < 0) {
+        ERROR("sec_lsm_manager_add_paths : %d %s", -rc, strerror(-rc));
+    } else {
+        LOG("add %zu paths", count);
+    }
+
+end:
+    free(path_types);
+    free(paths);
+    return uc;
+}
+
+static int do_permissions(int ac, char **av) {
+    int uc, rc;
+    int n = plink(ac, av, &uc, ac);
+
+    if (n < 2) {
+        ERROR("not enough arguments");
+        last_status = -EINVAL;
+        return uc;
+    }
+
+    size_t count = (size_t)(n - 1);
+
+    last_status = rc = sec_lsm_manager_add_permissions(sec_lsm_manager, count, (const char *const *)&av[1]);
+    if (rc < 0) {
+        ERROR("sec_lsm_manager_add_permissions : %d %s", -rc, strerror(-rc));
+    } else {
+        LOG("add %zu permissions", count);
+    }
+
+    return uc;
+}
+
 static int do_install(int ac, char **av) {
     int uc, rc;
     int n = plink(ac, av, &uc, 1);
@@ -363,6 +490,99 @@ static int do_uninstall(int ac, char **av) {
     return uc;
 }
 
+static int do_sync(int ac, char **av) {
+    int uc, rc;
+    int n = plink(ac, av, &uc, 1);
+
+    if (n < 1) {
+        ERROR("not enough arguments");
+        last_status = -EINVAL;
+        return uc;
+    }
+
+    last_status = rc = sec_lsm_manager_sync(sec_lsm_manager);
+
+    if (rc < 0) {
+        ERROR("sec_lsm_manager_sync : %d %s (request %d)", -rc, strerror(-rc),
+              sec_lsm_manager_failed_request(sec_lsm_manager));
+    } else {
+        LOG("sync success");
+    }
+
+    return uc;
+}
+
+static void print_record(void *closure, const char *kind, const char *value, const char *extra) {
+    (void)closure;
+    if (extra != NULL)
+        fprintf(stdout, "%s %s %s\n", kind, value, extra);
+    else
+        fprintf(stdout, "%s %s\n", kind, value);
+}
+
+static int do_list(int ac, char **av) {
+    int uc, rc;
+    int n = plink(ac, av, &uc, 1);
+
+    if (n < 1) {
+        ERROR("not enough arguments");
+        last_status = -EINVAL;
+        return uc;
+    }
+
+    last_status = rc = sec_lsm_manager_list(sec_lsm_manager, print_record, NULL);
+
+    if (rc < 0) {
+        ERROR("sec_lsm_manager_list : %d %s", -rc, strerror(-rc));
+    } else {
+        LOG("%d installed applications", rc);
+    }
+
+    return uc;
+}
+
+static int do_query(int ac, char **av) {
+    int uc, rc;
+    int n = plink(ac, av, &uc, 2);
+
+    if (n < 2) {
+        ERROR("not enough arguments");
+        last_status = -EINVAL;
+        return uc;
+    }
+
+    last_status = rc = sec_lsm_manager_query(sec_lsm_manager, av[1], print_record, NULL);
+
+    if (rc == -ENOENT) {
+        LOG("%s is not installed", av[1]);
+    } else if (rc < 0) {
+        ERROR("sec_lsm_manager_query : %d %s", -rc, strerror(-rc));
+    }
+
+    return uc;
+}
+
+static int do_owner(int ac, char **av) {
+    int uc, rc;
+    int n = plink(ac, av, &uc, 2);
+
+    if (n < 2) {
+        ERROR("not enough arguments");
+        last_status = -EINVAL;
+        return uc;
+    }
+
+    last_status = rc = sec_lsm_manager_owner(sec_lsm_manager, av[1], print_record, NULL);
+
+    if (rc == -ENOENT) {
+        LOG("%s is not owned by an application", av[1]);
+    } else if (rc < 0) {
+        ERROR("sec_lsm_manager_owner : %d %s", -rc, strerror(-rc));
+    }
+
+    return uc;
+}
+
 static int do_log(int ac, char **av) {
     int uc, rc;
     int on = 0, off = 0;
@@ -403,12 +623,24 @@ static int do_help(int ac, char **av) {
         fprintf(stdout, "%s", help_id_text);
     else if (ac > 1 && !strcmp(av[1], "path"))
         fprintf(stdout, "%s", help_path_text);
+    else if (ac > 1 && !strcmp(av[1], "paths"))
+        fprintf(stdout, "%s", help_paths_text);
     else if (ac > 1 && !strcmp(av[1], "permission"))
         fprintf(stdout, "%s", help_permission_text);
+    else if (ac > 1 && !strcmp(av[1], "permissions"))
+        fprintf(stdout, "%s", help_permissions_text);
     else if (ac > 1 && !strcmp(av[1], "install"))
         fprintf(stdout, "%s", help_install_text);
     else if (ac > 1 && !strcmp(av[1], "uninstall"))
         fprintf(stdout, "%s", help_uninstall_text);
+    else if (ac > 1 && !strcmp(av[1], "sync"))
+        fprintf(stdout, "%s", help_sync_text);
+    else if (ac > 1 && !strcmp(av[1], "list"))
+        fprintf(stdout, "%s", help_list_text);
+    else if (ac > 1 && !strcmp(av[1], "query"))
+        fprintf(stdout, "%s", help_query_text);
+    else if (ac > 1 && !strcmp(av[1], "owner"))
+        fprintf(stdout, "%s", help_owner_text);
     else {
         fprintf(stdout, "%s", help__text);
         return 1;
@@ -435,15 +667,33 @@ static int do_any(int ac, char **av) {
     if (!strcmp(av[0], "path"))
         return do_path(ac, av);
 
+    if (!strcmp(av[0], "paths"))
+        return do_paths(ac, av);
+
     if (!strcmp(av[0], "permission"))
         return do_permission(ac, av);
 
+    if (!strcmp(av[0], "permissions"))
+        return do_permissions(ac, av);
+
     if (!strcmp(av[0], "install"))
         return do_install(ac, av);
 
     if (!strcmp(av[0], "uninstall"))
         return do_uninstall(ac, av);
 
+    if (!strcmp(av[0], "sync"))
+        return do_sync(ac, av);
+
+    if (!strcmp(av[0], "list"))
+        return do_list(ac, av);
+
+    if (!strcmp(av[0], "query"))
+        return do_query(ac, av);
+
+    if (!strcmp(av[0], "owner"))
+        return do_owner(ac, av);
+
     if (!strcmp(av[0], "quit"))
         exit(0);
 
@@ -475,6 +725,7 @@ int main(int ac, char **av) {
     int opt;
     int rc;
     int help = 0;
+    int pipeline = 0;
     int version = 0;
     int error = 0;
     char *socket = NULL;
@@ -495,6 +746,9 @@ int main(int ac, char **av) {
             case _HELP_:
                 help = 1;
                 break;
+            case _PIPELINE_:
+                pipeline = 1;
+                break;
             case _SOCKET_:
                 socket = optarg;
                 break;
@@ -529,11 +783,20 @@ int main(int ac, char **av) {
         return 1;
     }
 
+    if (pipeline) {
+        rc = sec_lsm_manager_set_pipelined(sec_lsm_manager, 1);
+        if (rc < 0) {
+            ERROR("sec_lsm_manager_set_pipelined : %d %s", -rc, strerror(-rc));
+            return 1;
+        }
+    }
+
     LOG("initialization success");
 
     if (optind < ac) {
         do_all(ac - optind, av + optind, 1);
-        return 0;
+        /* flush the requests still pipelined */
+        return sec_lsm_manager_sync(sec_lsm_manager) < 0;
     }
 
     bufill = 0;
@@ -556,5 +819,5 @@ int main(int ac, char **av) {
             }
         }
     }
-    return 0;
+    return sec_lsm_manager_sync(sec_lsm_manager) < 0;
 }
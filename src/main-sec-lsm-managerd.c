@@ -45,6 +45,14 @@
 #include "sec-lsm-manager-protocol.h"
 #include "sec-lsm-manager-server.h"
 
+#if defined(WITH_SMACK)
+#include "smack-template.h"
+#endif
+
+#if defined(WITH_SELINUX)
+#include "selinux-template.h"
+#endif
+
 #if !defined(SYSTEMD_NAME)
 #define SYSTEMD_NAME "sec-lsm-manager"
 #endif
@@ -57,6 +65,14 @@
 #define SHUTOFF_TIME (60 * 3) /* 3 minutes */
 #endif
 
+#if !defined(WORKERS_COUNT)
+#define WORKERS_COUNT 2
+#endif
+
+#if !defined(WORKERS_MAX)
+#define WORKERS_MAX 64
+#endif
+
 #if !defined(SUPL_GROUPS_MAX)
 #define SUPL_GROUPS_MAX 10
 #endif
@@ -73,12 +89,14 @@
 #define _MAKESOCKDIR_ 'M'
 #define _OWNSOCKDIR_ 'O'
 #define _OWNDBDIR_ 'o'
+#define _RESTORE_ 'r'
 #define _SOCKETDIR_ 'S'
 #define _SHUTOFF_ 's'
 #define _USER_ 'u'
 #define _VERSION_ 'v'
+#define _WORKERS_ 'w'
 
-static const char shortopts[] = "d:g:hi:klmMOoS:s:u:v";
+static const char shortopts[] = "d:g:hi:klmMOorS:s:u:vw:";
 
 static const struct option longopts[] = {{"group", 1, NULL, _GROUP_},
                                          {"groups", 1, NULL, _GROUPS_},
@@ -87,10 +105,12 @@ static const struct option longopts[] = {{"group", 1, NULL, _GROUP_},
                                          {"log", 0, NULL, _LOG_},
                                          {"make-socket-dir", 0, NULL, _MAKESOCKDIR_},
                                          {"own-socket-dir", 0, NULL, _OWNSOCKDIR_},
+                                         {"restore", 0, NULL, _RESTORE_},
                                          {"shutoff", 1, NULL, _SHUTOFF_ },
                                          {"socketdir", 1, NULL, _SOCKETDIR_},
                                          {"user", 1, NULL, _USER_},
                                          {"version", 0, NULL, _VERSION_},
+                                         {"workers", 1, NULL, _WORKERS_},
                                          {NULL, 0, NULL, 0}};
 
 static const char helptxt[] =
@@ -104,6 +124,15 @@ static const char helptxt[] =
     "    -l, --log             activate log of transactions\n"
     "    -k, --keep-going      continue to run on some errors\n"
     "    -s, --shutoff VALUE   shutting off time in seconds\n"
+    "    -w, --workers COUNT   count of threads running installs (default: %d)\n"
+    "                            0 runs them in the serving thread\n"
+#if defined(WITH_SELINUX)
+    "                            the default is the count of simultaneous\n"
+    "                            compilations (SELINUX_COMPILE_JOBS)\n"
+#endif
+#if defined(WITH_SMACK)
+    "    -r, --restore         load the smack rules of the policy directory and exit\n"
+#endif
     "\n"
     "    -S, --socketdir xxx   set the base directory xxx for sockets\n"
     "                            (default: %s)\n"
@@ -126,6 +155,7 @@ int main(int ac, char **av) {
     int ownsockdir = 0;
     int flog = 0;
     int keepgoing = 0;
+    int restore = 0;
     int help = 0;
     int version = 0;
     int error = 0;
@@ -134,6 +164,8 @@ int main(int ac, char **av) {
     int g;
     int soff = SHUTOFF_TIME;
     const char *shutoff = NULL;
+    const char *workers = NULL;
+    int nworkers = WORKERS_COUNT;
     const char *socketdir = NULL;
     const char *user = NULL;
     const char *group = NULL;
@@ -153,6 +185,13 @@ int main(int ac, char **av) {
     setlinebuf(stdout);
     setlinebuf(stderr);
 
+#if defined(WITH_SELINUX)
+    /* the workers run the compilations of the modules: one worker per simultaneous compilation */
+    nworkers = (int)get_selinux_compile_jobs(NULL);
+    if (nworkers > WORKERS_MAX)
+        nworkers = WORKERS_MAX;
+#endif
+
     /* scan arguments */
     for (;;) {
         opt = getopt_long(ac, av, shortopts, longopts, NULL);
@@ -193,6 +232,12 @@ int main(int ac, char **av) {
             case _VERSION_:
                 version = 1;
                 break;
+            case _RESTORE_:
+                restore = 1;
+                break;
+            case _WORKERS_:
+                workers = optarg;
+                break;
             default:
                 error = 1;
                 break;
@@ -201,7 +246,7 @@ int main(int ac, char **av) {
 
     /* handles help, version, error */
     if (help) {
-        fprintf(stdout, helptxt, sec_lsm_manager_default_socket_dir);
+        fprintf(stdout, helptxt, nworkers, sec_lsm_manager_default_socket_dir);
         return 0;
     }
     if (version) {
@@ -211,6 +256,24 @@ int main(int ac, char **av) {
     if (error)
         return EXIT_FAILURE;
 
+    /* load the rules at boot, in one pass over all the files */
+    if (restore) {
+#if defined(WITH_SMACK)
+        smack_restore_stats_t stats;
+        rc = restore_smack_rules(&stats);
+        fprintf(stdout, "restored %lu smack rules (%lu read in %lu files) with %lu writes in %lu us\n", stats.loaded,
+                stats.rules, stats.files, stats.writes, (unsigned long)stats.elapsed_us);
+        if (rc < 0) {
+            fprintf(stderr, "can't restore the smack rules: %s\n", strerror(-rc));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+#else
+        fprintf(stderr, "restore is only available with smack\n");
+        return EXIT_FAILURE;
+#endif
+    }
+
     /* set the defaults */
     if (socketdir == NULL)
         socketdir = sec_lsm_manager_default_socket_dir;
@@ -230,6 +293,15 @@ int main(int ac, char **av) {
         }
     }
 
+    /* compute count of workers */
+    if (workers != NULL) {
+        nworkers = isid(workers);
+        if (nworkers < 0 || nworkers > WORKERS_MAX) {
+            fprintf(stderr, "not a valid count of workers '%s'\n", workers);
+            return EXIT_FAILURE;
+        }
+    }
+
     /* compute socket specs */
     spec_socket = 0;
 #if defined(WITH_SYSTEMD)
@@ -372,6 +444,12 @@ int main(int ac, char **av) {
         return EXIT_FAILURE;
     }
 
+    rc = sec_lsm_manager_server_set_workers(server, (unsigned)nworkers);
+    if (rc < 0) {
+        fprintf(stderr, "can't start workers: %s\n", strerror(-rc));
+        return EXIT_FAILURE;
+    }
+
     /* ready ! */
 #if defined(WITH_SYSTEMD)
     sd_notify(0, "READY=1");
@@ -43,6 +43,65 @@ static const char *type_strings[number_path_type] =
 [type_public] =	"public"
 };
 
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Get the slot of the index where a path is or would be inserted
+ *
+ * @param[in] path_set path_set handler
+ * @param[in] path The path to search
+ * @param[in] path_len The length of the path without trailing '/'
+ * @return the slot of the index
+ */
+__nonnull() __wur static size_t *index_slot(const path_set_t *path_set, const char *path, size_t path_len) {
+    size_t mask = path_set->index_size - 1;
+    size_t i = hash_string(path, path_len, false) & mask;
+    size_t *slot;
+
+    while (*(slot = &path_set->index[i])) {
+        const char *item = path_set->paths[*slot - 1]->path;
+        if (!strncmp(item, path, path_len) && item[path_len] == '\0')
+            break;
+        i = (i + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Index all the paths in the emptied index
+ *
+ * @param[in] path_set path_set handler
+ */
+__nonnull() static void index_fill(path_set_t *path_set) {
+    memset(path_set->index, 0, path_set->index_size * sizeof(*path_set->index));
+    for (size_t i = 0; i < path_set->size; i++)
+        *index_slot(path_set, path_set->paths[i]->path, strlen(path_set->paths[i]->path)) = i + 1;
+}
+
+/**
+ * @brief Rebuild the index with 'index_size' slots
+ *
+ * @param[in] path_set path_set handler
+ * @param[in] index_size The count of slots (a power of 2)
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int index_rebuild(path_set_t *path_set, size_t index_size) {
+    size_t *index = calloc(index_size, sizeof(*index));
+    if (index == NULL) {
+        ERROR("calloc index");
+        return -ENOMEM;
+    }
+
+    free(path_set->index);
+    path_set->index = index;
+    path_set->index_size = index_size;
+    index_fill(path_set);
+
+    return 0;
+}
+
 /**********************/
 /*** PUBLIC METHODS ***/
 /**********************/
@@ -50,16 +109,23 @@ static const char *type_strings[number_path_type] =
 /* see paths.h */
 void init_path_set(path_set_t *path_set) {
     path_set->size = 0;
+    path_set->capacity = 0;
     path_set->paths = NULL;
+    path_set->index = NULL;
+    path_set->index_size = 0;
+    path_set->arena = NULL;
 }
 
 /* see paths.h */
 void free_path_set(path_set_t *path_set) {
     if (path_set) {
-        while(path_set->size)
-            free(path_set->paths[--path_set->size]);
+        path_set_truncate(path_set, 0);
         free(path_set->paths);
         path_set->paths = NULL;
+        path_set->capacity = 0;
+        free(path_set->index);
+        path_set->index = NULL;
+        path_set->index_size = 0;
     }
 }
 
@@ -77,14 +143,25 @@ int path_set_add_path(path_set_t *path_set, const char *path, enum path_type pat
         return -EINVAL;
     }
 
-    path_t **path_set_tmp = (path_t **)realloc(path_set->paths, sizeof(path_t*) * (path_set->size + 1));
-    if (path_set_tmp == NULL) {
-        ERROR("realloc path_set_t");
-        return -ENOMEM;
+    if (path_set->size == path_set->capacity) {
+        size_t capacity = path_set->capacity ? 2 * path_set->capacity : 8;
+        path_t **path_set_tmp = (path_t **)realloc(path_set->paths, sizeof(path_t *) * capacity);
+        if (path_set_tmp == NULL) {
+            ERROR("realloc path_set_t");
+            return -ENOMEM;
+        }
+        path_set->paths = path_set_tmp;
+
+        /* keep the index at most half full (the capacity grows only with it) */
+        int rc = index_rebuild(path_set, 2 * capacity);
+        if (rc < 0) {
+            return rc;
+        }
+        path_set->capacity = capacity;
     }
-    path_set->paths = path_set_tmp;
 
-    path_t *path_item = (path_t *)malloc(sizeof(path_t) + path_len + 1);
+    size_t item_size = sizeof(path_t) + path_len + 1;
+    path_t *path_item = (path_t *)(path_set->arena ? arena_alloc(path_set->arena, item_size) : malloc(item_size));
     if (path_item == NULL) {
         ERROR("malloc path_item");
         return -ENOMEM;
@@ -92,15 +169,43 @@ int path_set_add_path(path_set_t *path_set, const char *path, enum path_type pat
     
     secure_strncpy(path_item->path, path, path_len + 1);
     if (path_item->path[path_len - 1] == '/') {
-        path_item->path[path_len - 1] = '\0';
+        path_item->path[--path_len] = '\0';
     }
 
     path_item->path_type = path_type;
     path_set->paths[path_set->size++] = path_item;
+    *index_slot(path_set, path_item->path, path_len) = path_set->size;
 
     return 0;
 }
 
+/* see paths.h */
+void path_set_truncate(path_set_t *path_set, size_t size) {
+    if (path_set->size <= size)
+        return;
+
+    /* paths of an arena are released with it */
+    while (path_set->size > size) {
+        path_set->size--;
+        if (path_set->arena == NULL)
+            free(path_set->paths[path_set->size]);
+    }
+
+    /* reindexing is simpler than removing from an open addressing index */
+    index_fill(path_set);
+}
+
+/* see paths.h */
+bool path_set_has_path(const path_set_t *path_set, const char *path) {
+    size_t path_len = strlen(path);
+
+    if (path_set->size == 0)
+        return false;
+    if (path_len >= 2 && path[path_len - 1] == '/')
+        path_len--;
+    return *index_slot(path_set, path, path_len) != 0;
+}
+
 /* see paths.h */
 bool valid_path_type(enum path_type path_type) {
     return path_type > type_none && path_type < number_path_type;
@@ -28,6 +28,7 @@
 #include <stddef.h>
 #include <sys/cdefs.h>
 
+#include "arena.h"
 #include "limits.h"
 
 /**
@@ -75,10 +76,15 @@ typedef struct path {
 typedef struct path_set {
     path_t **paths;
     size_t size;
+    size_t capacity;
+    size_t *index; /* hash index of the paths: their position + 1 or 0 if free */
+    size_t index_size;
+    arena_t *arena; /* allocator of the paths or NULL for the heap */
 } path_set_t;
 
 /**
  * @brief Initialize the fields 'size' and 'paths'
+ * The paths are allocated in the heap unless 'arena' is set after
  *
  * @param[in] path_set path_set handler
  */
@@ -102,6 +108,24 @@ extern void free_path_set(path_set_t *path_set) __nonnull();
  */
 extern int path_set_add_path(path_set_t *path_set, const char *path, enum path_type path_type) __wur __nonnull();
 
+/**
+ * @brief Remove the paths added after the first 'size' ones
+ *
+ * @param[in] path_set path_set handler
+ * @param[in] size The number of paths to keep
+ */
+extern void path_set_truncate(path_set_t *path_set, size_t size) __nonnull();
+
+/**
+ * @brief Check if a path is in the path_set
+ * A trailing '/' is ignored as when adding paths
+ *
+ * @param[in] path_set path_set handler
+ * @param[in] path The path to search
+ * @return true if the path is in the path_set
+ */
+extern bool path_set_has_path(const path_set_t *path_set, const char *path) __wur __nonnull();
+
 /**
  * @brief Check if path_type is valid
  *
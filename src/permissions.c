@@ -20,10 +20,71 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "log.h"
 #include "utils.h"
 
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Get the slot of the index where a permission is or would be inserted
+ *
+ * @param[in] permission_set The permission_set handler
+ * @param[in] permission The permission to search
+ * @param[in] ignore_case Compare ignoring the case
+ * @return the slot of the index
+ */
+__nonnull() __wur static size_t *index_slot(const permission_set_t *permission_set, const char *permission,
+                                            bool ignore_case) {
+    size_t mask = permission_set->index_size - 1;
+    size_t i = hash_string(permission, strlen(permission), true) & mask;
+    size_t *slot;
+
+    while (*(slot = &permission_set->index[i])) {
+        const char *item = permission_set->permissions[*slot - 1];
+        if (!(ignore_case ? strcasecmp : strcmp)(item, permission))
+            break;
+        i = (i + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Index all the permissions in the emptied index
+ *
+ * @param[in] permission_set The permission_set handler
+ */
+__nonnull() static void index_fill(permission_set_t *permission_set) {
+    memset(permission_set->index, 0, permission_set->index_size * sizeof(*permission_set->index));
+    for (size_t i = 0; i < permission_set->size; i++)
+        *index_slot(permission_set, permission_set->permissions[i], false) = i + 1;
+}
+
+/**
+ * @brief Rebuild the index with 'index_size' slots
+ *
+ * @param[in] permission_set The permission_set handler
+ * @param[in] index_size The count of slots (a power of 2)
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int index_rebuild(permission_set_t *permission_set, size_t index_size) {
+    size_t *index = calloc(index_size, sizeof(*index));
+    if (index == NULL) {
+        ERROR("calloc index");
+        return -ENOMEM;
+    }
+
+    free(permission_set->index);
+    permission_set->index = index;
+    permission_set->index_size = index_size;
+    index_fill(permission_set);
+
+    return 0;
+}
+
 /**********************/
 /*** PUBLIC METHODS ***/
 /**********************/
@@ -31,16 +92,23 @@
 /* see permissions.h */
 void init_permission_set(permission_set_t *permission_set) {
     permission_set->size = 0;
+    permission_set->capacity = 0;
     permission_set->permissions = NULL;
+    permission_set->index = NULL;
+    permission_set->index_size = 0;
+    permission_set->arena = NULL;
 }
 
 /* see permissions.h */
 void free_permission_set(permission_set_t *permission_set) {
     if (permission_set) {
-        while (permission_set->size)
-            free(permission_set->permissions[--permission_set->size]);
+        permission_set_truncate(permission_set, 0);
         free(permission_set->permissions);
         permission_set->permissions = NULL;
+        permission_set->capacity = 0;
+        free(permission_set->index);
+        permission_set->index = NULL;
+        permission_set->index_size = 0;
     }
 }
 
@@ -52,22 +120,56 @@ int permission_set_add_permission(permission_set_t *permission_set, const char *
         return -EINVAL;
     }
 
-    size_t size = (permission_set->size + 1) * (sizeof(char*) * SEC_LSM_MANAGER_MAX_SIZE_PERMISSION);
+    if (permission_set->size == permission_set->capacity) {
+        size_t capacity = permission_set->capacity ? 2 * permission_set->capacity : 8;
+        char **permissions_tmp = realloc(permission_set->permissions, capacity * sizeof(char *));
+        if (permissions_tmp == NULL) {
+            ERROR("realloc permissions_tmp");
+            return -ENOMEM;
+        }
+        permission_set->permissions = permissions_tmp;
 
-    char **permissions_tmp = realloc(permission_set->permissions, size);
-    if (permissions_tmp == NULL) {
-        ERROR("realloc permissions_tmp");
-        return -ENOMEM;
+        /* keep the index at most half full (the capacity grows only with it) */
+        int rc = index_rebuild(permission_set, 2 * capacity);
+        if (rc < 0) {
+            return rc;
+        }
+        permission_set->capacity = capacity;
     }
-    permission_set->permissions = permissions_tmp;
 
-    char *perm_tmp = malloc(1 + permission_len);
+    char *perm_tmp = permission_set->arena ? arena_alloc(permission_set->arena, 1 + permission_len)
+                                           : malloc(1 + permission_len);
     if (perm_tmp == NULL) {
         ERROR("malloc perm_tmp");
         return -ENOMEM;
     }
     secure_strncpy(perm_tmp, permission, 1 + permission_len);
     permission_set->permissions[permission_set->size++] = perm_tmp;
+    *index_slot(permission_set, perm_tmp, false) = permission_set->size;
 
     return 0;
 }
+
+/* see permissions.h */
+void permission_set_truncate(permission_set_t *permission_set, size_t size) {
+    if (permission_set->size <= size)
+        return;
+
+    /* permissions of an arena are released with it */
+    while (permission_set->size > size) {
+        permission_set->size--;
+        if (permission_set->arena == NULL)
+            free(permission_set->permissions[permission_set->size]);
+    }
+
+    /* reindexing is simpler than removing from an open addressing index */
+    index_fill(permission_set);
+}
+
+/* see permissions.h */
+bool permission_set_has_permission(const permission_set_t *permission_set, const char *permission,
+                                   bool ignore_case) {
+    if (permission_set->size == 0)
+        return false;
+    return *index_slot(permission_set, permission, ignore_case) != 0;
+}
@@ -18,10 +18,12 @@
 #ifndef SEC_LSM_MANAGER_POLICIES_H
 #define SEC_LSM_MANAGER_POLICIES_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
+#include "arena.h"
 #include "limits.h"
 
 /**
@@ -32,10 +34,15 @@
 typedef struct permission_set {
     char **permissions;
     size_t size;
+    size_t capacity;
+    size_t *index; /* hash index of the permissions: their position + 1 or 0 if free */
+    size_t index_size;
+    arena_t *arena; /* allocator of the permissions or NULL for the heap */
 } permission_set_t;
 
 /**
  * @brief Initialize the fields 'size' and 'permissions'
+ * The permissions are allocated in the heap unless 'arena' is set after
  *
  * @param[in] permission_set The permission_set handler
  */
@@ -57,4 +64,23 @@ extern void free_permission_set(permission_set_t *permission_set) __nonnull();
  */
 extern int permission_set_add_permission(permission_set_t *permission_set, const char *permission) __wur __nonnull();
 
+/**
+ * @brief Remove the permissions added after the first 'size' ones
+ *
+ * @param[in] permission_set The permission_set handler
+ * @param[in] size The number of permissions to keep
+ */
+extern void permission_set_truncate(permission_set_t *permission_set, size_t size) __nonnull();
+
+/**
+ * @brief Check if a permission is in the permission_set
+ *
+ * @param[in] permission_set The permission_set handler
+ * @param[in] permission The permission to search
+ * @param[in] ignore_case Compare ignoring the case
+ * @return true if the permission is in the permission_set
+ */
+extern bool permission_set_has_permission(const permission_set_t *permission_set, const char *permission,
+                                          bool ignore_case) __wur __nonnull();
+
 #endif
\ No newline at end of file
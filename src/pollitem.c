@@ -27,8 +27,48 @@
 /******************************************************************************/
 #include "pollitem.h"
 
+#include <string.h>
 #include <sys/epoll.h>
 
+/**
+ * The batch of events being dispatched
+ */
+static struct {
+    /** the received events */
+    struct epoll_event events[POLLITEM_MAX_EVENTS];
+
+    /** count of received events */
+    int count;
+
+    /** index of the next event to dispatch */
+    int index;
+
+    /** the epoll of the batch */
+    int pollfd;
+} batch = {.count = 0, .index = 0, .pollfd = -1};
+
+/** counters of the dispatching */
+static pollitem_stats_t stats;
+
+/**
+ * @brief Drop the pending events of 'pollitem' in the batch of 'pollfd'
+ *
+ * @param pollitem the pollitem whose events are to be dropped
+ * @param pollfd the file descriptor for epoll
+ */
+static void pollitem_drop_pending(pollitem_t *pollitem, int pollfd) {
+    int i;
+
+    if (pollfd == batch.pollfd) {
+        for (i = batch.index; i < batch.count; i++) {
+            if (batch.events[i].data.ptr == pollitem) {
+                batch.events[i].data.ptr = NULL;
+                stats.dropped++;
+            }
+        }
+    }
+}
+
 /**
  * @brief Wraps the call to epoll_ctl for operation 'op'
  *
@@ -54,18 +94,41 @@ int pollitem_mod(pollitem_t *pollitem, uint32_t events, int pollfd) {
 }
 
 /* see pollitem.h */
-int pollitem_del(pollitem_t *pollitem, int pollfd) { return pollitem_do(pollitem, 0, pollfd, EPOLL_CTL_DEL); }
+int pollitem_del(pollitem_t *pollitem, int pollfd) {
+    pollitem_drop_pending(pollitem, pollfd);
+    return pollitem_do(pollitem, 0, pollfd, EPOLL_CTL_DEL);
+}
 
 /* see pollitem.h */
 int pollitem_wait_dispatch(int pollfd, int timeout) {
     int rc;
-    struct epoll_event ev;
+    struct epoll_event *ev;
     pollitem_t *pi;
 
-    rc = epoll_wait(pollfd, &ev, 1, timeout);
-    if (rc == 1) {
-        pi = ev.data.ptr;
-        pi->handler(pi, ev.events, pollfd);
+    rc = epoll_wait(pollfd, batch.events, POLLITEM_MAX_EVENTS, timeout);
+    if (rc > 0) {
+        /* record the batch */
+        stats.waits++;
+        stats.events += (unsigned)rc;
+        stats.last = (unsigned)rc;
+        if (stats.max < (unsigned)rc)
+            stats.max = (unsigned)rc;
+        stats.sizes[rc - 1]++;
+
+        /* dispatch it, skipping the events of deleted pollitems */
+        batch.pollfd = pollfd;
+        batch.count = rc;
+        for (batch.index = 0; batch.index < batch.count;) {
+            ev = &batch.events[batch.index++];
+            pi = ev->data.ptr;
+            if (pi != NULL)
+                pi->handler(pi, ev->events, pollfd);
+        }
+        batch.pollfd = -1;
+        batch.count = 0;
     }
     return rc;
 }
+
+/* see pollitem.h */
+void pollitem_get_stats(pollitem_stats_t *result) { memcpy(result, &stats, sizeof *result); }
@@ -31,6 +31,12 @@
 /******************************************************************************/
 
 #include <stdint.h>
+
+/** maximum count of events dispatched for one call to epoll_wait */
+#if !defined(POLLITEM_MAX_EVENTS)
+#define POLLITEM_MAX_EVENTS 16
+#endif
+
 /** structure for using epoll easily */
 typedef struct pollitem pollitem_t;
 
@@ -48,6 +54,29 @@ struct pollitem {
     int fd;
 };
 
+/**
+ * Counters of the dispatching
+ */
+typedef struct pollitem_stats {
+    /** count of calls to epoll_wait that returned at least one event */
+    unsigned long waits;
+
+    /** count of events received */
+    unsigned long events;
+
+    /** count of events dropped because their pollitem was deleted in the batch */
+    unsigned long dropped;
+
+    /** count of events of the last batch */
+    unsigned last;
+
+    /** count of events of the biggest batch */
+    unsigned max;
+
+    /** histogram of the batch sizes: sizes[n - 1] counts the batches of n events */
+    unsigned long sizes[POLLITEM_MAX_EVENTS];
+} pollitem_stats_t;
+
 /**
  * @brief Add a pollitem to epoll
  *
@@ -70,6 +99,9 @@ extern int pollitem_mod(pollitem_t *pollitem, uint32_t events, int pollfd);
 
 /**
  * @brief Delete a pollitem from epoll
+ * The events of the pollitem that are pending in the batch being
+ * dispatched are dropped, so the pollitem can be released safely
+ * from within a callback.
  *
  * @param pollitem the pollitem to delete
  * @param pollfd file descriptor of the epoll
@@ -78,14 +110,24 @@ extern int pollitem_mod(pollitem_t *pollitem, uint32_t events, int pollfd);
 extern int pollitem_del(pollitem_t *pollitem, int pollfd);
 
 /**
- * @brief Wait one event on epoll and dispatch it to its pollitem callback
+ * @brief Wait events on epoll and dispatch them to their pollitem callbacks
+ * Up to POLLITEM_MAX_EVENTS events are received by one call to epoll_wait
+ * and are dispatched in the order given by epoll, one event per ready
+ * file descriptor, before waiting again.
  *
  * @param pollfd file descriptor of the epoll
  * @param timeout time to wait
  * @return 0 on timeout
- *         1 if a callback was called
+ *         the count of received events (callbacks called)
  *         -1 with errno set accordingly to epoll_wait
  */
 extern int pollitem_wait_dispatch(int pollfd, int timeout);
 
+/**
+ * @brief Get the counters of the dispatching
+ *
+ * @param stats where to store the counters
+ */
+extern void pollitem_get_stats(pollitem_stats_t *stats);
+
 #endif
@@ -38,26 +38,48 @@
 
 #include "limits.h"
 
-#define MAX_FIELDS 20
-#define MAX_BUFFER_LENGTH 2000
+/** initial size of the buffers */
+#if !defined(PROT_INITIAL_BUFFER_LENGTH)
+#define PROT_INITIAL_BUFFER_LENGTH 2048
+#endif
+
+/** maximum size of the buffers (a record must fit in it) */
+#if !defined(PROT_MAX_BUFFER_LENGTH)
+#define PROT_MAX_BUFFER_LENGTH (1024 * 1024)
+#endif
+
+/** initial count of fields of a record */
+#if !defined(PROT_INITIAL_FIELDS)
+#define PROT_INITIAL_FIELDS 20
+#endif
+
+/** maximum count of fields of a record (the exceeding fields are ignored) */
+#if !defined(PROT_MAX_FIELDS)
+#define PROT_MAX_FIELDS 4096
+#endif
+
 #define FIELD_SEPARATOR ' '
 #define RECORD_SEPARATOR '\n'
 #define ESCAPE '\\'
 
 /**
- * the structure buf is generic the meaning of pos/count is not fixed
+ * the structure buf is generic the meaning of start/pos/count is not fixed
  */
 struct buf {
+    /** a start */
+    unsigned start;
+
     /** a position */
     unsigned pos;
 
     /** a count */
     unsigned count;
 
-    /* TODO: add a 3rd unsigned for improving management of read and write */
+    /** allocated size of the content */
+    unsigned size;
 
-    /** a fixed size content */
-    char content[MAX_BUFFER_LENGTH];
+    /** the content, growing on demand up to PROT_MAX_BUFFER_LENGTH */
+    char *content;
 };
 typedef struct buf buf_t;
 
@@ -66,8 +88,11 @@ struct fields {
     /** count of field (negative if invalid) */
     int count;
 
+    /** allocated count of fields */
+    unsigned size;
+
     /** the fields as strings */
-    const char *fields[MAX_FIELDS];
+    const char **fields;
 };
 typedef struct fields fields_t;
 
@@ -75,22 +100,57 @@ typedef struct fields fields_t;
  * structure for handling the protocol
  */
 struct prot {
-    /** input buf, pos is the scanning position */
+    /** input buf, start is the current record, pos is the scanning position */
     buf_t inbuf;
 
-    /** output buf, pos is to be written position */
+    /** output buf (a ring), pos is to be written position */
     buf_t outbuf;
 
     /** count of pending output fields */
     unsigned outfields;
 
-    /** cancel index when putting values */
-    unsigned cancelidx;
+    /** count of bytes in outbuf when the pending record was started */
+    unsigned cancelcount;
 
     /** the fields */
     fields_t fields;
 };
 
+/**
+ * Grow the ring 'buf' so that it can hold at least 'need' bytes
+ * The content is set linear (pos = 0) in the new allocation.
+ * returns:
+ *  - 0 on success
+ *  - -ECANCELED if the maximum size is reached or allocation failed
+ */
+static int ring_grow(buf_t *buf, unsigned need) {
+    unsigned size, head;
+    char *content;
+
+    if (need > PROT_MAX_BUFFER_LENGTH)
+        return -ECANCELED;
+    size = buf->size;
+    while (size < need) size = size > PROT_MAX_BUFFER_LENGTH / 2 ? PROT_MAX_BUFFER_LENGTH : 2 * size;
+
+    content = malloc(size);
+    if (content == NULL)
+        return -ECANCELED;
+
+    /* copy the content linearly */
+    head = buf->size - buf->pos;
+    if (buf->count <= head)
+        memcpy(content, buf->content + buf->pos, buf->count);
+    else {
+        memcpy(content, buf->content + buf->pos, head);
+        memcpy(content + head, buf->content, buf->count - head);
+    }
+    free(buf->content);
+    buf->content = content;
+    buf->size = size;
+    buf->pos = 0;
+    return 0;
+}
+
 /**
  * Put the 'car' into the 'buf'
  * returns:
@@ -101,13 +161,13 @@ static int buf_put_car(buf_t *buf, char car) {
     unsigned pos;
 
     pos = buf->count;
-    if (pos >= MAX_BUFFER_LENGTH)
+    if (pos >= buf->size && ring_grow(buf, pos + 1) < 0)
         return -ECANCELED;
 
     buf->count = pos + 1;
     pos += buf->pos;
-    if (pos >= MAX_BUFFER_LENGTH)
-        pos -= MAX_BUFFER_LENGTH;
+    if (pos >= buf->size)
+        pos -= buf->size;
     buf->content[pos] = car;
     return 0;
 }
@@ -119,14 +179,22 @@ static int buf_put_car(buf_t *buf, char car) {
  *  - -ECANCELED if there is not enought space in the buffer
  */
 static int buf_put_string(buf_t *buf, const char *string) {
-    unsigned pos, remain;
+    unsigned pos, remain, need;
+    const char *iter;
     char c;
 
+    /* compute the needed size */
+    need = buf->count;
+    for (iter = string; (c = *iter++) && need <= PROT_MAX_BUFFER_LENGTH;)
+        need += c == FIELD_SEPARATOR || c == RECORD_SEPARATOR || c == ESCAPE ? 2 : 1;
+    if (need > buf->size && ring_grow(buf, need) < 0)
+        return -ECANCELED;
+
     remain = buf->count;
     pos = buf->pos + remain;
-    if (pos >= MAX_BUFFER_LENGTH)
-        pos -= MAX_BUFFER_LENGTH;
-    remain = MAX_BUFFER_LENGTH - remain;
+    if (pos >= buf->size)
+        pos -= buf->size;
+    remain = buf->size - remain;
 
     /* put all chars of the string */
     while ((c = *string++)) {
@@ -135,19 +203,19 @@ static int buf_put_string(buf_t *buf, const char *string) {
             if (!remain--)
                 goto cancel;
             buf->content[pos++] = ESCAPE;
-            if (pos == MAX_BUFFER_LENGTH)
+            if (pos == buf->size)
                 pos = 0;
         }
         /* put the char */
         if (!remain--)
             goto cancel;
         buf->content[pos++] = c;
-        if (pos == MAX_BUFFER_LENGTH)
+        if (pos == buf->size)
             pos = 0;
     }
 
     /* record the new values */
-    buf->count = MAX_BUFFER_LENGTH - remain;
+    buf->count = buf->size - remain;
     return 0;
 
 cancel:
@@ -172,11 +240,11 @@ static int buf_write(buf_t *buf, int fd) {
 
     /* prepare the iovec */
     vec[0].iov_base = buf->content + buf->pos;
-    if (buf->pos + count <= MAX_BUFFER_LENGTH) {
+    if (buf->pos + count <= buf->size) {
         vec[0].iov_len = count;
         n = 1;
     } else {
-        vec[0].iov_len = MAX_BUFFER_LENGTH - buf->pos;
+        vec[0].iov_len = buf->size - buf->pos;
         vec[1].iov_base = buf->content;
         vec[1].iov_len = count - vec[0].iov_len;
         n = 2;
@@ -194,48 +262,78 @@ static int buf_write(buf_t *buf, int fd) {
         /* update the state */
         buf->count -= (unsigned)rc;
         buf->pos += (unsigned)rc;
-        if (buf->pos >= MAX_BUFFER_LENGTH)
-            buf->pos -= MAX_BUFFER_LENGTH;
+        if (buf->pos >= buf->size)
+            buf->pos -= buf->size;
     }
 
     return (int)rc;
 }
 
+/**
+ * Add the field 'field' to 'fields' growing it at need
+ * returns:
+ *  - 0 on success
+ *  - -ENOBUFS if the field can't be added
+ */
+static int fields_add(fields_t *fields, const char *field) {
+    unsigned size;
+    const char **array;
+
+    if ((unsigned)fields->count >= fields->size) {
+        if (fields->size >= PROT_MAX_FIELDS)
+            return -ENOBUFS;
+        size = fields->size * 2 < PROT_MAX_FIELDS ? fields->size * 2 : PROT_MAX_FIELDS;
+        array = realloc(fields->fields, size * sizeof(*array));
+        if (array == NULL)
+            return -ENOBUFS;
+        fields->fields = array;
+        fields->size = size;
+    }
+    fields->fields[fields->count++] = field;
+    return 0;
+}
+
 /**
  * get the 'fields' from 'buf'
+ * The fields are decoded in place, in the record that begins at start
+ * and ends at pos. Fields exceeding PROT_MAX_FIELDS are ignored.
  */
 static void buf_get_fields(buf_t *buf, fields_t *fields) {
-    char c;
-    unsigned read, write;
+    char c, *content;
+    unsigned read, write, end;
+    int rc;
 
     /* advance the pos after the end */
     assert(buf->content[buf->pos] == RECORD_SEPARATOR);
-    buf->pos++;
+    end = ++buf->pos;
 
     /* init first field */
-    fields->fields[fields->count = 0] = buf->content;
+    content = buf->content + buf->start;
+    end -= buf->start;
+    fields->count = 0;
+    rc = fields_add(fields, content);
     read = write = 0;
-    for (;;) {
-        c = buf->content[read++];
+    while (read < end) {
+        c = content[read++];
         switch (c) {
             case FIELD_SEPARATOR: /* field separator */
-                buf->content[write++] = 0;
-                if (fields->count >= MAX_FIELDS)
-                    return;
-                fields->fields[++fields->count] = &buf->content[write];
+                content[write++] = 0;
+                if (rc == 0)
+                    rc = fields_add(fields, &content[write]);
                 break;
             case RECORD_SEPARATOR: /* end of line (record separator) */
-                buf->content[write] = 0;
-                fields->count += (write > 0);
+                content[write] = 0;
+                if (write == 0)
+                    fields->count = 0;
                 return;
             case ESCAPE: /* escaping */
-                c = buf->content[read++];
+                c = content[read++];
                 if (c != FIELD_SEPARATOR && c != RECORD_SEPARATOR && c != ESCAPE)
-                    buf->content[write++] = ESCAPE;
-                buf->content[write++] = c;
+                    content[write++] = ESCAPE;
+                content[write++] = c;
                 break;
             default: /* other characters */
-                buf->content[write++] = c;
+                content[write++] = c;
                 break;
         }
     }
@@ -247,43 +345,81 @@ static void buf_get_fields(buf_t *buf, fields_t *fields) {
  */
 static int buf_scan_end_record(buf_t *buf) {
     unsigned nesc;
+    char *rs;
 
     /* search the next RS */
     while (buf->pos < buf->count) {
-        if (buf->content[buf->pos] == RECORD_SEPARATOR) {
-            /* check whether RS is escaped */
-            nesc = 0;
-            while (buf->pos > nesc && buf->content[buf->pos - (nesc + 1)] == ESCAPE) nesc++;
-            if ((nesc & 1) == 0)
-                return 1; /* not escaped */
+        rs = memchr(buf->content + buf->pos, RECORD_SEPARATOR, buf->count - buf->pos);
+        if (rs == NULL) {
+            buf->pos = buf->count;
+            break;
         }
+        buf->pos = (unsigned)(rs - buf->content);
+
+        /* check whether RS is escaped */
+        nesc = 0;
+        while (buf->pos - buf->start > nesc && buf->content[buf->pos - (nesc + 1)] == ESCAPE) nesc++;
+        if ((nesc & 1) == 0)
+            return 1; /* not escaped */
         buf->pos++;
     }
     return 0;
 }
 
 /**
- * remove chars of 'buf' until pos
+ * make room in the input 'buf' for reading
+ * The unread data are moved to the beginning of the buffer only if
+ * there is no room after them and the buffer grows only if moving
+ * isn't enough. Both invalidate the fields pointing in the buffer
+ * and so aren't done when 'locked' is not zero.
+ * returns:
+ *  - 0 on success
+ *  - -ENOBUFS if there is no room
  */
-static void buf_crop(buf_t *buf) {
-    buf->count -= buf->pos;
-    if (buf->count)
-        memmove(buf->content, buf->content + buf->pos, buf->count);
-    buf->pos = 0;
+static int inbuf_make_room(buf_t *buf, int locked) {
+    unsigned size;
+    char *content;
+
+    if (buf->count < buf->size)
+        return 0;
+    if (locked)
+        return -ENOBUFS;
+
+    /* compact */
+    if (buf->start > 0) {
+        buf->count -= buf->start;
+        buf->pos -= buf->start;
+        if (buf->count)
+            memmove(buf->content, buf->content + buf->start, buf->count);
+        buf->start = 0;
+        return 0;
+    }
+
+    /* grow */
+    if (buf->size >= PROT_MAX_BUFFER_LENGTH)
+        return -ENOBUFS;
+    size = buf->size > PROT_MAX_BUFFER_LENGTH / 2 ? PROT_MAX_BUFFER_LENGTH : 2 * buf->size;
+    content = realloc(buf->content, size);
+    if (content == NULL)
+        return -ENOBUFS;
+    buf->content = content;
+    buf->size = size;
+    return 0;
 }
 
 /**
  * read input 'buf' from 'fd'
  */
-static int inbuf_read(buf_t *buf, int fd) {
+static int inbuf_read(buf_t *buf, int fd, int locked) {
     ssize_t szr;
     int rc;
 
-    if (buf->count == MAX_BUFFER_LENGTH)
-        return -ENOBUFS;
+    rc = inbuf_make_room(buf, locked);
+    if (rc < 0)
+        return rc;
 
     do {
-        szr = read(fd, buf->content + buf->count, MAX_BUFFER_LENGTH - buf->count);
+        szr = read(fd, buf->content + buf->count, buf->size - buf->count);
     } while (szr < 0 && errno == EINTR);
     if (szr >= 0)
         buf->count += (unsigned)(rc = (int)szr);
@@ -293,15 +429,34 @@ static int inbuf_read(buf_t *buf, int fd) {
     return rc;
 }
 
+/**
+ * allocate the initial content of 'buf'
+ */
+static int buf_init(buf_t *buf) {
+    buf->start = buf->pos = buf->count = 0;
+    buf->size = PROT_INITIAL_BUFFER_LENGTH;
+    buf->content = malloc(buf->size);
+    return buf->content == NULL ? -ENOMEM : 0;
+}
+
 /* see prot.h */
 int prot_create(prot_t **prot) {
     prot_t *p;
 
     /* allocation of the structure */
-    *prot = p = malloc(sizeof *p);
+    *prot = p = calloc(1, sizeof *p);
     if (p == NULL)
         return -ENOMEM;
 
+    /* allocation of the buffers */
+    p->fields.size = PROT_INITIAL_FIELDS;
+    p->fields.fields = malloc(p->fields.size * sizeof(*p->fields.fields));
+    if (buf_init(&p->inbuf) < 0 || buf_init(&p->outbuf) < 0 || p->fields.fields == NULL) {
+        prot_destroy(p);
+        *prot = NULL;
+        return -ENOMEM;
+    }
+
     /* initialisation of the structure */
     prot_reset(p);
 
@@ -310,24 +465,26 @@ int prot_create(prot_t **prot) {
 }
 
 /* see prot.h */
-void prot_destroy(prot_t *prot) { free(prot); }
+void prot_destroy(prot_t *prot) {
+    free(prot->inbuf.content);
+    free(prot->outbuf.content);
+    free(prot->fields.fields);
+    free(prot);
+}
 
 /* see prot.h */
 void prot_reset(prot_t *prot) {
     /* initialisation of the structure */
-    prot->inbuf.pos = prot->inbuf.count = 0;
-    prot->outbuf.pos = prot->outbuf.count = 0;
+    prot->inbuf.start = prot->inbuf.pos = prot->inbuf.count = 0;
+    prot->outbuf.start = prot->outbuf.pos = prot->outbuf.count = 0;
     prot->outfields = 0;
     prot->fields.count = -1;
 }
 
 /* see prot.h */
 void prot_put_cancel(prot_t *prot) {
-    unsigned count;
-
     if (prot->outfields) {
-        count = prot->cancelidx - prot->outbuf.pos;
-        prot->outbuf.count = count > MAX_BUFFER_LENGTH ? count - MAX_BUFFER_LENGTH : count;
+        prot->outbuf.count = prot->cancelcount;
         prot->outfields = 0;
     }
 }
@@ -353,7 +510,7 @@ int prot_put_field(prot_t *prot, const char *field) {
     if (prot->outfields++)
         rc = buf_put_car(&prot->outbuf, FIELD_SEPARATOR);
     else {
-        prot->cancelidx = prot->outbuf.pos + prot->outbuf.count;
+        prot->cancelcount = prot->outbuf.count;
         rc = 0;
     }
     if (rc >= 0 && field)
@@ -412,17 +569,40 @@ int prot_putx(prot_t *prot, ...) {
     return rc;
 }
 
+/* see prot.h */
+int prot_fits(unsigned count, const char **fields) {
+    size_t need = count; /* the separators */
+    const char *iter;
+    char c;
+
+    while (count-- && need <= PROT_MAX_BUFFER_LENGTH)
+        for (iter = *fields++; iter != NULL && (c = *iter++);)
+            need += c == FIELD_SEPARATOR || c == RECORD_SEPARATOR || c == ESCAPE ? 2 : 1;
+    return need <= PROT_MAX_BUFFER_LENGTH;
+}
+
 /* see prot.h */
 int prot_should_write(prot_t *prot) { return prot->outbuf.count > 0; }
 
 /* see prot.h */
-int prot_write(prot_t *prot, int fdout) { return buf_write(&prot->outbuf, fdout); }
+unsigned prot_write_pending(prot_t *prot) { return prot->outbuf.count; }
+
+/* see prot.h */
+int prot_write(prot_t *prot, int fdout) {
+    int rc = buf_write(&prot->outbuf, fdout);
+    if (rc > 0 && prot->outfields)
+        prot->cancelcount = (unsigned)rc < prot->cancelcount ? prot->cancelcount - (unsigned)rc : 0;
+    return rc;
+}
 
 /* see prot.h */
-int prot_can_read(prot_t *prot) { return prot->inbuf.count < MAX_BUFFER_LENGTH; }
+int prot_can_read(prot_t *prot) {
+    return prot->inbuf.count < prot->inbuf.size
+        || (prot->fields.count < 0 && (prot->inbuf.start > 0 || prot->inbuf.size < PROT_MAX_BUFFER_LENGTH));
+}
 
 /* see prot.h */
-int prot_read(prot_t *prot, int fdin) { return inbuf_read(&prot->inbuf, fdin); }
+int prot_read(prot_t *prot, int fdin) { return inbuf_read(&prot->inbuf, fdin, prot->fields.count >= 0); }
 
 /* see prot.h */
 int prot_get(prot_t *prot, const char ***fields) {
@@ -439,7 +619,9 @@ int prot_get(prot_t *prot, const char ***fields) {
 /* see prot.h */
 void prot_next(prot_t *prot) {
     if (prot->fields.count >= 0) {
-        buf_crop(&prot->inbuf);
+        prot->inbuf.start = prot->inbuf.pos;
+        if (prot->inbuf.start == prot->inbuf.count)
+            prot->inbuf.start = prot->inbuf.pos = prot->inbuf.count = 0;
         prot->fields.count = -1;
     }
 }
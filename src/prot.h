@@ -110,6 +110,16 @@ extern int prot_put(prot_t *prot, unsigned count, const char **fields);
  */
 extern int prot_putx(prot_t *prot, ...);
 
+/**
+ * @brief Check whether a record fits in the buffers
+ * A record that doesn't fit can't be sent nor received.
+ *
+ * @param count count of fields
+ * @param fields array of the fields of the record
+ * @return 1 if the record fits or 0 otherwise
+ */
+extern int prot_fits(unsigned count, const char **fields);
+
 /**
  * @brief Check whether write should be done or not
  *
@@ -118,6 +128,14 @@ extern int prot_putx(prot_t *prot, ...);
  */
 extern int prot_should_write(prot_t *prot);
 
+/**
+ * @brief Get the count of bytes waiting to be written
+ *
+ * @param prot the protocol handler
+ * @return the count of bytes to write
+ */
+extern unsigned prot_write_pending(prot_t *prot);
+
 /**
  * @brief Write the content to write and return either the count
  * of bytes written or an error code (negative). Note that
@@ -0,0 +1,919 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#include "registry.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "limits.h"
+#include "log.h"
+#include "utils.h"
+
+#if !defined(SEC_LSM_MANAGER_STATEDIR)
+#define SEC_LSM_MANAGER_STATEDIR "/var/lib/sec-lsm-manager"
+#endif
+
+/** default file of the registry */
+#if !defined(SEC_LSM_MANAGER_REGISTRY_FILE)
+#define SEC_LSM_MANAGER_REGISTRY_FILE SEC_LSM_MANAGER_STATEDIR "/registry.db"
+#endif
+
+/** magic of the file, the last character is the version of the format */
+#define REGISTRY_MAGIC "SLMREG\n\1"
+
+/** minimal count of buckets of an index */
+#define MIN_BUCKETS 8
+
+/*
+ * The file of the registry is an image used as is once mapped in memory.
+ * Its tables are arrays of 32 bits integers, strings are given by their
+ * offset in the pool of strings ending the image and the indexes are open
+ * addressing hash tables (linear probing) of the position + 1 of the entries
+ * (0 for free buckets).
+ */
+
+/** header of the image */
+typedef struct registry_header {
+    char magic[8];           /* REGISTRY_MAGIC */
+    uint32_t size;           /* size of the image */
+    uint32_t apps;           /* count of applications */
+    uint32_t paths;          /* count of paths */
+    uint32_t permissions;    /* count of permissions */
+    uint32_t app_buckets;    /* buckets of the id and label indexes (power of 2) */
+    uint32_t path_buckets;   /* buckets of the path index (power of 2) */
+    uint32_t app_table;      /* offset of the applications */
+    uint32_t path_table;     /* offset of the paths */
+    uint32_t permission_table; /* offset of the permissions (string offsets) */
+    uint32_t id_index;       /* offset of the index of the applications by id */
+    uint32_t label_index;    /* offset of the index of the applications by label */
+    uint32_t path_index;     /* offset of the index of the paths */
+    uint32_t strings;        /* offset of the pool of strings */
+} registry_header_t;
+
+/** an application of the image */
+typedef struct registry_app {
+    uint32_t id;               /* string of the id */
+    uint32_t label;            /* string of the label */
+    uint32_t path;             /* first path */
+    uint32_t path_count;       /* count of paths */
+    uint32_t permission;       /* first permission */
+    uint32_t permission_count; /* count of permissions */
+} registry_app_t;
+
+/** a path of the image */
+typedef struct registry_path {
+    uint32_t path; /* string of the path */
+    uint32_t type; /* string of the path type */
+    uint32_t app;  /* position of the application */
+} registry_path_t;
+
+/** the registry */
+struct registry {
+    /** protects the image against its replacement */
+    pthread_mutex_t lock;
+
+    /** serializes the updates */
+    pthread_mutex_t writer;
+
+    /** the image or NULL when empty */
+    char *image;
+
+    /** size of the image */
+    size_t size;
+
+    /** is the image mapped from the file (or allocated) */
+    bool mapped;
+
+    /** the file of the registry */
+    char file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+};
+
+/** an image being built */
+typedef struct builder {
+    registry_app_t *apps;
+    size_t app_count, app_capacity;
+    registry_path_t *paths;
+    size_t path_count, path_capacity;
+    uint32_t *permissions;
+    size_t permission_count, permission_capacity;
+    char *strings;
+    size_t strings_size, strings_capacity;
+} builder_t;
+
+const char default_registry_file[] = SEC_LSM_MANAGER_REGISTRY_FILE;
+
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Get the header of an image
+ *
+ * @param[in] image the image
+ * @return the header
+ */
+__nonnull() __wur static inline const registry_header_t *header_of(const char *image) {
+    return (const registry_header_t *)image;
+}
+
+/**
+ * @brief Get a table of an image
+ *
+ * @param[in] image the image
+ * @param[in] offset the offset of the table
+ * @return the table
+ */
+__nonnull() __wur static inline const void *table_of(const char *image, uint32_t offset) {
+    return image + offset;
+}
+
+/**
+ * @brief Get a string of an image
+ *
+ * @param[in] image the image
+ * @param[in] offset the offset of the string in the pool
+ * @return the string
+ */
+__nonnull() __wur static inline const char *string_of(const char *image, uint32_t offset) {
+    return image + header_of(image)->strings + offset;
+}
+
+/**
+ * @brief Hash a key of an index
+ *
+ * @param[in] key the key
+ * @return the hash of the key
+ */
+__nonnull() __wur static inline uint32_t hash_key(const char *key) {
+    return (uint32_t)hash_string(key, strlen(key), false);
+}
+
+/**
+ * @brief Count of buckets of an index of 'count' entries (load under 1/2)
+ *
+ * @param[in] count count of entries
+ * @return the count of buckets, a power of 2
+ */
+__wur static uint32_t buckets_for(size_t count) {
+    uint32_t buckets = MIN_BUCKETS;
+    while (buckets < 2 * count) buckets <<= 1;
+    return buckets;
+}
+
+/**
+ * @brief Search an application by id or by label
+ *
+ * @param[in] image the image
+ * @param[in] index offset of the index (id_index or label_index)
+ * @param[in] field 0 for searching by id, 1 for searching by label
+ * @param[in] key the id or the label
+ * @return the application or NULL if not found
+ */
+__nonnull() __wur static const registry_app_t *search_app(const char *image, uint32_t index, int field,
+                                                          const char *key) {
+    const registry_header_t *header = header_of(image);
+    const uint32_t *buckets = table_of(image, index);
+    const registry_app_t *apps = table_of(image, header->app_table);
+    uint32_t mask = header->app_buckets - 1;
+
+    for (uint32_t i = hash_key(key) & mask; buckets[i] != 0; i = (i + 1) & mask) {
+        const registry_app_t *app = &apps[buckets[i] - 1];
+        if (!strcmp(string_of(image, field ? app->label : app->id), key))
+            return app;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Search a path
+ *
+ * @param[in] image the image
+ * @param[in] key the path
+ * @return the path or NULL if not found
+ */
+__nonnull() __wur static const registry_path_t *search_path(const char *image, const char *key) {
+    const registry_header_t *header = header_of(image);
+    const uint32_t *buckets = table_of(image, header->path_index);
+    const registry_path_t *paths = table_of(image, header->path_table);
+    uint32_t mask = header->path_buckets - 1;
+
+    for (uint32_t i = hash_key(key) & mask; buckets[i] != 0; i = (i + 1) & mask) {
+        const registry_path_t *path = &paths[buckets[i] - 1];
+        if (!strcmp(string_of(image, path->path), key))
+            return path;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check that a table of an image is within the image
+ *
+ * @param[in] header the header of the image
+ * @param[in] offset the offset of the table
+ * @param[in] count the count of items
+ * @param[in] size the size of an item
+ * @return true if valid
+ */
+__nonnull() __wur static bool check_table(const registry_header_t *header, uint32_t offset, uint32_t count,
+                                          size_t size) {
+    return offset % sizeof(uint32_t) == 0 && offset >= sizeof(*header) &&
+           (uint64_t)offset + (uint64_t)count * size <= header->strings;
+}
+
+/**
+ * @brief Check that an index of an image only references existing entries
+ *
+ * @param[in] image the image
+ * @param[in] index offset of the index
+ * @param[in] buckets count of buckets
+ * @param[in] count count of entries
+ * @return true if valid
+ */
+__nonnull() __wur static bool check_index(const char *image, uint32_t index, uint32_t buckets, uint32_t count) {
+    const uint32_t *table = table_of(image, index);
+    bool has_free = false;
+
+    for (uint32_t i = 0; i < buckets; i++) {
+        if (table[i] > count)
+            return false;
+        has_free = has_free || table[i] == 0;
+    }
+    return has_free;
+}
+
+/**
+ * @brief Check an image read from the file
+ * After this check, the lookups don't need to check anything
+ *
+ * @param[in] image the image
+ * @param[in] size the size of the image
+ * @return true if valid
+ */
+__nonnull() __wur static bool check_image(const char *image, size_t size) {
+    const registry_header_t *header = header_of(image);
+
+    if (size < sizeof(*header) || memcmp(header->magic, REGISTRY_MAGIC, sizeof(header->magic)) ||
+        header->size != size || header->strings >= size || image[size - 1] != '\0')
+        return false;
+
+    uint32_t pool = header->size - header->strings;
+    if (header->app_buckets < MIN_BUCKETS || (header->app_buckets & (header->app_buckets - 1)) ||
+        header->path_buckets < MIN_BUCKETS || (header->path_buckets & (header->path_buckets - 1)) ||
+        !check_table(header, header->app_table, header->apps, sizeof(registry_app_t)) ||
+        !check_table(header, header->path_table, header->paths, sizeof(registry_path_t)) ||
+        !check_table(header, header->permission_table, header->permissions, sizeof(uint32_t)) ||
+        !check_table(header, header->id_index, header->app_buckets, sizeof(uint32_t)) ||
+        !check_table(header, header->label_index, header->app_buckets, sizeof(uint32_t)) ||
+        !check_table(header, header->path_index, header->path_buckets, sizeof(uint32_t)) ||
+        !check_index(image, header->id_index, header->app_buckets, header->apps) ||
+        !check_index(image, header->label_index, header->app_buckets, header->apps) ||
+        !check_index(image, header->path_index, header->path_buckets, header->paths))
+        return false;
+
+    const registry_app_t *apps = table_of(image, header->app_table);
+    for (uint32_t i = 0; i < header->apps; i++) {
+        if (apps[i].id >= pool || apps[i].label >= pool ||
+            (uint64_t)apps[i].path + apps[i].path_count > header->paths ||
+            (uint64_t)apps[i].permission + apps[i].permission_count > header->permissions)
+            return false;
+    }
+
+    const registry_path_t *paths = table_of(image, header->path_table);
+    for (uint32_t i = 0; i < header->paths; i++) {
+        if (paths[i].path >= pool || paths[i].type >= pool || paths[i].app >= header->apps)
+            return false;
+    }
+
+    const uint32_t *permissions = table_of(image, header->permission_table);
+    for (uint32_t i = 0; i < header->permissions; i++) {
+        if (permissions[i] >= pool)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Move an invalid file of the registry aside
+ * The registry is left empty, the file is kept for inspection
+ *
+ * @param[in] registry the registry
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int move_aside(registry_t *registry) {
+    char aside[SEC_LSM_MANAGER_MAX_SIZE_PATH + 8];
+
+    snprintf(aside, sizeof(aside), "%s.corrupt", registry->file);
+    if (rename(registry->file, aside) < 0) {
+        int rc = -errno;
+        ERROR("rename %s : %d %s", registry->file, -rc, strerror(-rc));
+        return rc;
+    }
+    ERROR("invalid registry %s moved to %s", registry->file, aside);
+    return 0;
+}
+
+/**
+ * @brief Load the image of the file
+ * A missing file leaves the registry empty, an invalid file is moved aside
+ *
+ * @param[in] registry the registry
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int load_image(registry_t *registry) {
+    struct stat st;
+    void *image;
+    int rc = 0;
+
+    int fd = open(registry->file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        rc = -errno;
+        if (rc == -ENOENT)
+            return 0;
+        ERROR("open %s : %d %s", registry->file, -rc, strerror(-rc));
+        return rc;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        rc = -errno;
+        ERROR("fstat %s : %d %s", registry->file, -rc, strerror(-rc));
+        goto end;
+    }
+
+    if (st.st_size < (off_t)sizeof(registry_header_t) || st.st_size > UINT32_MAX) {
+        rc = move_aside(registry);
+        goto end;
+    }
+
+    image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED) {
+        rc = -errno;
+        ERROR("mmap %s : %d %s", registry->file, -rc, strerror(-rc));
+        goto end;
+    }
+
+    if (!check_image(image, (size_t)st.st_size)) {
+        munmap(image, (size_t)st.st_size);
+        rc = move_aside(registry);
+        goto end;
+    }
+
+    registry->image = image;
+    registry->size = (size_t)st.st_size;
+    registry->mapped = true;
+
+end:
+    close(fd);
+    return rc;
+}
+
+/**
+ * @brief Release an image
+ *
+ * @param[in] image the image or NULL
+ * @param[in] size the size of the image
+ * @param[in] mapped is the image mapped
+ */
+static void free_image(char *image, size_t size, bool mapped) {
+    if (mapped)
+        munmap(image, size);
+    else
+        free(image);
+}
+
+/**
+ * @brief Ensure room for one more item in an array of a builder
+ *
+ * @param[in,out] array the array
+ * @param[in,out] capacity the capacity of the array
+ * @param[in] count the count of items of the array
+ * @param[in] size the size of the items
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int grow(void **array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity)
+        return 0;
+
+    if (count >= UINT32_MAX) {
+        ERROR("registry too big");
+        return -EFBIG;
+    }
+
+    size_t new_capacity = *capacity ? 2 * *capacity : 16;
+    void *new_array = realloc(*array, new_capacity * size);
+    if (new_array == NULL) {
+        ERROR("realloc failed");
+        return -ENOMEM;
+    }
+    *array = new_array;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Add a string to the pool of a builder
+ *
+ * @param[in] builder the builder
+ * @param[in] string the string
+ * @param[out] offset the offset of the string in the pool
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int add_string(builder_t *builder, const char *string, uint32_t *offset) {
+    size_t len = strlen(string) + 1;
+
+    if (builder->strings_size + len > builder->strings_capacity) {
+        size_t capacity = builder->strings_capacity ?: 4096;
+        while (capacity < builder->strings_size + len) capacity *= 2;
+        if (capacity > UINT32_MAX / 2) {
+            ERROR("registry too big");
+            return -EFBIG;
+        }
+        char *strings = realloc(builder->strings, capacity);
+        if (strings == NULL) {
+            ERROR("realloc failed");
+            return -ENOMEM;
+        }
+        builder->strings = strings;
+        builder->strings_capacity = capacity;
+    }
+
+    memcpy(builder->strings + builder->strings_size, string, len);
+    *offset = (uint32_t)builder->strings_size;
+    builder->strings_size += len;
+    return 0;
+}
+
+/**
+ * @brief Start a new application in a builder
+ *
+ * @param[in] builder the builder
+ * @param[in] id the id of the application
+ * @param[in] label the label of the application
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int add_app(builder_t *builder, const char *id, const char *label) {
+    int rc = grow((void **)&builder->apps, &builder->app_capacity, builder->app_count, sizeof(registry_app_t));
+    if (rc < 0)
+        return rc;
+
+    registry_app_t *app = &builder->apps[builder->app_count];
+    app->path = (uint32_t)builder->path_count;
+    app->path_count = 0;
+    app->permission = (uint32_t)builder->permission_count;
+    app->permission_count = 0;
+    rc = add_string(builder, id, &app->id);
+    if (rc >= 0)
+        rc = add_string(builder, label, &app->label);
+    if (rc >= 0)
+        builder->app_count++;
+    return rc;
+}
+
+/**
+ * @brief Add a path to the last application of a builder
+ *
+ * @param[in] builder the builder
+ * @param[in] path the path
+ * @param[in] type the path type
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int add_path(builder_t *builder, const char *path, const char *type) {
+    int rc = grow((void **)&builder->paths, &builder->path_capacity, builder->path_count, sizeof(registry_path_t));
+    if (rc < 0)
+        return rc;
+
+    registry_path_t *item = &builder->paths[builder->path_count];
+    item->app = (uint32_t)builder->app_count - 1;
+    rc = add_string(builder, path, &item->path);
+    if (rc >= 0)
+        rc = add_string(builder, type, &item->type);
+    if (rc >= 0) {
+        builder->path_count++;
+        builder->apps[builder->app_count - 1].path_count++;
+    }
+    return rc;
+}
+
+/**
+ * @brief Add a permission to the last application of a builder
+ *
+ * @param[in] builder the builder
+ * @param[in] permission the permission
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int add_permission(builder_t *builder, const char *permission) {
+    int rc = grow((void **)&builder->permissions, &builder->permission_capacity, builder->permission_count,
+                  sizeof(uint32_t));
+    if (rc < 0)
+        return rc;
+
+    rc = add_string(builder, permission, &builder->permissions[builder->permission_count]);
+    if (rc >= 0) {
+        builder->permission_count++;
+        builder->apps[builder->app_count - 1].permission_count++;
+    }
+    return rc;
+}
+
+/**
+ * @brief Copy the applications of an image to a builder
+ *
+ * @param[in] builder the builder
+ * @param[in] image the image or NULL
+ * @param[in] except the id of an application not to copy
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull((1, 3)) __wur static int copy_apps(builder_t *builder, const char *image, const char *except) {
+    if (image == NULL)
+        return 0;
+
+    const registry_header_t *header = header_of(image);
+    const registry_app_t *apps = table_of(image, header->app_table);
+    const registry_path_t *paths = table_of(image, header->path_table);
+    const uint32_t *permissions = table_of(image, header->permission_table);
+    int rc = 0;
+
+    for (uint32_t i = 0; rc >= 0 && i < header->apps; i++) {
+        if (!strcmp(string_of(image, apps[i].id), except))
+            continue;
+        rc = add_app(builder, string_of(image, apps[i].id), string_of(image, apps[i].label));
+        for (uint32_t j = 0; rc >= 0 && j < apps[i].path_count; j++) {
+            const registry_path_t *path = &paths[apps[i].path + j];
+            rc = add_path(builder, string_of(image, path->path), string_of(image, path->type));
+        }
+        for (uint32_t j = 0; rc >= 0 && j < apps[i].permission_count; j++)
+            rc = add_permission(builder, string_of(image, permissions[apps[i].permission + j]));
+    }
+    return rc;
+}
+
+/**
+ * @brief Add an entry to an index
+ * An entry of same key is replaced
+ *
+ * @param[in] image the image
+ * @param[in] buckets the index
+ * @param[in] mask the count of buckets - 1
+ * @param[in] key the key of the entry
+ * @param[in] position the position of the entry
+ * @param[in] key_of function getting the key of an entry
+ */
+__nonnull() static void index_entry(char *image, uint32_t *buckets, uint32_t mask, const char *key, uint32_t position,
+                                    const char *(*key_of)(const char *image, uint32_t position)) {
+    uint32_t i = hash_key(key) & mask;
+    while (buckets[i] != 0 && strcmp(key_of(image, buckets[i] - 1), key)) i = (i + 1) & mask;
+    buckets[i] = position + 1;
+}
+
+__nonnull() __wur static const char *id_of(const char *image, uint32_t position) {
+    return string_of(image, ((const registry_app_t *)table_of(image, header_of(image)->app_table))[position].id);
+}
+
+__nonnull() __wur static const char *label_of(const char *image, uint32_t position) {
+    return string_of(image, ((const registry_app_t *)table_of(image, header_of(image)->app_table))[position].label);
+}
+
+__nonnull() __wur static const char *path_of(const char *image, uint32_t position) {
+    return string_of(image, ((const registry_path_t *)table_of(image, header_of(image)->path_table))[position].path);
+}
+
+/**
+ * @brief Make the image of a builder
+ *
+ * @param[in] builder the builder
+ * @param[out] image the allocated image
+ * @param[out] size the size of the image
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int make_image(builder_t *builder, char **image, size_t *size) {
+    registry_header_t header;
+    uint64_t offset = sizeof(header);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REGISTRY_MAGIC, sizeof(header.magic));
+    header.apps = (uint32_t)builder->app_count;
+    header.paths = (uint32_t)builder->path_count;
+    header.permissions = (uint32_t)builder->permission_count;
+    header.app_buckets = buckets_for(builder->app_count);
+    header.path_buckets = buckets_for(builder->path_count);
+    header.app_table = (uint32_t)offset;
+    offset += builder->app_count * sizeof(registry_app_t);
+    header.path_table = (uint32_t)offset;
+    offset += builder->path_count * sizeof(registry_path_t);
+    header.permission_table = (uint32_t)offset;
+    offset += builder->permission_count * sizeof(uint32_t);
+    header.id_index = (uint32_t)offset;
+    offset += header.app_buckets * sizeof(uint32_t);
+    header.label_index = (uint32_t)offset;
+    offset += header.app_buckets * sizeof(uint32_t);
+    header.path_index = (uint32_t)offset;
+    offset += header.path_buckets * sizeof(uint32_t);
+    header.strings = (uint32_t)offset;
+    offset += builder->strings_size + 1;
+    if (offset > UINT32_MAX) {
+        ERROR("registry too big");
+        return -EFBIG;
+    }
+    header.size = (uint32_t)offset;
+
+    char *result = calloc(1, header.size);
+    if (result == NULL) {
+        ERROR("calloc failed");
+        return -ENOMEM;
+    }
+
+    memcpy(result, &header, sizeof(header));
+    memcpy(result + header.app_table, builder->apps, builder->app_count * sizeof(registry_app_t));
+    memcpy(result + header.path_table, builder->paths, builder->path_count * sizeof(registry_path_t));
+    memcpy(result + header.permission_table, builder->permissions, builder->permission_count * sizeof(uint32_t));
+    if (builder->strings_size)
+        memcpy(result + header.strings, builder->strings, builder->strings_size);
+
+    for (uint32_t i = 0; i < header.apps; i++) {
+        index_entry(result, (uint32_t *)(result + header.id_index), header.app_buckets - 1, id_of(result, i), i, id_of);
+        index_entry(result, (uint32_t *)(result + header.label_index), header.app_buckets - 1, label_of(result, i), i,
+                    label_of);
+    }
+    /* a path recorded twice goes to the last installed application */
+    for (uint32_t i = 0; i < header.paths; i++)
+        index_entry(result, (uint32_t *)(result + header.path_index), header.path_buckets - 1, path_of(result, i), i,
+                    path_of);
+
+    *image = result;
+    *size = header.size;
+    return 0;
+}
+
+/**
+ * @brief Release the arrays of a builder
+ *
+ * @param[in] builder the builder
+ */
+__nonnull() static void free_builder(builder_t *builder) {
+    free(builder->apps);
+    free(builder->paths);
+    free(builder->permissions);
+    free(builder->strings);
+}
+
+/**
+ * @brief Write an image and make it the image of the registry
+ * The writer lock must be held
+ *
+ * @param[in] registry the registry
+ * @param[in] builder the builder of the image
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int commit_image(registry_t *registry, builder_t *builder) {
+    char *image;
+    size_t size;
+
+    int rc = make_image(builder, &image, &size);
+    if (rc < 0)
+        return rc;
+
+    rc = write_file(registry->file, image, size);
+    if (rc < 0) {
+        ERROR("write_file %s : %d %s", registry->file, -rc, strerror(-rc));
+        free(image);
+        return rc;
+    }
+
+    char *old_image = registry->image;
+    size_t old_size = registry->size;
+    bool old_mapped = registry->mapped;
+
+    pthread_mutex_lock(&registry->lock);
+    registry->image = image;
+    registry->size = size;
+    registry->mapped = false;
+    pthread_mutex_unlock(&registry->lock);
+
+    if (old_image != NULL)
+        free_image(old_image, old_size, old_mapped);
+    return 0;
+}
+
+/**
+ * @brief Report an application
+ *
+ * @param[in] image the image
+ * @param[in] app the application
+ * @param[in] cb the function receiving the items
+ * @param[in] closure the closure of 'cb'
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull((1, 2, 3)) __wur static int report_app(const char *image, const registry_app_t *app, registry_cb_t cb,
+                                                 void *closure) {
+    const registry_header_t *header = header_of(image);
+    const registry_path_t *paths = table_of(image, header->path_table);
+    const uint32_t *permissions = table_of(image, header->permission_table);
+
+    int rc = cb(closure, registry_app, string_of(image, app->id), string_of(image, app->label));
+    for (uint32_t i = 0; rc >= 0 && i < app->path_count; i++) {
+        const registry_path_t *path = &paths[app->path + i];
+        rc = cb(closure, registry_path, string_of(image, path->path), string_of(image, path->type));
+    }
+    for (uint32_t i = 0; rc >= 0 && i < app->permission_count; i++)
+        rc = cb(closure, registry_permission, string_of(image, permissions[app->permission + i]), NULL);
+    return rc;
+}
+
+/**********************/
+/*** PUBLIC METHODS ***/
+/**********************/
+
+/* see registry.h */
+const char *get_registry_file(const char *value) {
+    value = value ?: secure_getenv("SEC_LSM_MANAGER_REGISTRY") ?: default_registry_file;
+    if (strlen(value) >= SEC_LSM_MANAGER_MAX_SIZE_PATH) {
+        ERROR("registry file too long, using default");
+        value = default_registry_file;
+    }
+    return value;
+}
+
+/* see registry.h */
+int registry_create(registry_t **registry, const char *file) {
+    if (strlen(file) >= SEC_LSM_MANAGER_MAX_SIZE_PATH) {
+        ERROR("registry file too long : %s", file);
+        return -EINVAL;
+    }
+
+    registry_t *result = calloc(1, sizeof(*result));
+    if (result == NULL) {
+        ERROR("calloc failed");
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&result->lock, NULL);
+    pthread_mutex_init(&result->writer, NULL);
+    secure_strncpy(result->file, file, sizeof(result->file));
+
+    int rc = load_image(result);
+    if (rc < 0) {
+        registry_destroy(result);
+        return rc;
+    }
+
+    *registry = result;
+    return 0;
+}
+
+/* see registry.h */
+void registry_destroy(registry_t *registry) {
+    if (registry->image != NULL)
+        free_image(registry->image, registry->size, registry->mapped);
+    pthread_mutex_destroy(&registry->writer);
+    pthread_mutex_destroy(&registry->lock);
+    free(registry);
+}
+
+/* see registry.h */
+int registry_add(registry_t *registry, const secure_app_t *secure_app) {
+    builder_t builder;
+    int rc;
+
+    memset(&builder, 0, sizeof(builder));
+    pthread_mutex_lock(&registry->writer);
+
+    rc = copy_apps(&builder, registry->image, secure_app->id);
+    if (rc >= 0)
+        rc = add_app(&builder, secure_app->id, secure_app->label);
+    for (size_t i = 0; rc >= 0 && i < secure_app->path_set.size; i++) {
+        const path_t *path = secure_app->path_set.paths[i];
+        rc = add_path(&builder, path->path, get_path_type_string(path->path_type));
+    }
+    for (size_t i = 0; rc >= 0 && i < secure_app->permission_set.size; i++)
+        rc = add_permission(&builder, secure_app->permission_set.permissions[i]);
+    if (rc >= 0)
+        rc = commit_image(registry, &builder);
+
+    pthread_mutex_unlock(&registry->writer);
+    free_builder(&builder);
+    return rc;
+}
+
+/* see registry.h */
+int registry_remove(registry_t *registry, const char *id) {
+    builder_t builder;
+    int rc;
+
+    memset(&builder, 0, sizeof(builder));
+    pthread_mutex_lock(&registry->writer);
+
+    if (registry->image == NULL || search_app(registry->image, header_of(registry->image)->id_index, 0, id) == NULL) {
+        rc = -ENOENT;
+    } else {
+        rc = copy_apps(&builder, registry->image, id);
+        if (rc >= 0)
+            rc = commit_image(registry, &builder);
+    }
+
+    pthread_mutex_unlock(&registry->writer);
+    free_builder(&builder);
+    return rc;
+}
+
+/* see registry.h */
+int registry_list(registry_t *registry, registry_cb_t cb, void *closure) {
+    int rc = 0;
+
+    pthread_mutex_lock(&registry->lock);
+    if (registry->image != NULL) {
+        const registry_header_t *header = header_of(registry->image);
+        const registry_app_t *apps = table_of(registry->image, header->app_table);
+        for (uint32_t i = 0; rc >= 0 && i < header->apps; i++)
+            rc = cb(closure, registry_app, string_of(registry->image, apps[i].id),
+                    string_of(registry->image, apps[i].label));
+        if (rc >= 0)
+            rc = (int)header->apps;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return rc;
+}
+
+/* see registry.h */
+int registry_query(registry_t *registry, const char *key, registry_cb_t cb, void *closure) {
+    const registry_app_t *app = NULL;
+    int rc = -ENOENT;
+
+    pthread_mutex_lock(&registry->lock);
+    if (registry->image != NULL) {
+        const registry_header_t *header = header_of(registry->image);
+        app = search_app(registry->image, header->id_index, 0, key)
+                  ?: search_app(registry->image, header->label_index, 1, key);
+        if (app != NULL)
+            rc = report_app(registry->image, app, cb, closure);
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return rc;
+}
+
+/* see registry.h */
+int registry_owner(registry_t *registry, const char *path, registry_cb_t cb, void *closure) {
+    char buffer[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    const registry_path_t *found = NULL;
+    size_t len = strlen(path);
+    int rc = -ENOENT;
+
+    if (len >= sizeof(buffer))
+        return -ENAMETOOLONG;
+    memcpy(buffer, path, len + 1);
+    while (len > 1 && buffer[len - 1] == '/') buffer[--len] = '\0';
+
+    pthread_mutex_lock(&registry->lock);
+    if (registry->image != NULL) {
+        /* the path itself then its parent directories */
+        for (;;) {
+            found = search_path(registry->image, buffer);
+            if (found != NULL || len <= 1)
+                break;
+            while (len > 0 && buffer[len - 1] != '/') len--;
+            if (len == 0)
+                break;
+            buffer[len > 1 ? --len : len] = '\0';
+        }
+        if (found != NULL) {
+            const registry_app_t *apps = table_of(registry->image, header_of(registry->image)->app_table);
+            const registry_app_t *app = &apps[found->app];
+            rc = cb(closure, registry_app, string_of(registry->image, app->id),
+                    string_of(registry->image, app->label));
+            if (rc >= 0)
+                rc = cb(closure, registry_path, string_of(registry->image, found->path),
+                        string_of(registry->image, found->type));
+        }
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return rc;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#ifndef SEC_LSM_MANAGER_REGISTRY_H
+#define SEC_LSM_MANAGER_REGISTRY_H
+
+#include <sys/cdefs.h>
+
+#include "secure-app.h"
+
+typedef struct registry registry_t;
+
+/**
+ * @brief Kinds of the items reported by the lookups of the registry
+ *
+ * registry_app        : an application, value is its id and extra its label
+ * registry_path       : a path of the application, extra is its path type
+ * registry_permission : a permission of the application, extra is NULL
+ */
+enum registry_item { registry_app, registry_path, registry_permission };
+
+/**
+ * @brief Function receiving the items of a lookup
+ *
+ * @param[in] closure the closure given to the lookup
+ * @param[in] item the kind of the item
+ * @param[in] value the value of the item
+ * @param[in] extra the extra value of the item or NULL
+ * @return 0 to continue or a negative -errno value that stops the lookup
+ */
+typedef int (*registry_cb_t)(void *closure, enum registry_item item, const char *value, const char *extra);
+
+/**
+ * @brief Get the file of the registry
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the path of the file of the registry
+ */
+extern const char *get_registry_file(const char *value) __wur;
+
+/**
+ * @brief Create a registry and load it from its file
+ * A missing file gives an empty registry. An invalid file is reported and
+ * renamed with the suffix ".corrupt", the registry is then empty.
+ *
+ * @param[out] registry where to store the handler of the registry
+ * @param[in] file the file of the registry
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int registry_create(registry_t **registry, const char *file) __wur __nonnull();
+
+/**
+ * @brief Destroy a registry (its file is kept)
+ *
+ * @param[in] registry the registry
+ */
+extern void registry_destroy(registry_t *registry) __nonnull();
+
+/**
+ * @brief Record an installed application, replacing the previous record of its id
+ * The file is replaced atomically: on error, the registry is unchanged.
+ * The whole file is rewritten, so the cost grows with the count of applications.
+ *
+ * @param[in] registry the registry
+ * @param[in] secure_app the installed application
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int registry_add(registry_t *registry, const secure_app_t *secure_app) __wur __nonnull();
+
+/**
+ * @brief Remove the record of an uninstalled application
+ * The file is replaced atomically: on error, the registry is unchanged.
+ *
+ * @param[in] registry the registry
+ * @param[in] id the id of the application
+ * @return 0 in case of success, -ENOENT if not recorded or a negative -errno value
+ */
+extern int registry_remove(registry_t *registry, const char *id) __wur __nonnull();
+
+/**
+ * @brief Report the id and label of the recorded applications
+ *
+ * @param[in] registry the registry
+ * @param[in] cb the function receiving the registry_app items
+ * @param[in] closure the closure of 'cb'
+ * @return the count of applications or a negative -errno value
+ */
+extern int registry_list(registry_t *registry, registry_cb_t cb, void *closure) __wur __nonnull((1, 2));
+
+/**
+ * @brief Report an application with its paths and its permissions
+ *
+ * @param[in] registry the registry
+ * @param[in] key the id or the label of the application
+ * @param[in] cb the function receiving the items
+ * @param[in] closure the closure of 'cb'
+ * @return 0 in case of success, -ENOENT if not recorded or a negative -errno value
+ */
+extern int registry_query(registry_t *registry, const char *key, registry_cb_t cb, void *closure) __wur
+    __nonnull((1, 2, 3));
+
+/**
+ * @brief Report the application owning a file
+ * The owner is the application of the path or, if not recorded, of its
+ * nearest recorded parent directory. It is reported with the recorded path.
+ *
+ * @param[in] registry the registry
+ * @param[in] path the path of the file
+ * @param[in] cb the function receiving the registry_app and registry_path items
+ * @param[in] closure the closure of 'cb'
+ * @return 0 in case of success, -ENOENT if not owned or a negative -errno value
+ */
+extern int registry_owner(registry_t *registry, const char *path, registry_cb_t cb, void *closure) __wur
+    __nonnull((1, 2, 3));
+
+#endif
@@ -38,7 +38,8 @@
     }
 
 extern const char _sec_lsm_manager_[], _done_[], _error_[], _log_[], _id_[], _permission_[], _path_[], _install_[],
-    _uninstall_[], _display_[], _clear_[], _on_[], _off_[], _string_[];
+    _uninstall_[], _display_[], _clear_[], _on_[], _off_[], _string_[], _paths_[], _permissions_[],
+    _list_[], _query_[], _owner_[], _app_[];
 
 /* predefined names */
 extern const char sec_lsm_manager_default_socket_scheme[], sec_lsm_manager_default_socket_dir[],
@@ -26,32 +26,64 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "journal.h"
 #include "log.h"
 #include "pollitem.h"
 #include "prot.h"
+#include "registry.h"
 #include "sec-lsm-manager-protocol.h"
 #include "secure-app.h"
 #include "socket.h"
+#include "template.h"
 #include "utils.h"
+#include "worker.h"
 
 typedef struct client client_t;
+typedef struct outrec outrec_t;
 
 #define MAX_PUTX_ITEMS 15
 
+/** size of pending output above which the reading of the client is paused */
+#if !defined(OUTPUT_HIGH_WATER)
+#define OUTPUT_HIGH_WATER (64 * 1024)
+#endif
+
+/** size of pending output below which the reading of the client is resumed */
+#if !defined(OUTPUT_LOW_WATER)
+#define OUTPUT_LOW_WATER (16 * 1024)
+#endif
+
 /** should log? */
 int sec_lsm_manager_server_log = 0;
 
+/** structure of a reply waiting for room in the output buffer */
+struct outrec {
+    /** next record of the queue */
+    outrec_t *next;
+
+    /** size of the record (sum of the lengths of the fields) */
+    size_t size;
+
+    /** count of fields */
+    unsigned count;
+
+    /** the fields, copied after the array */
+    const char *fields[];
+};
+
 /** structure that represents a client */
 struct client {
     /** a protocol structure */
@@ -69,6 +101,33 @@ struct client {
     /** is the actual link invalid or valid */
     unsigned invalid : 1;
 
+    /** is an action running in a worker (reading is suspended) */
+    unsigned busy : 1;
+
+    /** is the link closed while busy (destroy on completion) */
+    unsigned closed : 1;
+
+    /** is the reading paused because too much output is queued */
+    unsigned paused : 1;
+
+    /** events currently polled */
+    uint32_t events;
+
+    /** replies waiting for room in the output buffer */
+    outrec_t *outq;
+
+    /** size of the queued replies */
+    size_t outq_size;
+
+    /** action run by the worker */
+    int (*action)(sec_lsm_manager_server_t *server, const secure_app_t *secure_app);
+
+    /** secure_app detached from the client while its action runs */
+    secure_app_t *action_app;
+
+    /** name of the action for reporting errors */
+    const char *action_name;
+
     /** polling callback */
     pollitem_t pollitem;
 
@@ -90,8 +149,35 @@ struct sec_lsm_manager_server {
     /** cynagora client used by all client */
     cynagora_t *cynagora_admin_client;
 
+    /** serialize the uses of cynagora_admin_client by the workers */
+    pthread_mutex_t cynagora_lock;
+
+    /** is cynagora_admin_client connected? (protected by cynagora_lock) */
+    bool cynagora_connected;
+
+    /** last use of cynagora_admin_client in ms (protected by cynagora_lock) */
+    int64_t cynagora_used;
+
+    /** count of connections to cynagora (protected by cynagora_lock) */
+    unsigned long cynagora_connects;
+
+    /** seconds before closing an unused connection to cynagora */
+    int cynagora_idle_timeout;
+
+    /** the pool of workers or NULL for running actions inline */
+    worker_pool_t *workers;
+
     /** the server socket */
     pollitem_t socket;
+
+    /** the watch of the templates */
+    pollitem_t templates;
+
+    /** the record of the installed applications */
+    registry_t *registry;
+
+    /** the journal of the installs and uninstalls */
+    journal_t *journal;
 };
 
 #ifdef WITH_SMACK
@@ -148,32 +234,127 @@ __nonnull() __wur static bool ckarg(const char *arg, const char *value, unsigned
 }
 
 /**
- * @brief Flush the write buffer
+ * @brief Update the events polled for the client
+ * Reading is polled unless the client is busy or has too much pending
+ * output. Writing is polled while output is pending.
+ *
+ * @param[in] cli client handler
+ */
+__nonnull() static void update_events(client_t *cli) {
+    uint32_t events;
+    size_t pending = cli->outq_size + prot_write_pending(cli->prot);
+
+    if (pending >= OUTPUT_HIGH_WATER)
+        cli->paused = 1;
+    else if (pending <= OUTPUT_LOW_WATER)
+        cli->paused = 0;
+
+    events = cli->busy || cli->paused ? 0 : EPOLLIN;
+    if (prot_should_write(cli->prot))
+        events |= EPOLLOUT;
+
+    if (events != cli->events && !cli->closed) {
+        if (pollitem_mod(&cli->pollitem, events, cli->sec_lsm_manager_server->pollfd) < 0) {
+            ERROR("can't update client polling: %d %s", errno, strerror(errno));
+        } else {
+            cli->events = events;
+        }
+    }
+}
+
+/**
+ * @brief Queue a reply that doesn't fit in the output buffer
+ *
+ * @param[in] cli client handler
+ * @param[in] count count of fields
+ * @param[in] fields the fields
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int enqueue_record(client_t *cli, unsigned count, const char **fields) {
+    outrec_t *rec, **prev;
+    size_t size = 0, len;
+    char *data;
+    unsigned i;
+
+    for (i = 0; i < count; i++) size += strlen(fields[i]) + 1;
+
+    rec = malloc(sizeof(*rec) + count * sizeof(*rec->fields) + size);
+    if (rec == NULL) {
+        ERROR("malloc outrec_t");
+        return -ENOMEM;
+    }
+    rec->next = NULL;
+    rec->size = size;
+    rec->count = count;
+    data = (char *)&rec->fields[count];
+    for (i = 0; i < count; i++) {
+        len = strlen(fields[i]) + 1;
+        memcpy(data, fields[i], len);
+        rec->fields[i] = data;
+        data += len;
+    }
+
+    for (prev = &cli->outq; *prev != NULL; prev = &(*prev)->next) {
+    }
+    *prev = rec;
+    cli->outq_size += size;
+    return 0;
+}
+
+/**
+ * @brief Release the queued replies
+ *
+ * @param[in] cli client handler
+ */
+__nonnull() static void clear_outq(client_t *cli) {
+    outrec_t *rec;
+
+    while ((rec = cli->outq) != NULL) {
+        cli->outq = rec->next;
+        free(rec);
+    }
+    cli->outq_size = 0;
+}
+
+/**
+ * @brief Flush the write buffer without blocking
+ * The queued replies are moved to the output buffer as room is made.
+ * What can't be written now is written when the socket becomes writable.
  *
  * @param[in] cli client handler
  * @return 0 in case of success or a negative -errno value
  */
 __nonnull() __wur static int flushw(client_t *cli) {
     int rc;
-    struct pollfd pfd;
+    outrec_t *rec;
 
     for (;;) {
-        rc = prot_should_write(cli->prot);
-        if (!rc)
+        /* fill the output buffer with the queued replies */
+        while ((rec = cli->outq) != NULL) {
+            rc = prot_put(cli->prot, rec->count, rec->fields);
+            if (rc == -ECANCELED && prot_should_write(cli->prot))
+                break;
+            if (rc < 0) {
+                ERROR("reply dropped : %d %s", -rc, strerror(-rc));
+            }
+            cli->outq = rec->next;
+            cli->outq_size -= rec->size;
+            free(rec);
+        }
+
+        /* write what can be written */
+        if (!prot_should_write(cli->prot)) {
+            rc = 0;
             break;
-        rc = prot_write(cli->prot, cli->pollitem.fd);
-        if (rc == -EAGAIN) {
-            pfd.fd = cli->pollitem.fd;
-            pfd.events = POLLOUT;
-            do {
-                rc = poll(&pfd, 1, 0);
-            } while (rc < 0 && errno == EINTR);
-            if (rc < 0)
-                rc = -errno;
         }
-        if (rc < 0)
+        rc = prot_write(cli->prot, cli->pollitem.fd);
+        if (rc < 0) {
+            if (rc == -EAGAIN)
+                rc = 0;
             break;
+        }
     }
+    update_events(cli);
     return rc;
 }
 
@@ -204,14 +385,20 @@ __nonnull((1)) __wur static int putx(client_t *cli, ...) {
 
     dolog_protocol(cli, 0, n, fields);
 
-    /* send now */
-    rc = prot_put(cli->prot, n, fields);
-    if (rc == -ECANCELED) {
-        rc = flushw(cli);
-        if (rc == 0)
-            rc = prot_put(cli->prot, n, fields);
+    /* send now if nothing is queued */
+    if (cli->outq == NULL) {
+        rc = prot_put(cli->prot, n, fields);
+        if (rc == -ECANCELED) {
+            rc = flushw(cli);
+            if (rc == 0 && cli->outq == NULL)
+                rc = prot_put(cli->prot, n, fields);
+        }
+        if (rc != -ECANCELED)
+            return rc;
     }
-    return rc;
+
+    /* queue it until the socket is writable */
+    return enqueue_record(cli, n, fields);
 }
 
 /**
@@ -285,51 +472,204 @@ __nonnull() __wur static int send_display_secure_app(client_t *cli) {
         }
     }
 
+    DEBUG("memory of the session : %zu bytes", secure_app_memory_usage(cli->secure_app));
+
     return 0;
 }
 
 /**
- * @brief Update the policy (drop the old and set the new)
+ * @brief emit an item of the registry
  *
- * @param[in] sm_handle sec_lsm_manager_handle handler
+ * @param[in] closure client handler
+ * @param[in] item kind of the item
+ * @param[in] value value of the item
+ * @param[in] extra extra value of the item or NULL
  * @return 0 in case of success or a negative -errno value
  */
-__nonnull() __wur static int update_policy(secure_app_t *secure_app, cynagora_t *cynagora_admin_client) {
-    // drop old policies
-    int rc = cynagora_drop_policies(cynagora_admin_client, secure_app->label);
+__nonnull((1, 3)) __wur static int send_registry_item(void *closure, enum registry_item item, const char *value,
+                                                      const char *extra) {
+    client_t *cli = closure;
+    const char *kind = item == registry_app ? _app_ : item == registry_path ? _path_ : _permission_;
+    int rc = putx(cli, kind, value, extra, NULL);
     if (rc < 0) {
-        ERROR("cynagora_drop_policies %s : %d %s", secure_app->label, -rc, strerror(-rc));
-        return rc;
+        ERROR("putx : %d %s", -rc, strerror(-rc));
     }
+    return rc;
+}
 
-    // apply new policies
-    rc = cynagora_set_policies(cynagora_admin_client, secure_app->label, &(secure_app->permission_set));
-    if (rc < 0) {
-        ERROR("cynagora_set_policies %s : %d %s", secure_app->label, -rc, strerror(-rc));
-        return rc;
+/**
+ * @brief emit the reply of a lookup in the registry
+ * An unknown application or path is not an error: the reply is empty
+ *
+ * @param[in] cli client handler
+ * @param[in] rc the result of the lookup
+ * @param[in] errorstr string error to send
+ */
+__nonnull() static void reply_lookup(client_t *cli, int rc, const char *errorstr) {
+    if (rc >= 0 || rc == -ENOENT) {
+        send_done(cli);
+    } else {
+        ERROR("%s : %d %s", errorstr, -rc, strerror(-rc));
+        send_error(cli, errorstr);
     }
+}
 
-    return 0;
+/**
+ * @brief Get the monotonic time in ms
+ *
+ * @return the time in ms
+ */
+__wur static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-__nonnull() __wur static int install(client_t *cli) {
-    if (cli->secure_app->error_flag) {
-        ERROR("error flag has been raised, clear secure app");
-        return -EPERM;
+/**
+ * @brief Close the connection to cynagora
+ * The connection is opened again on its next use.
+ *
+ * @param[in] server the server
+ */
+__nonnull() static void disconnect_cynagora(sec_lsm_manager_server_t *server) {
+    pthread_mutex_lock(&server->cynagora_lock);
+    if (server->cynagora_connected) {
+        cynagora_disconnect(server->cynagora_admin_client);
+        server->cynagora_connected = false;
     }
+    pthread_mutex_unlock(&server->cynagora_lock);
+}
 
-    int rc = update_policy(cli->secure_app, cli->sec_lsm_manager_server->cynagora_admin_client);
+/**
+ * @brief Get the delay before closing the unused connection to cynagora
+ *
+ * @param[in] server the server
+ * @return the delay in ms or -1 if there is nothing to close
+ */
+__nonnull() __wur static int idle_cynagora_delay(sec_lsm_manager_server_t *server) {
+    int64_t delay = -1;
+
+    pthread_mutex_lock(&server->cynagora_lock);
+    if (server->cynagora_connected && server->cynagora_idle_timeout > 0) {
+        delay = server->cynagora_used + server->cynagora_idle_timeout * 1000 - now_ms();
+        if (delay < 0)
+            delay = 0;
+    }
+    pthread_mutex_unlock(&server->cynagora_lock);
+    return (int)delay;
+}
+
+/**
+ * @brief Run an action with cynagora_admin_client
+ * The connection is opened by cynagora when needed. When it is broken,
+ * it is closed and the action is tried once more on a new connection.
+ *
+ * @param[in] server the server
+ * @param[in] action the action
+ * @param[in] secure_app the secure app given to the action
+ * @return the result of the action
+ */
+__nonnull() __wur static int with_cynagora(sec_lsm_manager_server_t *server,
+                                           int (*action)(cynagora_t *, const secure_app_t *),
+                                           const secure_app_t *secure_app) {
+    int rc, retry = 1;
+
+    pthread_mutex_lock(&server->cynagora_lock);
+    for (;;) {
+        if (!server->cynagora_connected) {
+            server->cynagora_connected = true;
+            server->cynagora_connects++;
+            DEBUG("connect to cynagora (%lu)", server->cynagora_connects);
+        }
+        rc = action(server->cynagora_admin_client, secure_app);
+        if (rc >= 0 || !cynagora_link_error(rc))
+            break;
+        ERROR("cynagora link broken : %d %s", -rc, strerror(-rc));
+        cynagora_disconnect(server->cynagora_admin_client);
+        server->cynagora_connected = false;
+        if (!retry--)
+            break;
+    }
+    server->cynagora_used = now_ms();
+    pthread_mutex_unlock(&server->cynagora_lock);
+    return rc;
+}
+
+/**
+ * @brief Update the policy (drop the old and set the new, in one transaction)
+ *
+ * @param[in] cynagora_admin_client cynagora admin client
+ * @param[in] secure_app secure app handler
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int update_policy(cynagora_t *cynagora_admin_client, const secure_app_t *secure_app) {
+    int rc = cynagora_update_policies(cynagora_admin_client, secure_app->label, &(secure_app->permission_set));
     if (rc < 0) {
-        ERROR("update_policy : %d %s", -rc, strerror(-rc));
+        ERROR("cynagora_update_policies %s : %d %s", secure_app->label, -rc, strerror(-rc));
         return rc;
     }
 
-    DEBUG("update_policy success");
+    return 0;
+}
+
+/**
+ * @brief Drop the policy
+ *
+ * @param[in] cynagora_admin_client cynagora admin client
+ * @param[in] secure_app secure app handler
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int drop_policy(cynagora_t *cynagora_admin_client, const secure_app_t *secure_app) {
+    return cynagora_drop_policies(cynagora_admin_client, secure_app->label);
+}
+
+/** stages of the install and of the uninstall recorded in the journal */
+enum action_stage { stage_none, stage_policy, stage_mac };
+
+/**
+ * @brief Install an application from the stage following 'done'
+ *
+ * @param[in] server the server
+ * @param[in] secure_app the application
+ * @param[in] seq the sequence number of the operation in the journal or 0
+ * @param[in] done the last stage already completed
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int install_app(sec_lsm_manager_server_t *server, const secure_app_t *secure_app, uint32_t seq,
+                                         enum action_stage done) {
+    int rc;
+
+    if (done < stage_policy) {
+        rc = with_cynagora(server, update_policy, secure_app);
+        if (rc < 0) {
+            ERROR("update_policy : %d %s", -rc, strerror(-rc));
+            return rc;
+        }
+        journal_stage(server->journal, seq, stage_policy);
+        DEBUG("update_policy success");
+    }
+
+    if (done < stage_mac) {
+        rc = install_mac(secure_app);
+        if (rc < 0) {
+            ERROR("install_mac : %d %s", -rc, strerror(-rc));
+            int rc2 = with_cynagora(server, drop_policy, secure_app);
+            if (rc2 < 0) {
+                ERROR("cannot delete policy : %d %s", -rc2, strerror(-rc2));
+            }
+            return rc;
+        }
+        journal_stage(server->journal, seq, stage_mac);
+    }
 
-    rc = install_mac(cli->secure_app);
+    rc = registry_add(server->registry, secure_app);
     if (rc < 0) {
-        ERROR("install_mac : %d %s", -rc, strerror(-rc));
-        int rc2 = cynagora_drop_policies(cli->sec_lsm_manager_server->cynagora_admin_client, cli->secure_app->label);
+        ERROR("registry_add : %d %s", -rc, strerror(-rc));
+        int rc2 = uninstall_mac(secure_app);
+        if (rc2 < 0) {
+            ERROR("cannot uninstall mac : %d %s", -rc2, strerror(-rc2));
+        }
+        rc2 = with_cynagora(server, drop_policy, secure_app);
         if (rc2 < 0) {
             ERROR("cannot delete policy : %d %s", -rc2, strerror(-rc2));
         }
@@ -341,29 +681,264 @@ __nonnull() __wur static int install(client_t *cli) {
     return 0;
 }
 
-__nonnull() __wur static int uninstall(client_t *cli) {
-    if (cli->secure_app->error_flag) {
-        ERROR("error flag has been raised, clear secure app");
-        return -EPERM;
+/**
+ * @brief Copy an item of the registry to a secure app (see registry_query)
+ *
+ * @param[in] closure the secure app
+ * @param[in] item the kind of the item
+ * @param[in] value the value of the item
+ * @param[in] extra the extra value of the item or NULL
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull((1, 3)) __wur static int copy_registry_item(void *closure, enum registry_item item, const char *value,
+                                                      const char *extra) {
+    secure_app_t *secure_app = closure;
+
+    switch (item) {
+        case registry_app:
+            return secure_app_set_id(secure_app, value);
+        case registry_path:
+            return secure_app_add_path(secure_app, value, get_path_type(extra));
+        case registry_permission:
+            return secure_app_add_permission(secure_app, value);
     }
+    return 0;
+}
 
-    int rc = cynagora_drop_policies(cli->sec_lsm_manager_server->cynagora_admin_client, cli->secure_app->label);
+/**
+ * @brief Uninstall an application from the stage following 'done'
+ * The record of the registry is removed first and restored if a stage fails,
+ * so that a failed removal of the record leaves the application untouched.
+ *
+ * @param[in] server the server
+ * @param[in] secure_app the application
+ * @param[in] seq the sequence number of the operation in the journal or 0
+ * @param[in] done the last stage already completed
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int uninstall_app(sec_lsm_manager_server_t *server, const secure_app_t *secure_app,
+                                           uint32_t seq, enum action_stage done) {
+    secure_app_t *record = NULL;
+    int rc, rc2;
 
+    /* keep the record, the uninstall may only give the id */
+    rc = create_secure_app(&record);
     if (rc < 0) {
-        ERROR("cynagora_drop_policies : %d %s", -rc, strerror(-rc));
+        ERROR("create_secure_app : %d %s", -rc, strerror(-rc));
         return rc;
     }
+    rc = registry_query(server->registry, secure_app->id, copy_registry_item, record);
+    if (rc >= 0) {
+        rc = registry_remove(server->registry, secure_app->id);
+    } else if (rc == -ENOENT) {
+        /* applications installed before the registry existed aren't recorded */
+        destroy_secure_app(record);
+        record = NULL;
+        rc = 0;
+    }
+    if (rc < 0) {
+        ERROR("registry_remove : %d %s", -rc, strerror(-rc));
+        destroy_secure_app(record);
+        return rc;
+    }
+
+    if (done < stage_policy) {
+        rc = with_cynagora(server, drop_policy, secure_app);
+        if (rc < 0) {
+            ERROR("cynagora_drop_policies : %d %s", -rc, strerror(-rc));
+            goto restore;
+        }
+        journal_stage(server->journal, seq, stage_policy);
+    }
+
+    if (done < stage_mac) {
+        rc = uninstall_mac(secure_app);
+        if (rc < 0) {
+            ERROR("uninstall_mac : %d %s", -rc, strerror(-rc));
+            goto restore;
+        }
+        journal_stage(server->journal, seq, stage_mac);
+    }
+
+    DEBUG("uninstall success");
+    rc = 0;
+    goto end;
 
-    rc = uninstall_mac(cli->secure_app);
+restore:
+    /* the application is still installed, at least partly: keep its record */
+    if (record != NULL) {
+        rc2 = registry_add(server->registry, record);
+        if (rc2 < 0) {
+            ERROR("cannot restore registry : %d %s", -rc2, strerror(-rc2));
+        }
+    }
 
+end:
+    if (record != NULL) {
+        destroy_secure_app(record);
+    }
+    return rc;
+}
+
+/**
+ * @brief Run an install or an uninstall recorded in the journal
+ *
+ * @param[in] server the server
+ * @param[in] secure_app the application
+ * @param[in] op the operation
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int journaled_action(sec_lsm_manager_server_t *server, const secure_app_t *secure_app,
+                                              enum journal_op op) {
+    uint32_t seq;
+
+    if (secure_app->error_flag) {
+        ERROR("error flag has been raised, clear secure app");
+        return -EPERM;
+    }
+
+    /* the intent is on the disk before anything is changed */
+    int rc = journal_begin(server->journal, op, secure_app, &seq);
     if (rc < 0) {
-        ERROR("uninstall_mac : %d %s", -rc, strerror(-rc));
+        ERROR("journal_begin : %d %s", -rc, strerror(-rc));
         return rc;
     }
 
-    DEBUG("uninstall success");
+    if (op == journal_install)
+        rc = install_app(server, secure_app, seq, stage_none);
+    else
+        rc = uninstall_app(server, secure_app, seq, stage_none);
 
-    return 0;
+    journal_end(server->journal, seq);
+    return rc;
+}
+
+__nonnull() __wur static int install(sec_lsm_manager_server_t *server, const secure_app_t *secure_app) {
+    return journaled_action(server, secure_app, journal_install);
+}
+
+__nonnull() __wur static int uninstall(sec_lsm_manager_server_t *server, const secure_app_t *secure_app) {
+    return journaled_action(server, secure_app, journal_uninstall);
+}
+
+/**
+ * @brief Complete an install or an uninstall interrupted by a crash
+ * An install that can't be completed is rolled back by an uninstall.
+ *
+ * @param[in] closure the server
+ * @param[in] op the operation
+ * @param[in] secure_app the application
+ * @param[in] stage the last stage completed
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int recover_action(void *closure, enum journal_op op, secure_app_t *secure_app,
+                                            unsigned stage) {
+    sec_lsm_manager_server_t *server = closure;
+
+    if (op == journal_uninstall)
+        return uninstall_app(server, secure_app, 0, (enum action_stage)stage);
+
+    int rc = install_app(server, secure_app, 0, (enum action_stage)stage);
+    if (rc < 0) {
+        ERROR("cannot complete install of %s, roll back", secure_app->id);
+        rc = uninstall_app(server, secure_app, 0, stage_none);
+    }
+    return rc;
+}
+
+/**
+ * @brief Reply the result of the action of the client
+ *
+ * @param[in] cli client handler
+ * @param[in] rc the result of the action
+ */
+__nonnull() static void reply_action(client_t *cli, int rc) {
+    if (rc >= 0) {
+        send_done(cli);
+    } else {
+        ERROR("%s : %d %s", cli->action_name, -rc, strerror(-rc));
+        send_error(cli, cli->action_name);
+    }
+}
+
+/**
+ * @brief Run the action of the client in a worker thread
+ *
+ * @param[in] closure the client
+ * @return the result of the action
+ */
+static int action_job(void *closure) {
+    client_t *cli = closure;
+    return cli->action(cli->sec_lsm_manager_server, cli->action_app);
+}
+
+static void on_action_done(void *closure, int status);
+
+/**
+ * @brief Run an action that may block (install, uninstall)
+ * If the server has workers, the action is run by a worker and the client
+ * is suspended until its completion. Otherwise, it is run inline.
+ * The worker gets the secure app detached from the client: nothing of the
+ * client can change it until the completion gives it back.
+ * The actions on the same application id never run concurrently.
+ *
+ * @param[in] cli client handler
+ * @param[in] action the action to run
+ * @param[in] action_name name of the action for reporting errors
+ */
+__nonnull() static void run_action(client_t *cli, int (*action)(sec_lsm_manager_server_t *, const secure_app_t *),
+                                   const char *action_name) {
+    sec_lsm_manager_server_t *server = cli->sec_lsm_manager_server;
+    int rc;
+
+    cli->action = action;
+    cli->action_name = action_name;
+    if (server->workers != NULL) {
+        cli->action_app = cli->secure_app;
+        cli->secure_app = NULL;
+        rc = worker_pool_submit(server->workers, cli->action_app->id, action_job, on_action_done, cli);
+        if (rc >= 0) {
+            cli->busy = 1;
+            return;
+        }
+        ERROR("worker_pool_submit : %d %s", -rc, strerror(-rc));
+        cli->secure_app = cli->action_app;
+        cli->action_app = NULL;
+    } else {
+        rc = action(server, cli->secure_app);
+    }
+    reply_action(cli, rc);
+}
+
+/**
+ * @brief Add the path/type pairs of a 'paths' request
+ *
+ * @param[in] cli client handler
+ * @param[in] count The number of pairs
+ * @param[in] pairs The paths followed by their type
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int add_paths(client_t *cli, unsigned count, const char *pairs[]) {
+    const char **paths = malloc(count * sizeof(*paths));
+    enum path_type *path_types = malloc(count * sizeof(*path_types));
+    int rc = -ENOMEM;
+
+    if (paths == NULL || path_types == NULL) {
+        ERROR("malloc paths");
+        goto end;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        paths[i] = pairs[2 * i];
+        path_types[i] = get_path_type(pairs[2 * i + 1]);
+    }
+
+    rc = secure_app_add_paths(cli->secure_app, count, paths, path_types);
+
+end:
+    free(path_types);
+    free(paths);
+    return rc;
 }
 
 /**
@@ -440,13 +1015,7 @@ __nonnull((1)) static void onrequest(client_t *cli, unsigned count, const char *
                 return;
             }
             if (ckarg(args[0], _install_, 1) && count == 1) {
-                rc = install(cli);
-                if (rc >= 0) {
-                    send_done(cli);
-                } else {
-                    ERROR("sec_lsm_manager_handle_install : %d %s", -rc, strerror(-rc));
-                    send_error(cli, "sec_lsm_manager_handle_install");
-                }
+                run_action(cli, install, "sec_lsm_manager_handle_install");
                 return;
             }
             break;
@@ -469,6 +1038,19 @@ __nonnull((1)) static void onrequest(client_t *cli, unsigned count, const char *
                 sec_lsm_manager_server_log = nextlog;
                 return;
             }
+            /* exact word: the abbreviations of 'l' stay for 'log' */
+            if (!strcmp(args[0], _list_) && count == 1) {
+                rc = registry_list(cli->sec_lsm_manager_server->registry, send_registry_item, cli);
+                reply_lookup(cli, rc, "sec_lsm_manager_handle_list");
+                return;
+            }
+            break;
+        case 'o':
+            if (ckarg(args[0], _owner_, 1) && count == 2) {
+                rc = registry_owner(cli->sec_lsm_manager_server->registry, args[1], send_registry_item, cli);
+                reply_lookup(cli, rc, "sec_lsm_manager_handle_owner");
+                return;
+            }
             break;
         case 'p':
             if (ckarg(args[0], _path_, 1) && count == 3) {
@@ -488,6 +1070,17 @@ __nonnull((1)) static void onrequest(client_t *cli, unsigned count, const char *
                 }
                 return;
             }
+            if (ckarg(args[0], _paths_, 1) && count >= 3 && count % 2 == 1 &&
+                count <= 2 * SEC_LSM_MANAGER_MAX_BULK_ITEMS + 1) {
+                rc = add_paths(cli, count / 2, &args[1]);
+                if (rc >= 0) {
+                    send_done(cli);
+                } else {
+                    ERROR("sec_lsm_manager_handle_add_paths : %d %s", -rc, strerror(-rc));
+                    send_error(cli, "sec_lsm_manager_handle_add_paths");
+                }
+                return;
+            }
             if (ckarg(args[0], _permission_, 1) && count == 2) {
                 rc = secure_app_add_permission(cli->secure_app, args[1]);
                 if (rc >= 0) {
@@ -505,18 +1098,29 @@ __nonnull((1)) static void onrequest(client_t *cli, unsigned count, const char *
                 }
                 return;
             }
-            break;
-        case 'u':
-            if (ckarg(args[0], _uninstall_, 1) && count == 1) {
-                rc = uninstall(cli);
+            if (ckarg(args[0], _permissions_, 1) && count >= 2 && count <= SEC_LSM_MANAGER_MAX_BULK_ITEMS + 1) {
+                rc = secure_app_add_permissions(cli->secure_app, count - 1, &args[1]);
                 if (rc >= 0) {
                     send_done(cli);
                 } else {
-                    ERROR("sec_lsm_manager_handle_uninstall : %d %s", -rc, strerror(-rc));
-                    send_error(cli, "sec_lsm_manager_handle_uninstall");
+                    ERROR("sec_lsm_manager_handle_add_permissions : %d %s", -rc, strerror(-rc));
+                    send_error(cli, "sec_lsm_manager_handle_add_permissions");
                 }
                 return;
             }
+            break;
+        case 'q':
+            if (ckarg(args[0], _query_, 1) && count == 2) {
+                rc = registry_query(cli->sec_lsm_manager_server->registry, args[1], send_registry_item, cli);
+                reply_lookup(cli, rc, "sec_lsm_manager_handle_query");
+                return;
+            }
+            break;
+        case 'u':
+            if (ckarg(args[0], _uninstall_, 1) && count == 1) {
+                run_action(cli, uninstall, "sec_lsm_manager_handle_uninstall");
+                return;
+            }
     }
     return;
 }
@@ -528,21 +1132,98 @@ __nonnull((1)) static void onrequest(client_t *cli, unsigned count, const char *
  * @param[in] closefds if true close pollitem fd
  */
 __nonnull((1)) static void destroy_client(client_t *cli, bool closefds) {
-    cli->sec_lsm_manager_server->count--;
-    if (!cli->sec_lsm_manager_server->count) {
-        cynagora_disconnect(cli->sec_lsm_manager_server->cynagora_admin_client);
+    sec_lsm_manager_server_t *server = cli->sec_lsm_manager_server;
+
+    /* without idle timeout, the connection to cynagora closes with the last client */
+    server->count--;
+    if (!server->count && server->cynagora_idle_timeout == 0) {
+        disconnect_cynagora(server);
     }
 
     /* close protocol */
     if (closefds)
         close(cli->pollitem.fd);
 
+    clear_outq(cli);
     prot_destroy(cli->prot);
     destroy_secure_app(cli->secure_app);
     cli->secure_app = NULL;
     free(cli);
 }
 
+/**
+ * @brief terminate a client session
+ * When an action of the client is running, the link is closed but the
+ * client is destroyed only on completion of the action.
+ *
+ * @param[in] cli client handler
+ * @param[in] pollfd pollfd of the client
+ */
+__nonnull() static void terminate_client(client_t *cli, int pollfd) {
+    pollitem_del(&cli->pollitem, pollfd);
+    if (cli->busy) {
+        close(cli->pollitem.fd);
+        cli->closed = 1;
+    } else {
+        destroy_client(cli, true);
+    }
+}
+
+/**
+ * @brief process the received requests until none remains or the client gets busy
+ *
+ * @param[in] cli client handler
+ * @return 0 in case of success or -EPROTO if the client must be terminated
+ */
+__nonnull() __wur static int process_requests(client_t *cli) {
+    int nargs;
+    const char **args;
+
+    while (!cli->busy && !cli->paused) {
+        nargs = prot_get(cli->prot, &args);
+        if (nargs < 0)
+            break;
+        onrequest(cli, (unsigned)nargs, args);
+        if (cli->invalid && !cli->relax) {
+            return -EPROTO;
+        }
+        prot_next(cli->prot);
+    }
+    return 0;
+}
+
+/**
+ * @brief completion of the action of a client run by a worker
+ *
+ * @param[in] closure the client
+ * @param[in] status the result of the action
+ */
+static void on_action_done(void *closure, int status) {
+    client_t *cli = closure;
+    int pollfd = cli->sec_lsm_manager_server->pollfd;
+    int rc;
+
+    /* give the secure app back to the client */
+    cli->busy = 0;
+    cli->secure_app = cli->action_app;
+    cli->action_app = NULL;
+    if (cli->closed) {
+        destroy_client(cli, false);
+        return;
+    }
+
+    /* reply then process the requests received meanwhile */
+    reply_action(cli, status);
+    rc = process_requests(cli);
+    if (rc < 0) {
+        terminate_client(cli, pollfd);
+        return;
+    }
+
+    /* resume reading */
+    update_events(cli);
+}
+
 /**
  * @brief handle client requests
  *
@@ -551,8 +1232,7 @@ __nonnull((1)) static void destroy_client(client_t *cli, bool closefds) {
  * @param[in] pollfd pollfd of the client
  */
 static void on_client_event(pollitem_t *pollitem, uint32_t events, int pollfd) {
-    int nargs, nr;
-    const char **args;
+    int nr, rc;
     client_t *cli = pollitem->closure;
 
     /* is it a hangup? */
@@ -560,29 +1240,36 @@ static void on_client_event(pollitem_t *pollitem, uint32_t events, int pollfd) {
         goto terminate;
     }
 
+    /* possible output */
+    if (events & EPOLLOUT) {
+        rc = flushw(cli);
+        if (rc < 0) {
+            ERROR("flushw : %d %s", -rc, strerror(-rc));
+            goto terminate;
+        }
+    }
+
     /* possible input */
-    if (events & EPOLLIN) {
+    if ((events & EPOLLIN) && !cli->busy && !cli->paused) {
         nr = prot_read(cli->prot, cli->pollitem.fd);
         if (nr <= 0) {
             goto terminate;
         }
+    }
 
-        nargs = prot_get(cli->prot, &args);
-        while (nargs >= 0) {
-            onrequest(cli, (unsigned)nargs, args);
-            if (cli->invalid && !cli->relax) {
-                goto terminate;
-            }
-            prot_next(cli->prot);
-            nargs = prot_get(cli->prot, &args);
-        }
+    /* process the received requests, if not suspended */
+    rc = process_requests(cli);
+    if (rc < 0) {
+        goto terminate;
     }
+
+    /* suspend or resume reading and writing */
+    update_events(cli);
     return;
 
     /* terminate the client session */
 terminate:
-    pollitem_del(&cli->pollitem, pollfd);
-    destroy_client(cli, true);
+    terminate_client(cli, pollfd);
 }
 
 /**
@@ -620,6 +1307,7 @@ __wur static int create_client(client_t **pcli, int fd, sec_lsm_manager_server_t
     (*pcli)->version = 0; /* version not set */
     (*pcli)->relax = 0;   /* relax on error */
     (*pcli)->invalid = 0; /* not invalid */
+    (*pcli)->events = EPOLLIN;
     (*pcli)->pollitem.handler = on_client_event;
     (*pcli)->pollitem.closure = (*pcli);
     (*pcli)->pollitem.fd = fd;
@@ -682,7 +1370,7 @@ static void on_server_event(pollitem_t *pollitem, uint32_t events, int pollfd) {
     }
 
     /* add the client to the epolling */
-    rc = pollitem_add(&cli->pollitem, EPOLLIN, pollfd);
+    rc = pollitem_add(&cli->pollitem, cli->events, pollfd);
     if (rc < 0) {
         ERROR("can't poll client connection: %d %s", -rc, strerror(-rc));
         destroy_client(cli, 1);
@@ -690,20 +1378,46 @@ static void on_server_event(pollitem_t *pollitem, uint32_t events, int pollfd) {
     }
 }
 
+/**
+ * @brief handle the changes of the templates
+ *
+ * @param[in] pollitem pollitem of the templates
+ * @param[in] events events receive
+ * @param[in] pollfd pollfd of the server
+ */
+static void on_templates_event(pollitem_t *pollitem, uint32_t events, int pollfd) {
+    (void)pollitem;
+    (void)pollfd;
+    if (events & EPOLLIN)
+        template_cache_process();
+}
+
 /**********************/
 /*** PUBLIC METHODS ***/
 /**********************/
 
 /* see sec-lsm-manager-server.h */
 void sec_lsm_manager_server_destroy(sec_lsm_manager_server_t *server) {
+    worker_pool_t *workers = server->workers;
+
+    /* the completions dispatched by the destruction run the next actions inline */
+    server->workers = NULL;
+    if (workers != NULL)
+        worker_pool_destroy(workers);
     if (server->pollfd >= 0)
         close(server->pollfd);
     if (server->socket.fd >= 0)
         close(server->socket.fd);
+    if (server->cynagora_admin_client != NULL)
+        cynagora_destroy(server->cynagora_admin_client);
+    if (server->templates.fd >= 0)
+        template_cache_clear();
+    if (server->registry != NULL)
+        registry_destroy(server->registry);
+    if (server->journal != NULL)
+        journal_close(server->journal);
+    pthread_mutex_destroy(&server->cynagora_lock);
     free(server);
-    server = NULL;
-    cynagora_destroy(server->cynagora_admin_client);
-    server->cynagora_admin_client = NULL;
 }
 
 /* see sec-lsm-manager-server.h */
@@ -719,9 +1433,12 @@ __wur int sec_lsm_manager_server_create(sec_lsm_manager_server_t **server, const
         goto ret;
     }
     memset(*server, 0, sizeof(sec_lsm_manager_server_t));
+    pthread_mutex_init(&(*server)->cynagora_lock, NULL);
+    (*server)->cynagora_idle_timeout = get_cynagora_idle_timeout(NULL);
 
     /* create the polling fd */
     (*server)->socket.fd = -1;
+    (*server)->templates.fd = -1;
     (*server)->pollfd = epoll_create1(EPOLL_CLOEXEC);
     if ((*server)->pollfd < 0) {
         rc = -errno;
@@ -753,6 +1470,23 @@ __wur int sec_lsm_manager_server_create(sec_lsm_manager_server_t **server, const
         goto error;
     }
 
+    /* reload the templates when they change, or check them at each use */
+    (*server)->templates.fd = template_cache_watch();
+    if ((*server)->templates.fd >= 0) {
+        (*server)->templates.handler = on_templates_event;
+        (*server)->templates.closure = *server;
+        if (pollitem_add(&(*server)->templates, EPOLLIN, (*server)->pollfd) < 0) {
+            ERROR("pollitem_add templates : %d %s", errno, strerror(errno));
+        }
+    }
+
+    rc = registry_create(&(*server)->registry, get_registry_file(NULL));
+    if (rc < 0) {
+        ERROR("registry_create : %d %s", -rc, strerror(-rc));
+        (*server)->registry = NULL;
+        goto error;
+    }
+
     rc = cynagora_create(&((*server)->cynagora_admin_client), cynagora_Admin, 1, 0);
     if (rc < 0) {
         ERROR("cynagora_create : %d %s", -rc, strerror(-rc));
@@ -760,6 +1494,22 @@ __wur int sec_lsm_manager_server_create(sec_lsm_manager_server_t **server, const
         goto error;
     }
 
+    /* complete or roll back the actions interrupted by a crash */
+    rc = journal_open(&(*server)->journal, get_journal_file(NULL));
+    if (rc < 0) {
+        ERROR("journal_open : %d %s", -rc, strerror(-rc));
+        (*server)->journal = NULL;
+        goto error;
+    }
+
+    rc = journal_recover((*server)->journal, recover_action, *server);
+    if (rc < 0) {
+        ERROR("journal_recover : %d %s", -rc, strerror(-rc));
+    } else if (rc > 0) {
+        ERROR("journal_recover : %d actions not recovered, kept for the next start", rc);
+    }
+    rc = 0;
+
     goto ret;
 
 error:
@@ -771,19 +1521,71 @@ ret:
 /* see sec-lsm-manager-server.h */
 void sec_lsm_manager_server_stop(sec_lsm_manager_server_t *server, int status) {
     server->stopped = status != 0 ? status : INT_MIN;
-    cynagora_disconnect(server->cynagora_admin_client);
+    disconnect_cynagora(server);
+}
+
+/* see sec-lsm-manager-server.h */
+int sec_lsm_manager_server_set_workers(sec_lsm_manager_server_t *server, unsigned count) {
+    worker_pool_t *workers = server->workers;
+    int rc;
+
+    server->workers = NULL;
+    if (workers != NULL)
+        worker_pool_destroy(workers);
+    if (count == 0)
+        return 0;
+
+    rc = worker_pool_create(&server->workers, count, server->pollfd);
+    if (rc < 0) {
+        ERROR("worker_pool_create : %d %s", -rc, strerror(-rc));
+        server->workers = NULL;
+    }
+    return rc;
+}
+
+/* see sec-lsm-manager-server.h */
+unsigned long sec_lsm_manager_server_cynagora_connects(sec_lsm_manager_server_t *server) {
+    unsigned long connects;
+
+    pthread_mutex_lock(&server->cynagora_lock);
+    connects = server->cynagora_connects;
+    pthread_mutex_unlock(&server->cynagora_lock);
+    return connects;
 }
 
 /* see sec-lsm-manager-server.h */
 __wur int sec_lsm_manager_server_serve(sec_lsm_manager_server_t *server, int shutofftime) {
     int rc, tempo = shutofftime < 0 ? -1 : shutofftime > INT_MAX / 1000 ? INT_MAX : shutofftime * 1000;
+    int timeout, idle, remaining = tempo;
+    pollitem_stats_t stats;
+    journal_stats_t journal_stats;
     /* process inputs */
     server->stopped = 0;
     while (!server->stopped) {
-        rc = pollitem_wait_dispatch(server->pollfd, tempo);
+        /* wake up for closing the unused connection to cynagora */
+        idle = idle_cynagora_delay(server);
+        timeout = idle >= 0 && (remaining < 0 || idle < remaining) ? idle : remaining;
+        rc = pollitem_wait_dispatch(server->pollfd, timeout);
+        if (rc == 0 && timeout == idle && idle_cynagora_delay(server) == 0) {
+            DEBUG("close unused connection to cynagora");
+            disconnect_cynagora(server);
+        }
+        /* the inactivity goes on across the wake ups for cynagora */
+        if (rc != 0)
+            remaining = tempo;
+        else if (remaining > 0)
+            remaining -= timeout;
 	if ((rc < 0 && errno != EINTR)
-	 || (rc == 0 && server->count == 0))
+	 || (rc == 0 && remaining == 0 && server->count == 0))
 	    sec_lsm_manager_server_stop(server, rc);
+        if (remaining == 0)
+            remaining = tempo;
     }
+    pollitem_get_stats(&stats);
+    DEBUG("dispatched %lu events in %lu batches (max %u, dropped %lu)", stats.events, stats.waits, stats.max,
+          stats.dropped);
+    DEBUG("connected %lu times to cynagora", sec_lsm_manager_server_cynagora_connects(server));
+    journal_get_stats(server->journal, &journal_stats);
+    DEBUG("journaled %lu records with %lu flushes", journal_stats.records, journal_stats.syncs);
     return server->stopped == INT_MIN ? 0 : server->stopped;
 }
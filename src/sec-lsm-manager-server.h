@@ -56,6 +56,17 @@ extern int sec_lsm_manager_server_create(sec_lsm_manager_server_t **server,
  */
 extern void sec_lsm_manager_server_destroy(sec_lsm_manager_server_t *server) __nonnull();
 
+/**
+ * @brief Get the count of connections opened to cynagora
+ * The connection is opened when an action needs it and closed after
+ * get_cynagora_idle_timeout() seconds without use.
+ *
+ * @param[in] server the handler of the server
+ *
+ * @return the count of connections since the creation of the server
+ */
+extern unsigned long sec_lsm_manager_server_cynagora_connects(sec_lsm_manager_server_t *server) __nonnull() __wur;
+
 /**
  * @brief Start the sec_lsm_manager server and returns only when stopped
  *
@@ -79,4 +90,19 @@ extern int sec_lsm_manager_server_serve(sec_lsm_manager_server_t *server, int sh
  */
 extern void sec_lsm_manager_server_stop(sec_lsm_manager_server_t *server, int status) __nonnull();
 
+/**
+ * @brief Set the count of worker threads running the installs and uninstalls
+ * With workers, the server keeps serving the other clients while an install or
+ * an uninstall is running. Two actions on the same application id never run
+ * concurrently. With 0 worker, the actions run inline, as they do until this
+ * function is called (the daemon sets WORKERS_COUNT workers by default, or
+ * get_selinux_compile_jobs() workers with SELinux).
+ *
+ * @param[in] server the handler of the server
+ * @param[in] count the count of worker threads
+ *
+ * @return 0 on success or a negative value
+ */
+extern int sec_lsm_manager_server_set_workers(sec_lsm_manager_server_t *server, unsigned count) __nonnull() __wur;
+
 #endif
@@ -33,8 +33,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
+#include "limits.h"
 #include "log.h"
 #include "prot.h"
 #include "sec-lsm-manager-protocol.h"
@@ -52,6 +54,30 @@
         return;                                    \
     }
 
+/**
+ * structure recording an asynchronous action
+ */
+typedef struct async_request async_request_t;
+struct async_request {
+    /** next action */
+    async_request_t *next;
+
+    /** count of requests sent up to the action included */
+    unsigned upto;
+
+    /** status of the first failed request or 0 */
+    int status;
+
+    /** index of the first failed request or -1 */
+    int failed;
+
+    /** callback receiving the status */
+    sec_lsm_manager_async_cb_t callback;
+
+    /** closure of the callback */
+    void *closure;
+};
+
 /**
  * structure recording a client
  */
@@ -76,14 +102,69 @@ struct sec_lsm_manager {
 
     /** spec of the socket */
     char *socketspec;
+
+    /** pipelined requests */
+    struct {
+        /** are requests pipelined */
+        bool on;
+
+        /** count of requests sent since the last sync point */
+        unsigned sent;
+
+        /** count of replies received since the last sync point */
+        unsigned received;
+
+        /** status of the first failed request or 0 */
+        int status;
+
+        /** index of the first failed request or -1 */
+        int failed;
+
+        /** index of the first failed request of the last batch or -1 */
+        int last_failed;
+    } pipeline;
+
+    /** asynchronous mode */
+    struct {
+        /** control callback or NULL when not asynchronous */
+        sec_lsm_manager_async_ctl_cb_t controlcb;
+
+        /** closure of the control callback */
+        void *closure;
+
+        /** file descriptor given to the control callback or -1 */
+        int fd;
+
+        /** events given to the control callback */
+        uint32_t events;
+
+        /** pending actions */
+        async_request_t *requests;
+    } async;
 };
 
 /***********************/
 /*** PRIVATE METHODS ***/
 /***********************/
 
+__nonnull() __wur static int collect_replies(sec_lsm_manager_t *sec_lsm_manager, bool block);
+
+/**
+ * @brief Are the requests pipelined
+ * They are when asked or in asynchronous mode
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ *
+ * @return  true if pipelined
+ */
+__nonnull() __wur static bool pipelined(sec_lsm_manager_t *sec_lsm_manager) {
+    return sec_lsm_manager->pipeline.on || sec_lsm_manager->async.controlcb != NULL;
+}
+
 /**
  * @brief Flush the write buffer of the client
+ * While pipelining, the replies already available are collected meanwhile
+ * so that the server is never blocked writing them
  *
  * @param[in] sec_lsm_manager  the handler of the client
  *
@@ -101,11 +182,15 @@ __nonnull() __wur static int flushw(sec_lsm_manager_t *sec_lsm_manager) {
         if (rc == -EAGAIN) {
             pfd.fd = sec_lsm_manager->fd;
             pfd.events = POLLOUT;
+            if (sec_lsm_manager->pipeline.received < sec_lsm_manager->pipeline.sent)
+                pfd.events |= POLLIN;
             do {
                 rc = poll(&pfd, 1, -1);
             } while (rc < 0 && errno == EINTR);
             if (rc < 0)
                 rc = -errno;
+            else if (pfd.revents & POLLIN)
+                rc = collect_replies(sec_lsm_manager, false);
         }
         if (rc < 0) {
             break;
@@ -116,6 +201,7 @@ __nonnull() __wur static int flushw(sec_lsm_manager_t *sec_lsm_manager) {
 
 /**
  * @brief Send a reply
+ * When pipelining, the reply is only buffered and sent at the next sync point
  *
  * @param[in] sec_lsm_manager the client
  * @param[in] fields the fields to send
@@ -137,7 +223,8 @@ __nonnull() __wur static int send_reply(sec_lsm_manager_t *sec_lsm_manager, cons
         if (rc == 0) {
             rc = prot_put_end(prot);
             if (rc == 0) {
-                rc = flushw(sec_lsm_manager);
+                if (!pipelined(sec_lsm_manager))
+                    rc = flushw(sec_lsm_manager);
                 break;
             }
         }
@@ -281,6 +368,25 @@ __nonnull() __wur static int wait_any_reply(sec_lsm_manager_t *sec_lsm_manager)
     }
 }
 
+/**
+ * @brief Check that the current reply is "done" or "error"
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ *
+ * @return  0 in case of success or a negative -errno value
+ *          -ECANCELED when received an error status
+ */
+__nonnull() __wur static int check_done_or_error(sec_lsm_manager_t *sec_lsm_manager) {
+    if (!strcmp(sec_lsm_manager->reply.fields[0], _done_)) {
+        return 0;
+    } else if (!strcmp(sec_lsm_manager->reply.fields[0], _error_)) {
+        ERROR("%s", sec_lsm_manager->reply.fields[1]);
+        return -1;
+    } else {
+        return -ECANCELED;
+    }
+}
+
 /**
  * @brief Wait the reply "done" or "error"
  *
@@ -293,27 +399,208 @@ __nonnull() __wur static int wait_done_or_error(sec_lsm_manager_t *sec_lsm_manag
     int rc = wait_any_reply(sec_lsm_manager);
 
     if (rc > 0) {
-        if (!strcmp(sec_lsm_manager->reply.fields[0], _done_)) {
-            return 0;
-        } else if (!strcmp(sec_lsm_manager->reply.fields[0], _error_)) {
-            ERROR("%s", sec_lsm_manager->reply.fields[1]);
-            return -1;
-        } else {
-            return -ECANCELED;
-        }
+        return check_done_or_error(sec_lsm_manager);
     }
     return rc;
 }
 
+/**
+ * @brief Record the status of the request of index 'index' in the pipeline
+ * The status goes to the pending asynchronous action ending the batch of
+ * the request or, if none, to the current batch. Only the first failure
+ * of a batch is kept
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ * @param[in] index  index of the request since the last sync point
+ * @param[in] status status of the request
+ */
+__nonnull() static void pipeline_status(sec_lsm_manager_t *sec_lsm_manager, unsigned index, int status) {
+    unsigned base = 0;
+    async_request_t *request = sec_lsm_manager->async.requests;
+
+    while (request != NULL && request->upto <= index) {
+        base = request->upto;
+        request = request->next;
+    }
+
+    int *pstatus = request ? &request->status : &sec_lsm_manager->pipeline.status;
+    int *pfailed = request ? &request->failed : &sec_lsm_manager->pipeline.failed;
+    if (status < 0 && *pfailed < 0) {
+        *pstatus = status;
+        *pfailed = (int)(index - base);
+    }
+}
+
+/**
+ * @brief Tell the control callback the events to poll, if asynchronous
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ */
+__nonnull() static void async_update(sec_lsm_manager_t *sec_lsm_manager) {
+    sec_lsm_manager_async_ctl_cb_t controlcb = sec_lsm_manager->async.controlcb;
+    int fd = sec_lsm_manager->fd;
+    uint32_t events = 0;
+
+    if (controlcb == NULL)
+        return;
+
+    if (fd >= 0) {
+        events = EPOLLIN;
+        if (prot_should_write(sec_lsm_manager->prot))
+            events |= EPOLLOUT;
+    }
+
+    if (fd != sec_lsm_manager->async.fd) {
+        if (sec_lsm_manager->async.fd >= 0)
+            controlcb(sec_lsm_manager->async.closure, EPOLL_CTL_DEL, sec_lsm_manager->async.fd, 0);
+        if (fd >= 0)
+            controlcb(sec_lsm_manager->async.closure, EPOLL_CTL_ADD, fd, events);
+    } else if (fd >= 0 && events != sec_lsm_manager->async.events) {
+        controlcb(sec_lsm_manager->async.closure, EPOLL_CTL_MOD, fd, events);
+    }
+
+    sec_lsm_manager->async.fd = fd;
+    sec_lsm_manager->async.events = events;
+}
+
 /**
  * @brief Disconnect the client
+ * The requests of the pipeline still waiting a reply are lost
  *
  * @param[in] sec_lsm_manager  the handler of the client
  */
 __nonnull() static void disconnection(sec_lsm_manager_t *sec_lsm_manager) {
-    if (sec_lsm_manager->fd >= 0) {
-        close(sec_lsm_manager->fd);
+    int fd = sec_lsm_manager->fd;
+
+    if (fd >= 0) {
         sec_lsm_manager->fd = -1;
+        async_update(sec_lsm_manager);
+        close(fd);
+    }
+    while (sec_lsm_manager->pipeline.received < sec_lsm_manager->pipeline.sent)
+        pipeline_status(sec_lsm_manager, sec_lsm_manager->pipeline.received++, -EPIPE);
+}
+
+/**
+ * @brief Collect the replies of the pipelined requests
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ * @param[in] block  wait all the replies or only get the available ones
+ *
+ * @return  0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int collect_replies(sec_lsm_manager_t *sec_lsm_manager, bool block) {
+    while (sec_lsm_manager->pipeline.received < sec_lsm_manager->pipeline.sent) {
+        int rc = wait_reply(sec_lsm_manager, block);
+        if (rc == -EAGAIN && !block)
+            return 0;
+        if (rc < 0) {
+            disconnection(sec_lsm_manager);
+            return rc;
+        }
+        pipeline_status(sec_lsm_manager, sec_lsm_manager->pipeline.received++, check_done_or_error(sec_lsm_manager));
+    }
+    return 0;
+}
+
+/**
+ * @brief Sync point of the pipeline: send the pending requests and wait their replies
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ *
+ * @return  0 in case of success or the status of the first failed request
+ */
+__nonnull() __wur static int pipeline_sync(sec_lsm_manager_t *sec_lsm_manager) {
+    if (sec_lsm_manager->async.requests != NULL)
+        return -EBUSY;
+
+    if (sec_lsm_manager->pipeline.sent == 0)
+        return 0;
+
+    int rc = flushw(sec_lsm_manager);
+    if (rc >= 0)
+        rc = collect_replies(sec_lsm_manager, true);
+    if (rc < 0)
+        disconnection(sec_lsm_manager);
+
+    rc = sec_lsm_manager->pipeline.status;
+    sec_lsm_manager->pipeline.last_failed = sec_lsm_manager->pipeline.failed;
+    sec_lsm_manager->pipeline.sent = sec_lsm_manager->pipeline.received = 0;
+    sec_lsm_manager->pipeline.status = 0;
+    sec_lsm_manager->pipeline.failed = -1;
+    return rc;
+}
+
+/**
+ * @brief End a request: wait its reply or, when pipelining, count it in the pipeline
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ *
+ * @return  0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int end_request(sec_lsm_manager_t *sec_lsm_manager) {
+    if (!pipelined(sec_lsm_manager))
+        return wait_done_or_error(sec_lsm_manager);
+
+    sec_lsm_manager->pipeline.sent++;
+    async_update(sec_lsm_manager);
+    return 0;
+}
+
+/**
+ * @brief Write without blocking what can be written
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ *
+ * @return  0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int async_write(sec_lsm_manager_t *sec_lsm_manager) {
+    int rc = 0;
+
+    while (rc >= 0 && prot_should_write(sec_lsm_manager->prot)) {
+        rc = prot_write(sec_lsm_manager->prot, sec_lsm_manager->fd);
+    }
+    return rc == -EAGAIN ? 0 : rc;
+}
+
+/**
+ * @brief Detach the asynchronous actions whose replies are all received
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ *
+ * @return  the list of the completed actions
+ */
+__nonnull() __wur static async_request_t *async_completed(sec_lsm_manager_t *sec_lsm_manager) {
+    async_request_t *head = NULL, **tail = &head, *request;
+
+    while ((request = sec_lsm_manager->async.requests) != NULL &&
+           request->upto <= sec_lsm_manager->pipeline.received) {
+        sec_lsm_manager->async.requests = request->next;
+        sec_lsm_manager->pipeline.sent -= request->upto;
+        sec_lsm_manager->pipeline.received -= request->upto;
+        for (async_request_t *it = request->next; it != NULL; it = it->next) it->upto -= request->upto;
+        request->next = NULL;
+        *tail = request;
+        tail = &request->next;
+    }
+    return head;
+}
+
+/**
+ * @brief Call the callbacks of the completed asynchronous actions and free them
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ * @param[in] requests the completed actions
+ * @param[in] status   status overriding the one of the actions or 0
+ */
+__nonnull((1)) static void async_notify(sec_lsm_manager_t *sec_lsm_manager, async_request_t *requests, int status) {
+    async_request_t *request;
+
+    while ((request = requests) != NULL) {
+        requests = request->next;
+        sec_lsm_manager->pipeline.last_failed = request->failed;
+        request->callback(request->closure, status ? status : request->status);
+        free(request);
     }
 }
 
@@ -336,12 +623,15 @@ __nonnull() __wur static int connection(sec_lsm_manager_t *sec_lsm_manager) {
 
     /* negociate the protocol */
     rc = putxkv(sec_lsm_manager, _sec_lsm_manager_, "1", NULL);
+    if (rc >= 0)
+        rc = flushw(sec_lsm_manager);
     if (rc >= 0) {
         rc = wait_any_reply(sec_lsm_manager);
         if (rc >= 0) {
             rc = -EPROTO;
             if (sec_lsm_manager->reply.count >= 2 && 0 == strcmp(sec_lsm_manager->reply.fields[0], _done_) &&
                 0 == strcmp(sec_lsm_manager->reply.fields[1], "1")) {
+                async_update(sec_lsm_manager);
                 return 0;
             }
         }
@@ -352,6 +642,8 @@ __nonnull() __wur static int connection(sec_lsm_manager_t *sec_lsm_manager) {
 
 /**
  * @brief Ensure the connection is opened
+ * The requests pipelined since the last sync point are bound to their
+ * connection: it is not reopened before the next sync point
  *
  * @param[in] sec_lsm_manager  the handler of the client
  *
@@ -360,9 +652,129 @@ __nonnull() __wur static int connection(sec_lsm_manager_t *sec_lsm_manager) {
 __nonnull() __wur static int ensure_opened(sec_lsm_manager_t *sec_lsm_manager) {
     if (sec_lsm_manager->fd >= 0 && write(sec_lsm_manager->fd, NULL, 0) < 0)
         disconnection(sec_lsm_manager);
+    if (sec_lsm_manager->fd < 0 && sec_lsm_manager->pipeline.sent)
+        return -EPIPE;
     return sec_lsm_manager->fd < 0 ? connection(sec_lsm_manager) : 0;
 }
 
+/**
+ * @brief Send an action asynchronously, ending the current batch
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ * @param[in] command  the action to send
+ * @param[in] callback the callback receiving the status
+ * @param[in] closure  the closure of the callback
+ *
+ * @return  0 in case of success or a negative -errno value
+ */
+__nonnull((1, 2, 3)) __wur static int async_action(sec_lsm_manager_t *sec_lsm_manager, const char *command,
+                                               sec_lsm_manager_async_cb_t callback, void *closure) {
+    if (sec_lsm_manager->async.controlcb == NULL)
+        return -EINVAL;
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    sec_lsm_manager->synclock = true;
+
+    async_request_t *request = malloc(sizeof(*request));
+    int rc = request == NULL ? -ENOMEM : ensure_opened(sec_lsm_manager);
+    if (rc >= 0) {
+        rc = putxkv(sec_lsm_manager, command, NULL);
+    }
+    if (rc >= 0) {
+        rc = end_request(sec_lsm_manager);
+    }
+    if (rc < 0) {
+        free(request);
+        goto ret;
+    }
+
+    /* the action ends the current batch */
+    request->upto = sec_lsm_manager->pipeline.sent;
+    request->status = sec_lsm_manager->pipeline.status;
+    request->failed = sec_lsm_manager->pipeline.failed;
+    request->callback = callback;
+    request->closure = closure;
+    request->next = NULL;
+    sec_lsm_manager->pipeline.status = 0;
+    sec_lsm_manager->pipeline.failed = -1;
+
+    async_request_t **prev = &sec_lsm_manager->async.requests;
+    while (*prev != NULL) prev = &(*prev)->next;
+    *prev = request;
+
+    /* from now, errors are reported to the callback */
+    if (async_write(sec_lsm_manager) < 0)
+        disconnection(sec_lsm_manager);
+    async_update(sec_lsm_manager);
+
+ret:
+    sec_lsm_manager->synclock = false;
+    return rc;
+}
+
+/**
+ * @brief Send a lookup in the registry and report the received records
+ *
+ * @param[in] sec_lsm_manager  the handler of the client
+ * @param[in] command   the command to send
+ * @param[in] arg       the argument of the command or NULL
+ * @param[in] callback  the callback receiving the records
+ * @param[in] closure   the closure of the callback
+ *
+ * @return  the count of applications received or a negative -errno value
+ */
+__nonnull((1, 2, 4)) __wur static int lookup(sec_lsm_manager_t *sec_lsm_manager, const char *command, const char *arg,
+                                             sec_lsm_manager_record_cb_t callback, void *closure) {
+    int apps = 0;
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    sec_lsm_manager->synclock = true;
+
+    int rc = ensure_opened(sec_lsm_manager);
+    if (rc < 0) {
+        goto ret;
+    }
+
+    rc = pipeline_sync(sec_lsm_manager);
+    if (rc < 0) {
+        goto ret;
+    }
+
+    rc = putxkv(sec_lsm_manager, command, arg, NULL);
+    if (rc >= 0) {
+        rc = flushw(sec_lsm_manager);
+    }
+
+    if (rc < 0) {
+        goto ret;
+    }
+
+    for (;;) {
+        rc = wait_reply(sec_lsm_manager, true);
+        if (rc < 2 || !strcmp(sec_lsm_manager->reply.fields[0], _done_) ||
+            !strcmp(sec_lsm_manager->reply.fields[0], _error_))
+            break;
+        if (!strcmp(sec_lsm_manager->reply.fields[0], _app_))
+            apps++;
+        callback(closure, sec_lsm_manager->reply.fields[0], sec_lsm_manager->reply.fields[1],
+                 rc > 2 ? sec_lsm_manager->reply.fields[2] : NULL);
+    }
+
+    if (rc > 0) {
+        rc = check_done_or_error(sec_lsm_manager);
+        if (rc >= 0)
+            rc = apps;
+    }
+
+ret:
+    sec_lsm_manager->synclock = false;
+    return rc;
+}
+
 /**********************/
 /*** PUBLIC METHODS ***/
 /**********************/
@@ -402,6 +814,14 @@ int sec_lsm_manager_create(sec_lsm_manager_t **sec_lsm_manager, const char *sock
     /* lazy connection */
     (*sec_lsm_manager)->fd = -1;
 
+    /* no pipelining */
+    (*sec_lsm_manager)->pipeline.on = false;
+    (*sec_lsm_manager)->pipeline.failed = -1;
+    (*sec_lsm_manager)->pipeline.last_failed = -1;
+
+    /* not asynchronous */
+    (*sec_lsm_manager)->async.fd = -1;
+
     /* done */
     return 0;
 }
@@ -411,6 +831,7 @@ void sec_lsm_manager_destroy(sec_lsm_manager_t *sec_lsm_manager) {
     CHECK_NO_NULL_NO_RETURN(sec_lsm_manager, "sec_lsm_manager");
 
     disconnection(sec_lsm_manager);
+    async_notify(sec_lsm_manager, async_completed(sec_lsm_manager), -ECANCELED);
     if (sec_lsm_manager->prot)
         prot_destroy(sec_lsm_manager->prot);
     free(sec_lsm_manager->socketspec);
@@ -446,7 +867,7 @@ int sec_lsm_manager_set_id(sec_lsm_manager_t *sec_lsm_manager, const char *id) {
         goto ret;
     }
 
-    rc = wait_done_or_error(sec_lsm_manager);
+    rc = end_request(sec_lsm_manager);
 
 ret:
     sec_lsm_manager->synclock = false;
@@ -472,7 +893,7 @@ int sec_lsm_manager_add_path(sec_lsm_manager_t *sec_lsm_manager, const char *pat
         goto ret;
     }
 
-    rc = wait_done_or_error(sec_lsm_manager);
+    rc = end_request(sec_lsm_manager);
 
 ret:
     sec_lsm_manager->synclock = false;
@@ -498,9 +919,106 @@ int sec_lsm_manager_add_permission(sec_lsm_manager_t *sec_lsm_manager, const cha
         goto ret;
     }
 
-    rc = wait_done_or_error(sec_lsm_manager);
+    rc = end_request(sec_lsm_manager);
+
+ret:
+    sec_lsm_manager->synclock = false;
+    return rc;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_add_paths(sec_lsm_manager_t *sec_lsm_manager, size_t count, const char *const paths[],
+                              const char *const path_types[]) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+    CHECK_NO_NULL(paths, "paths");
+    CHECK_NO_NULL(path_types, "path_types");
+
+    if (count == 0 || count > SEC_LSM_MANAGER_MAX_BULK_ITEMS) {
+        ERROR("invalid paths count : %zu", count);
+        return -EINVAL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        CHECK_NO_NULL(paths[i], "path");
+        CHECK_NO_NULL(path_types[i], "path_type");
+    }
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    sec_lsm_manager->synclock = true;
+
+    const char **fields = malloc((2 * count + 1) * sizeof(*fields));
+    int rc = fields == NULL ? -ENOMEM : ensure_opened(sec_lsm_manager);
+    if (rc < 0) {
+        goto ret;
+    }
+
+    fields[0] = _paths_;
+    for (size_t i = 0; i < count; i++) {
+        fields[2 * i + 1] = paths[i];
+        fields[2 * i + 2] = path_types[i];
+    }
+    if (!prot_fits(2 * (unsigned)count + 1, fields)) {
+        ERROR("paths too big for one request, send them in several requests");
+        rc = -E2BIG;
+        goto ret;
+    }
+    rc = send_reply(sec_lsm_manager, fields, (int)(2 * count + 1));
+    if (rc < 0) {
+        goto ret;
+    }
+
+    rc = end_request(sec_lsm_manager);
 
 ret:
+    free(fields);
+    sec_lsm_manager->synclock = false;
+    return rc;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_add_permissions(sec_lsm_manager_t *sec_lsm_manager, size_t count,
+                                    const char *const permissions[]) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+    CHECK_NO_NULL(permissions, "permissions");
+
+    if (count == 0 || count > SEC_LSM_MANAGER_MAX_BULK_ITEMS) {
+        ERROR("invalid permissions count : %zu", count);
+        return -EINVAL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        CHECK_NO_NULL(permissions[i], "permission");
+    }
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    sec_lsm_manager->synclock = true;
+
+    const char **fields = malloc((count + 1) * sizeof(*fields));
+    int rc = fields == NULL ? -ENOMEM : ensure_opened(sec_lsm_manager);
+    if (rc < 0) {
+        goto ret;
+    }
+
+    fields[0] = _permissions_;
+    memcpy(&fields[1], permissions, count * sizeof(*fields));
+    if (!prot_fits((unsigned)count + 1, fields)) {
+        ERROR("permissions too big for one request, send them in several requests");
+        rc = -E2BIG;
+        goto ret;
+    }
+    rc = send_reply(sec_lsm_manager, fields, (int)(count + 1));
+    if (rc < 0) {
+        goto ret;
+    }
+
+    rc = end_request(sec_lsm_manager);
+
+ret:
+    free(fields);
     sec_lsm_manager->synclock = false;
     return rc;
 }
@@ -523,7 +1041,7 @@ int sec_lsm_manager_clear(sec_lsm_manager_t *sec_lsm_manager) {
         goto ret;
     }
 
-    rc = wait_done_or_error(sec_lsm_manager);
+    rc = end_request(sec_lsm_manager);
 
 ret:
     sec_lsm_manager->synclock = false;
@@ -548,7 +1066,10 @@ int sec_lsm_manager_install(sec_lsm_manager_t *sec_lsm_manager) {
         goto ret;
     }
 
-    rc = wait_done_or_error(sec_lsm_manager);
+    rc = end_request(sec_lsm_manager);
+    if (rc >= 0) {
+        rc = pipeline_sync(sec_lsm_manager);
+    }
 
 ret:
     sec_lsm_manager->synclock = false;
@@ -573,7 +1094,10 @@ int sec_lsm_manager_uninstall(sec_lsm_manager_t *sec_lsm_manager) {
         goto ret;
     }
 
-    rc = wait_done_or_error(sec_lsm_manager);
+    rc = end_request(sec_lsm_manager);
+    if (rc >= 0) {
+        rc = pipeline_sync(sec_lsm_manager);
+    }
 
 ret:
     sec_lsm_manager->synclock = false;
@@ -589,8 +1113,14 @@ int sec_lsm_manager_log(sec_lsm_manager_t *sec_lsm_manager, int on, int off) {
 
     sec_lsm_manager->synclock = true;
     int rc = ensure_opened(sec_lsm_manager);
+    if (rc >= 0) {
+        rc = pipeline_sync(sec_lsm_manager);
+    }
     if (rc >= 0) {
         rc = putxkv(sec_lsm_manager, _log_, off ? _off_ : on ? _on_ : 0, NULL);
+        if (rc >= 0) {
+            rc = flushw(sec_lsm_manager);
+        }
         if (rc >= 0) {
             rc = wait_done_or_error(sec_lsm_manager);
             if (rc > 0)
@@ -616,7 +1146,15 @@ int sec_lsm_manager_display(sec_lsm_manager_t *sec_lsm_manager) {
         goto ret;
     }
 
+    rc = pipeline_sync(sec_lsm_manager);
+    if (rc < 0) {
+        goto ret;
+    }
+
     rc = putxkv(sec_lsm_manager, _display_, NULL);
+    if (rc >= 0) {
+        rc = flushw(sec_lsm_manager);
+    }
 
     if (rc < 0) {
         goto ret;
@@ -644,3 +1182,141 @@ ret:
     sec_lsm_manager->synclock = false;
     return rc;
 }
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_list(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_record_cb_t callback, void *closure) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+    CHECK_NO_NULL(callback, "callback");
+
+    return lookup(sec_lsm_manager, _list_, NULL, callback, closure);
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_query(sec_lsm_manager_t *sec_lsm_manager, const char *key, sec_lsm_manager_record_cb_t callback,
+                          void *closure) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+    CHECK_NO_NULL(key, "key");
+    CHECK_NO_NULL(callback, "callback");
+
+    int rc = lookup(sec_lsm_manager, _query_, key, callback, closure);
+    return rc == 0 ? -ENOENT : rc < 0 ? rc : 0;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_owner(sec_lsm_manager_t *sec_lsm_manager, const char *path, sec_lsm_manager_record_cb_t callback,
+                          void *closure) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+    CHECK_NO_NULL(path, "path");
+    CHECK_NO_NULL(callback, "callback");
+
+    int rc = lookup(sec_lsm_manager, _owner_, path, callback, closure);
+    return rc == 0 ? -ENOENT : rc < 0 ? rc : 0;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_set_pipelined(sec_lsm_manager_t *sec_lsm_manager, int pipelined) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    sec_lsm_manager->synclock = true;
+    int rc = pipeline_sync(sec_lsm_manager);
+    sec_lsm_manager->pipeline.on = pipelined != 0;
+    sec_lsm_manager->synclock = false;
+
+    return rc;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_sync(sec_lsm_manager_t *sec_lsm_manager) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    sec_lsm_manager->synclock = true;
+    int rc = pipeline_sync(sec_lsm_manager);
+    sec_lsm_manager->synclock = false;
+
+    return rc;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_failed_request(sec_lsm_manager_t *sec_lsm_manager) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+
+    return sec_lsm_manager->pipeline.last_failed;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_async_setup(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_async_ctl_cb_t controlcb,
+                                void *closure) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    if (controlcb == NULL && sec_lsm_manager->async.requests != NULL)
+        return -EBUSY;
+
+    /* leaving the asynchronous mode is a sync point unless pipelining */
+    sec_lsm_manager->synclock = true;
+    int rc = controlcb == NULL && !sec_lsm_manager->pipeline.on ? pipeline_sync(sec_lsm_manager) : 0;
+    sec_lsm_manager->synclock = false;
+
+    /* unregister the previous control callback */
+    if (sec_lsm_manager->async.controlcb != NULL && sec_lsm_manager->async.fd >= 0)
+        sec_lsm_manager->async.controlcb(sec_lsm_manager->async.closure, EPOLL_CTL_DEL, sec_lsm_manager->async.fd, 0);
+    sec_lsm_manager->async.fd = -1;
+
+    sec_lsm_manager->async.controlcb = controlcb;
+    sec_lsm_manager->async.closure = closure;
+    async_update(sec_lsm_manager);
+
+    return rc;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_async_process(sec_lsm_manager_t *sec_lsm_manager) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+
+    if (sec_lsm_manager->synclock)
+        return -EBUSY;
+
+    sec_lsm_manager->synclock = true;
+
+    int rc = 0;
+    if (sec_lsm_manager->fd >= 0) {
+        rc = async_write(sec_lsm_manager);
+        if (rc >= 0)
+            rc = collect_replies(sec_lsm_manager, false);
+        if (rc < 0)
+            disconnection(sec_lsm_manager);
+    }
+
+    async_request_t *completed = async_completed(sec_lsm_manager);
+    async_update(sec_lsm_manager);
+    sec_lsm_manager->synclock = false;
+
+    async_notify(sec_lsm_manager, completed, 0);
+    return rc;
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_async_install(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_async_cb_t callback,
+                                  void *closure) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+    CHECK_NO_NULL(callback, "callback");
+
+    return async_action(sec_lsm_manager, _install_, callback, closure);
+}
+
+/* see sec-lsm-manager.h */
+int sec_lsm_manager_async_uninstall(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_async_cb_t callback,
+                                    void *closure) {
+    CHECK_NO_NULL(sec_lsm_manager, "sec_lsm_manager");
+    CHECK_NO_NULL(callback, "callback");
+
+    return async_action(sec_lsm_manager, _uninstall_, callback, closure);
+}
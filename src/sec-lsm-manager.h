@@ -24,10 +24,44 @@
 #ifndef SEC_LSM_MANAGER_H
 #define SEC_LSM_MANAGER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct sec_lsm_manager sec_lsm_manager_t;
 
+/**
+ * @brief Callback for controlling the polling of the asynchronous mode
+ * Called with op being EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL
+ *
+ * @param[in] closure   closure given at setup
+ * @param[in] op        the operation (EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL)
+ * @param[in] fd        the file descriptor to poll
+ * @param[in] events    the events to poll (EPOLLIN, EPOLLOUT)
+ * @return 0 in case of success or a negative -errno value
+ */
+typedef int (*sec_lsm_manager_async_ctl_cb_t)(void *closure, int op, int fd, uint32_t events);
+
+/**
+ * @brief Callback receiving the status of an asynchronous action
+ *
+ * @param[in] closure   closure given with the action
+ * @param[in] status    0 in case of success or the status of the first failed request
+ */
+typedef void (*sec_lsm_manager_async_cb_t)(void *closure, int status);
+
+/**
+ * @brief Callback receiving the records of the registry of the installed applications
+ * The kind is "app" (value is the id, extra the label), "path" (extra is the
+ * path type) or "permission" (extra is NULL). The strings are only valid
+ * during the call.
+ *
+ * @param[in] closure   closure given with the lookup
+ * @param[in] kind      the kind of the record
+ * @param[in] value     the value of the record
+ * @param[in] extra     the extra value of the record or NULL
+ */
+typedef void (*sec_lsm_manager_record_cb_t)(void *closure, const char *kind, const char *value, const char *extra);
+
 /**
  * @brief Create a client for server sec_lsm_manager
  * The client is created but not connected. The connection is made on need.
@@ -89,6 +123,33 @@ extern int sec_lsm_manager_add_path(sec_lsm_manager_t *sec_lsm_manager, const ch
  */
 extern int sec_lsm_manager_add_permission(sec_lsm_manager_t *sec_lsm_manager, const char *permission) __nonnull() __wur;
 
+/**
+ * @brief Add several paths in one request
+ * Either all the paths are added or none of them
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] count The number of paths (at most 1000, and all of them must fit in
+ *                  one message of 1 MiB, or -E2BIG is returned)
+ * @param[in] paths The paths to add
+ * @param[in] path_types The path types of the paths
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int sec_lsm_manager_add_paths(sec_lsm_manager_t *sec_lsm_manager, size_t count, const char *const paths[],
+                                     const char *const path_types[]) __nonnull() __wur;
+
+/**
+ * @brief Add several permissions in one request
+ * Either all the permissions are added or none of them
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] count The number of permissions (at most 1000, and all of them must fit in
+ *                  one message of 1 MiB, or -E2BIG is returned)
+ * @param[in] permissions The permissions to add
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int sec_lsm_manager_add_permissions(sec_lsm_manager_t *sec_lsm_manager, size_t count,
+                                           const char *const permissions[]) __nonnull() __wur;
+
 /**
  * @brief Clear the sec_lsm_manager client handler
  * Return in the create state
@@ -135,4 +196,128 @@ extern int sec_lsm_manager_log(sec_lsm_manager_t *sec_lsm_manager, int on, int o
  */
 extern int sec_lsm_manager_display(sec_lsm_manager_t *sec_lsm_manager) __nonnull() __wur;
 
+/**
+ * @brief List the installed applications
+ * The callback receives an "app" record for each application
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] callback        the callback receiving the records
+ * @param[in] closure         the closure of the callback
+ * @return the count of installed applications or a negative -errno value
+ */
+extern int sec_lsm_manager_list(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_record_cb_t callback,
+                                void *closure) __nonnull((1, 2)) __wur;
+
+/**
+ * @brief Query an installed application
+ * The callback receives the "app" record of the application followed by its
+ * "path" and "permission" records
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] key             the id or the label of the application
+ * @param[in] callback        the callback receiving the records
+ * @param[in] closure         the closure of the callback
+ * @return 0 in case of success, -ENOENT if not installed or a negative -errno value
+ */
+extern int sec_lsm_manager_query(sec_lsm_manager_t *sec_lsm_manager, const char *key,
+                                 sec_lsm_manager_record_cb_t callback, void *closure) __nonnull((1, 2, 3)) __wur;
+
+/**
+ * @brief Get the installed application owning a file
+ * The callback receives the "app" record of the owner and the "path" record
+ * of its path containing the file
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] path            the path of the file
+ * @param[in] callback        the callback receiving the records
+ * @param[in] closure         the closure of the callback
+ * @return 0 in case of success, -ENOENT if not owned or a negative -errno value
+ */
+extern int sec_lsm_manager_owner(sec_lsm_manager_t *sec_lsm_manager, const char *path,
+                                 sec_lsm_manager_record_cb_t callback, void *closure) __nonnull((1, 2, 3)) __wur;
+
+/**
+ * @brief Set or unset the pipelined mode
+ * In pipelined mode, the requests setting the id, adding paths or permissions
+ * and clearing are only buffered and return 0 at once. They are sent back to
+ * back and their replies are collected at the next sync point: install,
+ * uninstall, display, log, sec_lsm_manager_sync or when leaving the mode.
+ * A sync point returns the status of the first failed request of the batch.
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] pipelined       should pipeline the requests
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int sec_lsm_manager_set_pipelined(sec_lsm_manager_t *sec_lsm_manager, int pipelined) __nonnull() __wur;
+
+/**
+ * @brief Send the pipelined requests and wait for their replies
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @return 0 in case of success or the status of the first failed request
+ *
+ * @see sec_lsm_manager_failed_request
+ */
+extern int sec_lsm_manager_sync(sec_lsm_manager_t *sec_lsm_manager) __nonnull() __wur;
+
+/**
+ * @brief Get the index of the first failed request of the last pipelined batch
+ * Requests are counted from 0 since the previous sync point
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @return the index of the failed request or -1 if none failed
+ */
+extern int sec_lsm_manager_failed_request(sec_lsm_manager_t *sec_lsm_manager) __nonnull() __wur;
+
+/**
+ * @brief Set or unset the asynchronous mode
+ * In asynchronous mode, the requests are pipelined and the control callback
+ * is called to add, modify or delete the file descriptor and events to poll.
+ * When it is polled, sec_lsm_manager_async_process must be called.
+ * Only the connection to the server is still made synchronously.
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] controlcb       the control callback or NULL to leave the mode
+ * @param[in] closure         the closure of the control callback
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int sec_lsm_manager_async_setup(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_async_ctl_cb_t controlcb,
+                                       void *closure) __nonnull((1)) __wur;
+
+/**
+ * @brief Process the events of the asynchronous mode
+ * Writes the pending requests, reads the replies and calls the callbacks of
+ * the completed actions. The callbacks must not destroy the handler.
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int sec_lsm_manager_async_process(sec_lsm_manager_t *sec_lsm_manager) __nonnull() __wur;
+
+/**
+ * @brief Install asynchronously the application described since the last action
+ * The callback receives the status of the first failed request, if any, and
+ * sec_lsm_manager_failed_request gives its index while in the callback.
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] callback        the callback receiving the status
+ * @param[in] closure         the closure of the callback
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int sec_lsm_manager_async_install(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_async_cb_t callback,
+                                         void *closure) __nonnull((1, 2)) __wur;
+
+/**
+ * @brief Uninstall asynchronously the application described since the last action
+ *
+ * @param[in] sec_lsm_manager sec_lsm_manager client handler
+ * @param[in] callback        the callback receiving the status
+ * @param[in] closure         the closure of the callback
+ * @return 0 in case of success or a negative -errno value
+ *
+ * @see sec_lsm_manager_async_install
+ */
+extern int sec_lsm_manager_async_uninstall(sec_lsm_manager_t *sec_lsm_manager, sec_lsm_manager_async_cb_t callback,
+                                           void *closure) __nonnull((1, 2)) __wur;
+
 #endif
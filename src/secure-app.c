@@ -45,8 +45,11 @@ __nonnull() static void init_secure_app(secure_app_t *secure_app) {
     memset(secure_app->id, '\0', SEC_LSM_MANAGER_MAX_SIZE_ID);
     memset(secure_app->id_underscore, '\0', SEC_LSM_MANAGER_MAX_SIZE_ID);
     memset(secure_app->label, '\0', SEC_LSM_MANAGER_MAX_SIZE_LABEL);
+    init_arena(&(secure_app->arena));
     init_path_set(&(secure_app->path_set));
     init_permission_set(&(secure_app->permission_set));
+    secure_app->path_set.arena = &(secure_app->arena);
+    secure_app->permission_set.arena = &(secure_app->arena);
     secure_app->error_flag = false;
 }
 
@@ -84,15 +87,21 @@ int create_secure_app(secure_app_t **secure_app) {
 void clear_secure_app(secure_app_t *secure_app) {
     if (secure_app) {
 	secure_app->id[0] = '\0';
-        free_permission_set(&(secure_app->permission_set));
-        free_path_set(&(secure_app->path_set));
+        /* keep the storage of the sets and of the arena for the next use */
+        permission_set_truncate(&(secure_app->permission_set), 0);
+        path_set_truncate(&(secure_app->path_set), 0);
+        arena_reset(&(secure_app->arena));
         secure_app->error_flag = false;
     }
 }
 
 /* see secure-app.h */
 void destroy_secure_app(secure_app_t *secure_app) {
-    clear_secure_app(secure_app);
+    if (secure_app) {
+        free_permission_set(&(secure_app->permission_set));
+        free_path_set(&(secure_app->path_set));
+        free_arena(&(secure_app->arena));
+    }
     free(secure_app);
 }
 
@@ -140,11 +149,9 @@ int secure_app_add_permission(secure_app_t *secure_app, const char *permission)
         return -EPERM;
     }
 
-    for (size_t i = 0; i < secure_app->permission_set.size; i++) {
-        if (!strcmp(secure_app->permission_set.permissions[i], permission)) {
-            ERROR("permission already defined");
-            return -EINVAL;
-        }
+    if (permission_set_has_permission(&(secure_app->permission_set), permission, false)) {
+        ERROR("permission already defined");
+        return -EINVAL;
     }
 
     int rc = permission_set_add_permission(&(secure_app->permission_set), permission);
@@ -168,11 +175,9 @@ int secure_app_add_path(secure_app_t *secure_app, const char *path, enum path_ty
         return -EPERM;
     }
 
-    for (size_t i = 0; i < secure_app->path_set.size; i++) {
-        if (!strcmp(secure_app->path_set.paths[i]->path, path)) {
-            ERROR("path already defined");
-            return -EINVAL;
-        }
+    if (path_set_has_path(&(secure_app->path_set), path)) {
+        ERROR("path already defined");
+        return -EINVAL;
     }
 
     int rc = path_set_add_path(&(secure_app->path_set), path, path_type);
@@ -184,5 +189,48 @@ int secure_app_add_path(secure_app_t *secure_app, const char *path, enum path_ty
     return 0;
 }
 
+/* see secure-app.h */
+int secure_app_add_permissions(secure_app_t *secure_app, size_t count, const char *const permissions[]) {
+    size_t saved = secure_app->permission_set.size;
+    int rc = 0;
+
+    for (size_t i = 0; rc >= 0 && i < count; i++) {
+        rc = secure_app_add_permission(secure_app, permissions[i]);
+    }
+
+    if (rc < 0) {
+        permission_set_truncate(&(secure_app->permission_set), saved);
+    }
+
+    return rc;
+}
+
+/* see secure-app.h */
+int secure_app_add_paths(secure_app_t *secure_app, size_t count, const char *const paths[],
+                         const enum path_type path_types[]) {
+    size_t saved = secure_app->path_set.size;
+    int rc = 0;
+
+    for (size_t i = 0; rc >= 0 && i < count; i++) {
+        rc = secure_app_add_path(secure_app, paths[i], path_types[i]);
+    }
+
+    if (rc < 0) {
+        path_set_truncate(&(secure_app->path_set), saved);
+    }
+
+    return rc;
+}
+
+/* see secure-app.h */
+size_t secure_app_memory_usage(const secure_app_t *secure_app) {
+    const permission_set_t *permission_set = &(secure_app->permission_set);
+    const path_set_t *path_set = &(secure_app->path_set);
+
+    return secure_app->arena.size + permission_set->capacity * sizeof(*permission_set->permissions) +
+           permission_set->index_size * sizeof(*permission_set->index) +
+           path_set->capacity * sizeof(*path_set->paths) + path_set->index_size * sizeof(*path_set->index);
+}
+
 /* see secure-app.h */
 void raise_error_flag(secure_app_t *secure_app) { secure_app->error_flag = true; }
\ No newline at end of file
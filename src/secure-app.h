@@ -36,6 +36,7 @@ typedef struct secure_app {
     char label[SEC_LSM_MANAGER_MAX_SIZE_LABEL];
     permission_set_t permission_set;
     path_set_t path_set;
+    arena_t arena; /* allocator of the paths and permissions */
     bool error_flag;
 } secure_app_t;
 
@@ -94,6 +95,39 @@ extern int secure_app_add_permission(secure_app_t *secure_app, const char *permi
  */
 extern int secure_app_add_path(secure_app_t *secure_app, const char *path, enum path_type path_type) __wur __nonnull();
 
+/**
+ * @brief Add several permissions at once
+ * Either all the permissions are added or none of them
+ *
+ * @param[in] secure_app handler
+ * @param[in] count The number of permissions
+ * @param[in] permissions The permissions to add
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int secure_app_add_permissions(secure_app_t *secure_app, size_t count, const char *const permissions[])
+    __wur __nonnull();
+
+/**
+ * @brief Add several paths at once
+ * Either all the paths are added or none of them
+ *
+ * @param[in] secure_app handler
+ * @param[in] count The number of paths
+ * @param[in] paths The paths to add
+ * @param[in] path_types The path types of the paths
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int secure_app_add_paths(secure_app_t *secure_app, size_t count, const char *const paths[],
+                                const enum path_type path_types[]) __wur __nonnull();
+
+/**
+ * @brief Get the memory used by the secure app for its paths and permissions
+ *
+ * @param[in] secure_app handler
+ * @return the count of bytes
+ */
+extern size_t secure_app_memory_usage(const secure_app_t *secure_app) __wur __nonnull();
+
 /**
  * @brief Set error_flag
  * The secure_app can't be installed after
@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+#include "selinux-cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "limits.h"
+#include "log.h"
+#include "utils.h"
+
+/** default maximum size of the cache of compiled modules in bytes (0 = no cache) */
+#if !defined(SELINUX_CACHE_SIZE)
+#define SELINUX_CACHE_SIZE (16 * 1024 * 1024)
+#endif
+
+#define PP_SUFFIX ".pp"
+#define SOURCE_SUFFIX ".src"
+
+/** counters of the cache */
+static selinux_cache_stats_t cache_stats = {.hits = 0, .misses = 0, .evictions = 0};
+
+/** protects the counters */
+static pthread_mutex_t cache_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** an entry of the cache while evicting */
+typedef struct cache_entry {
+    char name[SEC_LSM_MANAGER_MAX_SIZE_PATH]; /* path of the entry without suffix */
+    struct timespec used;                     /* last use of the entry */
+    size_t size;                              /* size of the compiled module and of its sources */
+} cache_entry_t;
+
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Count an event of the cache
+ *
+ * @param[in] counter the counter to increment
+ */
+__nonnull() static void count_event(unsigned long *counter) {
+    pthread_mutex_lock(&cache_stats_mutex);
+    (*counter)++;
+    pthread_mutex_unlock(&cache_stats_mutex);
+}
+
+/**
+ * @brief Get the path of the entry of 'source' without suffix
+ *
+ * @param[out] path the path of the entry
+ * @param[in] cache_dir the directory of the cache
+ * @param[in] id the id of the application
+ * @param[in] source the sources of the module
+ * @param[in] size the size of the sources
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int entry_path(char path[SEC_LSM_MANAGER_MAX_SIZE_PATH], const char *cache_dir,
+                                        const char *id, const char *source, size_t size) {
+    int rc = snprintf(path, SEC_LSM_MANAGER_MAX_SIZE_PATH - sizeof(SOURCE_SUFFIX), "%s/%s-%016zx", cache_dir, id,
+                      hash_string(source, size, false));
+    if (rc < 0 || (size_t)rc >= SEC_LSM_MANAGER_MAX_SIZE_PATH - sizeof(SOURCE_SUFFIX)) {
+        ERROR("cache entry of %s too long", id);
+        return -ENAMETOOLONG;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read a whole file
+ *
+ * @param[in] path the path of the file
+ * @param[out] data the content of the file (to be freed)
+ * @param[out] size the size of the content
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int read_whole(const char *path, char **data, size_t *size) {
+    int rc = 0;
+    int fd;
+    struct stat st;
+    ssize_t len;
+    size_t pos = 0;
+
+    *data = NULL;
+    *size = 0;
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        rc = -errno;
+        goto end;
+    }
+
+    *data = malloc((size_t)st.st_size + 1);
+    if (*data == NULL) {
+        rc = -ENOMEM;
+        goto end;
+    }
+
+    while (pos < (size_t)st.st_size) {
+        len = read(fd, *data + pos, (size_t)st.st_size - pos);
+        if (len < 0 && errno != EINTR) {
+            rc = -errno;
+            goto end;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (len > 0) {
+            pos += (size_t)len;
+        }
+    }
+    *size = pos;
+
+end:
+    if (rc < 0) {
+        free(*data);
+        *data = NULL;
+    }
+    close(fd);
+    return rc;
+}
+
+/**
+ * @brief Copy a file atomically
+ *
+ * @param[in] src the file to copy
+ * @param[in] dest the destination
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int copy_file(const char *src, const char *dest) {
+    char *data;
+    size_t size;
+    int rc = read_whole(src, &data, &size);
+    if (rc < 0) {
+        ERROR("read %s : %d %s", src, -rc, strerror(-rc));
+        return rc;
+    }
+
+    rc = write_file(dest, data, size);
+    free(data);
+    return rc;
+}
+
+/**
+ * @brief Remove the files of an entry
+ *
+ * @param[in] name the path of the entry without suffix
+ */
+__nonnull() static void remove_entry(const char *name) {
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH + sizeof(SOURCE_SUFFIX)];
+
+    snprintf(path, sizeof(path), "%s%s", name, PP_SUFFIX);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s%s", name, SOURCE_SUFFIX);
+    unlink(path);
+}
+
+/**
+ * @brief Compare the last use of two entries (oldest first)
+ */
+static int compare_entries(const void *a, const void *b) {
+    const cache_entry_t *ea = a, *eb = b;
+
+    if (ea->used.tv_sec != eb->used.tv_sec)
+        return ea->used.tv_sec < eb->used.tv_sec ? -1 : 1;
+    if (ea->used.tv_nsec != eb->used.tv_nsec)
+        return ea->used.tv_nsec < eb->used.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Evict the least recently used entries until the cache holds at most 'max_size' bytes
+ *
+ * @param[in] cache_dir the directory of the cache
+ * @param[in] max_size the maximum size of the cache in bytes
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int evict(const char *cache_dir, size_t max_size) {
+    int rc = 0;
+    DIR *dir;
+    struct dirent *dirent;
+    struct stat st;
+    cache_entry_t *entries = NULL, *tmp;
+    size_t count = 0, capacity = 0, total = 0, len, i;
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH + sizeof(SOURCE_SUFFIX)];
+
+    dir = opendir(cache_dir);
+    if (dir == NULL) {
+        rc = -errno;
+        ERROR("opendir %s : %d %s", cache_dir, -rc, strerror(-rc));
+        return rc;
+    }
+
+    while ((dirent = readdir(dir)) != NULL) {
+        len = strlen(dirent->d_name);
+        if (len <= strlen(PP_SUFFIX) || strcmp(dirent->d_name + len - strlen(PP_SUFFIX), PP_SUFFIX))
+            continue;
+
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            tmp = realloc(entries, capacity * sizeof(*entries));
+            if (tmp == NULL) {
+                rc = -ENOMEM;
+                ERROR("realloc entries");
+                goto end;
+            }
+            entries = tmp;
+        }
+
+        snprintf(entries[count].name, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%.*s", cache_dir,
+                 (int)(len - strlen(PP_SUFFIX)), dirent->d_name);
+        snprintf(path, sizeof(path), "%s%s", entries[count].name, PP_SUFFIX);
+        if (stat(path, &st) < 0)
+            continue;
+        entries[count].used = st.st_mtim;
+        entries[count].size = (size_t)st.st_size;
+        snprintf(path, sizeof(path), "%s%s", entries[count].name, SOURCE_SUFFIX);
+        if (stat(path, &st) == 0)
+            entries[count].size += (size_t)st.st_size;
+        total += entries[count++].size;
+    }
+
+    qsort(entries, count, sizeof(*entries), compare_entries);
+    for (i = 0; i < count && total > max_size; i++) {
+        DEBUG("evict %s of the selinux cache", entries[i].name);
+        remove_entry(entries[i].name);
+        total -= entries[i].size;
+        count_event(&cache_stats.evictions);
+    }
+
+end:
+    free(entries);
+    closedir(dir);
+    return rc;
+}
+
+/**********************/
+/*** PUBLIC METHODS ***/
+/**********************/
+
+/* see selinux-cache.h */
+size_t get_selinux_cache_size(const char *value) {
+    char *end;
+    unsigned long long size;
+
+    value = value ?: secure_getenv("SELINUX_CACHE_SIZE");
+    if (value != NULL) {
+        size = strtoull(value, &end, 10);
+        if (*value != '\0' && *end == '\0' && size <= SIZE_MAX)
+            return (size_t)size;
+        ERROR("invalid selinux cache size %s", value);
+    }
+    return SELINUX_CACHE_SIZE;
+}
+
+/* see selinux-cache.h */
+int selinux_cache_fetch(const char *cache_dir, const char *id, const char *source, size_t size,
+                        const char *pp_file) {
+    char name[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH + sizeof(SOURCE_SUFFIX)];
+    char *cached = NULL;
+    size_t cached_size;
+    selinux_cache_stats_t stats;
+    bool found;
+
+    int rc = entry_path(name, cache_dir, id, source, size);
+    if (rc < 0) {
+        return rc;
+    }
+
+    /* the sources are compared: a collision of the hashes is not a hit */
+    snprintf(path, sizeof(path), "%s%s", name, SOURCE_SUFFIX);
+    found = read_whole(path, &cached, &cached_size) == 0 && cached_size == size && !memcmp(cached, source, size);
+    free(cached);
+
+    if (found) {
+        snprintf(path, sizeof(path), "%s%s", name, PP_SUFFIX);
+        rc = copy_file(path, pp_file);
+        if (rc < 0) {
+            ERROR("copy_file %s : %d %s", path, -rc, strerror(-rc));
+            found = false;
+        } else {
+            /* the modification time records the last use */
+            utimensat(AT_FDCWD, path, NULL, 0);
+        }
+    }
+
+    if (found) {
+        count_event(&cache_stats.hits);
+    } else {
+        count_event(&cache_stats.misses);
+    }
+    get_selinux_cache_stats(&stats);
+    DEBUG("selinux cache %s for %s (hits %lu, misses %lu)", found ? "hit" : "miss", id, stats.hits, stats.misses);
+    return found;
+}
+
+/* see selinux-cache.h */
+int selinux_cache_store(const char *cache_dir, size_t max_size, const char *id, const char *source, size_t size,
+                        const char *pp_file) {
+    char name[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH + sizeof(SOURCE_SUFFIX)];
+
+    int rc = entry_path(name, cache_dir, id, source, size);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (mkdir(cache_dir, 0755) < 0 && errno != EEXIST) {
+        rc = -errno;
+        ERROR("mkdir %s : %d %s", cache_dir, -rc, strerror(-rc));
+        return rc;
+    }
+
+    /* the module first: an entry without sources is never hit */
+    snprintf(path, sizeof(path), "%s%s", name, PP_SUFFIX);
+    rc = copy_file(pp_file, path);
+    if (rc < 0) {
+        ERROR("copy_file %s : %d %s", pp_file, -rc, strerror(-rc));
+        return rc;
+    }
+
+    snprintf(path, sizeof(path), "%s%s", name, SOURCE_SUFFIX);
+    rc = write_file(path, source, size);
+    if (rc < 0) {
+        ERROR("write_whole %s : %d %s", path, -rc, strerror(-rc));
+        remove_entry(name);
+        return rc;
+    }
+
+    return evict(cache_dir, max_size);
+}
+
+/* see selinux-cache.h */
+void get_selinux_cache_stats(selinux_cache_stats_t *stats) {
+    pthread_mutex_lock(&cache_stats_mutex);
+    *stats = cache_stats;
+    pthread_mutex_unlock(&cache_stats_mutex);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+#ifndef SEC_LSM_MANAGER_SELINUX_CACHE_H
+#define SEC_LSM_MANAGER_SELINUX_CACHE_H
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+/**
+ * @brief Counters of the cache of compiled modules
+ */
+typedef struct selinux_cache_stats {
+    unsigned long hits;      /* modules found in the cache */
+    unsigned long misses;    /* modules compiled */
+    unsigned long evictions; /* modules evicted of the cache */
+} selinux_cache_stats_t;
+
+/**
+ * @brief Get the maximum size of the cache of compiled modules
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the maximum size in bytes (0 disables the cache)
+ */
+extern size_t get_selinux_cache_size(const char *value) __wur;
+
+/**
+ * @brief Get the compiled module of 'source' from the cache
+ * The sources are the te, if and fc files of the module: a module is found
+ * only if it was compiled from exactly the same sources.
+ *
+ * @param[in] cache_dir the directory of the cache
+ * @param[in] id the id of the application
+ * @param[in] source the sources of the module
+ * @param[in] size the size of the sources
+ * @param[in] pp_file where to copy the compiled module
+ * @return 1 if the module is found, 0 if not, or a negative -errno value
+ */
+extern int selinux_cache_fetch(const char *cache_dir, const char *id, const char *source, size_t size,
+                               const char *pp_file) __wur __nonnull();
+
+/**
+ * @brief Store the compiled module of 'source' in the cache
+ * The least recently used modules are evicted to keep the cache under 'max_size' bytes.
+ *
+ * @param[in] cache_dir the directory of the cache
+ * @param[in] max_size the maximum size of the cache in bytes
+ * @param[in] id the id of the application
+ * @param[in] source the sources of the module
+ * @param[in] size the size of the sources
+ * @param[in] pp_file the compiled module
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int selinux_cache_store(const char *cache_dir, size_t max_size, const char *id, const char *source,
+                               size_t size, const char *pp_file) __wur __nonnull();
+
+/**
+ * @brief Get the counters of the cache
+ *
+ * @param[out] stats the counters
+ */
+extern void get_selinux_cache_stats(selinux_cache_stats_t *stats) __nonnull();
+
+#endif
@@ -43,9 +43,10 @@ int launch_compile(const char *id) {
     pid_t pid = 0;
     int status = 0;
 
+    // the child shares the memory of the parent until exec: it only calls exec or _exit
+    DEBUG("Launch : %s %s", COMPILE_SCRIPT_NAME, id);
     pid = vfork();
     if (pid == 0) {
-        DEBUG("Launch : %s %s", COMPILE_SCRIPT_NAME, id);
         execl(COMPILE_SCRIPT, COMPILE_SCRIPT_NAME, id, NULL);
         _exit(EXIT_FAILURE);
     }
@@ -64,9 +65,9 @@ int launch_compile(const char *id) {
         return rc;
     }
 
-    if (!WIFEXITED(status)) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
         ERROR("error during compile : child return %d", WEXITSTATUS(status));
-        return status;
+        return -EIO;
     }
 
     return 0;
@@ -24,12 +24,18 @@
 #include "selinux-template.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "label-tree.h"
 #include "limits.h"
 #include "log.h"
+#include "selinux-cache.h"
 #include "selinux-compile.h"
 #include "template.h"
 #include "utils.h"
@@ -42,6 +48,9 @@
 #define FC_EXTENSION "fc"
 #define IF_EXTENSION "if"
 #define PP_EXTENSION "pp"
+#define CIL_EXTENSION "cil"
+
+#define CACHE_DIR "cache"
 
 #if !defined(TE_TEMPLATE_FILE)
 #define TE_TEMPLATE_FILE "app-template.te"
@@ -51,6 +60,10 @@
 #define IF_TEMPLATE_FILE "app-template.if"
 #endif
 
+#if !defined(CIL_TEMPLATE_FILE)
+#define CIL_TEMPLATE_FILE "app-template.cil"
+#endif
+
 #if !defined(SELINUX_TE_TEMPLATE_FILE)
 #define SELINUX_TE_TEMPLATE_FILE SEC_LSM_MANAGER_DATADIR "/" TE_TEMPLATE_FILE
 #endif
@@ -59,22 +72,58 @@
 #define SELINUX_IF_TEMPLATE_FILE SEC_LSM_MANAGER_DATADIR "/" IF_TEMPLATE_FILE
 #endif
 
+#if !defined(SELINUX_CIL_TEMPLATE_FILE)
+#define SELINUX_CIL_TEMPLATE_FILE SEC_LSM_MANAGER_DATADIR "/" CIL_TEMPLATE_FILE
+#endif
+
 #if !defined(SELINUX_RULES_DIR)
 #define SELINUX_RULES_DIR SEC_LSM_MANAGER_DATADIR "/selinux-rules"
 #endif
 
+/** policy type used when the one of the system can't be read */
+#if !defined(SELINUX_POLICY_TYPE)
+#define SELINUX_POLICY_TYPE "targeted"
+#endif
+
+/** root of the policy stores, the active store is in ROOT/POLICY-TYPE/active */
+#if !defined(SELINUX_STORE_ROOT)
+#define SELINUX_STORE_ROOT "/var/lib/selinux"
+#endif
+
+/** directory of the active policy store, computed from the policy type when not defined */
+#if !defined(SELINUX_STORE_ACTIVE_DIR) && defined(SIMULATE_SELINUX) && defined(SIMULATION_SELINUX_POLICY_DIR)
+#define SELINUX_STORE_ACTIVE_DIR SIMULATION_SELINUX_POLICY_DIR
+#endif
+
+/**
+ * count of compilations running at the same time
+ * the daemon starts as many workers by default
+ */
+#if !defined(SELINUX_COMPILE_JOBS)
+#define SELINUX_COMPILE_JOBS 2
+#endif
+
+/** milliseconds waited for more modules before committing a group (0 = no wait) */
+#if !defined(SELINUX_COMMIT_WINDOW)
+#define SELINUX_COMMIT_WINDOW 0
+#endif
+
 const char default_selinux_rules_dir[] = SELINUX_RULES_DIR;
 const char default_selinux_te_template_file[] = SELINUX_TE_TEMPLATE_FILE;
 const char default_selinux_if_template_file[] = SELINUX_IF_TEMPLATE_FILE;
+const char default_selinux_cil_template_file[] = SELINUX_CIL_TEMPLATE_FILE;
 
 typedef struct selinux_module {
     char selinux_te_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];           ///////////////////
     char selinux_if_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];           //   PATH MODULE //
     char selinux_fc_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];           //      FILE     //
     char selinux_pp_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];           ///////////////////
+    char selinux_cil_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];          // CIL module as installed
     char selinux_rules_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR];          // Store te, if, fc, pp files
+    char selinux_cache_dir[SEC_LSM_MANAGER_MAX_SIZE_PATH];         // Cache of compiled pp files
     char selinux_te_template_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];  // te base template
     char selinux_if_template_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];  // if base template
+    char selinux_cil_template_file[SEC_LSM_MANAGER_MAX_SIZE_PATH]; // cil base template
 } selinux_module_t;
 
 char suffix_id[] = "_t";
@@ -86,6 +135,119 @@ char suffix_data[] = "_data_t";
 char suffix_http[] = "_http_t";
 char public_app[] = "redpesk_public_t";
 
+/**
+ * Serialize the accesses to the semanage store
+ * (rules may be installed from several threads)
+ */
+static pthread_mutex_t semanage_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The semanage handle shared by all the operations, protected by semanage_mutex
+ * (connected on first use and reconnected after an error)
+ */
+static semanage_handle_t *shared_semanage_handle = NULL;
+
+/**
+ * The names of the modules of the policy, protected by semanage_mutex
+ * It is filled from the store, updated by our commits and reloaded when the
+ * active store is changed by someone else.
+ */
+static struct {
+    /** names of the modules */
+    char **names;
+
+    /** count of names */
+    size_t count;
+
+    /** allocated count of names */
+    size_t capacity;
+
+    /** open addressing index of names: position + 1 or 0 for free slots */
+    size_t *index;
+
+    /** count of slots of the index (a power of 2) */
+    size_t index_size;
+
+    /** is the inventory loaded? */
+    bool valid;
+
+    /** status of the active store when the inventory was loaded or updated */
+    struct stat stamp;
+} module_inventory = {.names = NULL, .count = 0, .capacity = 0, .index = NULL, .index_size = 0, .valid = false};
+
+/** directory of the active policy store, computed once */
+static char store_active_dir[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+static pthread_once_t store_active_dir_once = PTHREAD_ONCE_INIT;
+
+/**
+ * The running compilations: each one builds in its own directory, so that
+ * up to get_selinux_compile_jobs() of them run at the same time
+ */
+static struct {
+    /** protects the count */
+    pthread_mutex_t mutex;
+
+    /** signals the end of a compilation */
+    pthread_cond_t cond;
+
+    /** count of running compilations */
+    unsigned running;
+} compile_jobs = {.mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER, .running = 0};
+
+/**
+ * Serialize the accesses to the cache of compiled modules
+ */
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct commit_request commit_request_t;
+
+/** a module to install or to remove in a group commit */
+struct commit_request {
+    /** next request of the group */
+    commit_request_t *next;
+
+    /** pp file to install or NULL */
+    const char *selinux_pp_file;
+
+    /** CIL module to install or NULL */
+    char *module_data;
+
+    /** size of the CIL module */
+    size_t module_size;
+
+    /** name of the module (removed when no pp file nor CIL module is given) */
+    const char *module_name;
+
+    /** result of the request */
+    int status;
+
+    /** is the request processed? */
+    bool done;
+};
+
+/**
+ * The group commit: requests arriving while a commit is running or within
+ * the commit window are committed together by the first of them (the leader)
+ */
+static struct {
+    /** protects the fields */
+    pthread_mutex_t mutex;
+
+    /** signals the end of a commit */
+    pthread_cond_t cond;
+
+    /** requests waiting for the next commit */
+    commit_request_t *pending;
+
+    /** is a leader committing? */
+    bool committing;
+} group_commit = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .pending = NULL,
+    .committing = false
+};
+
 /***********************/
 /*** PRIVATE METHODS ***/
 /***********************/
@@ -108,6 +270,9 @@ __nonnull() static void init_selinux_module(selinux_module_t *selinux_module, co
     secure_strncpy(selinux_module->selinux_if_template_file, get_selinux_if_template_file(NULL),
                    SEC_LSM_MANAGER_MAX_SIZE_PATH);
 
+    secure_strncpy(selinux_module->selinux_cil_template_file, get_selinux_cil_template_file(NULL),
+                   SEC_LSM_MANAGER_MAX_SIZE_PATH);
+
     snprintf(selinux_module->selinux_te_file, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s.%s",
              selinux_module->selinux_rules_dir, secure_app->id, TE_EXTENSION);
 
@@ -119,6 +284,12 @@ __nonnull() static void init_selinux_module(selinux_module_t *selinux_module, co
 
     snprintf(selinux_module->selinux_pp_file, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s.%s",
              selinux_module->selinux_rules_dir, secure_app->id, PP_EXTENSION);
+
+    snprintf(selinux_module->selinux_cil_file, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s.%s",
+             selinux_module->selinux_rules_dir, secure_app->id, CIL_EXTENSION);
+
+    snprintf(selinux_module->selinux_cache_dir, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s",
+             selinux_module->selinux_rules_dir, CACHE_DIR);
 }
 
 /**
@@ -217,6 +388,212 @@ ret:
     return rc;
 }
 
+/**
+ * @brief Read the generated te, if and fc files, the sources of the compilation
+ *
+ * @param[in] selinux_module selinux module handler
+ * @param[out] source the sources (to be freed)
+ * @param[out] size the size of the sources
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int read_module_sources(const selinux_module_t *selinux_module, char **source,
+                                                 size_t *size) {
+    const char *files[] = {selinux_module->selinux_te_file, selinux_module->selinux_if_file,
+                           selinux_module->selinux_fc_file};
+    char *content;
+    int rc = 0;
+    FILE *file = open_memstream(source, size);
+
+    if (file == NULL) {
+        rc = -errno;
+        ERROR("open_memstream : %d %s", -rc, strerror(-rc));
+        return rc;
+    }
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(*files) && rc == 0; i++) {
+        content = read_file(files[i]);
+        if (content == NULL) {
+            ERROR("read_file %s", files[i]);
+            rc = -ENOENT;
+        } else {
+            /* the terminating zeros separate the files */
+            fwrite(content, 1, strlen(content) + 1, file);
+            free(content);
+        }
+    }
+
+    if (fclose(file) != 0 && rc == 0) {
+        rc = -errno;
+        ERROR("fclose : %d %s", -rc, strerror(-rc));
+    }
+    if (rc < 0) {
+        free(*source);
+        *source = NULL;
+    }
+    return rc;
+}
+
+/**
+ * @brief Compile the pp file of the module or get it from the cache of the compiled modules
+ *
+ * @param[in] selinux_module selinux module handler
+ * @param[in] id the id of the application
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int compile_module(const selinux_module_t *selinux_module, const char *id) {
+    int rc;
+    unsigned max;
+    char *source = NULL;
+    size_t size = 0;
+    size_t cache_size = get_selinux_cache_size(NULL);
+
+    if (cache_size > 0) {
+        rc = read_module_sources(selinux_module, &source, &size);
+        if (rc < 0) {
+            ERROR("read_module_sources : %d %s", -rc, strerror(-rc));
+        } else {
+            pthread_mutex_lock(&cache_mutex);
+            rc = selinux_cache_fetch(selinux_module->selinux_cache_dir, id, source, size,
+                                     selinux_module->selinux_pp_file);
+            pthread_mutex_unlock(&cache_mutex);
+            if (rc > 0) {
+                rc = 0;
+                goto end;
+            }
+        }
+    }
+
+    /* wait for a free compilation slot */
+    max = get_selinux_compile_jobs(NULL);
+    pthread_mutex_lock(&compile_jobs.mutex);
+    while (compile_jobs.running >= max)
+        pthread_cond_wait(&compile_jobs.cond, &compile_jobs.mutex);
+    compile_jobs.running++;
+    pthread_mutex_unlock(&compile_jobs.mutex);
+
+    rc = launch_compile(id);
+
+    pthread_mutex_lock(&compile_jobs.mutex);
+    compile_jobs.running--;
+    pthread_cond_signal(&compile_jobs.cond);
+    pthread_mutex_unlock(&compile_jobs.mutex);
+
+    if (rc < 0) {
+        ERROR("launch_compile : %d %s", -rc, strerror(-rc));
+        goto end;
+    }
+
+    /* the cache is only an optimization: its errors don't fail the install */
+    if (source != NULL) {
+        pthread_mutex_lock(&cache_mutex);
+        if (selinux_cache_store(selinux_module->selinux_cache_dir, cache_size, id, source, size,
+                                selinux_module->selinux_pp_file) < 0) {
+            ERROR("selinux_cache_store %s failed", id);
+        }
+        pthread_mutex_unlock(&cache_mutex);
+    }
+
+end:
+    free(source);
+    return rc;
+}
+
+/**
+ * @brief Is the CIL backend used?
+ * It is used when its template is installed.
+ *
+ * @param[in] selinux_module selinux module handler
+ * @return true if the module is rendered in CIL, false if it is compiled from te, if, fc
+ */
+__nonnull() __wur static bool use_cil_backend(const selinux_module_t *selinux_module) {
+    return access(selinux_module->selinux_cil_template_file, R_OK) == 0;
+}
+
+/**
+ * @brief Write the file contexts of the paths in CIL
+ *
+ * @param[in] file the destination
+ * @param[in] secure_app secure_app handler
+ * @param[in] path_type_definitions the labels of the path types
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int write_cil_filecons(FILE *file, const secure_app_t *secure_app,
+                                                path_type_definitions_t path_type_definitions[number_path_type]) {
+    path_t *path;
+    const char *type;
+
+    for (size_t i = 0; i < secure_app->path_set.size; i++) {
+        path = secure_app->path_set.paths[i];
+        if (strchr(path->path, '"') != NULL) {
+            ERROR("path %s can't be written in CIL", path->path);
+            return -EINVAL;
+        }
+
+        /* labels are user:role:type, CIL wants the fields */
+        type = strrchr(path_type_definitions[path->path_type].label, ':') + 1;
+        if (fprintf(file, "(filecon \"%s(/.*)?\" any (system_u object_r %s ((s0) (s0))))\n", path->path, type) < 0) {
+            ERROR("fprintf filecon %s", path->path);
+            return -EIO;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Render the CIL module of the application in memory and keep a copy
+ * in the rules directory
+ *
+ * @param[in] selinux_module selinux module handler
+ * @param[in] secure_app secure app handler
+ * @param[in] path_type_definitions the labels of the path types
+ * @param[out] module_data the CIL module (to be freed)
+ * @param[out] module_size the size of the CIL module
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int generate_app_module_cil(const selinux_module_t *selinux_module,
+                                                     const secure_app_t *secure_app,
+                                                     path_type_definitions_t path_type_definitions[number_path_type],
+                                                     char **module_data, size_t *module_size) {
+    int rc = 0;
+    FILE *file;
+
+    *module_data = NULL;
+    *module_size = 0;
+    file = open_memstream(module_data, module_size);
+    if (file == NULL) {
+        rc = -errno;
+        ERROR("open_memstream : %d %s", -rc, strerror(-rc));
+        return rc;
+    }
+
+    rc = fprocess_template(selinux_module->selinux_cil_template_file, file, secure_app);
+    if (rc < 0) {
+        ERROR("fprocess_template %s : %d %s", selinux_module->selinux_cil_template_file, -rc, strerror(-rc));
+    } else {
+        rc = write_cil_filecons(file, secure_app, path_type_definitions);
+    }
+
+    if (fclose(file) != 0 && rc >= 0) {
+        rc = -errno;
+        ERROR("fclose : %d %s", -rc, strerror(-rc));
+    }
+
+    if (rc >= 0) {
+        rc = write_file(selinux_module->selinux_cil_file, *module_data, *module_size);
+        if (rc < 0) {
+            ERROR("write_file %s : %d %s", selinux_module->selinux_cil_file, -rc, strerror(-rc));
+        }
+    }
+
+    if (rc < 0) {
+        free(*module_data);
+        *module_data = NULL;
+        *module_size = 0;
+    }
+    return rc;
+}
+
 /**
  * @brief Check te, fc, if file exists
  *
@@ -227,6 +604,12 @@ ret:
 __nonnull() __wur static bool check_app_module_files_exists(const selinux_module_t *selinux_module) {
     bool exists;
     int sum = 0;
+
+    get_file_informations(selinux_module->selinux_cil_file, &exists, NULL, NULL);
+    if (exists) {
+        return true;
+    }
+
     get_file_informations(selinux_module->selinux_te_file, &exists, NULL, NULL);
     sum += exists;
     get_file_informations(selinux_module->selinux_fc_file, &exists, NULL, NULL);
@@ -304,6 +687,22 @@ __nonnull() __wur static int destroy_semanage_handle(semanage_handle_t *semanage
     return rc;
 }
 
+/**
+ * @brief Destroy the shared semanage handle so that the next use reconnects
+ * The caller must hold semanage_mutex.
+ */
+static void drop_semanage_handle(void) {
+    int rc;
+
+    if (shared_semanage_handle != NULL) {
+        rc = destroy_semanage_handle(shared_semanage_handle);
+        if (rc < 0) {
+            ERROR("destroy_semanage_handle : %d %s", -rc, strerror(-rc));
+        }
+        shared_semanage_handle = NULL;
+    }
+}
+
 /**
  * @brief Create a semanage handle
  *
@@ -315,7 +714,7 @@ __wur static int create_semanage_handle(semanage_handle_t **semanage_handle) {
     int rc2 = 0;
     *semanage_handle = semanage_handle_create();
 
-    if (semanage_handle == NULL) {
+    if (*semanage_handle == NULL) {
         rc = -errno;
         ERROR("semanage_handle_create : %d %s", -rc, strerror(-rc));
         goto ret;
@@ -349,63 +748,193 @@ ret:
 }
 
 /**
- * @brief Install selinux module
+ * @brief Get the shared semanage handle, connecting it if needed
+ * The caller must hold semanage_mutex.
  *
- * @param[in] semanage_handle semanage_handle handler
- * @param[in] selinux_pp_file Path of the pp file
+ * @param[out] semanage_handle pointer semanage_handle handler
  * @return 0 in case of success or a negative -errno value
  */
-__nonnull((1)) __wur static int install_module(semanage_handle_t *semanage_handle, const char *selinux_pp_file) {
-    int rc = semanage_module_install_file(semanage_handle, selinux_pp_file);
-    if (rc < 0) {
-        rc = -errno;
-        ERROR("semanage_module_install_file %s : %d %s", selinux_pp_file, -rc, strerror(-rc));
-        goto end;
+__nonnull() __wur static int get_semanage_handle(semanage_handle_t **semanage_handle) {
+    int rc = 0;
+
+    if (shared_semanage_handle != NULL && !semanage_is_connected(shared_semanage_handle)) {
+        DEBUG("semanage handle disconnected, reconnecting");
+        drop_semanage_handle();
     }
 
-    rc = semanage_commit(semanage_handle);
-    if (rc < 0) {
-        rc = -errno;
-        ERROR("semanage_commit (install_module %s) : %d %s", selinux_pp_file, -rc, strerror(-rc));
-        goto end;
+    if (shared_semanage_handle == NULL) {
+        rc = create_semanage_handle(&shared_semanage_handle);
+        if (rc < 0) {
+            shared_semanage_handle = NULL;
+            ERROR("create_semanage_handle : %d %s", -rc, strerror(-rc));
+            return rc;
+        }
     }
 
-end:
+    *semanage_handle = shared_semanage_handle;
     return rc;
 }
 
 /**
- * @brief Remove module in the policy
+ * @brief Get the slot of 'name' in the index of the module inventory
+ *
+ * @param[in] name the name of the module
+ * @return the slot of the name or the free slot where to index it
+ */
+__nonnull() __wur static size_t *inventory_slot(const char *name) {
+    size_t mask = module_inventory.index_size - 1;
+    size_t i = hash_string(name, strlen(name), false) & mask;
+    size_t *slot;
+
+    while (*(slot = &module_inventory.index[i])) {
+        if (!strcmp(module_inventory.names[*slot - 1], name))
+            break;
+        i = (i + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Rebuild the index of the module inventory with 'index_size' slots
  *
- * @param[in] semanage_handle semanage handle handler
- * @param[in] module_name Module name in the selinux policy
+ * @param[in] index_size The count of slots (a power of 2)
  * @return 0 in case of success or a negative -errno value
  */
-__nonnull() __wur static int remove_module(semanage_handle_t *semanage_handle, const char *module_name) {
-    int rc = 0;
-    char *module_name_ = strdupa(module_name);  // semanage_module_remove take no const module name
-    if (module_name_ == NULL) {
-        rc = -ENOMEM;
-        ERROR("strdupa %s : %d %s", module_name, -rc, strerror(-rc));
-        goto end;
+__wur static int inventory_reindex(size_t index_size) {
+    size_t *index = calloc(index_size, sizeof(*index));
+    if (index == NULL) {
+        ERROR("calloc index");
+        return -ENOMEM;
     }
 
-    rc = semanage_module_remove(semanage_handle, module_name_);
-    if (rc < 0) {
-        rc = -errno;
-        ERROR("semanage_module_remove %s : %d %s", module_name_, -rc, strerror(-rc));
-        goto end;
+    free(module_inventory.index);
+    module_inventory.index = index;
+    module_inventory.index_size = index_size;
+    for (size_t i = 0; i < module_inventory.count; i++)
+        *inventory_slot(module_inventory.names[i]) = i + 1;
+    return 0;
+}
+
+/**
+ * @brief Empty the module inventory and mark it as not loaded
+ */
+static void inventory_clear(void) {
+    for (size_t i = 0; i < module_inventory.count; i++)
+        free(module_inventory.names[i]);
+    module_inventory.count = 0;
+    if (module_inventory.index != NULL)
+        memset(module_inventory.index, 0, module_inventory.index_size * sizeof(*module_inventory.index));
+    module_inventory.valid = false;
+}
+
+/**
+ * @brief Add a module name to the inventory (nothing if already there)
+ *
+ * @param[in] name the name of the module
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int inventory_add(const char *name) {
+    char **names;
+    size_t capacity;
+    int rc;
+
+    if (module_inventory.count > 0 && *inventory_slot(name) != 0)
+        return 0;
+
+    if (module_inventory.count == module_inventory.capacity) {
+        capacity = module_inventory.capacity ? 2 * module_inventory.capacity : 64;
+        names = realloc(module_inventory.names, capacity * sizeof(*names));
+        if (names == NULL) {
+            ERROR("realloc names");
+            return -ENOMEM;
+        }
+        module_inventory.names = names;
+        rc = inventory_reindex(2 * capacity);
+        if (rc < 0)
+            return rc;
+        module_inventory.capacity = capacity;
     }
 
-    rc = semanage_commit(semanage_handle);
-    if (rc < 0) {
-        rc = -errno;
-        ERROR("semanage_commit (remove module %s) : %d %s", module_name_, -rc, strerror(-rc));
-        goto end;
+    names = &module_inventory.names[module_inventory.count];
+    *names = strdup(name);
+    if (*names == NULL) {
+        ERROR("strdup name");
+        return -ENOMEM;
     }
+    *inventory_slot(name) = ++module_inventory.count;
+    return 0;
+}
 
-end:
-    return rc;
+/**
+ * @brief Remove a module name from the inventory (nothing if not there)
+ *
+ * @param[in] name the name of the module
+ */
+__nonnull() static void inventory_remove(const char *name) {
+    size_t *slot;
+    size_t position;
+
+    if (module_inventory.count == 0)
+        return;
+
+    slot = inventory_slot(name);
+    if (*slot == 0)
+        return;
+
+    /* the last name fills the hole and the index is rebuilt in place */
+    position = *slot - 1;
+    free(module_inventory.names[position]);
+    module_inventory.names[position] = module_inventory.names[--module_inventory.count];
+    memset(module_inventory.index, 0, module_inventory.index_size * sizeof(*module_inventory.index));
+    for (size_t i = 0; i < module_inventory.count; i++)
+        *inventory_slot(module_inventory.names[i]) = i + 1;
+}
+
+/**
+ * @brief Compute the directory of the active store
+ * Its changes invalidate the module inventory.
+ */
+static void init_store_active_dir(void) {
+#if defined(SELINUX_STORE_ACTIVE_DIR)
+    secure_strncpy(store_active_dir, SELINUX_STORE_ACTIVE_DIR, sizeof(store_active_dir));
+#else
+    char *policy_type = NULL;
+
+    /* the store is the one of the loaded policy type (targeted, mls, minimum, ...) */
+    if (selinux_getpolicytype(&policy_type) < 0) {
+        ERROR("selinux_getpolicytype failed, use %s", SELINUX_POLICY_TYPE);
+        policy_type = NULL;
+    }
+    snprintf(store_active_dir, sizeof(store_active_dir), "%s/%s/active", SELINUX_STORE_ROOT,
+             policy_type ?: SELINUX_POLICY_TYPE);
+    free(policy_type);
+#endif
+    DEBUG("active store %s", store_active_dir);
+}
+
+/**
+ * @brief Get the status of the active store
+ *
+ * @param[out] stamp the status of the store
+ * @return true if the status is got, false else
+ */
+__nonnull() __wur static bool store_stamp(struct stat *stamp) {
+    pthread_once(&store_active_dir_once, init_store_active_dir);
+    return stat(store_active_dir, stamp) == 0;
+}
+
+/**
+ * @brief Check that the active store is unchanged since the inventory was loaded
+ *
+ * @return true if the inventory is up to date, false else
+ */
+__wur static bool inventory_is_fresh(void) {
+    struct stat stamp;
+
+    return module_inventory.valid && store_stamp(&stamp) && stamp.st_ino == module_inventory.stamp.st_ino &&
+           stamp.st_dev == module_inventory.stamp.st_dev &&
+           stamp.st_mtim.tv_sec == module_inventory.stamp.st_mtim.tv_sec &&
+           stamp.st_mtim.tv_nsec == module_inventory.stamp.st_mtim.tv_nsec;
 }
 
 /**
@@ -427,28 +956,32 @@ __nonnull() static void free_module_info_list(semanage_handle_t *semanage_handle
 }
 
 /**
- * @brief Check module in selinux policy
+ * @brief Load the module inventory from the store
  *
  * @param[in] semanage_handle semanage_handle handler
- * @param[in] id name of the module
- * @return true if exists, false else
+ * @return 0 in case of success or a negative -errno value
  */
-__nonnull() __wur static bool check_module(semanage_handle_t *semanage_handle, const char *id) {
-    bool ret = false;
+__nonnull() __wur static int inventory_load(semanage_handle_t *semanage_handle) {
     int semanage_module_info_len = 0;
     semanage_module_info_t *semanage_module_info = NULL;
     semanage_module_info_t *semanage_module_info_list = NULL;
+    const char *module_name = NULL;
+    bool stamped;
+
+    inventory_clear();
+
+    /* stamp first: a change during the listing triggers a reload */
+    stamped = store_stamp(&module_inventory.stamp);
 
     int rc = semanage_module_list(semanage_handle, &semanage_module_info_list, &semanage_module_info_len);
     if (rc < 0) {
         rc = -errno;
         ERROR("semanage_module_list : %d %s", -rc, strerror(-rc));
-        goto end;
+        return rc;
     }
 
     for (int i = 0; i < semanage_module_info_len; i++) {
         semanage_module_info = semanage_module_list_nth(semanage_module_info_list, i);
-        const char *module_name = NULL;
         rc = semanage_module_info_get_name(semanage_handle, semanage_module_info, &module_name);
         if (rc < 0) {
             rc = -errno;
@@ -456,14 +989,246 @@ __nonnull() __wur static bool check_module(semanage_handle_t *semanage_handle, c
             goto end;
         }
 
-        if (!strcmp(module_name, id)) {
-            ret = true;
+        rc = inventory_add(module_name);
+        if (rc < 0) {
+            ERROR("inventory_add %s : %d %s", module_name, -rc, strerror(-rc));
             goto end;
         }
     }
+
+    /* without status of the store, the inventory is reloaded at each use */
+    module_inventory.valid = stamped;
+    DEBUG("module inventory loaded: %zu module(s)", module_inventory.count);
 end:
+    if (rc < 0)
+        inventory_clear();
     free_module_info_list(semanage_handle, semanage_module_info_list, semanage_module_info_len);
-    return ret;
+    return rc;
+}
+
+/**
+ * @brief Report the committed requests of 'group' in the module inventory
+ * If the store was changed by someone else, the inventory is reloaded later.
+ *
+ * @param[in] group the committed requests
+ * @param[in] fresh was the inventory up to date before the commit?
+ */
+__nonnull() static void inventory_commit(const commit_request_t *group, bool fresh) {
+    const commit_request_t *request;
+
+    if (!fresh || !store_stamp(&module_inventory.stamp)) {
+        module_inventory.valid = false;
+        return;
+    }
+
+    for (request = group; request != NULL; request = request->next) {
+        if (request->selinux_pp_file == NULL && request->module_data == NULL) {
+            inventory_remove(request->module_name);
+        } else if (inventory_add(request->module_name) < 0) {
+            module_inventory.valid = false;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Stage the install or the removal of a module in the transaction
+ *
+ * @param[in] semanage_handle semanage_handle handler
+ * @param[in] request the request to stage
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int stage_module(semanage_handle_t *semanage_handle, const commit_request_t *request) {
+    int rc = 0;
+    char *module_name_ = NULL;
+
+    if (request->module_data != NULL) {
+        rc = semanage_module_install(semanage_handle, request->module_data, request->module_size,
+                                     request->module_name, CIL_EXTENSION);
+        if (rc < 0) {
+            rc = -errno;
+            ERROR("semanage_module_install %s : %d %s", request->module_name, -rc, strerror(-rc));
+        }
+        return rc;
+    }
+
+    if (request->selinux_pp_file != NULL) {
+        rc = semanage_module_install_file(semanage_handle, request->selinux_pp_file);
+        if (rc < 0) {
+            rc = -errno;
+            ERROR("semanage_module_install_file %s : %d %s", request->selinux_pp_file, -rc, strerror(-rc));
+        }
+        return rc;
+    }
+
+    module_name_ = strdupa(request->module_name);  // semanage_module_remove take no const module name
+    if (module_name_ == NULL) {
+        rc = -ENOMEM;
+        ERROR("strdupa %s : %d %s", request->module_name, -rc, strerror(-rc));
+        return rc;
+    }
+
+    rc = semanage_module_remove(semanage_handle, module_name_);
+    if (rc < 0) {
+        rc = -errno;
+        ERROR("semanage_module_remove %s : %d %s", module_name_, -rc, strerror(-rc));
+    }
+    return rc;
+}
+
+/**
+ * @brief Stage the requests of 'group' and commit them in one transaction
+ *
+ * @param[in] group the requests to commit
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int commit_group(commit_request_t *group) {
+    int rc;
+    bool fresh;
+    commit_request_t *request;
+    semanage_handle_t *semanage_handle;
+
+    rc = get_semanage_handle(&semanage_handle);
+    if (rc < 0) {
+        ERROR("get_semanage_handle : %d %s", -rc, strerror(-rc));
+        return rc;
+    }
+
+    fresh = inventory_is_fresh();
+
+    for (request = group; request != NULL && rc >= 0; request = request->next)
+        rc = stage_module(semanage_handle, request);
+
+    if (rc >= 0) {
+        rc = semanage_commit(semanage_handle);
+        if (rc < 0) {
+            rc = -errno;
+            ERROR("semanage_commit (%s) : %d %s", group->module_name, -rc, strerror(-rc));
+        } else {
+            inventory_commit(group, fresh);
+        }
+    }
+
+    /* a failed transaction may stay open in the handle: start again with a new one */
+    if (rc < 0)
+        drop_semanage_handle();
+    return rc;
+}
+
+/**
+ * @brief Commit the requests of 'group' and set their status
+ * The requests are committed in one transaction. If it fails, each request
+ * is committed alone so that a faulty module does not fail the others.
+ *
+ * @param[in] group the requests to commit
+ */
+__nonnull() static void process_group(commit_request_t *group) {
+    commit_request_t *request, *next;
+    int rc;
+
+    pthread_mutex_lock(&semanage_mutex);
+    rc = commit_group(group);
+    if (rc < 0 && group->next != NULL) {
+        ERROR("commit of the group failed, committing the modules one by one");
+        for (request = group; request != NULL; request = request->next) {
+            next = request->next;
+            request->next = NULL;
+            request->status = commit_group(request);
+            request->next = next;
+        }
+    } else {
+        for (request = group; request != NULL; request = request->next)
+            request->status = rc;
+    }
+    pthread_mutex_unlock(&semanage_mutex);
+}
+
+/**
+ * @brief Install or remove a module through the group commit
+ * The calling thread either becomes the leader committing all the pending
+ * requests or waits that a leader commits its request.
+ *
+ * @param[in] selinux_pp_file pp file to install or NULL
+ * @param[in] module_data CIL module to install or NULL
+ * @param[in] module_size size of the CIL module
+ * @param[in] module_name name of the module (removed if no pp file nor CIL module)
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull((4)) __wur static int commit_module(const char *selinux_pp_file, char *module_data, size_t module_size,
+                                              const char *module_name) {
+    commit_request_t request = {.next = NULL,
+                                .selinux_pp_file = selinux_pp_file,
+                                .module_data = module_data,
+                                .module_size = module_size,
+                                .module_name = module_name,
+                                .status = 0,
+                                .done = false};
+    commit_request_t **prev, *group, *item;
+    unsigned window, count;
+    struct timespec ts;
+
+    pthread_mutex_lock(&group_commit.mutex);
+    for (prev = &group_commit.pending; *prev != NULL; prev = &(*prev)->next) {
+    }
+    *prev = &request;
+
+    while (!request.done) {
+        if (group_commit.committing) {
+            pthread_cond_wait(&group_commit.cond, &group_commit.mutex);
+            continue;
+        }
+
+        /* lead the commit of the group, after waiting the window */
+        group_commit.committing = true;
+        window = get_selinux_commit_window(NULL);
+        if (window > 0) {
+            pthread_mutex_unlock(&group_commit.mutex);
+            ts.tv_sec = (time_t)(window / 1000);
+            ts.tv_nsec = (long)(window % 1000) * 1000000;
+            nanosleep(&ts, NULL);
+            pthread_mutex_lock(&group_commit.mutex);
+        }
+        group = group_commit.pending;
+        group_commit.pending = NULL;
+        pthread_mutex_unlock(&group_commit.mutex);
+
+        for (count = 0, item = group; item != NULL; item = item->next) count++;
+        DEBUG("group commit of %u module(s)", count);
+        process_group(group);
+
+        pthread_mutex_lock(&group_commit.mutex);
+        while (group != NULL) {
+            item = group;
+            group = item->next;
+            item->done = true;
+        }
+        group_commit.committing = false;
+        pthread_cond_broadcast(&group_commit.cond);
+    }
+    pthread_mutex_unlock(&group_commit.mutex);
+    return request.status;
+}
+
+/**
+ * @brief Check module in selinux policy
+ * The module inventory is reloaded only if the store changed.
+ *
+ * @param[in] semanage_handle semanage_handle handler
+ * @param[in] id name of the module
+ * @return true if exists, false else
+ */
+__nonnull() __wur static bool check_module(semanage_handle_t *semanage_handle, const char *id) {
+    int rc;
+
+    if (!inventory_is_fresh()) {
+        rc = inventory_load(semanage_handle);
+        if (rc < 0) {
+            ERROR("inventory_load : %d %s", -rc, strerror(-rc));
+            return false;
+        }
+    }
+
+    return module_inventory.count > 0 && *inventory_slot(id) != 0;
 }
 
 /**********************/
@@ -480,6 +1245,42 @@ const char *get_selinux_if_template_file(const char *value) {
     return value ?: secure_getenv("SELINUX_IF_TEMPLATE_FILE") ?: default_selinux_if_template_file;
 }
 
+/* see selinux-template.h */
+const char *get_selinux_cil_template_file(const char *value) {
+    return value ?: secure_getenv("SELINUX_CIL_TEMPLATE_FILE") ?: default_selinux_cil_template_file;
+}
+
+/* see selinux-template.h */
+unsigned get_selinux_compile_jobs(const char *value) {
+    char *end;
+    unsigned long jobs;
+
+    value = value ?: secure_getenv("SELINUX_COMPILE_JOBS");
+    if (value != NULL) {
+        jobs = strtoul(value, &end, 10);
+        if (*value != '\0' && *end == '\0' && jobs > 0 && jobs <= SEC_LSM_MANAGER_MAX_COMPILE_JOBS)
+            return (unsigned)jobs;
+        ERROR("invalid selinux compile jobs %s", value);
+    }
+
+    return SELINUX_COMPILE_JOBS > 0 ? SELINUX_COMPILE_JOBS : 1;
+}
+
+/* see selinux-template.h */
+unsigned get_selinux_commit_window(const char *value) {
+    char *end;
+    unsigned long window;
+
+    value = value ?: secure_getenv("SELINUX_COMMIT_WINDOW");
+    if (value != NULL) {
+        window = strtoul(value, &end, 10);
+        if (*value != '\0' && *end == '\0' && window <= 60000)
+            return (unsigned)window;
+        ERROR("invalid selinux commit window %s", value);
+    }
+    return SELINUX_COMMIT_WINDOW;
+}
+
 /* see selinux-template.h */
 const char *get_selinux_rules_dir(const char *value) {
     value = value ?: secure_getenv("SELINUX_RULES_DIR") ?: default_selinux_rules_dir;
@@ -508,6 +1309,11 @@ void init_path_type_definitions(path_type_definitions_t path_type_definitions[nu
              suffix_lib);
     snprintf(path_type_definitions[type_public].label, SEC_LSM_MANAGER_MAX_SIZE_LABEL, "system_u:object_r:%s",
              public_app);
+
+    // recursive
+    for (int type = type_none; type < number_path_type; type++) {
+        path_type_definitions[type].is_recursive = is_label_tree_path_type(type);
+    }
 }
 
 /* see selinux-template.h */
@@ -515,13 +1321,34 @@ int create_selinux_rules(const secure_app_t *secure_app,
                          path_type_definitions_t path_type_definitions[number_path_type]) {
     int rc = 0;
     int rc2 = 0;
+    char *module_data = NULL;
+    size_t module_size = 0;
     selinux_module_t selinux_module;
     init_selinux_module(&selinux_module, secure_app);
 
-    semanage_handle_t *semanage_handle;
-    rc = create_semanage_handle(&semanage_handle);
-    if (rc < 0) {
-        ERROR("create_semanage_handle : %d %s", -rc, strerror(-rc));
+    if (use_cil_backend(&selinux_module)) {
+        // CIL rendered in memory, no compilation
+        rc = generate_app_module_cil(&selinux_module, secure_app, path_type_definitions, &module_data, &module_size);
+        if (rc < 0) {
+            ERROR("generate_app_module_cil : %d %s", -rc, strerror(-rc));
+            goto ret;
+        }
+
+        DEBUG("success generate selinux cil module");
+
+        rc = commit_module(NULL, module_data, module_size, secure_app->id);
+        free(module_data);
+        if (rc < 0) {
+            ERROR("commit_module : %d %s", -rc, strerror(-rc));
+            rc2 = remove_file(selinux_module.selinux_cil_file);
+            if (rc2 < 0) {
+                ERROR("remove_file %s : %d %s", selinux_module.selinux_cil_file, -rc2, strerror(-rc2));
+            }
+            goto ret;
+        }
+
+        DEBUG("success install module");
+
         goto ret;
     }
 
@@ -529,15 +1356,15 @@ int create_selinux_rules(const secure_app_t *secure_app,
     rc = generate_app_module_files(&selinux_module, secure_app, path_type_definitions);
     if (rc < 0) {
         ERROR("generate_app_module_files : %d %s", -rc, strerror(-rc));
-        goto end2;
+        goto ret;
     }
 
     DEBUG("success generate selinux files module");
 
     // fc, if, te generated
-    rc = launch_compile(secure_app->id);
+    rc = compile_module(&selinux_module, secure_app->id);
     if (rc < 0) {
-        ERROR("launch_compile : %d %s", -rc, strerror(-rc));
+        ERROR("compile_module : %d %s", -rc, strerror(-rc));
         goto error3;
     }
 
@@ -545,15 +1372,15 @@ int create_selinux_rules(const secure_app_t *secure_app,
 
     // pp generated
 
-    rc = install_module(semanage_handle, selinux_module.selinux_pp_file);
+    rc = commit_module(selinux_module.selinux_pp_file, NULL, 0, secure_app->id);
     if (rc < 0) {
-        ERROR("install_module : %d %s", -rc, strerror(-rc));
+        ERROR("commit_module : %d %s", -rc, strerror(-rc));
         goto error4;
     }
 
     DEBUG("success install module");
 
-    goto end2;
+    goto ret;
 
 error4:
     rc2 = remove_pp_file(&selinux_module);
@@ -565,11 +1392,6 @@ error3:
     if (rc2 < 0) {
         ERROR("remove_app_module_files : %d %s", -rc2, strerror(-rc2));
     }
-end2:
-    rc2 = destroy_semanage_handle(semanage_handle);
-    if (rc2 < 0) {
-        ERROR("destroy_semanage_handle : %d %s", -rc2, strerror(-rc2));
-    }
 ret:
     return rc;
 }
@@ -585,67 +1407,60 @@ bool check_module_files_exist(const secure_app_t *secure_app) {
 bool check_module_in_policy(const secure_app_t *secure_app) {
     bool ret = false;
     semanage_handle_t *semanage_handle;
-    int rc = create_semanage_handle(&semanage_handle);
+    pthread_mutex_lock(&semanage_mutex);
+    int rc = get_semanage_handle(&semanage_handle);
     if (rc < 0) {
-        ERROR("create_semanage_handle : %d %s", -rc, strerror(-rc));
+        ERROR("get_semanage_handle : %d %s", -rc, strerror(-rc));
         goto end;
     }
 
     ret = check_module(semanage_handle, secure_app->id);
 
-    rc = destroy_semanage_handle(semanage_handle);
-    if (rc < 0) {
-        ERROR("destroy_semanage_handle : %d %s", -rc, strerror(-rc));
-    }
-
 end:
+    pthread_mutex_unlock(&semanage_mutex);
     return ret;
 }
 
 /* see selinux-template.h */
 int remove_selinux_rules(const secure_app_t *secure_app) {
     int rc = 0;
-    int rc2 = 0;
+    bool cil;
     selinux_module_t selinux_module;
     init_selinux_module(&selinux_module, secure_app);
 
     // remove files
-    rc = remove_app_module_files(&selinux_module);
-    if (rc < 0) {
-        ERROR("remove_app_module_files : %d %s", -rc, strerror(-rc));
-        goto ret;
-    }
+    get_file_informations(selinux_module.selinux_cil_file, &cil, NULL, NULL);
+    if (cil) {
+        rc = remove_file(selinux_module.selinux_cil_file);
+        if (rc < 0) {
+            ERROR("remove_file %s : %d %s", selinux_module.selinux_cil_file, -rc, strerror(-rc));
+            goto ret;
+        }
+    } else {
+        rc = remove_app_module_files(&selinux_module);
+        if (rc < 0) {
+            ERROR("remove_app_module_files : %d %s", -rc, strerror(-rc));
+            goto ret;
+        }
 
-    rc = remove_pp_file(&selinux_module);
-    if (rc < 0) {
-        ERROR("remove_pp_file : %d %s", -rc, strerror(-rc));
-        goto ret;
+        rc = remove_pp_file(&selinux_module);
+        if (rc < 0) {
+            ERROR("remove_pp_file : %d %s", -rc, strerror(-rc));
+            goto ret;
+        }
     }
 
     DEBUG("success remove selinux files");
 
     // remove module in policy
-    semanage_handle_t *semanage_handle;
-    rc = create_semanage_handle(&semanage_handle);
+    rc = commit_module(NULL, NULL, 0, secure_app->id);
     if (rc < 0) {
-        ERROR("create_semanage_handle : %d %s", -rc, strerror(-rc));
+        ERROR("commit_module : %d %s", -rc, strerror(-rc));
         goto ret;
     }
-    rc = remove_module(semanage_handle, secure_app->id);
-    if (rc < 0) {
-        ERROR("remove_module : %d %s", -rc, strerror(-rc));
-        goto end;
-    }
 
     DEBUG("success remove selinux module");
 
-    goto end;
-
-end:
-    rc2 = destroy_semanage_handle(semanage_handle);
-    if (rc2 < 0) {
-        ERROR("destroy_semanage_handle : %d %s", -rc2, strerror(-rc2));
-    }
 ret:
     return rc;
 }
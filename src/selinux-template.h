@@ -36,6 +36,7 @@
 
 typedef struct path_type_definitions {
     char label[SEC_LSM_MANAGER_MAX_SIZE_LABEL];
+    bool is_recursive;
 } path_type_definitions_t;
 
 /**
@@ -54,6 +55,38 @@ extern const char *get_selinux_te_template_file(const char *value) __wur;
  */
 extern const char *get_selinux_if_template_file(const char *value) __wur;
 
+/**
+ * @brief Get the selinux cil template file
+ * When this file exists, the modules are rendered in CIL and installed
+ * without compilation.
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the selinux cil template file specification
+ */
+extern const char *get_selinux_cil_template_file(const char *value) __wur;
+
+/**
+ * @brief Get the count of module compilations running at the same time
+ * Each compilation builds in its own directory, only the commits of the
+ * modules are serialized.
+ * The compilations run in the workers of the server: the daemon starts this
+ * count of workers unless its option --workers sets another one.
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the count of compilations (SELINUX_COMPILE_JOBS by default)
+ */
+extern unsigned get_selinux_compile_jobs(const char *value) __wur;
+
+/**
+ * @brief Get the window of the group commit
+ * Installs and removals arriving within this window, or while a commit is
+ * running, are committed together in one semanage transaction.
+ *
+ * @param[in] value some value or NULL for getting default
+ * @return the window in milliseconds
+ */
+extern unsigned get_selinux_commit_window(const char *value) __wur;
+
 /**
  * @brief Get the selinux rules directory
  *
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <sys/xattr.h>
 
+#include "label-tree.h"
 #include "log.h"
 #include "selinux-template.h"
 #include "utils.h"
@@ -57,6 +58,27 @@ __nonnull() __wur static int label_file(const char *path, const char *label) {
     return 0;
 }
 
+/**
+ * @brief Label a file of a tree (see label_tree)
+ *
+ * @param[in] fd The descriptor of the file
+ * @param[in] name The name of the file
+ * @param[in] st The status of the file
+ * @param[in] closure The label to set
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int label_tree_file(int fd, const char *name, __attribute__((unused)) const struct stat *st,
+                                             void *closure) {
+    const char *label = closure;
+    int rc = set_label_fd(fd, XATTR_NAME_SELINUX, label);
+    if (rc < 0) {
+        return rc;
+    }
+
+    DEBUG("label %s : %s", name, label);
+    return 0;
+}
+
 /**
  * @brief Apply selinux on a secure app
  *
@@ -76,6 +98,13 @@ __nonnull() __wur static int selinux_process_paths(const secure_app_t *secure_ap
                   -rc, strerror(-rc));
             return rc;
         }
+        if (path_type_definitions[path->path_type].is_recursive) {
+            rc = label_tree(path->path, label_tree_file, label, NULL);
+            if (rc < 0) {
+                ERROR("label_tree(%s,%s) : %d %s", path->path, label, -rc, strerror(-rc));
+                return rc;
+            }
+        }
     }
 
     return 0;
@@ -132,7 +161,9 @@ int install_selinux(const secure_app_t *secure_app) {
         return rc;
     }
 
-    DEBUG("success apply selinux label");
+    label_stats_t label_stats;
+    get_label_stats(&label_stats);
+    DEBUG("success apply selinux label (labels written %lu, skipped %lu)", label_stats.written, label_stats.skipped);
 
     return 0;
 }
@@ -24,6 +24,8 @@
 #include "selinux.h"
 
 static int ptr = 0;
+static intptr_t connected = 0;
+static unsigned commits = 0; /* count of semanage_commit, checked by the tests */
 
 #if !defined(SEC_LSM_MANAGER_DATADIR)
 #define SEC_LSM_MANAGER_DATADIR "/usr/share/sec-lsm-manager"
@@ -33,7 +35,9 @@ static int ptr = 0;
 #define SELINUX_RULES_DIR SEC_LSM_MANAGER_DATADIR "selinux-rules"
 #endif
 
-#if !defined(SELINUX_POLICY_DIR)
+#if !defined(SELINUX_POLICY_DIR) && defined(SIMULATION_SELINUX_POLICY_DIR)
+#define SELINUX_POLICY_DIR SIMULATION_SELINUX_POLICY_DIR
+#elif !defined(SELINUX_POLICY_DIR)
 #define SELINUX_POLICY_DIR SEC_LSM_MANAGER_DATADIR "selinux-simulation"
 #endif
 
@@ -63,13 +67,20 @@ int selinux_restorecon(const char *pathname, unsigned int restorecon_flags) {
     return 0;
 }
 
+int selinux_getpolicytype(char **policytype) {
+    printf("selinux_getpolicytype()\n");
+    *policytype = strdup("targeted");
+    return *policytype == NULL ? -1 : 0;
+}
+
 int semanage_is_connected(semanage_handle_t *sh) {
     printf("semanage_is_connected(%p)\n", (void *)sh);
-    return 0;
+    return (intptr_t)sh == connected;
 }
 
 int semanage_disconnect(semanage_handle_t *sh) {
     printf("semanage_disconnect(%p)\n", (void *)sh);
+    connected = 0;
     return 0;
 }
 
@@ -90,11 +101,13 @@ int semanage_set_default_priority(semanage_handle_t *sh, uint16_t priority) {
 
 int semanage_connect(semanage_handle_t *sh) {
     printf("semanage_connect(%p)\n", (void *)sh);
+    connected = (intptr_t)sh;
     return 0;
 }
 
 int semanage_commit(semanage_handle_t *sh) {
     printf("semanage_commit(%p)\n", (void *)sh);
+    commits++;
     return 0;
 }
 
@@ -112,6 +125,17 @@ int semanage_module_install_file(semanage_handle_t *sh, const char *file_path) {
     return rc;
 }
 
+int semanage_module_install(semanage_handle_t *sh, char *module_data, size_t data_len, const char *name,
+                            const char *ext_lang) {
+    printf("semanage_module_install(%p, %zu, %s, %s)\n", (void *)sh, data_len, name, ext_lang);
+    (void)module_data;
+    mkdir(SELINUX_POLICY_DIR, 0755);
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    snprintf(path, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s", SELINUX_POLICY_DIR, name);
+    int rc = create_file(path);
+    return rc;
+}
+
 int semanage_module_remove(semanage_handle_t *sh, char *module_name) {
     printf("semanage_module_remove(%p, %s)\n", (void *)sh, module_name);
     char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
@@ -24,6 +24,7 @@
 #ifndef SEC_LSM_MANAGER_SIMULATION_SELINUX_H
 #define SEC_LSM_MANAGER_SIMULATION_SELINUX_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define SELINUX_RESTORECON_SET_SPECFILE_CTX 1
@@ -36,6 +37,8 @@ extern int is_selinux_enabled(void);
 
 extern int selinux_restorecon(const char *pathname, unsigned int restorecon_flags);
 
+extern int selinux_getpolicytype(char **policytype);
+
 extern int semanage_is_connected(semanage_handle_t *sh);
 
 extern int semanage_disconnect(semanage_handle_t *);
@@ -52,6 +55,9 @@ extern int semanage_set_default_priority(semanage_handle_t *sh, uint16_t priorit
 
 extern int semanage_module_install_file(semanage_handle_t *, const char *module_name);
 
+extern int semanage_module_install(semanage_handle_t *, char *module_data, size_t data_len, const char *name,
+                                   const char *ext_lang);
+
 extern int semanage_commit(semanage_handle_t *);
 
 extern int semanage_module_remove(semanage_handle_t *, char *module_name);
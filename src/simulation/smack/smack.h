@@ -39,6 +39,9 @@ int smack_accesses_new(struct smack_accesses **handle);
 
 int smack_accesses_add(struct smack_accesses *handle, const char *subject, const char *object, const char *access_type);
 
+int smack_accesses_add_modify(struct smack_accesses *handle, const char *subject, const char *object,
+                              const char *allow_access_type, const char *deny_access_type);
+
 int smack_accesses_apply(struct smack_accesses *handle);
 
 int smack_accesses_save(struct smack_accesses *handle, int fd);
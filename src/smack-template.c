@@ -23,13 +23,17 @@
 
 #include "smack-template.h"
 
+#include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "label-tree.h"
 #include "log.h"
 #include "template.h"
 #include "utils.h"
@@ -65,6 +69,28 @@ char suffix_http[] = ":Http";
 char user_home[] = "User:Home";
 char public_app[] = "System:Shared";
 
+/** a rule 'subject object access' or 'subject object allow deny' */
+typedef struct smack_rule {
+    const char *subject;
+    const char *object;
+    const char *access;
+    const char *deny; /* NULL for 'subject object access' */
+} smack_rule_t;
+
+/** parsed rules */
+typedef struct smack_rules {
+    smack_rule_t *rules; /* the rules */
+    size_t count;        /* count of rules */
+    char *text;          /* the text holding the fields of the rules */
+} smack_rules_t;
+
+/** rules indexed by subject and object, without two rules of same subject and object */
+typedef struct smack_rule_set {
+    const smack_rule_t **slots; /* open addressing hash table of the rules */
+    size_t capacity;            /* count of slots (power of 2) */
+    size_t count;               /* count of rules */
+} smack_rule_set_t;
+
 /***********************/
 /*** PRIVATE METHODS ***/
 /***********************/
@@ -115,6 +141,473 @@ ret:
     return rc;
 }
 
+/**
+ * @brief Render the rules of an application in memory
+ *
+ * @param[in] template_file The template of the rules
+ * @param[in] secure_app The secure_app of the application
+ * @param[out] rules The rules (to be freed)
+ * @param[out] size The size of the rules
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int render_rules(const char *template_file, const secure_app_t *secure_app, char **rules,
+                                          size_t *size) {
+    int rc = 0;
+    FILE *file;
+
+    *rules = NULL;
+    *size = 0;
+    file = open_memstream(rules, size);
+    if (file == NULL) {
+        rc = -errno;
+        ERROR("open_memstream : %d %s", -rc, strerror(-rc));
+        return rc;
+    }
+
+    rc = fprocess_template(template_file, file, secure_app);
+    if (rc < 0) {
+        ERROR("fprocess_template %s : %d %s", template_file, -rc, strerror(-rc));
+    }
+
+    if (fclose(file) != 0 && rc >= 0) {
+        rc = -errno;
+        ERROR("fclose : %d %s", -rc, strerror(-rc));
+    }
+
+    if (rc < 0) {
+        free(*rules);
+        *rules = NULL;
+        *size = 0;
+    }
+    return rc;
+}
+
+/**
+ * @brief Free parsed rules
+ *
+ * @param[in] smack_rules The parsed rules
+ */
+__nonnull() static void free_rules(smack_rules_t *smack_rules) {
+    free(smack_rules->rules);
+    free(smack_rules->text);
+    smack_rules->rules = NULL;
+    smack_rules->text = NULL;
+    smack_rules->count = 0;
+}
+
+/**
+ * @brief Parse rules
+ * Each line is 'subject object access' or 'subject object allow deny'
+ * (as in the files of the smack policy directory).
+ *
+ * @param[in] text The text of the rules
+ * @param[out] smack_rules The parsed rules (to be freed with free_rules)
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int parse_rules(const char *text, smack_rules_t *smack_rules) {
+    int rc = 0;
+    char *line, *saveline, *saveword;
+    char *fields[5];
+    size_t count, capacity = 0;
+    smack_rule_t *rules;
+
+    smack_rules->rules = NULL;
+    smack_rules->count = 0;
+    smack_rules->text = strdup(text);
+    if (smack_rules->text == NULL) {
+        ERROR("strdup rules");
+        return -ENOMEM;
+    }
+
+    for (line = strtok_r(smack_rules->text, "\n", &saveline); line != NULL && rc >= 0;
+         line = strtok_r(NULL, "\n", &saveline)) {
+        count = 0;
+        for (char *word = strtok_r(line, " \t", &saveword); word != NULL && count < 5;
+             word = strtok_r(NULL, " \t", &saveword))
+            fields[count++] = word;
+
+        if (count == 0 || fields[0][0] == '#')
+            continue;
+
+        if (count != 3 && count != 4) {
+            ERROR("invalid smack rule %s %s ...", fields[0], count > 1 ? fields[1] : "");
+            rc = -EINVAL;
+            break;
+        }
+
+        if (smack_rules->count == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            rules = realloc(smack_rules->rules, capacity * sizeof(*rules));
+            if (rules == NULL) {
+                ERROR("realloc rules");
+                rc = -ENOMEM;
+                break;
+            }
+            smack_rules->rules = rules;
+        }
+
+        rules = &smack_rules->rules[smack_rules->count++];
+        rules->subject = fields[0];
+        rules->object = fields[1];
+        rules->access = fields[2];
+        rules->deny = count == 4 ? fields[3] : NULL;
+    }
+
+    if (rc < 0)
+        free_rules(smack_rules);
+    return rc;
+}
+
+/**
+ * @brief Get the set of the accesses of an access string
+ *
+ * @param[in] access The access string (like "rwx" or "-")
+ * @return the set of accesses as a bit mask
+ */
+__nonnull() __wur static unsigned access_mask(const char *access) {
+    static const char letters[] = "rwxatlb";
+    const char *letter;
+    unsigned mask = 0;
+
+    for (; *access; access++) {
+        letter = strchr(letters, tolower(*access));
+        if (letter != NULL && *letter)
+            mask |= 1u << (letter - letters);
+    }
+    return mask;
+}
+
+/**
+ * @brief Find the rule of the same subject and object
+ *
+ * @param[in] smack_rules The rules where to search
+ * @param[in] rule The rule to find
+ * @return the rule found or NULL
+ */
+__nonnull() __wur static const smack_rule_t *find_rule(const smack_rules_t *smack_rules, const smack_rule_t *rule) {
+    for (size_t i = 0; i < smack_rules->count; i++) {
+        if (!strcmp(smack_rules->rules[i].subject, rule->subject) &&
+            !strcmp(smack_rules->rules[i].object, rule->object))
+            return &smack_rules->rules[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Tell whether a rule sets the same accesses as an other one
+ *
+ * @param[in] rule The rule to compare or NULL
+ * @param[in] other The other rule
+ * @return true if both rules are the same
+ */
+__nonnull((2)) __wur static bool same_rule(const smack_rule_t *rule, const smack_rule_t *other) {
+    if (rule == NULL || access_mask(rule->access) != access_mask(other->access))
+        return false;
+    if (rule->deny == NULL || other->deny == NULL)
+        return rule->deny == other->deny;
+    return access_mask(rule->deny) == access_mask(other->deny);
+}
+
+/**
+ * @brief Add to smack accesses the changes going from the rules 'from' to the rules 'to'
+ * The accesses of the rules removed are cleared, the rules added or changed are set
+ * and the unchanged rules are not written again.
+ * A modify rule 'subject object allow deny' removed or changed is reverted by
+ * removing the accesses it allowed (the accesses it denied are not given back).
+ *
+ * @param[in] smack_accesses The smack accesses handler
+ * @param[in] from The rules loaded
+ * @param[in] to The rules to load
+ * @param[out] count The count of changes
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int add_delta(struct smack_accesses *smack_accesses, const smack_rules_t *from,
+                                       const smack_rules_t *to, size_t *count) {
+    int rc = 0;
+    const smack_rule_t *rule, *other;
+
+    *count = 0;
+    for (size_t i = 0; i < from->count && rc >= 0; i++) {
+        rule = &from->rules[i];
+        other = find_rule(to, rule);
+        if (rule->deny != NULL) {
+            if (!same_rule(other, rule)) {
+                rc = smack_accesses_add_modify(smack_accesses, rule->subject, rule->object, "", rule->access);
+                (*count)++;
+            }
+        } else if (other == NULL || other->deny != NULL) {
+            rc = smack_accesses_add(smack_accesses, rule->subject, rule->object, "-");
+            (*count)++;
+        }
+    }
+
+    for (size_t i = 0; i < to->count && rc >= 0; i++) {
+        rule = &to->rules[i];
+        if (same_rule(find_rule(from, rule), rule))
+            continue;
+
+        if (rule->deny != NULL)
+            rc = smack_accesses_add_modify(smack_accesses, rule->subject, rule->object, rule->access, rule->deny);
+        else
+            rc = smack_accesses_add(smack_accesses, rule->subject, rule->object, rule->access);
+        (*count)++;
+    }
+
+    if (rc < 0) {
+        ERROR("smack_accesses_add");
+        rc = -EINVAL;
+    }
+    return rc;
+}
+
+/**
+ * @brief Apply the changes going from the rules 'from' to the rules 'to'
+ *
+ * @param[in] from The rules loaded
+ * @param[in] to The rules to load
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int apply_delta(const smack_rules_t *from, const smack_rules_t *to) {
+    int rc;
+    size_t count = 0;
+    struct smack_accesses *smack_accesses = NULL;
+
+    rc = smack_accesses_new(&smack_accesses);
+    if (rc < 0) {
+        ERROR("smack_accesses_new");
+        return rc;
+    }
+
+    rc = add_delta(smack_accesses, from, to, &count);
+    if (rc < 0) {
+        ERROR("add_delta : %d %s", -rc, strerror(-rc));
+    } else if (count > 0 && smack_enabled()) {
+        rc = smack_accesses_apply(smack_accesses);
+        if (rc < 0) {
+            ERROR("smack_accesses_apply");
+        }
+    }
+
+    DEBUG("%zu smack rule(s) changed", count);
+    smack_accesses_free(smack_accesses);
+    return rc;
+}
+
+/**
+ * @brief Hash the subject and the object of a rule
+ *
+ * @param[in] rule The rule
+ * @return the hash
+ */
+__nonnull() __wur static size_t hash_rule(const smack_rule_t *rule) {
+    return hash_string(rule->subject, strlen(rule->subject), false) * 31 +
+           hash_string(rule->object, strlen(rule->object), false);
+}
+
+/**
+ * @brief Add a rule to a set, replacing the rule of same subject and object
+ *
+ * @param[in] set The set of rules
+ * @param[in] rule The rule to add (not copied)
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int rule_set_add(smack_rule_set_t *set, const smack_rule_t *rule) {
+    size_t mask, i;
+
+    /* keep the load under 1/2 */
+    if (2 * (set->count + 1) > set->capacity) {
+        size_t capacity = set->capacity ? 2 * set->capacity : 1024;
+        const smack_rule_t **slots = calloc(capacity, sizeof(*slots));
+        if (slots == NULL) {
+            ERROR("calloc rules");
+            return -ENOMEM;
+        }
+        for (size_t j = 0; j < set->capacity; j++) {
+            if (set->slots[j] != NULL) {
+                for (i = hash_rule(set->slots[j]) & (capacity - 1); slots[i] != NULL; i = (i + 1) & (capacity - 1));
+                slots[i] = set->slots[j];
+            }
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+
+    mask = set->capacity - 1;
+    for (i = hash_rule(rule) & mask; set->slots[i] != NULL; i = (i + 1) & mask) {
+        if (!strcmp(set->slots[i]->subject, rule->subject) && !strcmp(set->slots[i]->object, rule->object)) {
+            set->slots[i] = rule;
+            return 0;
+        }
+    }
+    set->slots[i] = rule;
+    set->count++;
+    return 0;
+}
+
+/**
+ * @brief Compare two names for qsort
+ */
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Get the sorted names of the rule files of a directory
+ *
+ * @param[in] dir The directory
+ * @param[out] names The allocated array of allocated names
+ * @param[out] count The count of names
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int list_rule_files(const char *dir, char ***names, size_t *count) {
+    size_t capacity = 0, len;
+    struct dirent *entry;
+    char **array;
+    int rc = 0;
+
+    *names = NULL;
+    *count = 0;
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        rc = -errno;
+        ERROR("opendir %s : %d %s", dir, -rc, strerror(-rc));
+        return rc;
+    }
+
+    while ((entry = readdir(d)) != NULL) {
+        len = strlen(entry->d_name);
+        if (len <= sizeof(SMACK_EXTENSION) || entry->d_name[len - sizeof(SMACK_EXTENSION)] != '.' ||
+            strcmp(&entry->d_name[len - sizeof(SMACK_EXTENSION) + 1], SMACK_EXTENSION) ||
+            (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN))
+            continue;
+
+        if (*count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            array = realloc(*names, capacity * sizeof(*array));
+            if (array == NULL) {
+                ERROR("realloc names");
+                rc = -ENOMEM;
+                break;
+            }
+            *names = array;
+        }
+        (*names)[*count] = strdup(entry->d_name);
+        if ((*names)[*count] == NULL) {
+            ERROR("strdup name");
+            rc = -ENOMEM;
+            break;
+        }
+        (*count)++;
+    }
+    closedir(d);
+
+    /* the rules of the last files win, as when loaded file by file */
+    if (*count > 0)
+        qsort(*names, *count, sizeof(**names), compare_names);
+    return rc;
+}
+
+/**
+ * @brief Write a batch of rules to a file of smackfs
+ * The kernel reads at most a page minus one byte per write and only takes
+ * complete lines: the remaining part is written again.
+ *
+ * @param[in] fd The file of smackfs
+ * @param[in] buffer The rules
+ * @param[in] size The size of the rules
+ * @param[in,out] stats The counters
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int write_batch(int fd, const char *buffer, size_t size, smack_restore_stats_t *stats) {
+    ssize_t len;
+
+    for (size_t pos = 0; pos < size;) {
+        len = write(fd, buffer + pos, size - pos);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return len < 0 ? -errno : -EIO;
+        pos += (size_t)len;
+        stats->writes++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write rules to a file of smackfs, as many as possible per write
+ * The file is only opened if there are rules to write.
+ *
+ * @param[in] file The file of smackfs
+ * @param[in] set The rules
+ * @param[in] modify write the rules 'subject object allow deny' (or 'subject object access')
+ * @param[in,out] stats The counters
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int write_rules(const char *file, const smack_rule_set_t *set, bool modify,
+                                         smack_restore_stats_t *stats) {
+    size_t batch = (size_t)sysconf(_SC_PAGESIZE) - 1;
+    size_t size = 0;
+    char *buffer = NULL;
+    int n, fd = -1, rc = 0;
+
+    for (size_t i = 0; rc >= 0 && i < set->capacity; i++) {
+        const smack_rule_t *rule = set->slots[i];
+        if (rule == NULL || (rule->deny != NULL) != modify)
+            continue;
+
+        if (fd < 0) {
+            buffer = malloc(batch);
+            if (buffer == NULL) {
+                ERROR("malloc batch");
+                rc = -ENOMEM;
+                goto end;
+            }
+            fd = open(file, O_WRONLY | O_CLOEXEC);
+            if (fd < 0) {
+                rc = -errno;
+                ERROR("open %s : %d %s", file, -rc, strerror(-rc));
+                goto end;
+            }
+        }
+
+        for (;;) {
+            if (modify)
+                n = snprintf(buffer + size, batch - size, "%s %s %s %s\n", rule->subject, rule->object, rule->access,
+                             rule->deny);
+            else
+                n = snprintf(buffer + size, batch - size, "%s %s %s\n", rule->subject, rule->object, rule->access);
+            if (n >= 0 && (size_t)n < batch - size) {
+                size += (size_t)n;
+                stats->loaded++;
+                break;
+            }
+            if (size == 0) {
+                ERROR("smack rule too long %s %s", rule->subject, rule->object);
+                break;
+            }
+            /* the batch is full */
+            rc = write_batch(fd, buffer, size, stats);
+            size = 0;
+            if (rc < 0)
+                break;
+        }
+    }
+
+    if (rc >= 0 && size > 0)
+        rc = write_batch(fd, buffer, size, stats);
+    if (rc < 0) {
+        ERROR("write %s : %d %s", file, -rc, strerror(-rc));
+    }
+
+end:
+    if (fd >= 0)
+        close(fd);
+    free(buffer);
+    return rc;
+}
+
 /**********************/
 /*** PUBLIC METHODS ***/
 /**********************/
@@ -178,16 +671,26 @@ void init_path_type_definitions(path_type_definitions_t path_type_definitions[nu
     path_type_definitions[type_id].is_transmute = true;
     path_type_definitions[type_lib].is_transmute = true;
     path_type_definitions[type_public].is_transmute = true;
+
+    // recursive
+    for (int type = type_none; type < number_path_type; type++) {
+        path_type_definitions[type].is_recursive = is_label_tree_path_type(type);
+    }
 }
 
 /* see smack-template.h */
 int create_smack_rules(const secure_app_t *secure_app) {
     int rc = 0;
     int rc2 = 0;
-    struct smack_accesses *smack_accesses = NULL;
+    char *rules = NULL;
+    char *loaded = NULL;
+    size_t size = 0;
+    smack_rules_t new_rules = {.rules = NULL, .count = 0, .text = NULL};
+    smack_rules_t old_rules = {.rules = NULL, .count = 0, .text = NULL};
     char smack_policy_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR];
     char smack_rules_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
     char smack_template_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    bool exists;
 
     secure_strncpy(smack_policy_dir, get_smack_policy_dir(NULL), SEC_LSM_MANAGER_MAX_SIZE_DIR);
     secure_strncpy(smack_template_file, get_smack_template_file(NULL), SEC_LSM_MANAGER_MAX_SIZE_PATH);
@@ -195,50 +698,54 @@ int create_smack_rules(const secure_app_t *secure_app) {
     snprintf(smack_rules_file, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s.%s", smack_policy_dir, secure_app->id,
              SMACK_EXTENSION);
 
-    rc = process_template(smack_template_file, smack_rules_file, secure_app);
+    rc = render_rules(smack_template_file, secure_app, &rules, &size);
     if (rc < 0) {
-        ERROR("process_template : %d %s", -rc, strerror(-rc));
+        ERROR("render_rules : %d %s", -rc, strerror(-rc));
         goto end;
     }
 
-    int fd = open(smack_rules_file, O_RDONLY);
-    if (fd < 0) {
-        rc = -errno;
-        ERROR("open file %s : %d %s", smack_rules_file, -rc, strerror(-rc));
-        goto error;
+    rc = parse_rules(rules, &new_rules);
+    if (rc < 0) {
+        ERROR("parse_rules : %d %s", -rc, strerror(-rc));
+        goto end;
     }
 
-    rc = smack_accesses_new(&smack_accesses);
-    if (rc < 0) {
-        ERROR("smack_accesses_new");
-        goto error;
+    // rules of a previous install: only the differences are loaded
+    get_file_informations(smack_rules_file, &exists, NULL, NULL);
+    if (exists) {
+        loaded = read_file(smack_rules_file);
+        if (loaded == NULL || parse_rules(loaded, &old_rules) < 0) {
+            ERROR("can't read the previous rules %s, loading all the rules", smack_rules_file);
+        }
     }
 
-    rc = smack_accesses_add_from_file(smack_accesses, fd);
+    rc = apply_delta(&old_rules, &new_rules);
     if (rc < 0) {
-        ERROR("smack_accesses_add_from_file");
-        goto error;
+        ERROR("apply_delta : %d %s", -rc, strerror(-rc));
+        goto end;
     }
 
-    if (smack_enabled()) {
-        rc = smack_accesses_apply(smack_accesses);
-        if (rc < 0) {
-            ERROR("smack_accesses_apply");
-            goto error;
-        }
+    // the file is written from the same buffer, never partially
+    rc = write_file(smack_rules_file, rules, size);
+    if (rc < 0) {
+        ERROR("write_file %s : %d %s", smack_rules_file, -rc, strerror(-rc));
+        goto error;
     }
 
     DEBUG("create_smack_rules success");
     goto end;
 
 error:
-    rc2 = remove(smack_rules_file);
+    // back to the rules of the file
+    rc2 = apply_delta(&new_rules, &old_rules);
     if (rc2 < 0) {
-        ERROR("remove %s : %d %s", smack_rules_file, errno, strerror(errno));
+        ERROR("apply_delta : %d %s", -rc2, strerror(-rc2));
     }
 end:
-    smack_accesses_free(smack_accesses);
-    smack_accesses = NULL;
+    free_rules(&old_rules);
+    free_rules(&new_rules);
+    free(loaded);
+    free(rules);
     return rc;
 }
 
@@ -266,3 +773,76 @@ int remove_smack_rules(const secure_app_t *secure_app) {
 
     return rc;
 }
+
+/* see smack-template.h */
+int restore_smack_rules(smack_restore_stats_t *stats) {
+    struct timespec start, end;
+    smack_rule_set_t set = {.slots = NULL, .capacity = 0, .count = 0};
+    smack_rules_t *files = NULL;
+    char **names = NULL;
+    size_t count = 0;
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    const char *dir, *smackfs;
+    char *text;
+    int rc;
+
+    memset(stats, 0, sizeof(*stats));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    smackfs = smack_smackfs_path();
+    dir = get_smack_policy_dir(NULL);
+    if (smackfs == NULL || dir == NULL) {
+        ERROR("smack not enabled or no policy directory");
+        return -ENOTSUP;
+    }
+
+    rc = list_rule_files(dir, &names, &count);
+    if (rc < 0)
+        goto end;
+
+    files = calloc(count ?: 1, sizeof(*files));
+    if (files == NULL) {
+        ERROR("calloc files");
+        rc = -ENOMEM;
+        goto end;
+    }
+
+    /* read all the rules, the last one of a subject and object wins */
+    for (size_t i = 0; rc >= 0 && i < count; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        text = read_file(path);
+        if (text == NULL || parse_rules(text, &files[i]) < 0) {
+            ERROR("can't read the rules %s, skipped", path);
+            free(text);
+            continue;
+        }
+        free(text);
+        stats->files++;
+        stats->rules += files[i].count;
+        for (size_t j = 0; rc >= 0 && j < files[i].count; j++)
+            rc = rule_set_add(&set, &files[i].rules[j]);
+    }
+
+    if (rc >= 0) {
+        snprintf(path, sizeof(path), "%s/load2", smackfs);
+        rc = write_rules(path, &set, false, stats);
+    }
+    if (rc >= 0) {
+        snprintf(path, sizeof(path), "%s/change-rule", smackfs);
+        rc = write_rules(path, &set, true, stats);
+    }
+
+end:
+    for (size_t i = 0; files != NULL && i < count; i++)
+        free_rules(&files[i]);
+    for (size_t i = 0; i < count; i++)
+        free(names[i]);
+    free(files);
+    free(names);
+    free(set.slots);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->elapsed_us = (uint64_t)((int64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+                                   ((int64_t)end.tv_nsec - (int64_t)start.tv_nsec) / 1000);
+    return rc;
+}
@@ -24,6 +24,7 @@
 #ifndef SEC_LSM_MANAGER_SMACK_TEMPLATE_H
 #define SEC_LSM_MANAGER_SMACK_TEMPLATE_H
 
+#include <stdint.h>
 #include <sys/cdefs.h>
 
 #include "secure-app.h"
@@ -40,8 +41,20 @@ typedef struct path_type_definitions {
     char label[SEC_LSM_MANAGER_MAX_SIZE_LABEL];
     bool is_executable;
     bool is_transmute;
+    bool is_recursive;
 } path_type_definitions_t;
 
+/**
+ * @brief Counters of a restore of the smack rules
+ */
+typedef struct smack_restore_stats {
+    unsigned long files;   /* rule files read */
+    unsigned long rules;   /* rules read */
+    unsigned long loaded;  /* distinct rules loaded */
+    unsigned long writes;  /* writes to smackfs */
+    uint64_t elapsed_us;   /* duration of the restore in microseconds */
+} smack_restore_stats_t;
+
 /**
  * @brief Get the selinux template file
  *
@@ -92,4 +105,15 @@ extern int create_smack_rules(const secure_app_t *secure_app) __wur __nonnull();
  */
 extern int remove_smack_rules(const secure_app_t *secure_app) __wur __nonnull();
 
+/**
+ * @brief Load in the kernel the rules of all the files of the smack policy directory
+ * The rules are read from all the files before being loaded, a rule of same
+ * subject and object as a previous one replaces it, and they are written to
+ * smackfs in writes of many rules. Invalid files are reported and skipped.
+ *
+ * @param[out] stats the counters of the restore
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int restore_smack_rules(smack_restore_stats_t *stats) __wur __nonnull();
+
 #endif
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <sys/stat.h>
 
+#include "label-tree.h"
 #include "log.h"
 #include "smack-template.h"
 #include "utils.h"
@@ -40,13 +41,13 @@
 /***********************/
 
 /**
- * @brief Label an executable file
+ * @brief Get the label used when executing a file
  *
- * @param[in] path The path of the file
- * @param[in] label The label that will be used when exec
+ * @param[in] label The label of the file
+ * @param[out] label_no_exec The label without :Exec
  * @return 0 in case of success or a negative -errno value
  */
-__nonnull() __wur static int label_exec(const char *path, const char *label) {
+__nonnull() __wur static int get_exec_label(const char *label, char label_no_exec[SEC_LSM_MANAGER_MAX_SIZE_LABEL]) {
     char *test_exec = strstr(label, suffix_exec);
     if (test_exec == NULL || strcmp(test_exec, suffix_exec)) {
         ERROR("%s not end with %s", label, suffix_exec)
@@ -54,14 +55,26 @@ __nonnull() __wur static int label_exec(const char *path, const char *label) {
     }
 
     // remove :Exec (SMACK64EXEC)
-    char *label_no_exec = strdupa(label);
-    if (!label_no_exec) {
-        return -ENOMEM;
-    }
-
+    secure_strncpy(label_no_exec, label, SEC_LSM_MANAGER_MAX_SIZE_LABEL);
     label_no_exec[strlen(label_no_exec) - strlen(suffix_exec)] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Label an executable file
+ *
+ * @param[in] path The path of the file
+ * @param[in] label The label that will be used when exec
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int label_exec(const char *path, const char *label) {
+    char label_no_exec[SEC_LSM_MANAGER_MAX_SIZE_LABEL];
+    int rc = get_exec_label(label, label_no_exec);
+    if (rc < 0) {
+        return rc;
+    }
 
-    int rc = set_label(path, XATTR_NAME_SMACKEXEC, label_no_exec);
+    rc = set_label(path, XATTR_NAME_SMACKEXEC, label_no_exec);
     if (rc < 0) {
         ERROR("set_smack(%s,%s,%s) : %d %s", path, XATTR_NAME_SMACKEXEC, label_no_exec, -rc, strerror(-rc));
         return rc;
@@ -118,6 +131,72 @@ static int label_path(const char *path, const char *label, int is_executable, in
     return 0;
 }
 
+/**
+ * @brief Label a file of a tree (see label_tree)
+ *
+ * @param[in] fd The descriptor of the file
+ * @param[in] name The name of the file
+ * @param[in] st The status of the file
+ * @param[in] closure The path type definition of the tree
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int label_tree_file(int fd, const char *name, const struct stat *st, void *closure) {
+    const path_type_definitions_t *definition = closure;
+    char label_no_exec[SEC_LSM_MANAGER_MAX_SIZE_LABEL];
+
+    int rc = set_label_fd(fd, XATTR_NAME_SMACK, definition->label);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // exec
+    if (definition->is_executable && S_ISREG(st->st_mode) && (st->st_mode & (S_IXUSR | S_IXGRP))) {
+        rc = get_exec_label(definition->label, label_no_exec);
+        if (rc < 0) {
+            return rc;
+        }
+        rc = set_label_fd(fd, XATTR_NAME_SMACKEXEC, label_no_exec);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    // dir
+    if (definition->is_transmute && S_ISDIR(st->st_mode)) {
+        rc = set_label_fd(fd, XATTR_NAME_SMACKTRANSMUTE, "TRUE");
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    DEBUG("label %s : %s", name, definition->label);
+    return 0;
+}
+
+/**
+ * @brief Label a path and, if its type is recursive, its content
+ *
+ * @param[in] path The path
+ * @param[in] definition The definition of the type of the path
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int label_path_tree(const char *path, path_type_definitions_t *definition) {
+    int rc = label_path(path, definition->label, definition->is_executable, definition->is_transmute);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (definition->is_recursive) {
+        rc = label_tree(path, label_tree_file, definition, NULL);
+        if (rc < 0) {
+            ERROR("label_tree(%s,%s) : %d %s", path, definition->label, -rc, strerror(-rc));
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * @brief Set smack labels for secure app
  *
@@ -130,12 +209,10 @@ __nonnull() __wur static int smack_set_path_labels(const secure_app_t *secure_ap
     path_t *path = NULL;
     for (size_t i = 0; i < secure_app->path_set.size; i++) {
         path = secure_app->path_set.paths[i];
-        rc = label_path(path->path, path_type_definitions[path->path_type].label,
-                        path_type_definitions[path->path_type].is_executable,
-                        path_type_definitions[path->path_type].is_transmute);
+        rc = label_path_tree(path->path, &path_type_definitions[path->path_type]);
 
         if (rc < 0) {
-            ERROR("label_path((%s,%s),%s) : %d %s", secure_app->path_set.paths[i]->path,
+            ERROR("label_path_tree((%s,%s),%s) : %d %s", secure_app->path_set.paths[i]->path,
                   get_path_type_string(secure_app->path_set.paths[i]->path_type), secure_app->id, -rc, strerror(-rc));
             return rc;
         }
@@ -153,11 +230,13 @@ __nonnull() __wur static int smack_set_path_labels(const secure_app_t *secure_ap
 __nonnull() __wur static int smack_drop_path_labels(const secure_app_t *secure_app) {
     int rc = 0;
     path_t *path = NULL;
+    path_type_definitions_t drop = {.label = DROP_LABEL, .is_executable = false, .is_transmute = false};
     for (size_t i = 0; i < secure_app->path_set.size; i++) {
         path = secure_app->path_set.paths[i];
-        rc = label_path(path->path, DROP_LABEL, 0, 0);
+        drop.is_recursive = is_label_tree_path_type(path->path_type);
+        rc = label_path_tree(path->path, &drop);
         if (rc < 0) {
-            ERROR("label_path((%s,%s),%s) : %d %s", secure_app->path_set.paths[i]->path,
+            ERROR("label_path_tree((%s,%s),%s) : %d %s", secure_app->path_set.paths[i]->path,
                   get_path_type_string(secure_app->path_set.paths[i]->path_type), secure_app->id, -rc, strerror(-rc));
             return rc;
         }
@@ -192,7 +271,9 @@ int install_smack(const secure_app_t *secure_app) {
         goto error;
     }
 
-    DEBUG("install smack success");
+    label_stats_t label_stats;
+    get_label_stats(&label_stats);
+    DEBUG("install smack success (labels written %lu, skipped %lu)", label_stats.written, label_stats.skipped);
 
     goto end;
 
@@ -21,11 +21,15 @@
  * $RP_END_LICENSE$
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -36,9 +40,79 @@
 #include "utils.h"
 #include "template.h"
 
-static int put(void *closure, const char *name, int escape, FILE *file) {
-    (void)escape;
-    const secure_app_t *secure_app = (const secure_app_t *)closure;
+/** kind of the compiled operations */
+typedef enum template_op_kind {
+    op_text,     /* copy a span of the template */
+    op_put,      /* put the value of a variable */
+    op_section,  /* enter a section if the permission is set */
+    op_inverted, /* enter a section if the permission is not set */
+    op_end       /* end of a section */
+} template_op_kind_t;
+
+/** a compiled operation */
+typedef struct template_op {
+    /** kind of the operation */
+    template_op_kind_t kind;
+
+    /** offset of the span in the text or of the name in the names */
+    size_t offset;
+
+    /** length of the span */
+    size_t length;
+
+    /** for sections, index of their op_end */
+    size_t end;
+} template_op_t;
+
+typedef struct template_entry template_entry_t;
+
+/** a template of the cache */
+struct template_entry {
+    /** next template of the cache */
+    template_entry_t *next;
+
+    /** count of references (the cache and the renderings) */
+    unsigned refcount;
+
+    /** watch descriptor of the directory or -1 */
+    int wd;
+
+    /** status of the file when loaded */
+    struct stat stat;
+
+    /** content of the file */
+    char *text;
+
+    /** compiled operations or NULL if the template can only be processed by mustach */
+    template_op_t *ops;
+
+    /** count of operations */
+    size_t count;
+
+    /** names of the variables and sections, zero terminated */
+    char *names;
+
+    /** path of the template */
+    char path[];
+};
+
+/** the cache of the templates */
+static struct {
+    /** protects the cache */
+    pthread_mutex_t mutex;
+
+    /** the templates */
+    template_entry_t *entries;
+
+    /** the inotify file descriptor or -1 */
+    int fd;
+} template_cache = {.mutex = PTHREAD_MUTEX_INITIALIZER, .entries = NULL, .fd = -1};
+
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+static void put_value(const secure_app_t *secure_app, const char *name, FILE *file) {
     // DEBUG("name : %s", name);
 
     if (!strcmp(name, "id")) {
@@ -46,18 +120,20 @@ static int put(void *closure, const char *name, int escape, FILE *file) {
     } else if (!strcmp(name, "id_underscore")) {
         fputs(secure_app->id_underscore, file);
     }
+}
 
+static int put(void *closure, const char *name, int escape, FILE *file) {
+    (void)escape;
+    put_value((const secure_app_t *)closure, name, file);
     return 0;
 }
 
+static bool has_section(const secure_app_t *secure_app, const char *name) {
+    return permission_set_has_permission(&(secure_app->permission_set), name, true);
+}
+
 static int enter(void *closure, const char *name) {
-    const secure_app_t *secure_app = (const secure_app_t *)closure;
-    for (size_t i = 0; i < secure_app->permission_set.size; i++) {
-        if (!strcasecmp(name, secure_app->permission_set.permissions[i])) {
-            return 1;
-        }
-    }
-    return 0;
+    return has_section((const secure_app_t *)closure, name);
 }
 
 static int leave(void *closure) {
@@ -74,33 +150,483 @@ static int next(void *closure) {
 
 static struct mustach_itf itf = {.enter = enter, .put = put, .next = next, .leave = leave};
 
+/**
+ * @brief Append an operation to a template
+ *
+ * @param[in] entry the template
+ * @param[in] kind the kind of the operation
+ * @param[in] offset the offset of its span in the text
+ * @param[in] length the length of its span
+ * @param[in,out] size the count of allocated names
+ * @return the index of the operation or a negative -errno value
+ */
+__nonnull() __wur static long add_op(template_entry_t *entry, template_op_kind_t kind, size_t offset, size_t length,
+                                     size_t *size) {
+    template_op_t *ops = realloc(entry->ops, (entry->count + 1) * sizeof(*ops));
+    if (ops == NULL) {
+        return -ENOMEM;
+    }
+    entry->ops = ops;
+
+    // names are copied with a terminating zero
+    if (kind != op_text) {
+        char *names = realloc(entry->names, *size + length + 1);
+        if (names == NULL) {
+            return -ENOMEM;
+        }
+        memcpy(names + *size, entry->text + offset, length);
+        names[*size + length] = '\0';
+        entry->names = names;
+        offset = *size;
+        *size += length + 1;
+    }
+
+    ops[entry->count] = (template_op_t){.kind = kind, .offset = offset, .length = length, .end = 0};
+    return (long)entry->count++;
+}
+
+/**
+ * @brief Compile the text of a template in a list of operations
+ * The parsing follows the one of mustach, except that the partials
+ * are not supported: such templates stay processed by mustach.
+ *
+ * @param[in] entry the template
+ * @return 0 in case of success, a negative mustach error or -ENOTSUP
+ */
+__nonnull() __wur static int compile(template_entry_t *entry) {
+    const char *text = entry->text, *opstr = "{{", *clstr = "}}", *beg, *term;
+    size_t oplen = 2, cllen = 2, len, l, size = 0, length = strlen(text);
+    size_t stack[MUSTACH_MAX_DEPTH];
+    size_t depth = 0;
+    long index;
+    char c;
+
+    for (;;) {
+        beg = memmem(text, length - (size_t)(text - entry->text), opstr, oplen);
+        if (beg == NULL) {
+            /* no more mustach */
+            if (text[0] && add_op(entry, op_text, (size_t)(text - entry->text), strlen(text), &size) < 0)
+                return -ENOMEM;
+            return depth ? MUSTACH_ERROR_UNEXPECTED_END : 0;
+        }
+        if (beg != text && add_op(entry, op_text, (size_t)(text - entry->text), (size_t)(beg - text), &size) < 0)
+            return -ENOMEM;
+        beg += oplen;
+        term = memmem(beg, length - (size_t)(beg - entry->text), clstr, cllen);
+        if (term == NULL)
+            return MUSTACH_ERROR_UNEXPECTED_END;
+        text = term + cllen;
+        len = (size_t)(term - beg);
+        c = *beg;
+        switch (c) {
+            case '!':
+            case '=':
+                break;
+            case '{':
+                for (l = 0; l < cllen && clstr[l] == '}'; l++)
+                    ;
+                if (l < cllen) {
+                    if (!len || beg[len - 1] != '}')
+                        return MUSTACH_ERROR_BAD_UNESCAPE_TAG;
+                    len--;
+                } else {
+                    if (term[l] != '}')
+                        return MUSTACH_ERROR_BAD_UNESCAPE_TAG;
+                    text++;
+                }
+                c = '&';
+                /*@fallthrough@*/
+            case '^':
+            case '#':
+            case '/':
+            case '&':
+            case '>':
+            case ':':
+                beg++;
+                len--;
+                /*@fallthrough@*/
+            default:
+                while (len && isspace(beg[0])) {
+                    beg++;
+                    len--;
+                }
+                while (len && isspace(beg[len - 1])) len--;
+                if (len == 0)
+                    return MUSTACH_ERROR_EMPTY_TAG;
+                if (len > MUSTACH_MAX_LENGTH)
+                    return MUSTACH_ERROR_TAG_TOO_LONG;
+                break;
+        }
+        switch (c) {
+            case '!':
+                /* comment */
+                break;
+            case '=':
+                /* defines separators */
+                if (len < 5 || beg[len - 1] != '=')
+                    return MUSTACH_ERROR_BAD_SEPARATORS;
+                beg++;
+                len -= 2;
+                for (l = 0; l < len && !isspace(beg[l]); l++)
+                    ;
+                if (l == len)
+                    return MUSTACH_ERROR_BAD_SEPARATORS;
+                opstr = beg;
+                oplen = l;
+                while (l < len && isspace(beg[l])) l++;
+                if (l == len)
+                    return MUSTACH_ERROR_BAD_SEPARATORS;
+                clstr = beg + l;
+                cllen = len - l;
+                break;
+            case '^':
+            case '#':
+                /* begin section */
+                if (depth == MUSTACH_MAX_DEPTH)
+                    return MUSTACH_ERROR_TOO_DEEP;
+                index = add_op(entry, c == '#' ? op_section : op_inverted, (size_t)(beg - entry->text), len, &size);
+                if (index < 0)
+                    return -ENOMEM;
+                stack[depth++] = (size_t)index;
+                break;
+            case '/':
+                /* end section */
+                if (depth-- == 0 || len != entry->ops[stack[depth]].length ||
+                    memcmp(entry->names + entry->ops[stack[depth]].offset, beg, len))
+                    return MUSTACH_ERROR_CLOSING;
+                index = add_op(entry, op_end, (size_t)(beg - entry->text), len, &size);
+                if (index < 0)
+                    return -ENOMEM;
+                entry->ops[stack[depth]].end = (size_t)index;
+                break;
+            case '>':
+                /* partials */
+                return -ENOTSUP;
+            default:
+                /* replacement */
+                if (add_op(entry, op_put, (size_t)(beg - entry->text), len, &size) < 0)
+                    return -ENOMEM;
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Render a compiled template
+ *
+ * @param[in] entry the template
+ * @param[in] file the output
+ * @param[in] secure_app the secure app
+ * @return 0 in case of success or MUSTACH_ERROR_SYSTEM
+ */
+__nonnull() __wur static int render(const template_entry_t *entry, FILE *file, const secure_app_t *secure_app) {
+    const template_op_t *op;
+    bool entered;
+
+    for (size_t i = 0; i < entry->count; i++) {
+        op = &entry->ops[i];
+        switch (op->kind) {
+            case op_text:
+                if (fwrite(entry->text + op->offset, op->length, 1, file) != 1)
+                    return MUSTACH_ERROR_SYSTEM;
+                break;
+            case op_put:
+                put_value(secure_app, entry->names + op->offset, file);
+                break;
+            case op_section:
+            case op_inverted:
+                entered = has_section(secure_app, entry->names + op->offset);
+                if (entered != (op->kind == op_section))
+                    i = op->end;
+                break;
+            case op_end:
+                break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Release a reference to a template
+ * Must be called with the mutex of the cache locked.
+ *
+ * @param[in] entry the template
+ */
+__nonnull() static void unref_entry(template_entry_t *entry) {
+    if (--entry->refcount == 0) {
+        free(entry->text);
+        free(entry->ops);
+        free(entry->names);
+        free(entry);
+    }
+}
+
+/**
+ * @brief Check if the file of a template is still the one loaded
+ *
+ * @param[in] entry the template
+ * @return true if the file didn't change
+ */
+__nonnull() __wur static bool is_fresh(const template_entry_t *entry) {
+    struct stat st;
+
+    // changes are notified by inotify
+    if (entry->wd >= 0)
+        return true;
+
+    return stat(entry->path, &st) == 0 && st.st_ino == entry->stat.st_ino && st.st_dev == entry->stat.st_dev &&
+           st.st_size == entry->stat.st_size && st.st_mtim.tv_sec == entry->stat.st_mtim.tv_sec &&
+           st.st_mtim.tv_nsec == entry->stat.st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Watch the directory of a template
+ * Must be called with the mutex of the cache locked.
+ *
+ * @param[in] entry the template
+ */
+__nonnull() static void watch_entry(template_entry_t *entry) {
+    char dir[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char *slash;
+
+    if (template_cache.fd < 0)
+        return;
+
+    secure_strncpy(dir, entry->path, SEC_LSM_MANAGER_MAX_SIZE_PATH);
+    slash = strrchr(dir, '/');
+    if (slash == NULL)
+        secure_strncpy(dir, ".", SEC_LSM_MANAGER_MAX_SIZE_PATH);
+    else
+        slash[slash == dir] = '\0';
+
+    entry->wd = inotify_add_watch(template_cache.fd, dir,
+                                  IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB);
+    if (entry->wd < 0) {
+        ERROR("inotify_add_watch %s : %d %s", dir, errno, strerror(errno));
+    }
+}
+
+/**
+ * @brief Load and compile a template and put it in the cache
+ * A template of the same path already in the cache is replaced.
+ *
+ * @param[in] path the path of the template
+ * @param[out] result the template with a reference for the caller or NULL
+ * @return 0 in case of success or a negative -errno value
+ */
+__wur static int load_entry(const char *path, template_entry_t **result) {
+    template_entry_t *entry, **prev;
+    int rc;
+
+    entry = calloc(1, sizeof(*entry) + strlen(path) + 1);
+    if (entry == NULL) {
+        ERROR("calloc template_entry_t");
+        return -ENOMEM;
+    }
+    strcpy(entry->path, path);
+    entry->wd = -1;
+
+    // status first, a change while reading is seen later
+    if (stat(path, &entry->stat) < 0 || (entry->text = read_file(path)) == NULL) {
+        ERROR("read_file : %s", path);
+        free(entry);
+        return -EINVAL;
+    }
+
+    rc = compile(entry);
+    if (rc < 0) {
+        DEBUG("template %s processed by mustach : %d", path, rc);
+        free(entry->ops);
+        free(entry->names);
+        entry->ops = NULL;
+        entry->names = NULL;
+        entry->count = 0;
+    }
+
+    pthread_mutex_lock(&template_cache.mutex);
+    for (prev = &template_cache.entries; *prev != NULL; prev = &(*prev)->next) {
+        if (!strcmp((*prev)->path, path)) {
+            template_entry_t *old = *prev;
+            *prev = old->next;
+            unref_entry(old);
+            break;
+        }
+    }
+    watch_entry(entry);
+    entry->next = template_cache.entries;
+    template_cache.entries = entry;
+    entry->refcount = 1;
+    if (result != NULL) {
+        entry->refcount++;
+        *result = entry;
+    }
+    pthread_mutex_unlock(&template_cache.mutex);
+    return 0;
+}
+
+/**
+ * @brief Get a template from the cache, loading it if needed
+ *
+ * @param[in] path the path of the template
+ * @param[out] result the template with a reference for the caller
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int get_entry(const char *path, template_entry_t **result) {
+    template_entry_t *entry;
+
+    pthread_mutex_lock(&template_cache.mutex);
+    for (entry = template_cache.entries; entry != NULL && strcmp(entry->path, path); entry = entry->next)
+        ;
+    if (entry != NULL && is_fresh(entry)) {
+        entry->refcount++;
+        *result = entry;
+        pthread_mutex_unlock(&template_cache.mutex);
+        return 0;
+    }
+    pthread_mutex_unlock(&template_cache.mutex);
+
+    return load_entry(path, result);
+}
+
+/**
+ * @brief Drop a template from the cache
+ * Must be called with the mutex of the cache locked.
+ *
+ * @param[in] entry the template
+ */
+__nonnull() static void drop_entry(template_entry_t *entry) {
+    template_entry_t **prev = &template_cache.entries;
+    while (*prev != entry) prev = &(*prev)->next;
+    *prev = entry->next;
+    unref_entry(entry);
+}
+
+/**********************/
+/*** PUBLIC METHODS ***/
+/**********************/
+
+/* see template.h */
 int process_template(const char *template_path, const char *dest, const secure_app_t *secure_app) {
     int rc = 0;
     int rc2 = 0;
-    char *template = read_file(template_path);
-    if (template == NULL) {
-        ERROR("read_file : %s", template_path);
-        return -EINVAL;
-    }
 
     FILE *f_dest = fopen(dest, "w");
     if (f_dest == NULL) {
         ERROR("fopen : %s", dest);
-        rc = -EINVAL;
-        goto end;
+        return -EINVAL;
     }
 
-    rc = fmustach(template, &itf, (void*)secure_app, f_dest);
-    if (rc < 0) {
-        ERROR("fmustach : %d %s", errno, strerror(errno));
-    }
+    rc = fprocess_template(template_path, f_dest, secure_app);
 
     rc2 = fclose(f_dest);
     if (rc2 < 0) {
         ERROR("fclose %s : %d %s", dest, errno, strerror(errno));
     }
 
-end:
-    free(template);
+    if (rc < 0) {
+        unlink(dest);
+    }
+
+    return rc;
+}
+
+/* see template.h */
+int fprocess_template(const char *template_path, FILE *file, const secure_app_t *secure_app) {
+    template_entry_t *entry;
+    int rc = get_entry(template_path, &entry);
+    if (rc < 0) {
+        ERROR("get_entry : %s", template_path);
+        return rc;
+    }
+
+    if (entry->ops != NULL) {
+        rc = render(entry, file, secure_app);
+    } else {
+        rc = fmustach(entry->text, &itf, (void *)secure_app, file);
+    }
+    if (rc < 0) {
+        ERROR("fmustach : %d %s", errno, strerror(errno));
+    }
+
+    pthread_mutex_lock(&template_cache.mutex);
+    unref_entry(entry);
+    pthread_mutex_unlock(&template_cache.mutex);
     return rc;
-}
\ No newline at end of file
+}
+
+/* see template.h */
+int template_cache_watch(void) {
+    template_entry_t *entry;
+    int rc;
+
+    pthread_mutex_lock(&template_cache.mutex);
+    if (template_cache.fd < 0) {
+        template_cache.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (template_cache.fd < 0) {
+            rc = -errno;
+            ERROR("inotify_init1 : %d %s", -rc, strerror(-rc));
+            pthread_mutex_unlock(&template_cache.mutex);
+            return rc;
+        }
+        for (entry = template_cache.entries; entry != NULL; entry = entry->next) watch_entry(entry);
+    }
+    rc = template_cache.fd;
+    pthread_mutex_unlock(&template_cache.mutex);
+    return rc;
+}
+
+/* see template.h */
+void template_cache_process(void) {
+    char buffer[sizeof(struct inotify_event) + SEC_LSM_MANAGER_MAX_SIZE_PATH]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    char reload[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    const struct inotify_event *event;
+    template_entry_t *entry, *next_entry;
+    const char *name;
+    ssize_t len;
+
+    while ((len = read(template_cache.fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)ptr;
+            reload[0] = '\0';
+
+            pthread_mutex_lock(&template_cache.mutex);
+            for (entry = template_cache.entries; entry != NULL; entry = next_entry) {
+                next_entry = entry->next;
+                if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+                    // lost events or watch: loaded again on next use
+                    if ((event->mask & IN_Q_OVERFLOW) || entry->wd == event->wd)
+                        drop_entry(entry);
+                } else if (entry->wd == event->wd && event->len > 0) {
+                    name = strrchr(entry->path, '/');
+                    name = name == NULL ? entry->path : name + 1;
+                    if (!strcmp(name, event->name)) {
+                        secure_strncpy(reload, entry->path, SEC_LSM_MANAGER_MAX_SIZE_PATH);
+                        drop_entry(entry);
+                        break;
+                    }
+                }
+            }
+            pthread_mutex_unlock(&template_cache.mutex);
+
+            // the new version replaces the old one, unless it is gone
+            if (reload[0] != '\0') {
+                DEBUG("template %s changed", reload);
+                if (access(reload, R_OK) == 0 && load_entry(reload, NULL) < 0) {
+                    ERROR("load_entry : %s", reload);
+                }
+            }
+        }
+    }
+}
+
+/* see template.h */
+void template_cache_clear(void) {
+    pthread_mutex_lock(&template_cache.mutex);
+    while (template_cache.entries != NULL) drop_entry(template_cache.entries);
+    if (template_cache.fd >= 0) {
+        close(template_cache.fd);
+        template_cache.fd = -1;
+    }
+    pthread_mutex_unlock(&template_cache.mutex);
+}
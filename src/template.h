@@ -21,4 +21,51 @@
  * $RP_END_LICENSE$
  */
 
-extern int process_template(const char *template, const char *dest, const secure_app_t *secure_app);
\ No newline at end of file
+#ifndef SEC_LSM_MANAGER_TEMPLATE_H
+#define SEC_LSM_MANAGER_TEMPLATE_H
+
+#include <stdio.h>
+
+#include "secure-app.h"
+
+/**
+ * @brief Render a template in a file
+ * The templates are read and compiled once, then kept in a cache
+ *
+ * @param[in] template the path of the template
+ * @param[in] dest the path of the file to write
+ * @param[in] secure_app the secure app
+ * @return 0 in case of success or a negative value
+ */
+extern int process_template(const char *template, const char *dest, const secure_app_t *secure_app);
+
+/**
+ * @brief Render a template in an open file
+ *
+ * @param[in] template the path of the template
+ * @param[in] file the file to write
+ * @param[in] secure_app the secure app
+ * @return 0 in case of success or a negative value
+ */
+extern int fprocess_template(const char *template, FILE *file, const secure_app_t *secure_app);
+
+/**
+ * @brief Watch the templates of the cache with inotify
+ * Without watch, the status of a template is checked at each use.
+ *
+ * @return the inotify file descriptor to poll or a negative -errno value
+ */
+extern int template_cache_watch(void) __wur;
+
+/**
+ * @brief Process the pending inotify events: the changed templates are
+ * loaded again and replace the old ones in the cache
+ */
+extern void template_cache_process(void);
+
+/**
+ * @brief Empty the cache and stop watching
+ */
+extern void template_cache_clear(void);
+
+#endif
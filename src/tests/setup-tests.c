@@ -19,7 +19,7 @@
 
 #include "../log.c"
 #include "../mustach/mustach.c"
-#include "../template.c"
+#include "../utils.h"
 
 Suite *suite;
 TCase *tcase;
@@ -98,6 +98,30 @@ int main(int argc, char const *argv[]) {
     addtcase("utils");
     test_utils();
 
+    addtcase("worker");
+    test_worker();
+
+    addtcase("arena");
+    test_arena();
+
+    addtcase("label_tree");
+    test_label_tree();
+
+    addtcase("template");
+    test_template();
+
+    addtcase("registry");
+    test_registry();
+
+    addtcase("journal");
+    test_journal();
+
+    addtcase("prot");
+    test_prot();
+
+    addtcase("sec_lsm_manager");
+    test_sec_lsm_manager();
+
 #if !defined(SIMULATE_CYNAGORA)
     addtcase("cynagora");
     test_cynagora();
@@ -112,6 +136,7 @@ int main(int argc, char const *argv[]) {
 #if defined(WITH_SELINUX)
     addtcase("selinux");
     test_selinux_template();
+    test_selinux_cache();
     test_selinux();
 #endif
 
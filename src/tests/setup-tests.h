@@ -28,6 +28,14 @@ extern void test_paths(void);
 extern void test_permissions(void);
 extern void test_secure_app(void);
 extern void test_utils(void);
+extern void test_worker(void);
+extern void test_arena(void);
+extern void test_label_tree(void);
+extern void test_template(void);
+extern void test_registry(void);
+extern void test_journal(void);
+extern void test_prot(void);
+extern void test_sec_lsm_manager(void);
 
 #if !defined(SIMULATE_CYNAGORA)
 extern void test_cynagora();
@@ -40,5 +48,6 @@ extern void test_smack_label(void);
 
 #if defined(WITH_SELINUX)
 extern void test_selinux_template(void);
+extern void test_selinux_cache(void);
 extern void test_selinux(void);
 #endif
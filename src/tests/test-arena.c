@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020-2023 IoT.bzh Company
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include "../arena.c"
+#include "setup-tests.h"
+
+START_TEST(test_arena_alloc) {
+    arena_t arena;
+    init_arena(&arena);
+
+    char *a = arena_alloc(&arena, 3);
+    char *b = arena_alloc(&arena, 10);
+    ck_assert_ptr_ne(a, NULL);
+    ck_assert_ptr_ne(b, NULL);
+    ck_assert_int_eq((int)((uintptr_t)b % ALIGNMENT), 0);
+    ck_assert_int_ge((int)(b - a), 3);
+    ck_assert_int_eq((int)arena.size, ARENA_BLOCK_SIZE);
+
+    // big allocations get their own block
+    char *c = arena_alloc(&arena, 3 * ARENA_BLOCK_SIZE);
+    ck_assert_ptr_ne(c, NULL);
+    ck_assert_int_eq((int)arena.size, 4 * ARENA_BLOCK_SIZE);
+    ck_assert_ptr_eq(arena.current, arena.blocks);
+
+    free_arena(&arena);
+    ck_assert_ptr_eq(arena.blocks, NULL);
+    ck_assert_int_eq((int)arena.size, 0);
+}
+END_TEST
+
+START_TEST(test_arena_reset) {
+    arena_t arena;
+    init_arena(&arena);
+
+    for (int i = 0; i < 100; i++) ck_assert_ptr_ne(arena_alloc(&arena, 1000), NULL);
+    ck_assert_int_gt((int)arena.size, ARENA_KEEP_SIZE);
+
+    // blocks are kept up to the limit and reused
+    arena_reset(&arena);
+    ck_assert_int_eq((int)arena.used, 0);
+    ck_assert_int_le((int)arena.size, ARENA_KEEP_SIZE);
+    size_t size = arena.size;
+    ck_assert_ptr_eq(arena_alloc(&arena, 1000), arena.blocks->data);
+    for (int i = 0; i < 40; i++) ck_assert_ptr_ne(arena_alloc(&arena, 1000), NULL);
+    ck_assert_int_eq((int)arena.size, (int)size);
+
+    free_arena(&arena);
+}
+END_TEST
+
+void test_arena(void) {
+    addtest(test_arena_alloc);
+    addtest(test_arena_reset);
+}
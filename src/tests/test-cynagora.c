@@ -114,7 +114,54 @@ START_TEST(test_cynagora_drop_policies) {
 }
 END_TEST
 
+START_TEST(test_cynagora_update_policies) {
+    cynagora_t *cynagora_admin_client = NULL;
+    char *id = "testid";
+    ck_assert_int_eq(cynagora_create(&cynagora_admin_client, cynagora_Admin, 1, 0), 0);
+
+    permission_set_t permission_set;
+    init_permission_set(&permission_set);
+    ck_assert_int_eq(permission_set_add_permission(&permission_set, "perm1"), 0);
+    ck_assert_int_eq(permission_set_add_permission(&permission_set, "perm2"), 0);
+    ck_assert_int_eq(cynagora_set_policies(cynagora_admin_client, id, &permission_set), 0);
+
+    // perm1 dropped, perm2 kept, perm3 set
+    permission_set_t permission_set2;
+    init_permission_set(&permission_set2);
+    ck_assert_int_eq(permission_set_add_permission(&permission_set2, "perm2"), 0);
+    ck_assert_int_eq(permission_set_add_permission(&permission_set2, "perm3"), 0);
+    ck_assert_int_eq(cynagora_update_policies(cynagora_admin_client, id, &permission_set2), 0);
+    ck_assert_int_eq(cynagora_update_policies(cynagora_admin_client, id, &permission_set2), 0);
+
+    permission_set_t permission_set3;
+    ck_assert_int_eq(cynagora_get_policies(cynagora_admin_client, id, &permission_set3), 0);
+    ck_assert_int_eq(permission_set3.size, 2);
+    ck_assert(!permission_set_has_permission(&permission_set3, "perm1", false));
+    ck_assert(permission_set_has_permission(&permission_set3, "perm2", false));
+    ck_assert(permission_set_has_permission(&permission_set3, "perm3", false));
+
+    ck_assert_int_eq(cynagora_drop_policies(cynagora_admin_client, id), 0);
+
+    free_permission_set(&permission_set);
+    free_permission_set(&permission_set2);
+    free_permission_set(&permission_set3);
+    cynagora_destroy(cynagora_admin_client);
+}
+END_TEST
+
+START_TEST(test_get_cynagora_idle_timeout) {
+    ck_assert_int_eq(get_cynagora_idle_timeout("0"), 0);
+    ck_assert_int_eq(get_cynagora_idle_timeout("120"), 120);
+    ck_assert_int_eq(get_cynagora_idle_timeout("-1"), CYNAGORA_IDLE_TIMEOUT);
+    ck_assert_int_eq(get_cynagora_idle_timeout("1s"), CYNAGORA_IDLE_TIMEOUT);
+    ck_assert(cynagora_link_error(-EPIPE));
+    ck_assert(!cynagora_link_error(-EINVAL));
+}
+END_TEST
+
 void test_cynagora() {
     addtest(test_cynagora_set_policies);
+    addtest(test_cynagora_update_policies);
+    addtest(test_get_cynagora_idle_timeout);
     addtest(test_cynagora_drop_policies);
 }
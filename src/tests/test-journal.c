@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#include "../journal.c"
+#include "setup-tests.h"
+
+static char recovered[1024];
+static int recover_status;
+
+static int record_recover(void *closure, enum journal_op op, secure_app_t *secure_app, unsigned stage) {
+    size_t len = strlen(recovered);
+    (void)closure;
+    snprintf(recovered + len, sizeof(recovered) - len, "%d:%s:%u:%zu:%zu;", (int)op, secure_app->id, stage,
+             secure_app->path_set.size, secure_app->permission_set.size);
+    return recover_status;
+}
+
+static void *run_actions(void *closure) {
+    journal_t *journal = closure;
+    secure_app_t *secure_app;
+    uint32_t seq;
+
+    ck_assert_int_eq(create_secure_app(&secure_app), 0);
+    ck_assert_int_eq(secure_app_set_id(secure_app, "app"), 0);
+    for (int i = 0; i < 10; i++) {
+        ck_assert_int_eq(journal_begin(journal, journal_install, secure_app, &seq), 0);
+        journal_stage(journal, seq, 1);
+        journal_end(journal, seq);
+    }
+    destroy_secure_app(secure_app);
+    return NULL;
+}
+
+START_TEST(test_journal_recover) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR];
+    char file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    secure_app_t *app1, *app2;
+    journal_t *journal;
+    uint32_t seq1, seq2, seq3;
+    struct stat st;
+
+    create_tmp_dir(tmp_dir);
+    snprintf(file, sizeof(file), "%s/journal", tmp_dir);
+    ck_assert_int_eq(create_secure_app(&app1), 0);
+    ck_assert_int_eq(secure_app_set_id(app1, "app1"), 0);
+    ck_assert_int_eq(secure_app_add_path(app1, "/opt/app1 bin", type_exec), 0);
+    ck_assert_int_eq(secure_app_add_path(app1, "/opt/app1/data", type_data), 0);
+    ck_assert_int_eq(secure_app_add_permission(app1, "perm1"), 0);
+    ck_assert_int_eq(create_secure_app(&app2), 0);
+    ck_assert_int_eq(secure_app_set_id(app2, "app2"), 0);
+
+    // interrupted: app1 after its first stage, app2 before any stage
+    ck_assert_int_eq(journal_open(&journal, file), 0);
+    ck_assert_int_eq(journal_recover(journal, record_recover, NULL), 0);
+    ck_assert_int_eq(journal_begin(journal, journal_install, app1, &seq1), 0);
+    ck_assert_int_eq(journal_begin(journal, journal_uninstall, app2, &seq2), 0);
+    ck_assert_int_eq(journal_begin(journal, journal_install, app2, &seq3), 0);
+    journal_stage(journal, seq1, 1);
+    journal_stage(journal, seq2, 1);
+    journal_end(journal, seq2);
+    journal_close(journal);
+
+    // a torn record is ignored and removed
+    ck_assert_int_eq(stat(file, &st), 0);
+    off_t valid = st.st_size;
+    FILE *f = fopen(file, "a");
+    ck_assert_ptr_ne(f, NULL);
+    fputs("torn", f);
+    fclose(f);
+
+    // not recovered: kept
+    ck_assert_int_eq(journal_open(&journal, file), 0);
+    recovered[0] = '\0';
+    recover_status = -EIO;
+    ck_assert_int_eq(journal_recover(journal, record_recover, NULL), 2);
+    ck_assert_str_eq(recovered, "1:app1:1:2:1;1:app2:0:0:0;");
+    ck_assert_int_eq(stat(file, &st), 0);
+    ck_assert_int_eq((int)st.st_size, (int)valid);
+    journal_close(journal);
+
+    // recovered: emptied
+    ck_assert_int_eq(journal_open(&journal, file), 0);
+    recovered[0] = '\0';
+    recover_status = 0;
+    ck_assert_int_eq(journal_recover(journal, record_recover, NULL), 0);
+    ck_assert_str_eq(recovered, "1:app1:1:2:1;1:app2:0:0:0;");
+    ck_assert_int_eq(stat(file, &st), 0);
+    ck_assert_int_eq((int)st.st_size, 0);
+    journal_close(journal);
+
+    destroy_secure_app(app1);
+    destroy_secure_app(app2);
+    snprintf(file, sizeof(file), "rm -rf %s", tmp_dir);
+    ck_assert_int_eq(system(file), 0);
+}
+END_TEST
+
+START_TEST(test_journal_group_sync) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR];
+    char file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    pthread_t threads[8];
+    journal_stats_t stats;
+    journal_t *journal;
+
+    create_tmp_dir(tmp_dir);
+    snprintf(file, sizeof(file), "%s/journal", tmp_dir);
+    ck_assert_int_eq(journal_open(&journal, file), 0);
+
+    for (int i = 0; i < 8; i++) ck_assert_int_eq(pthread_create(&threads[i], NULL, run_actions, journal), 0);
+    for (int i = 0; i < 8; i++) pthread_join(threads[i], NULL);
+
+    // each begin is flushed, at most once per begin
+    journal_get_stats(journal, &stats);
+    ck_assert_int_eq((int)stats.records, 8 * 10 * 3);
+    ck_assert_int_ge((int)stats.syncs, 1);
+    ck_assert_int_le((int)stats.syncs, 8 * 10);
+    ck_assert_int_eq(journal->active, 0);
+    journal_close(journal);
+
+    ck_assert_str_eq(get_journal_file("/tmp/journal"), "/tmp/journal");
+    ck_assert_str_eq(get_journal_file(NULL), SEC_LSM_MANAGER_JOURNAL_FILE);
+
+    snprintf(file, sizeof(file), "rm -rf %s", tmp_dir);
+    ck_assert_int_eq(system(file), 0);
+}
+END_TEST
+
+void test_journal(void) {
+    addtest(test_journal_recover);
+    addtest(test_journal_group_sync);
+}
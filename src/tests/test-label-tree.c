@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2020-2023 IoT.bzh Company
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../label-tree.c"
+#include "setup-tests.h"
+
+static pthread_mutex_t labelled_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int labelled;
+
+static int count_label(int fd, const char *name, const struct stat *st, void *closure) {
+    const char *fail = closure;
+    ck_assert_int_ge(fd, 0);
+    ck_assert(S_ISREG(st->st_mode) || S_ISDIR(st->st_mode));
+    if (fail != NULL && !strcmp(name, fail))
+        return -EPERM;
+    pthread_mutex_lock(&labelled_mutex);
+    labelled++;
+    pthread_mutex_unlock(&labelled_mutex);
+    return 0;
+}
+
+static void create_file_size(const char *dir, const char *name, size_t size) {
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    ck_assert_int_lt(snprintf(path, sizeof(path), "%s/%s", dir, name), (int)sizeof(path));
+    FILE *file = fopen(path, "w");
+    ck_assert_ptr_ne(file, NULL);
+    for (size_t i = 0; i < size; i++) fputc('x', file);
+    fclose(file);
+}
+
+START_TEST(test_label_tree_walk) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR];
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    label_tree_stats_t stats;
+    create_tmp_dir(tmp_dir);
+
+    snprintf(path, sizeof(path), "%s/a", tmp_dir);
+    ck_assert_int_eq(mkdir(path, 0700), 0);
+    snprintf(path, sizeof(path), "%s/a/b", tmp_dir);
+    ck_assert_int_eq(mkdir(path, 0700), 0);
+    create_file_size(tmp_dir, "file1", 10);
+    create_file_size(tmp_dir, "a/file2", 5);
+    create_file_size(path, "file3", 0);
+    snprintf(path, sizeof(path), "%s/a/link", tmp_dir);
+    ck_assert_int_eq(symlink("/etc", path), 0);
+    snprintf(path, sizeof(path), "%s/fifo", tmp_dir);
+    ck_assert_int_eq(mkfifo(path, 0600), 0);
+
+    // 2 directories and 3 files, the link and the fifo are skipped
+    for (int jobs = 1; jobs <= 4; jobs += 3) {
+        setenv("LABEL_TREE_JOBS", jobs == 1 ? "1" : "4", 1);
+        labelled = 0;
+        ck_assert_int_eq(label_tree(tmp_dir, count_label, NULL, &stats), 0);
+        ck_assert_int_eq(labelled, 5);
+        ck_assert_int_eq((int)stats.files, 5);
+        ck_assert_int_eq((int)stats.skipped, 2);
+        ck_assert_int_eq((int)stats.bytes, 15);
+    }
+
+    // errors stop the walk
+    ck_assert_int_eq(label_tree(tmp_dir, count_label, "file3", NULL), -EPERM);
+
+    // not a directory
+    snprintf(path, sizeof(path), "%s/file1", tmp_dir);
+    ck_assert_int_eq(label_tree(path, count_label, NULL, &stats), 0);
+    ck_assert_int_eq((int)stats.files, 0);
+    snprintf(path, sizeof(path), "%s/none", tmp_dir);
+    ck_assert_int_eq(label_tree(path, count_label, NULL, NULL), -ENOENT);
+
+    // a link to a directory is not followed
+    snprintf(path, sizeof(path), "%s/a/link", tmp_dir);
+    ck_assert_int_eq(label_tree(path, count_label, NULL, &stats), 0);
+    ck_assert_int_eq((int)stats.files, 0);
+
+    unsetenv("LABEL_TREE_JOBS");
+    snprintf(path, sizeof(path), "rm -rf %s", tmp_dir);
+    ck_assert_int_eq(system(path), 0);
+}
+END_TEST
+
+START_TEST(test_label_tree_config) {
+    ck_assert_int_eq((int)get_label_tree_jobs("8"), 8);
+    ck_assert_int_eq((int)get_label_tree_jobs("0"), LABEL_TREE_JOBS);
+    ck_assert_int_eq((int)get_label_tree_jobs("x"), LABEL_TREE_JOBS);
+    ck_assert_str_eq(get_label_tree_path_types("lib"), "lib");
+
+    setenv("LABEL_TREE_PATH_TYPES", "data,lib", 1);
+    ck_assert(is_label_tree_path_type(type_data));
+    ck_assert(is_label_tree_path_type(type_lib));
+    ck_assert(!is_label_tree_path_type(type_id));
+    ck_assert(!is_label_tree_path_type(type_exec));
+    unsetenv("LABEL_TREE_PATH_TYPES");
+    ck_assert(!is_label_tree_path_type(type_data));
+}
+END_TEST
+
+void test_label_tree(void) {
+    addtest(test_label_tree_walk);
+    addtest(test_label_tree_config);
+}
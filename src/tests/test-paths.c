@@ -81,6 +81,25 @@ START_TEST(test_path_set_add_path) {
 }
 END_TEST
 
+START_TEST(test_path_set_has_path) {
+    path_set_t paths;
+    init_path_set(&paths);
+    ck_assert_int_eq(path_set_has_path(&paths, "/test"), false);
+    ck_assert_int_eq(path_set_add_path(&paths, "/test/", type_data), 0);
+    ck_assert_int_eq(path_set_add_path(&paths, "/test/n", type_conf), 0);
+    ck_assert_int_eq(path_set_has_path(&paths, "/test"), true);
+    ck_assert_int_eq(path_set_has_path(&paths, "/test/"), true);
+    ck_assert_int_eq(path_set_has_path(&paths, "/test/n"), true);
+    ck_assert_int_eq(path_set_has_path(&paths, "/tes"), false);
+    ck_assert_int_eq(path_set_has_path(&paths, "/TEST"), false);
+
+    path_set_truncate(&paths, 1);
+    ck_assert_int_eq(path_set_has_path(&paths, "/test"), true);
+    ck_assert_int_eq(path_set_has_path(&paths, "/test/n"), false);
+    free_path_set(&paths);
+}
+END_TEST
+
 START_TEST(test_valid_path_type) {
     ck_assert_int_eq(valid_path_type(type_none), false);
     ck_assert_int_eq(valid_path_type(0), false);
@@ -136,6 +155,7 @@ void test_paths(void) {
     addtest(test_init_path_set);
     addtest(test_free_path_set);
     addtest(test_path_set_add_path);
+    addtest(test_path_set_has_path);
     addtest(test_valid_path_type);
     addtest(test_get_path_type);
     addtest(test_get_path_type_string);
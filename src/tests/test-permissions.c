@@ -49,8 +49,33 @@ START_TEST(test_permission_set_add_permission) {
 }
 END_TEST
 
+START_TEST(test_permission_set_has_permission) {
+    permission_set_t permission_set;
+    init_permission_set(&permission_set);
+    ck_assert_int_eq(permission_set_has_permission(&permission_set, "perm", false), false);
+    for (int i = 0; i < 100; i++) {
+        char buf[50];
+        snprintf(buf, 50, "perm%d", i);
+        ck_assert_int_eq(permission_set_add_permission(&permission_set, buf), 0);
+    }
+    ck_assert_int_eq((int)permission_set.size, 100);
+    ck_assert_str_eq(permission_set.permissions[42], "perm42");
+    ck_assert_int_eq(permission_set_has_permission(&permission_set, "perm99", false), true);
+    ck_assert_int_eq(permission_set_has_permission(&permission_set, "PERM99", false), false);
+    ck_assert_int_eq(permission_set_has_permission(&permission_set, "PERM99", true), true);
+    ck_assert_int_eq(permission_set_has_permission(&permission_set, "perm100", true), false);
+
+    permission_set_truncate(&permission_set, 50);
+    ck_assert_int_eq((int)permission_set.size, 50);
+    ck_assert_int_eq(permission_set_has_permission(&permission_set, "perm49", false), true);
+    ck_assert_int_eq(permission_set_has_permission(&permission_set, "perm50", false), false);
+    free_permission_set(&permission_set);
+}
+END_TEST
+
 void test_permissions() {
     addtest(test_init_permission_set);
     addtest(test_free_permission_set);
     addtest(test_permission_set_add_permission);
+    addtest(test_permission_set_has_permission);
 }
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2020-2023 IoT.bzh Company
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+
+#include "../prot.c"
+#include "setup-tests.h"
+
+// a string of 'length' times 'c'
+static char *make_field(size_t length, char c) {
+    char *field = malloc(length + 1);
+    ck_assert_ptr_nonnull(field);
+    memset(field, c, length);
+    field[length] = '\0';
+    return field;
+}
+
+// moves the output of 'out' to the input of 'in' through the pipe 'fds' until 'in' gets a record
+static int transfer(prot_t *out, prot_t *in, int fds[2], const char ***fields) {
+    int rc, moved;
+
+    for (;;) {
+        rc = prot_get(in, fields);
+        if (rc != -EAGAIN)
+            return rc;
+        moved = 0;
+        if (prot_should_write(out)) {
+            rc = prot_write(out, fds[1]);
+            if (rc < 0 && rc != -EAGAIN)
+                return rc;
+            moved |= rc > 0;
+        }
+        rc = prot_read(in, fds[0]);
+        if (rc < 0 && rc != -EAGAIN)
+            return rc;
+        moved |= rc > 0;
+        if (!moved)
+            return -EAGAIN;
+    }
+}
+
+// sends a record of 1500 bytes then puts a record of 1000 bytes wrapping at the end of the ring of 'out'
+static void put_wrapped_record(prot_t *out, prot_t *in, int fds[2], const char *first, const char *second) {
+    const char **fields;
+
+    ck_assert_int_eq(prot_putx(out, first, NULL), 0);
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 1);
+    ck_assert_str_eq(fields[0], first);
+    prot_next(in);
+    ck_assert_int_eq(out->outbuf.count, 0);
+
+    ck_assert_int_eq(prot_putx(out, second, NULL), 0);
+    ck_assert_int_eq(out->outbuf.size, PROT_INITIAL_BUFFER_LENGTH);
+    ck_assert_int_gt(out->outbuf.pos + out->outbuf.count, out->outbuf.size);
+}
+
+START_TEST(test_prot_wrapped_growth) {
+    prot_t *out, *in;
+    int fds[2];
+    const char **fields;
+    char *first = make_field(1500, 'a');
+    char *second = make_field(1000, 'b');
+    char *big = make_field(3000, 'c');
+
+    ck_assert_int_eq(prot_create(&out), 0);
+    ck_assert_int_eq(prot_create(&in), 0);
+    ck_assert_int_eq(pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+    put_wrapped_record(out, in, fds, first, second);
+
+    // the ring grows in the middle of a record: its content is made linear
+    ck_assert_int_eq(prot_put_field(out, "begin"), 0);
+    ck_assert_int_eq(prot_put_field(out, big), 0);
+    ck_assert_int_gt(out->outbuf.size, PROT_INITIAL_BUFFER_LENGTH);
+    ck_assert_int_eq(out->outbuf.pos, 0);
+    ck_assert_int_eq(prot_put_field(out, "with\\ escaped\n characters"), 0);
+    ck_assert_int_eq(prot_put_end(out), 0);
+
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 1);
+    ck_assert_str_eq(fields[0], second);
+    prot_next(in);
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 3);
+    ck_assert_str_eq(fields[0], "begin");
+    ck_assert_str_eq(fields[1], big);
+    ck_assert_str_eq(fields[2], "with\\ escaped\n characters");
+    prot_next(in);
+    ck_assert_int_eq(prot_write_pending(out), 0);
+
+    close(fds[0]);
+    close(fds[1]);
+    prot_destroy(out);
+    prot_destroy(in);
+    free(first);
+    free(second);
+    free(big);
+}
+END_TEST
+
+START_TEST(test_prot_cancel_after_growth) {
+    prot_t *out, *in;
+    int fds[2];
+    const char **fields;
+    char *first = make_field(1500, 'a');
+    char *second = make_field(1000, 'b');
+    char *big = make_field(3000, 'c');
+    char *huge = make_field(PROT_MAX_BUFFER_LENGTH, 'h');
+
+    ck_assert_int_eq(prot_create(&out), 0);
+    ck_assert_int_eq(prot_create(&in), 0);
+    ck_assert_int_eq(pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+    put_wrapped_record(out, in, fds, first, second);
+
+    // the cancelled record was started before the growth
+    ck_assert_int_eq(prot_put_field(out, "cancelled"), 0);
+    ck_assert_int_eq(prot_put_field(out, big), 0);
+    ck_assert_int_gt(out->outbuf.size, PROT_INITIAL_BUFFER_LENGTH);
+    prot_put_cancel(out);
+    ck_assert_int_eq(prot_write_pending(out), 1001);
+
+    // a record too big is cancelled
+    ck_assert_int_eq(prot_putx(out, "too-big", huge, NULL), -ECANCELED);
+    ck_assert_int_eq(prot_write_pending(out), 1001);
+
+    ck_assert_int_eq(prot_putx(out, "next", NULL), 0);
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 1);
+    ck_assert_str_eq(fields[0], second);
+    prot_next(in);
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 1);
+    ck_assert_str_eq(fields[0], "next");
+    prot_next(in);
+    ck_assert_int_eq(transfer(out, in, fds, &fields), -EAGAIN);
+
+    close(fds[0]);
+    close(fds[1]);
+    prot_destroy(out);
+    prot_destroy(in);
+    free(first);
+    free(second);
+    free(big);
+    free(huge);
+}
+END_TEST
+
+START_TEST(test_prot_large_record) {
+    prot_t *out, *in;
+    int fds[2];
+    const char **fields;
+    char *big = make_field(10000, 'd');
+
+    ck_assert_int_eq(prot_create(&out), 0);
+    ck_assert_int_eq(prot_create(&in), 0);
+    ck_assert_int_eq(pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+
+    // both records are read at once, the second one exceeding the input buffer
+    ck_assert_int_eq(prot_putx(out, "small", NULL), 0);
+    ck_assert_int_eq(prot_putx(out, "large", big, NULL), 0);
+    while (prot_should_write(out)) ck_assert_int_gt(prot_write(out, fds[1]), 0);
+
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 1);
+    ck_assert_str_eq(fields[0], "small");
+    ck_assert_int_eq(in->inbuf.size, PROT_INITIAL_BUFFER_LENGTH);
+    prot_next(in);
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 2);
+    ck_assert_str_eq(fields[0], "large");
+    ck_assert_str_eq(fields[1], big);
+    ck_assert_int_gt(in->inbuf.size, PROT_INITIAL_BUFFER_LENGTH);
+    prot_next(in);
+
+    close(fds[0]);
+    close(fds[1]);
+    prot_destroy(out);
+    prot_destroy(in);
+    free(big);
+}
+END_TEST
+
+START_TEST(test_prot_limit) {
+    prot_t *out, *in;
+    int fds[2];
+    const char **fields;
+    char *buffer = make_field(PROT_MAX_BUFFER_LENGTH, 'm');
+    const char *field = buffer + 1;
+    size_t written = 0;
+    ssize_t rc;
+
+    ck_assert_int_eq(prot_create(&out), 0);
+    ck_assert_int_eq(prot_create(&in), 0);
+    ck_assert_int_eq(pipe2(fds, O_NONBLOCK | O_CLOEXEC), 0);
+
+    // a record of exactly the limit, its separator included
+    ck_assert(prot_fits(1, &field));
+    ck_assert_int_eq(prot_put(out, 1, &field), 0);
+    ck_assert_int_eq(prot_write_pending(out), PROT_MAX_BUFFER_LENGTH);
+    ck_assert_int_eq(transfer(out, in, fds, &fields), 1);
+    ck_assert_int_eq(strlen(fields[0]), PROT_MAX_BUFFER_LENGTH - 1);
+    ck_assert_int_eq(in->inbuf.size, PROT_MAX_BUFFER_LENGTH);
+    prot_next(in);
+
+    // one byte more is over the limit
+    field = buffer;
+    ck_assert(!prot_fits(1, &field));
+    ck_assert_int_eq(prot_put(out, 1, &field), -ECANCELED);
+    ck_assert_int_eq(prot_write_pending(out), 0);
+
+    // the receiver rejects it too
+    for (;;) {
+        if (written <= PROT_MAX_BUFFER_LENGTH) {
+            rc = write(fds[1], buffer + written % PROT_MAX_BUFFER_LENGTH,
+                       PROT_MAX_BUFFER_LENGTH - written % PROT_MAX_BUFFER_LENGTH);
+            ck_assert(rc > 0 || (rc < 0 && errno == EAGAIN));
+            if (rc > 0)
+                written += (size_t)rc;
+        }
+        ck_assert_int_eq(prot_get(in, &fields), -EAGAIN);
+        rc = prot_read(in, fds[0]);
+        if (rc == -ENOBUFS)
+            break;
+        ck_assert(rc > 0 || rc == -EAGAIN);
+    }
+    ck_assert_int_eq(in->inbuf.count, PROT_MAX_BUFFER_LENGTH);
+
+    close(fds[0]);
+    close(fds[1]);
+    prot_destroy(out);
+    prot_destroy(in);
+    free(buffer);
+}
+END_TEST
+
+void test_prot(void) {
+    addtest(test_prot_wrapped_growth);
+    addtest(test_prot_cancel_after_growth);
+    addtest(test_prot_large_record);
+    addtest(test_prot_limit);
+}
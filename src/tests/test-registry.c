@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+
+#include "../registry.c"
+#include "setup-tests.h"
+
+static char records[4096];
+
+static int record_item(void *closure, enum registry_item item, const char *value, const char *extra) {
+    size_t len = strlen(records);
+    (void)closure;
+    snprintf(records + len, sizeof(records) - len, "%d:%s:%s;", (int)item, value, extra == NULL ? "" : extra);
+    return 0;
+}
+
+static void new_app(secure_app_t **secure_app, const char *id, const char *path, const char *permission) {
+    ck_assert_int_eq(create_secure_app(secure_app), 0);
+    ck_assert_int_eq(secure_app_set_id(*secure_app, id), 0);
+    ck_assert_int_eq(secure_app_add_path(*secure_app, path, type_data), 0);
+    ck_assert_int_eq(secure_app_add_permission(*secure_app, permission), 0);
+}
+
+START_TEST(test_registry_update) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR];
+    char file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char aside[SEC_LSM_MANAGER_MAX_SIZE_PATH + 8];
+    char expected[2 * SEC_LSM_MANAGER_MAX_SIZE_LABEL + 64];
+    secure_app_t *app1, *app2;
+    registry_t *registry;
+
+    create_tmp_dir(tmp_dir);
+    snprintf(file, sizeof(file), "%s/registry.db", tmp_dir);
+    new_app(&app1, "app1", "/opt/app1", "perm1");
+    new_app(&app2, "app2", "/opt/app2", "perm2");
+
+    // a missing file gives an empty registry
+    ck_assert_int_eq(registry_create(&registry, file), 0);
+    ck_assert_int_eq(registry_list(registry, record_item, NULL), 0);
+    ck_assert_int_eq(registry_query(registry, "app1", record_item, NULL), -ENOENT);
+    ck_assert_int_eq(registry_remove(registry, "app1"), -ENOENT);
+
+    ck_assert_int_eq(registry_add(registry, app1), 0);
+    ck_assert_int_eq(registry_add(registry, app2), 0);
+    ck_assert_int_eq(secure_app_add_permission(app1, "perm3"), 0);
+    ck_assert_int_eq(registry_add(registry, app1), 0);
+    registry_destroy(registry);
+
+    // reloaded from the file
+    ck_assert_int_eq(registry_create(&registry, file), 0);
+    ck_assert(registry->mapped);
+    records[0] = '\0';
+    ck_assert_int_eq(registry_list(registry, record_item, NULL), 2);
+    snprintf(expected, sizeof(expected), "0:app2:%s;0:app1:%s;", app2->label, app1->label);
+    ck_assert_str_eq(records, expected);
+
+    records[0] = '\0';
+    ck_assert_int_eq(registry_query(registry, app1->label, record_item, NULL), 0);
+    snprintf(expected, sizeof(expected), "0:app1:%s;1:/opt/app1:data;2:perm1:;2:perm3:;", app1->label);
+    ck_assert_str_eq(records, expected);
+
+    // the owner is the nearest recorded directory
+    records[0] = '\0';
+    ck_assert_int_eq(registry_owner(registry, "/opt/app2/data/file", record_item, NULL), 0);
+    snprintf(expected, sizeof(expected), "0:app2:%s;1:/opt/app2:data;", app2->label);
+    ck_assert_str_eq(records, expected);
+    ck_assert_int_eq(registry_owner(registry, "/opt/app3/file", record_item, NULL), -ENOENT);
+    ck_assert_int_eq(registry_owner(registry, "/opt", record_item, NULL), -ENOENT);
+
+    ck_assert_int_eq(registry_remove(registry, "app2"), 0);
+    ck_assert_int_eq(registry_query(registry, "app2", record_item, NULL), -ENOENT);
+    ck_assert_int_eq(registry_owner(registry, "/opt/app2/data/file", record_item, NULL), -ENOENT);
+    ck_assert_int_eq(registry_list(registry, record_item, NULL), 1);
+    registry_destroy(registry);
+
+    // an invalid file is moved aside and gives an empty registry
+    ck_assert_int_eq(write_file(file, "garbage", 7), 0);
+    ck_assert_int_eq(registry_create(&registry, file), 0);
+    ck_assert_int_eq(registry_list(registry, record_item, NULL), 0);
+    registry_destroy(registry);
+    ck_assert_int_ne(access(file, F_OK), 0);
+    snprintf(aside, sizeof(aside), "%s.corrupt", file);
+    ck_assert_int_eq(access(aside, F_OK), 0);
+
+    destroy_secure_app(app1);
+    destroy_secure_app(app2);
+    snprintf(file, sizeof(file), "rm -rf %s", tmp_dir);
+    ck_assert_int_eq(system(file), 0);
+}
+END_TEST
+
+START_TEST(test_registry_config) {
+    ck_assert_str_eq(get_registry_file("/tmp/registry"), "/tmp/registry");
+    ck_assert_str_eq(get_registry_file(NULL), SEC_LSM_MANAGER_REGISTRY_FILE);
+    setenv("SEC_LSM_MANAGER_REGISTRY", "/tmp/other", 1);
+    ck_assert_str_eq(get_registry_file(NULL), "/tmp/other");
+    unsetenv("SEC_LSM_MANAGER_REGISTRY");
+}
+END_TEST
+
+void test_registry(void) {
+    addtest(test_registry_update);
+    addtest(test_registry_config);
+}
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2020-2023 IoT.bzh Company
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "../sec-lsm-manager-protocol.c"
+#include "../sec-lsm-manager.c"
+#include "../socket.c"
+#include "setup-tests.h"
+
+#if defined(SEC_LSM_MANAGER_TEST_DAEMON)
+
+#define PERMISSION "urn:AGL:permission::partner:manage-tmp"
+
+typedef struct {
+    char dir[SEC_LSM_MANAGER_MAX_SIZE_DIR];
+    char socketspec[SEC_LSM_MANAGER_MAX_SIZE_DIR];
+    pid_t pid;
+} daemon_t;
+
+// exports the file 'name' of the directory 'dir' as the environment variable 'var'
+static void setenv_file(const char *var, const char *dir, const char *name) {
+    char path[SEC_LSM_MANAGER_MAX_SIZE_DIR];
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) < (int)sizeof(path))
+        setenv(var, path, 1);
+}
+
+// launches the daemon of the build tree with its files in a temporary directory
+static void start_daemon(daemon_t *daemon) {
+    int fd, trial;
+
+    create_tmp_dir(daemon->dir);
+    ck_assert_int_lt(snprintf(daemon->socketspec, sizeof(daemon->socketspec), "unix:%s/%s", daemon->dir,
+                              sec_lsm_manager_default_socket_name),
+                     (int)sizeof(daemon->socketspec));
+
+    daemon->pid = fork();
+    ck_assert_int_ge(daemon->pid, 0);
+    if (daemon->pid == 0) {
+        fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        setenv_file("SEC_LSM_MANAGER_REGISTRY", daemon->dir, "registry.db");
+        setenv_file("SEC_LSM_MANAGER_JOURNAL", daemon->dir, "journal");
+        execl(SEC_LSM_MANAGER_TEST_DAEMON, SEC_LSM_MANAGER_TEST_DAEMON, "-S", daemon->dir, "-s", "60", NULL);
+        _exit(127);
+    }
+
+    // wait until the daemon accepts connections
+    for (trial = 0; trial < 500; trial++) {
+        fd = socket_open(daemon->socketspec, 0);
+        if (fd >= 0)
+            break;
+        usleep(10000);
+    }
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+}
+
+static void stop_daemon(daemon_t *daemon) {
+    char command[SEC_LSM_MANAGER_MAX_SIZE_DIR + 10];
+    int status;
+
+    ck_assert_int_eq(kill(daemon->pid, SIGTERM), 0);
+    ck_assert_int_eq(waitpid(daemon->pid, &status, 0), daemon->pid);
+    ck_assert_int_lt(snprintf(command, sizeof(command), "rm -rf %s", daemon->dir), (int)sizeof(command));
+    ck_assert_int_eq(system(command), 0);
+}
+
+// the polling requested by the asynchronous client
+typedef struct {
+    int fd;
+    uint32_t events;
+} poller_t;
+
+// the completion of an asynchronous action
+typedef struct {
+    sec_lsm_manager_t *client;
+    int *counter;
+    int rank;
+    int status;
+    int failed;
+} action_t;
+
+static int poller_ctl(void *closure, int op, int fd, uint32_t events) {
+    poller_t *poller = closure;
+
+    poller->fd = op == EPOLL_CTL_DEL ? -1 : fd;
+    poller->events = op == EPOLL_CTL_DEL ? 0 : events;
+    return 0;
+}
+
+static void init_action(action_t *action, sec_lsm_manager_t *client, int *counter) {
+    action->client = client;
+    action->counter = counter;
+    action->rank = -1;
+    action->status = 0;
+    action->failed = -2;
+}
+
+static void on_action(void *closure, int status) {
+    action_t *action = closure;
+
+    action->rank = (*action->counter)++;
+    action->status = status;
+    action->failed = sec_lsm_manager_failed_request(action->client);
+}
+
+// processes the events of the client until 'expected' actions are completed
+static void process_until(sec_lsm_manager_t *client, poller_t *poller, int *counter, int expected) {
+    struct pollfd pfd;
+
+    while (*counter < expected) {
+        ck_assert_int_ge(poller->fd, 0);
+        pfd.fd = poller->fd;
+        pfd.events = (short)poller->events;
+        ck_assert_int_gt(poll(&pfd, 1, 5000), 0);
+        ck_assert_int_ge(sec_lsm_manager_async_process(client), 0);
+    }
+}
+
+START_TEST(test_pipeline_batch) {
+    daemon_t daemon;
+    sec_lsm_manager_t *client;
+
+    start_daemon(&daemon);
+    ck_assert_int_eq(sec_lsm_manager_create(&client, daemon.socketspec), 0);
+    ck_assert_int_eq(sec_lsm_manager_set_pipelined(client, 1), 0);
+
+    // the requests are only buffered until the sync point
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "pipeline-app"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_permission(client, PERMISSION), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_path(client, "/tmp/pipeline-app", "public"), 0);
+    ck_assert_int_eq(client->pipeline.sent, 3);
+    ck_assert_int_eq(client->pipeline.received, 0);
+    ck_assert_int_gt(prot_write_pending(client->prot), 0);
+
+    // all the replies are collected in one round trip
+    ck_assert_int_eq(sec_lsm_manager_sync(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_failed_request(client), -1);
+    ck_assert_int_eq(client->pipeline.sent, 0);
+    ck_assert_int_eq(client->pipeline.received, 0);
+    ck_assert_int_eq(prot_write_pending(client->prot), 0);
+
+    // nothing pending: the sync point is immediate
+    ck_assert_int_eq(sec_lsm_manager_sync(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_failed_request(client), -1);
+
+    sec_lsm_manager_destroy(client);
+    stop_daemon(&daemon);
+}
+END_TEST
+
+START_TEST(test_pipeline_failed_request) {
+    daemon_t daemon;
+    sec_lsm_manager_t *client;
+
+    start_daemon(&daemon);
+    ck_assert_int_eq(sec_lsm_manager_create(&client, daemon.socketspec), 0);
+    ck_assert_int_eq(sec_lsm_manager_set_pipelined(client, 1), 0);
+
+    // the first failure of the batch is reported, not the ones it causes
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "pipeline-app"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_permission(client, PERMISSION), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_path(client, "/tmp/pipeline-app", "no-such-type"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_path(client, "/tmp/pipeline-app/bin", "exec"), 0);
+    ck_assert_int_lt(sec_lsm_manager_sync(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_failed_request(client), 2);
+
+    // the index counts from the previous sync point, the install ending the batch
+    ck_assert_int_eq(sec_lsm_manager_clear(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "pipeline-app"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_path(client, "/tmp/pipeline-app", "public"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_path(client, "/tmp/pipeline-app", "public"), 0);
+    ck_assert_int_lt(sec_lsm_manager_install(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_failed_request(client), 3);
+
+    // a clear resets the error flag
+    ck_assert_int_eq(sec_lsm_manager_clear(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "pipeline-app"), 0);
+    ck_assert_int_eq(sec_lsm_manager_sync(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_failed_request(client), -1);
+
+    // leaving the pipelined mode is a sync point
+    ck_assert_int_eq(sec_lsm_manager_add_permission(client, PERMISSION), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_permission(client, PERMISSION), 0);
+    ck_assert_int_lt(sec_lsm_manager_set_pipelined(client, 0), 0);
+    ck_assert_int_eq(sec_lsm_manager_failed_request(client), 1);
+    ck_assert_int_eq(client->pipeline.sent, 0);
+
+    sec_lsm_manager_destroy(client);
+    stop_daemon(&daemon);
+}
+END_TEST
+
+START_TEST(test_async_order) {
+    daemon_t daemon;
+    poller_t poller = {-1, 0};
+    action_t first, second;
+    int counter = 0;
+    sec_lsm_manager_t *client;
+
+    start_daemon(&daemon);
+    ck_assert_int_eq(sec_lsm_manager_create(&client, daemon.socketspec), 0);
+    ck_assert_int_eq(sec_lsm_manager_async_setup(client, poller_ctl, &poller), 0);
+    init_action(&first, client, &counter);
+    init_action(&second, client, &counter);
+
+    // first batch failing at its request 1
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "async-first"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_path(client, "/tmp/async-first", "no-such-type"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_permission(client, PERMISSION), 0);
+    ck_assert_int_eq(sec_lsm_manager_async_install(client, on_action, &first), 0);
+
+    // second batch failing at its request 3
+    ck_assert_int_eq(sec_lsm_manager_clear(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "async-second"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_permission(client, PERMISSION), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_permission(client, PERMISSION), 0);
+    ck_assert_int_eq(sec_lsm_manager_async_install(client, on_action, &second), 0);
+
+    // the callbacks are only called by sec_lsm_manager_async_process, in the order of the actions
+    ck_assert_int_eq(counter, 0);
+    ck_assert_int_ge(poller.fd, 0);
+    process_until(client, &poller, &counter, 2);
+    ck_assert_int_eq(first.rank, 0);
+    ck_assert_int_lt(first.status, 0);
+    ck_assert_int_eq(first.failed, 1);
+    ck_assert_int_eq(second.rank, 1);
+    ck_assert_int_lt(second.status, 0);
+    ck_assert_int_eq(second.failed, 3);
+    ck_assert_ptr_null(client->async.requests);
+    ck_assert_int_eq(client->pipeline.sent, 0);
+    ck_assert_int_eq(client->pipeline.received, 0);
+
+    // leaving the asynchronous mode unregisters the socket
+    ck_assert_int_eq(sec_lsm_manager_async_setup(client, NULL, NULL), 0);
+    ck_assert_int_eq(poller.fd, -1);
+
+    sec_lsm_manager_destroy(client);
+    stop_daemon(&daemon);
+}
+END_TEST
+
+START_TEST(test_async_cancel) {
+    daemon_t daemon;
+    poller_t poller = {-1, 0};
+    action_t first, second;
+    int counter = 0;
+    sec_lsm_manager_t *client;
+
+    start_daemon(&daemon);
+    ck_assert_int_eq(sec_lsm_manager_create(&client, daemon.socketspec), 0);
+    ck_assert_int_eq(sec_lsm_manager_async_setup(client, poller_ctl, &poller), 0);
+    init_action(&first, client, &counter);
+    init_action(&second, client, &counter);
+
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "async-first"), 0);
+    ck_assert_int_eq(sec_lsm_manager_add_path(client, "/tmp/async-first", "no-such-type"), 0);
+    ck_assert_int_eq(sec_lsm_manager_async_install(client, on_action, &first), 0);
+    ck_assert_int_eq(sec_lsm_manager_clear(client), 0);
+    ck_assert_int_eq(sec_lsm_manager_set_id(client, "async-second"), 0);
+    ck_assert_int_eq(sec_lsm_manager_async_uninstall(client, on_action, &second), 0);
+
+    // the pending actions are cancelled in order, whatever the server replied
+    sec_lsm_manager_destroy(client);
+    ck_assert_int_eq(counter, 2);
+    ck_assert_int_eq(first.rank, 0);
+    ck_assert_int_eq(first.status, -ECANCELED);
+    ck_assert_int_eq(second.rank, 1);
+    ck_assert_int_eq(second.status, -ECANCELED);
+    ck_assert_int_eq(poller.fd, -1);
+
+    stop_daemon(&daemon);
+}
+END_TEST
+
+#endif
+
+void test_sec_lsm_manager(void) {
+#if defined(SEC_LSM_MANAGER_TEST_DAEMON)
+    addtest(test_pipeline_batch);
+    addtest(test_pipeline_failed_request);
+    addtest(test_async_order);
+    addtest(test_async_cancel);
+#endif
+}
@@ -121,6 +121,41 @@ START_TEST(test_secure_app_add_path) {
 }
 END_TEST
 
+START_TEST(test_secure_app_add_permissions) {
+    secure_app_t *secure_app = NULL;
+    const char *permissions[] = {"perm1", "perm2", "perm3"};
+    const char *bad_permissions[] = {"perm4", "perm1"};
+    ck_assert_int_eq(create_secure_app(&secure_app), 0);
+    ck_assert_int_eq(secure_app_add_permissions(secure_app, 3, permissions), 0);
+    ck_assert_int_eq((int)secure_app->permission_set.size, 3);
+    ck_assert_str_eq(secure_app->permission_set.permissions[2], "perm3");
+
+    // test all or nothing
+    ck_assert_int_eq(secure_app_add_permissions(secure_app, 2, bad_permissions), -EINVAL);
+    ck_assert_int_eq((int)secure_app->permission_set.size, 3);
+    destroy_secure_app(secure_app);
+}
+END_TEST
+
+START_TEST(test_secure_app_add_paths) {
+    secure_app_t *secure_app = NULL;
+    const char *paths[] = {"/tmp1", "/tmp2"};
+    const enum path_type path_types[] = {type_conf, type_data};
+    const enum path_type bad_path_types[] = {type_exec, type_none};
+    ck_assert_int_eq(create_secure_app(&secure_app), 0);
+    ck_assert_int_eq(secure_app_add_paths(secure_app, 2, paths, path_types), 0);
+    ck_assert_int_eq((int)secure_app->path_set.size, 2);
+    ck_assert_int_eq((int)secure_app->path_set.paths[1]->path_type, (int)type_data);
+
+    // test all or nothing
+    clear_secure_app(secure_app);
+    ck_assert_int_eq(secure_app_add_paths(secure_app, 2, paths, bad_path_types), -EINVAL);
+    ck_assert_int_eq((int)secure_app->path_set.size, 0);
+    ck_assert_int_eq(secure_app_add_paths(secure_app, 2, paths, path_types), 0);
+    destroy_secure_app(secure_app);
+}
+END_TEST
+
 START_TEST(test_free_secure_app) {
     secure_app_t *secure_app = NULL;
     ck_assert_int_eq(create_secure_app(&secure_app), 0);
@@ -150,6 +185,8 @@ void test_secure_app(void) {
     addtest(test_secure_app_set_id);
     addtest(test_secure_app_add_permission);
     addtest(test_secure_app_add_path);
+    addtest(test_secure_app_add_permissions);
+    addtest(test_secure_app_add_paths);
     addtest(test_free_secure_app);
     addtest(test_destroy_secure_app);
 }
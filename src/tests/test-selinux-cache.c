@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020-2023 IoT.bzh Company
+ * Author: Arthur Guyader <arthur.guyader@iot.bzh>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../selinux-cache.c"
+#include "setup-tests.h"
+
+#define CACHEID "testid-binding"
+
+START_TEST(test_selinux_cache_size) {
+    ck_assert_int_eq(get_selinux_cache_size("1024"), 1024);
+    ck_assert_int_eq(get_selinux_cache_size("0"), 0);
+    ck_assert_int_eq(get_selinux_cache_size("12k"), SELINUX_CACHE_SIZE);
+    ck_assert_int_eq(get_selinux_cache_size(""), SELINUX_CACHE_SIZE);
+}
+END_TEST
+
+START_TEST(test_selinux_cache_fetch_store) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR] = {'\0'};
+    char cache_dir[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char pp_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char fetched_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    const char source[] = "te\0if\0fc";
+    const char other_source[] = "te\0if\0fc2";
+    selinux_cache_stats_t before, after;
+    char name[SEC_LSM_MANAGER_MAX_SIZE_PATH + sizeof(PP_SUFFIX)];
+    char *data;
+    size_t size;
+
+    create_tmp_dir(tmp_dir);
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", tmp_dir);
+    snprintf(pp_file, sizeof(pp_file), "%s/module.pp", tmp_dir);
+    snprintf(fetched_file, sizeof(fetched_file), "%s/fetched.pp", tmp_dir);
+    ck_assert_int_eq(write_file(pp_file, "compiled", 8), 0);
+
+    get_selinux_cache_stats(&before);
+    ck_assert_int_eq(selinux_cache_fetch(cache_dir, CACHEID, source, sizeof(source), fetched_file), 0);
+    ck_assert_int_eq(selinux_cache_store(cache_dir, 1024, CACHEID, source, sizeof(source), pp_file), 0);
+    ck_assert_int_eq(selinux_cache_fetch(cache_dir, CACHEID, source, sizeof(source), fetched_file), 1);
+    ck_assert_int_eq(selinux_cache_fetch(cache_dir, CACHEID, other_source, sizeof(other_source), fetched_file), 0);
+    get_selinux_cache_stats(&after);
+    ck_assert_int_eq(after.hits - before.hits, 1);
+    ck_assert_int_eq(after.misses - before.misses, 2);
+
+    ck_assert_int_eq(read_whole(fetched_file, &data, &size), 0);
+    ck_assert_int_eq(size, 8);
+    ck_assert_int_eq(memcmp(data, "compiled", 8), 0);
+    free(data);
+
+    /* a cache smaller than two entries keeps the most recently used */
+    const struct timespec old[2] = {{.tv_sec = 1, .tv_nsec = 0}, {.tv_sec = 1, .tv_nsec = 0}};
+    ck_assert_int_eq(entry_path(name, cache_dir, CACHEID, source, sizeof(source)), 0);
+    strcat(name, PP_SUFFIX);
+    ck_assert_int_eq(utimensat(AT_FDCWD, name, old, 0), 0);
+    ck_assert_int_eq(selinux_cache_store(cache_dir, 30, CACHEID, other_source, sizeof(other_source), pp_file), 0);
+    get_selinux_cache_stats(&before);
+    ck_assert_int_eq(before.evictions - after.evictions, 1);
+    ck_assert_int_eq(selinux_cache_fetch(cache_dir, CACHEID, source, sizeof(source), fetched_file), 0);
+    ck_assert_int_eq(selinux_cache_fetch(cache_dir, CACHEID, other_source, sizeof(other_source), fetched_file), 1);
+
+    ck_assert_int_eq(entry_path(name, cache_dir, CACHEID, other_source, sizeof(other_source)), 0);
+    remove_entry(name);
+    rmdir(cache_dir);
+    remove(pp_file);
+    remove(fetched_file);
+    rmdir(tmp_dir);
+}
+END_TEST
+
+void test_selinux_cache() {
+    addtest(test_selinux_cache_size);
+    addtest(test_selinux_cache_fetch_store);
+}
@@ -79,7 +79,592 @@ START_TEST(test_generate_app_module_files) {
 }
 END_TEST
 
+START_TEST(test_generate_app_module_cil) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR] = {'\0'};
+    create_tmp_dir(tmp_dir);
+
+    secure_app_t *secure_app = NULL;
+    ck_assert_int_eq(create_secure_app(&secure_app), 0);
+    ck_assert_int_eq(secure_app_set_id(secure_app, TESTID), 0);
+    ck_assert_int_eq(secure_app_add_path(secure_app, "/tmp/data", type_data), 0);
+
+    selinux_module_t selinux_module = {0};
+    path_type_definitions_t path_type_definitions[number_path_type];
+    init_path_type_definitions(path_type_definitions, TESTID_SELINUX);
+
+    char *module_data = NULL;
+    size_t module_size = 0;
+    snprintf(selinux_module.selinux_cil_template_file, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s", tmp_dir, "template");
+    snprintf(selinux_module.selinux_cil_file, SEC_LSM_MANAGER_MAX_SIZE_PATH, "%s/%s", tmp_dir, "cilfile");
+
+    ck_assert_int_eq(use_cil_backend(&selinux_module), false);
+    ck_assert_int_lt(
+        generate_app_module_cil(&selinux_module, secure_app, path_type_definitions, &module_data, &module_size), 0);
+    ck_assert_ptr_null(module_data);
+
+    FILE *f = fopen(selinux_module.selinux_cil_template_file, "w");
+    ck_assert_ptr_nonnull(f);
+    fputs("(type {{id_underscore}}_t)\n{{#urn:AGL:permission::partner:manage-tmp}}(allow)\n"
+          "{{/urn:AGL:permission::partner:manage-tmp}}",
+          f);
+    fclose(f);
+
+    ck_assert_int_eq(use_cil_backend(&selinux_module), true);
+    ck_assert_int_eq(
+        generate_app_module_cil(&selinux_module, secure_app, path_type_definitions, &module_data, &module_size), 0);
+    ck_assert_int_eq(module_size, strlen(module_data));
+    ck_assert_str_eq(module_data,
+                     "(type testid_binding_t)\n"
+                     "(filecon \"/tmp/data(/.*)?\" any (system_u object_r testid_binding_data_t ((s0) (s0))))\n");
+    ck_assert_int_eq(check_app_module_files_exists(&selinux_module), true);
+    free(module_data);
+
+    ck_assert_int_eq(secure_app_add_path(secure_app, "/tmp/\"quoted\"", type_data), 0);
+    ck_assert_int_eq(
+        generate_app_module_cil(&selinux_module, secure_app, path_type_definitions, &module_data, &module_size),
+        -EINVAL);
+
+    destroy_secure_app(secure_app);
+    remove(selinux_module.selinux_cil_template_file);
+    remove(selinux_module.selinux_cil_file);
+    rmdir(tmp_dir);
+}
+END_TEST
+
+START_TEST(test_get_selinux_compile_jobs) {
+    ck_assert_int_eq(get_selinux_compile_jobs("3"), 3);
+    ck_assert_int_ge(get_selinux_compile_jobs("0"), 1);
+    ck_assert_int_ge(get_selinux_compile_jobs("many"), 1);
+    ck_assert_int_le(get_selinux_compile_jobs("100000"), SEC_LSM_MANAGER_MAX_COMPILE_JOBS);
+}
+END_TEST
+
+#if defined(SELINUX_TEMPLATE_BUILD_DIR)
+static char *render(const char *name, const secure_app_t *secure_app) {
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char *data = NULL;
+    size_t size = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", SELINUX_TEMPLATE_BUILD_DIR, name);
+    FILE *f = open_memstream(&data, &size);
+    ck_assert_ptr_nonnull(f);
+    // leading new line: each line of the result is preceded by '\n'
+    fputc('\n', f);
+    ck_assert_int_eq(fprocess_template(path, f, secure_app), 0);
+    fclose(f);
+    return data;
+}
+
+// statement of a line of a te template, without comment nor ending ';'
+static char *te_statement(char *line) {
+    char *end = strchr(line, '#');
+    if (end)
+        *end = '\0';
+    while (*line == ' ')
+        line++;
+    end = line + strlen(line);
+    while (end > line && (end[-1] == ' ' || end[-1] == ';'))
+        *--end = '\0';
+    return line;
+}
+
+// each statement of the te template is recalled by a "; te: " line of the cil template
+static void check_cil_te(const secure_app_t *secure_app) {
+    char *te = render("app-template.te", secure_app);
+    char *iface = render("app-template.if", secure_app);
+    char *cil = render("app-template.cil", secure_app);
+    char marker[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    bool require = false;
+    int statements = 0;
+    int markers = 0;
+
+    for (char *line = strtok(te, "\n"); line; line = strtok(NULL, "\n")) {
+        line = te_statement(line);
+        if (require) {
+            require = strcmp(line, ")") != 0;
+        } else if (!strncmp(line, "gen_require(", 12)) {
+            require = true;
+        } else if (*line && strncmp(line, "policy_module(", 14)) {
+            snprintf(marker, sizeof(marker), "\n; te: %s\n", line);
+            if (!strstr(cil, marker)) {
+                ERROR("missing in the cil template: %s", line);
+            }
+            ck_assert_ptr_nonnull(strstr(cil, marker));
+            statements++;
+        }
+    }
+    for (char *p = strstr(cil, "\n; te: "); p; p = strstr(p + 1, "\n; te: "))
+        markers++;
+    ck_assert_int_eq(markers, statements);
+
+    for (char *p = strstr(iface, "\ninterface("); p; p = strstr(p + 1, "\ninterface(")) {
+        p += 11;
+        int length = (int)strcspn(p, ",");
+        snprintf(marker, sizeof(marker), "(macro %.*s (", length, p);
+        if (!strstr(cil, marker)) {
+            ERROR("missing in the cil template: interface %.*s", length, p);
+        }
+        ck_assert_ptr_nonnull(strstr(cil, marker));
+    }
+
+    free(te);
+    free(iface);
+    free(cil);
+}
+
+// permission sets of the reference policy (obj_perm_sets.spt) used by the templates
+static const char *const perm_sets[][2] = {
+    {"rw_socket_perms", "ioctl read getattr write setattr append bind connect getopt setopt shutdown"},
+    {"create_socket_perms", "create rw_socket_perms"},
+    {"create_stream_socket_perms", "create_socket_perms listen accept"},
+    {"search_dir_perms", "getattr search open"},
+    {"list_dir_perms", "getattr search open read lock ioctl"},
+    {"rw_dir_perms", "open read getattr lock search ioctl add_name remove_name write"},
+    {"manage_dir_perms",
+     "create open getattr setattr read write link unlink rename search add_name remove_name reparent rmdir lock ioctl"},
+    {"read_file_perms", "getattr open read lock ioctl"},
+    {"mmap_exec_file_perms", "getattr open map read execute ioctl"},
+    {"exec_file_perms", "getattr open map read execute ioctl execute_no_trans"},
+    {"manage_file_perms", "create open getattr setattr read write append rename link unlink ioctl lock"},
+    {"read_lnk_file_perms", "getattr read"},
+    {"manage_lnk_file_perms", "create getattr setattr read write append rename link unlink ioctl lock"},
+    {"read_fifo_file_perms", "getattr open read lock ioctl"},
+    {"manage_fifo_file_perms", "create open getattr setattr read write append rename link unlink ioctl lock"},
+    {"read_sock_file_perms", "getattr open read"},
+    {"write_sock_file_perms", "getattr write open append"},
+    {"manage_sock_file_perms", "create open getattr setattr read write append rename link unlink ioctl lock"},
+};
+
+// interfaces of the reference and redpesk policies used by the templates, with their te expansion
+static const char *const interfaces[][2] = {
+    {"list_dirs_pattern", "allow $1 $2:dir search_dir_perms; allow $1 $3:dir list_dir_perms"},
+    {"read_files_pattern", "allow $1 $2:dir search_dir_perms; allow $1 $3:file read_file_perms"},
+    {"read_lnk_files_pattern", "allow $1 $2:dir search_dir_perms; allow $1 $3:lnk_file read_lnk_file_perms"},
+    {"read_fifo_files_pattern", "allow $1 $2:dir search_dir_perms; allow $1 $3:fifo_file read_fifo_file_perms"},
+    {"read_sock_files_pattern", "allow $1 $2:dir search_dir_perms; allow $1 $3:sock_file read_sock_file_perms"},
+    {"write_sock_files_pattern", "allow $1 $2:dir search_dir_perms; allow $1 $3:sock_file write_sock_file_perms"},
+    {"exec_files_pattern", "allow $1 $2:dir search_dir_perms; allow $1 $3:file exec_file_perms"},
+    {"manage_dirs_pattern", "allow $1 $2:dir rw_dir_perms; allow $1 $3:dir manage_dir_perms"},
+    {"manage_files_pattern", "allow $1 $2:dir rw_dir_perms; allow $1 $3:file manage_file_perms"},
+    {"manage_lnk_files_pattern", "allow $1 $2:dir rw_dir_perms; allow $1 $3:lnk_file manage_lnk_file_perms"},
+    {"manage_fifo_files_pattern", "allow $1 $2:dir rw_dir_perms; allow $1 $3:fifo_file manage_fifo_file_perms"},
+    {"manage_sock_files_pattern", "allow $1 $2:dir rw_dir_perms; allow $1 $3:sock_file manage_sock_file_perms"},
+    {"files_type", "typeattribute $1 file_type, non_security_file_type, non_auth_file_type"},
+    {"files_config_file", "files_type($1); typeattribute $1 configfile"},
+    {"domain_entry_file", "typeattribute $2 entry_type; allow $1 $2:file { entrypoint mmap_exec_file_perms }"},
+    {"init_daemon_domain",
+     "typeattribute $1 domain, daemon; typeattribute $2 exec_type; files_type($2); domain_entry_file($1, $2); "
+     "role system_r types $1; type_transition init_t $2:process $1; allow init_t $2:file mmap_exec_file_perms; "
+     "allow init_t $1:process transition; allow $1 init_t:fd use; allow $1 init_t:process sigchld"},
+    {"init_nnp_daemon_domain", "allow init_t $1:process2 nnp_transition"},
+    {"init_dbus_chat", "allow $1 init_t:dbus send_msg; allow init_t $1:dbus send_msg"},
+    {"init_stream_connect", "allow $1 init_t:unix_stream_socket connectto"},
+    {"init_rw_stream_sockets", "allow $1 init_t:unix_stream_socket rw_socket_perms"},
+    {"kernel_dgram_send", "allow $1 kernel_t:unix_dgram_socket sendto"},
+    {"kernel_dontaudit_read_system_state", "dontaudit $1 proc_t:file read_file_perms"},
+    {"kernel_request_load_module", "allow $1 kernel_t:system module_request"},
+    {"fs_getattr_xattr_fs", "allow $1 fs_t:filesystem getattr"},
+    {"corenet_tcp_bind_generic_node", "allow $1 node_t:tcp_socket node_bind"},
+    {"corenet_tcp_bind_all_unreserved_ports", "allow $1 unreserved_port_t:tcp_socket name_bind"},
+    {"corenet_tcp_connect_unreserved_ports", "allow $1 unreserved_port_t:tcp_socket name_connect"},
+    {"sysnet_dns_name_resolve",
+     "allow $1 self:udp_socket create_socket_perms; allow $1 dns_port_t:tcp_socket name_connect; "
+     "allow $1 dns_client_packet_t:packet { send recv }; allow $1 etc_t:dir search_dir_perms; "
+     "allow $1 net_conf_t:file read_file_perms; allow $1 net_conf_t:lnk_file read_lnk_file_perms"},
+    {"auth_read_passwd", "allow $1 etc_t:dir search_dir_perms; allow $1 passwd_file_t:file read_file_perms"},
+    {"corecmd_exec_bin",
+     "list_dirs_pattern($1, bin_t, bin_t); read_lnk_files_pattern($1, bin_t, bin_t); "
+     "exec_files_pattern($1, bin_t, bin_t)"},
+    {"corecmd_exec_shell", "allow $1 bin_t:dir search_dir_perms; allow $1 shell_exec_t:file exec_file_perms"},
+    {"redpesk_user_manage_home_files",
+     "allow $1 user_home_dir_t:dir search_dir_perms; manage_dirs_pattern($1, user_home_t, user_home_t); "
+     "manage_files_pattern($1, user_home_t, user_home_t); manage_lnk_files_pattern($1, user_home_t, user_home_t)"},
+    {"read_redpesk_public",
+     "list_dirs_pattern($1, redpesk_public_t, redpesk_public_t); read_files_pattern($1, redpesk_public_t, "
+     "redpesk_public_t); read_lnk_files_pattern($1, redpesk_public_t, redpesk_public_t)"},
+    {"mmap_redpesk_public", "allow $1 redpesk_public_t:file map"},
+    {"read_redpesk_scope_platform",
+     "list_dirs_pattern($1, redpesk_scope_platform_t, redpesk_scope_platform_t); "
+     "read_files_pattern($1, redpesk_scope_platform_t, redpesk_scope_platform_t); "
+     "read_lnk_files_pattern($1, redpesk_scope_platform_t, redpesk_scope_platform_t)"},
+    {"read_redpesk_platform_domain",
+     "list_dirs_pattern($1, redpesk_platform_domain, redpesk_platform_domain); "
+     "read_files_pattern($1, redpesk_platform_domain, redpesk_platform_domain); "
+     "read_lnk_files_pattern($1, redpesk_platform_domain, redpesk_platform_domain)"},
+    {"read_redpesk_user_domain",
+     "list_dirs_pattern($1, redpesk_user_domain, redpesk_user_domain); "
+     "read_files_pattern($1, redpesk_user_domain, redpesk_user_domain); "
+     "read_lnk_files_pattern($1, redpesk_user_domain, redpesk_user_domain)"},
+    {"write_redpesk_socket", "write_sock_files_pattern($1, redpesk_socket_t, redpesk_socket_t)"},
+    {"manage_redpesk_scope_platform",
+     "manage_dirs_pattern($1, redpesk_scope_platform_t, redpesk_scope_platform_t); "
+     "manage_files_pattern($1, redpesk_scope_platform_t, redpesk_scope_platform_t)"},
+    {"manage_redpesk_user_shared",
+     "manage_dirs_pattern($1, redpesk_user_shared_t, redpesk_user_shared_t); "
+     "manage_files_pattern($1, redpesk_user_shared_t, redpesk_user_shared_t); "
+     "manage_lnk_files_pattern($1, redpesk_user_shared_t, redpesk_user_shared_t)"},
+    {"read_afbtest_domain",
+     "list_dirs_pattern($1, afbtest_domain, afbtest_domain); read_files_pattern($1, afbtest_domain, afbtest_domain); "
+     "read_lnk_files_pattern($1, afbtest_domain, afbtest_domain); "
+     "read_fifo_files_pattern($1, afbtest_domain, afbtest_domain); "
+     "read_sock_files_pattern($1, afbtest_domain, afbtest_domain)"},
+};
+
+#define MAX_RULES 256
+#define MAX_PERMS 64
+#define MAX_SIZE_RULE 1024
+
+// a cil rule, the permissions of the allow rules being merged as the compiler does
+typedef struct {
+    char key[MAX_SIZE_RULE];
+    char perms[MAX_SIZE_RULE];
+} rule_t;
+
+typedef struct {
+    size_t count;
+    rule_t rules[MAX_RULES];
+} rules_t;
+
+static int compare_perms(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int compare_rules(const void *a, const void *b) {
+    return strcmp(((const rule_t *)a)->key, ((const rule_t *)b)->key);
+}
+
+static void add_rule(rules_t *rules, const char *key, const char *perms) {
+    char all[2 * MAX_SIZE_RULE];
+    char *tokens[MAX_PERMS];
+    char *save = NULL;
+    size_t i, count = 0;
+
+    for (i = 0; i < rules->count && strcmp(rules->rules[i].key, key); i++)
+        ;
+    ck_assert_int_lt(i, MAX_RULES);
+    rule_t *rule = &rules->rules[i];
+    if (i == rules->count) {
+        rules->count++;
+        ck_assert_int_lt(snprintf(rule->key, sizeof(rule->key), "%s", key), (int)sizeof(rule->key));
+    }
+
+    // sorted union of the permissions
+    ck_assert_int_lt(snprintf(all, sizeof(all), "%s %s", rule->perms, perms), (int)sizeof(all));
+    for (char *perm = strtok_r(all, " ", &save); perm; perm = strtok_r(NULL, " ", &save)) {
+        ck_assert_int_lt(count, MAX_PERMS);
+        tokens[count++] = perm;
+    }
+    qsort(tokens, count, sizeof(*tokens), compare_perms);
+    rule->perms[0] = '\0';
+    for (i = 0; i < count; i++) {
+        if (i == 0 || strcmp(tokens[i], tokens[i - 1])) {
+            size_t length = strlen(rule->perms);
+            snprintf(rule->perms + length, sizeof(rule->perms) - length, "%s%s", length ? " " : "", tokens[i]);
+        }
+    }
+}
+
+// the permission sets are replaced by their permissions
+static void expand_perms(char *perms, size_t size, const char *list) {
+    char copy[MAX_SIZE_RULE];
+    char *save = NULL;
+    size_t i, count = sizeof(perm_sets) / sizeof(*perm_sets);
+
+    ck_assert_int_lt(snprintf(copy, sizeof(copy), "%s", list), (int)sizeof(copy));
+    for (char *perm = strtok_r(copy, " {}", &save); perm; perm = strtok_r(NULL, " {}", &save)) {
+        for (i = 0; i < count && strcmp(perm, perm_sets[i][0]); i++)
+            ;
+        if (i < count) {
+            expand_perms(perms, size, perm_sets[i][1]);
+        } else {
+            size_t length = strlen(perms);
+            ck_assert_int_lt(snprintf(perms + length, size - length, " %s", perm), (int)(size - length));
+        }
+    }
+}
+
+static void expand_statements(rules_t *rules, const char *text, const char *const *args, int nargs,
+                              const char *iface);
+
+// adds the cil rules of one te statement
+static void expand_statement(rules_t *rules, char *statement, const char *iface) {
+    char key[MAX_SIZE_RULE];
+    char perms[MAX_SIZE_RULE] = "";
+    const char *args[3];
+    int nargs = 0;
+    char *save = NULL;
+
+    while (*statement == ' ')
+        statement++;
+    char *open = strchr(statement, '(');
+    if (open) {
+        // call of an interface
+        *open = '\0';
+        open[strcspn(open + 1, ")") + 1] = '\0';
+        for (char *arg = strtok_r(open + 1, ", ", &save); arg; arg = strtok_r(NULL, ", ", &save)) {
+            ck_assert_int_lt(nargs, 3);
+            args[nargs++] = arg;
+        }
+        for (size_t i = 0; i < sizeof(interfaces) / sizeof(*interfaces); i++) {
+            if (!strcmp(statement, interfaces[i][0])) {
+                expand_statements(rules, interfaces[i][1], args, nargs, iface);
+                return;
+            }
+        }
+        // interface of the module
+        ck_assert_int_lt(snprintf(key, sizeof(key), "\ninterface(%s,", statement), (int)sizeof(key));
+        if (!strstr(iface, key)) {
+            ERROR("unknown interface %s", statement);
+        }
+        ck_assert_ptr_nonnull(strstr(iface, key));
+        ck_assert_int_eq(nargs, 1);
+        snprintf(key, sizeof(key), "(call %s (%s))", statement, args[0]);
+        add_rule(rules, key, "");
+        return;
+    }
+
+    const char *kind = strtok_r(statement, " ", &save);
+    if (!strcmp(kind, "allow") || !strcmp(kind, "dontaudit")) {
+        const char *source = strtok_r(NULL, " ", &save);
+        const char *target = strtok_r(NULL, ":", &save);
+        const char *class = strtok_r(NULL, " ", &save);
+        expand_perms(perms, sizeof(perms), save);
+        snprintf(key, sizeof(key), "(%s %s %s (%s", kind, source, target, class);
+        add_rule(rules, key, perms);
+    } else if (!strcmp(kind, "type_transition")) {
+        const char *source = strtok_r(NULL, " ", &save);
+        const char *target = strtok_r(NULL, ":", &save);
+        const char *class = strtok_r(NULL, " ", &save);
+        snprintf(key, sizeof(key), "(typetransition %s %s %s %s)", source, target, class, save);
+        add_rule(rules, key, "");
+    } else if (!strcmp(kind, "typeattribute")) {
+        const char *type = strtok_r(NULL, " ", &save);
+        for (char *attribute = strtok_r(NULL, ", ", &save); attribute; attribute = strtok_r(NULL, ", ", &save)) {
+            snprintf(key, sizeof(key), "(typeattributeset %s (%s))", attribute, type);
+            add_rule(rules, key, "");
+        }
+    } else if (!strcmp(kind, "attribute")) {
+        snprintf(key, sizeof(key), "(typeattribute %s)", save);
+        add_rule(rules, key, "");
+    } else if (!strcmp(kind, "type")) {
+        snprintf(key, sizeof(key), "(type %s)", save);
+        add_rule(rules, key, "");
+    } else if (!strcmp(kind, "role")) {
+        const char *role = strtok_r(NULL, " ", &save);
+        ck_assert_str_eq(strtok_r(NULL, " ", &save), "types");
+        snprintf(key, sizeof(key), "(roletype %s %s)", role, save);
+        add_rule(rules, key, "");
+    } else {
+        ERROR("unknown statement %s", kind);
+        ck_assert_ptr_null(kind);
+    }
+}
+
+// adds the cil rules of te statements separated by ';', after substitution of the arguments
+static void expand_statements(rules_t *rules, const char *text, const char *const *args, int nargs,
+                              const char *iface) {
+    char statements[4 * MAX_SIZE_RULE];
+    char *save = NULL;
+    size_t length = 0;
+
+    for (const char *p = text; *p; p++) {
+        if (p[0] == '$' && p[1] >= '1' && p[1] <= '9') {
+            ck_assert_int_lt(p[1] - '1', nargs);
+            length += strlen(args[p[1] - '1']);
+            ck_assert_int_lt(length, sizeof(statements));
+            strcpy(statements + length - strlen(args[p[1] - '1']), args[p[1] - '1']);
+            p++;
+        } else {
+            ck_assert_int_lt(length + 1, sizeof(statements));
+            statements[length++] = *p;
+        }
+    }
+    statements[length] = '\0';
+    for (char *statement = strtok_r(statements, ";", &save); statement; statement = strtok_r(NULL, ";", &save))
+        expand_statement(rules, statement, iface);
+}
+
+// adds a rule of a cil module
+static void add_cil_rule(rules_t *rules, char *line) {
+    while (*line == ' ')
+        line++;
+    if (!strncmp(line, "(allow ", 7) || !strncmp(line, "(dontaudit ", 11)) {
+        // (kind source target (class (perms)))
+        char *perms = strstr(strstr(line, " (") + 2, " (");
+        *perms = '\0';
+        perms += 2;
+        perms[strcspn(perms, ")")] = '\0';
+        add_rule(rules, line, perms);
+    } else {
+        add_rule(rules, line, "");
+    }
+}
+
+// sorted text of the rules
+static char *dump_rules(rules_t *rules) {
+    char *data = NULL;
+    size_t size = 0;
+
+    qsort(rules->rules, rules->count, sizeof(*rules->rules), compare_rules);
+    FILE *f = open_memstream(&data, &size);
+    ck_assert_ptr_nonnull(f);
+    for (size_t i = 0; i < rules->count; i++) {
+        if (rules->rules[i].perms[0])
+            fprintf(f, "%s (%s)))\n", rules->rules[i].key, rules->rules[i].perms);
+        else
+            fprintf(f, "%s\n", rules->rules[i].key);
+    }
+    fclose(f);
+    memset(rules, 0, sizeof(*rules));
+    return data;
+}
+
+static void check_same_rules(rules_t *expected, rules_t *actual, const char *what) {
+    char *expected_text = dump_rules(expected);
+    char *actual_text = dump_rules(actual);
+    if (strcmp(expected_text, actual_text)) {
+        ERROR("%s: rules of the te template\n%s\nrules of the cil template\n%s", what, expected_text, actual_text);
+    }
+    ck_assert_str_eq(expected_text, actual_text);
+    free(expected_text);
+    free(actual_text);
+}
+
+// the rules of the cil template are the expansion of the te and if templates
+static void check_cil_rules(const secure_app_t *secure_app) {
+    char *te = render("app-template.te", secure_app);
+    char *iface = render("app-template.if", secure_app);
+    char *cil = render("app-template.cil", secure_app);
+    char marker[MAX_SIZE_RULE];
+    static const char *const domain[] = {"domain"};
+    rules_t *expected = calloc(1, sizeof(*expected));
+    rules_t *actual = calloc(1, sizeof(*actual));
+    char *save = NULL;
+    bool require = false;
+
+    ck_assert_ptr_nonnull(expected);
+    ck_assert_ptr_nonnull(actual);
+
+    // each interface against its macro
+    for (char *p = strstr(iface, "\ninterface("); p; p = strstr(p + 1, "\ninterface(")) {
+        int length = (int)strcspn(p + 11, ",");
+        char *body = strndup(p, (size_t)(strstr(p + 1, "\n)") - p));
+        ck_assert_ptr_nonnull(body);
+        for (char *line = strtok_r(strchr(body + 1, '\n'), "\n", &save); line;
+             line = strtok_r(NULL, "\n", &save)) {
+            line = te_statement(line);
+            if (require)
+                require = strchr(line, ')') == NULL;
+            else if (!strncmp(line, "gen_require(", 12))
+                require = true;
+            else if (*line)
+                expand_statements(expected, line, domain, 1, iface);
+        }
+        free(body);
+
+        snprintf(marker, sizeof(marker), "(macro %.*s ((type domain))\n", length, p + 11);
+        char *macro = strstr(cil, marker);
+        ck_assert_ptr_nonnull(macro);
+        macro += strlen(marker);
+        macro = strndup(macro, (size_t)(strstr(macro, "\n)") - macro));
+        ck_assert_ptr_nonnull(macro);
+        for (char *line = strtok_r(macro, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+            add_cil_rule(actual, line);
+        free(macro);
+        check_same_rules(expected, actual, marker);
+    }
+
+    // statements of the module
+    for (char *line = strtok_r(te, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        line = te_statement(line);
+        if (require)
+            require = strcmp(line, ")") != 0;
+        else if (!strncmp(line, "gen_require(", 12))
+            require = true;
+        else if (*line && strncmp(line, "policy_module(", 14))
+            expand_statements(expected, line, NULL, 0, iface);
+    }
+    for (char *line = strtok_r(cil, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        if (!strncmp(line, "(macro ", 7))
+            require = true;
+        else if (require)
+            require = strcmp(line, ")") != 0;
+        else if (strncmp(line, "; te: ", 6))
+            add_cil_rule(actual, line);
+    }
+    check_same_rules(expected, actual, "module");
+
+    free(expected);
+    free(actual);
+    free(te);
+    free(iface);
+    free(cil);
+}
+
+START_TEST(test_cil_matches_te) {
+    static const char *const permissions[] = {
+        "urn:AGL:permission::partner:scope-platform", "urn:AGL:permission::partner:create-can-socket",
+        "urn:AGL:permission::partner:read-afbtest",   "urn:AGL:permission::partner:execute-shell",
+        "urn:AGL:permission::partner:manage-tmp",     "urn:AGL:permission::partner:manage-user-shared"};
+
+    secure_app_t *secure_app = NULL;
+    ck_assert_int_eq(create_secure_app(&secure_app), 0);
+    ck_assert_int_eq(secure_app_set_id(secure_app, TESTID), 0);
+    check_cil_te(secure_app);
+    check_cil_rules(secure_app);
+
+    ck_assert_int_eq(secure_app_add_permissions(secure_app, sizeof(permissions) / sizeof(*permissions), permissions),
+                     0);
+    check_cil_te(secure_app);
+    check_cil_rules(secure_app);
+
+    destroy_secure_app(secure_app);
+}
+END_TEST
+#endif
+
+#if defined(SIMULATE_SELINUX)
+#define GROUP_COMMIT_THREADS 4
+
+static void *remove_module_thread(void *arg) {
+    return (void *)(intptr_t)commit_module(NULL, NULL, 0, arg);
+}
+
+START_TEST(test_group_commit) {
+    pthread_t threads[GROUP_COMMIT_THREADS];
+    char names[GROUP_COMMIT_THREADS][32];
+    void *status;
+
+    // the callers arriving within the window share the commit of the leader
+    ck_assert_int_eq(setenv("SELINUX_COMMIT_WINDOW", "200", 1), 0);
+    commits = 0;
+    for (int i = 0; i < GROUP_COMMIT_THREADS; i++) {
+        snprintf(names[i], sizeof(names[i]), "group-commit-%d", i);
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, remove_module_thread, names[i]), 0);
+    }
+    for (int i = 0; i < GROUP_COMMIT_THREADS; i++) {
+        ck_assert_int_eq(pthread_join(threads[i], &status), 0);
+        ck_assert_int_eq((intptr_t)status, 0);
+    }
+    ck_assert_int_eq(commits, 1);
+
+    // without window, a lone caller commits alone
+    ck_assert_int_eq(unsetenv("SELINUX_COMMIT_WINDOW"), 0);
+    ck_assert_int_eq(commit_module(NULL, NULL, 0, "group-commit-0"), 0);
+    ck_assert_int_eq(commits, 2);
+}
+END_TEST
+#endif
+
 void test_selinux_template() {
     addtest(test_generate_app_module_fc);
     addtest(test_generate_app_module_files);
+    addtest(test_generate_app_module_cil);
+    addtest(test_get_selinux_compile_jobs);
+#if defined(SELINUX_TEMPLATE_BUILD_DIR)
+    addtest(test_cil_matches_te);
+#endif
+#if defined(SIMULATE_SELINUX)
+    addtest(test_group_commit);
+#endif
 }
@@ -23,6 +23,7 @@
 
 #include "../selinux.c"
 #include "./test-selinux-template.c"
+#include "./test-selinux-cache.c"
 #include "setup-tests.h"
 
 START_TEST(test_selinux_process_paths) {
@@ -55,4 +55,134 @@ START_TEST(test_init_path_type_definitions) {
 }
 END_TEST
 
-void test_smack_label() { addtest(test_init_path_type_definitions); }
+START_TEST(test_parse_rules) {
+    smack_rules_t smack_rules;
+
+    ck_assert_int_eq(parse_rules("", &smack_rules), 0);
+    ck_assert_int_eq(smack_rules.count, 0);
+    free_rules(&smack_rules);
+
+    ck_assert_int_eq(parse_rules("\n# comment\nSystem App:testid rwxa\n\nApp:testid User:Home rx -\n", &smack_rules), 0);
+    ck_assert_int_eq(smack_rules.count, 2);
+    ck_assert_str_eq(smack_rules.rules[0].subject, "System");
+    ck_assert_str_eq(smack_rules.rules[0].object, "App:testid");
+    ck_assert_str_eq(smack_rules.rules[0].access, "rwxa");
+    ck_assert_ptr_null(smack_rules.rules[0].deny);
+    ck_assert_str_eq(smack_rules.rules[1].deny, "-");
+    free_rules(&smack_rules);
+
+    ck_assert_int_eq(parse_rules("App:testid System:Shared\n", &smack_rules), -EINVAL);
+    ck_assert_int_eq(parse_rules("App:testid System:Shared rx - w\n", &smack_rules), -EINVAL);
+}
+END_TEST
+
+START_TEST(test_add_delta) {
+    smack_rules_t from, to;
+    size_t count;
+    struct smack_accesses *smack_accesses = NULL;
+    ck_assert_int_eq(smack_accesses_new(&smack_accesses), 0);
+
+    ck_assert_int_eq(parse_rules("System App:testid rwxa\nApp:testid System:Shared rx\nApp:testid User:Home rx\n",
+                                 &from), 0);
+    ck_assert_int_eq(parse_rules("System App:testid awrx\nApp:testid System:Shared r\nApp:testid System:Run rw\n",
+                                 &to), 0);
+
+    // User:Home cleared, System:Shared changed, System:Run added
+    ck_assert_int_eq(add_delta(smack_accesses, &from, &to, &count), 0);
+    ck_assert_int_eq(count, 3);
+    ck_assert_int_eq(add_delta(smack_accesses, &to, &to, &count), 0);
+    ck_assert_int_eq(count, 0);
+    ck_assert_int_eq(add_delta(smack_accesses, &(smack_rules_t){.count = 0}, &to, &count), 0);
+    ck_assert_int_eq(count, 3);
+
+    free_rules(&from);
+    free_rules(&to);
+
+    ck_assert_int_eq(
+        parse_rules("App:testid User:Home rx -\nApp:testid System:Shared rw -\nApp:testid System:Run r w\n", &from),
+        0);
+    ck_assert_int_eq(
+        parse_rules("App:testid User:Home xr -\nApp:testid System:Shared r -\nApp:testid System:Run r\n", &to), 0);
+
+    // User:Home unchanged, System:Shared reverted and set, System:Run reverted and set
+    ck_assert_int_eq(add_delta(smack_accesses, &from, &to, &count), 0);
+    ck_assert_int_eq(count, 4);
+    ck_assert_int_eq(add_delta(smack_accesses, &to, &to, &count), 0);
+    ck_assert_int_eq(count, 0);
+    // all the modify rules reverted
+    ck_assert_int_eq(add_delta(smack_accesses, &from, &(smack_rules_t){.count = 0}, &count), 0);
+    ck_assert_int_eq(count, 3);
+
+    free_rules(&from);
+    free_rules(&to);
+    smack_accesses_free(smack_accesses);
+}
+END_TEST
+
+START_TEST(test_restore_rules) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR] = {'\0'};
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char load[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    smack_rules_t first, second;
+    smack_rule_set_t set = {.slots = NULL, .capacity = 0, .count = 0};
+    smack_restore_stats_t stats = {0};
+    char **names;
+    size_t count;
+    create_tmp_dir(tmp_dir);
+
+    // only the rule files are listed, sorted
+    snprintf(path, sizeof(path), "%s/b.smack", tmp_dir);
+    ck_assert_int_eq(create_file(path), 0);
+    snprintf(path, sizeof(path), "%s/a.smack", tmp_dir);
+    ck_assert_int_eq(create_file(path), 0);
+    snprintf(path, sizeof(path), "%s/c.txt", tmp_dir);
+    ck_assert_int_eq(create_file(path), 0);
+    ck_assert_int_eq(list_rule_files(tmp_dir, &names, &count), 0);
+    ck_assert_int_eq(count, 2);
+    ck_assert_str_eq(names[0], "a.smack");
+    ck_assert_str_eq(names[1], "b.smack");
+    free(names[0]);
+    free(names[1]);
+    free(names);
+
+    // the last rule of a subject and object wins
+    ck_assert_int_eq(parse_rules("System App:testid rwxa\nApp:testid System:Shared rx\n", &first), 0);
+    ck_assert_int_eq(parse_rules("App:testid System:Shared r\nApp:testid User:Home rx -\n", &second), 0);
+    for (size_t i = 0; i < first.count; i++)
+        ck_assert_int_eq(rule_set_add(&set, &first.rules[i]), 0);
+    for (size_t i = 0; i < second.count; i++)
+        ck_assert_int_eq(rule_set_add(&set, &second.rules[i]), 0);
+    ck_assert_int_eq(set.count, 3);
+
+    // the rules are written in one batch per file
+    snprintf(load, sizeof(load), "%s/load2", tmp_dir);
+    ck_assert_int_eq(create_file(load), 0);
+    ck_assert_int_eq(write_rules(load, &set, false, &stats), 0);
+    ck_assert_int_eq(stats.loaded, 2);
+    ck_assert_int_eq(stats.writes, 1);
+    char *text = read_file(load);
+    ck_assert_ptr_nonnull(text);
+    ck_assert_ptr_nonnull(strstr(text, "System App:testid rwxa\n"));
+    ck_assert_ptr_nonnull(strstr(text, "App:testid System:Shared r\n"));
+    ck_assert_ptr_null(strstr(text, "User:Home"));
+    free(text);
+
+    free(set.slots);
+    free_rules(&first);
+    free_rules(&second);
+    remove(load);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/a.smack", tmp_dir);
+    remove(path);
+    snprintf(path, sizeof(path), "%s/b.smack", tmp_dir);
+    remove(path);
+    rmdir(tmp_dir);
+}
+END_TEST
+
+void test_smack_label() {
+    addtest(test_init_path_type_definitions);
+    addtest(test_parse_rules);
+    addtest(test_add_delta);
+    addtest(test_restore_rules);
+}
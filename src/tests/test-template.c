@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020-2023 IoT.bzh Company
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../template.c"
+#include "setup-tests.h"
+
+static void write_template(const char *path, const char *text) {
+    FILE *file = fopen(path, "w");
+    ck_assert_ptr_ne(file, NULL);
+    fputs(text, file);
+    fclose(file);
+}
+
+static char *render_template(const char *path, const secure_app_t *secure_app) {
+    char *result = NULL;
+    size_t size;
+    FILE *file = open_memstream(&result, &size);
+    ck_assert_ptr_ne(file, NULL);
+    ck_assert_int_eq(fprocess_template(path, file, secure_app), 0);
+    fclose(file);
+    return result;
+}
+
+// mustach takes a mutable closure: the fixture is given as is
+static char *render_mustach(const char *text, secure_app_t *secure_app) {
+    char *result = NULL;
+    size_t size;
+    ck_assert_int_eq(mustach(text, &itf, secure_app, &result, &size), 0);
+    return result;
+}
+
+START_TEST(test_template_compile) {
+    const char *texts[] = {"no tag at all\n",
+                           "{{id}} {{ id_underscore }} {{{id}}} {{&id}} {{unknown}}\n",
+                           "{{#perm1}}in {{id}}{{/perm1}}{{^perm1}}out{{/perm1}}\n",
+                           "{{#perm2}}A{{#perm1}}B{{/perm1}}{{/perm2}}{{^perm2}}C{{#perm1}}D{{/perm1}}{{/perm2}}\n",
+                           "{{! comment }}x{{=<% %>=}}<%id%>{{id}}<%={{ }}=%>{{id}}\n"};
+    char tmp_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    secure_app_t *secure_app = NULL;
+    create_tmp_file(tmp_file);
+
+    ck_assert_int_eq(create_secure_app(&secure_app), 0);
+    ck_assert_int_eq(secure_app_set_id(secure_app, "test-id"), 0);
+    ck_assert_int_eq(secure_app_add_permission(secure_app, "perm1"), 0);
+
+    // same output as mustach
+    for (size_t i = 0; i < sizeof(texts) / sizeof(*texts); i++) {
+        write_template(tmp_file, texts[i]);
+        template_cache_clear();
+        char *expected = render_mustach(texts[i], secure_app);
+        char *result = render_template(tmp_file, secure_app);
+        ck_assert_str_eq(result, expected);
+        ck_assert_ptr_ne(template_cache.entries->ops, NULL);
+        free(expected);
+        free(result);
+    }
+
+    // partials are left to mustach, errors are reported
+    write_template(tmp_file, "{{>id}}\n");
+    template_cache_clear();
+    char *result = render_template(tmp_file, secure_app);
+    ck_assert_ptr_eq(template_cache.entries->ops, NULL);
+    free(result);
+    write_template(tmp_file, "{{#perm1}}\n");
+    FILE *file = fopen("/dev/null", "w");
+    ck_assert_int_lt(fprocess_template(tmp_file, file, secure_app), 0);
+    fclose(file);
+
+    template_cache_clear();
+    destroy_secure_app(secure_app);
+    ck_assert_int_eq(remove_file(tmp_file), 0);
+}
+END_TEST
+
+START_TEST(test_template_reload) {
+    char tmp_file[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    secure_app_t *secure_app = NULL;
+    create_tmp_file(tmp_file);
+    ck_assert_int_eq(create_secure_app(&secure_app), 0);
+    ck_assert_int_eq(secure_app_set_id(secure_app, "test-id"), 0);
+    template_cache_clear();
+
+    // without watch, checked at each use
+    write_template(tmp_file, "v1 {{id}}");
+    char *result = render_template(tmp_file, secure_app);
+    ck_assert_str_eq(result, "v1 test-id");
+    free(result);
+    write_template(tmp_file, "v22 {{id}}");
+    result = render_template(tmp_file, secure_app);
+    ck_assert_str_eq(result, "v22 test-id");
+    free(result);
+
+    // with watch, replaced on notification
+    ck_assert_int_ge(template_cache_watch(), 0);
+    ck_assert_int_ge(template_cache.entries->wd, 0);
+    write_template(tmp_file, "v333 {{id}}");
+    template_cache_process();
+    ck_assert_ptr_ne(template_cache.entries, NULL);
+    result = render_template(tmp_file, secure_app);
+    ck_assert_str_eq(result, "v333 test-id");
+    free(result);
+
+    template_cache_clear();
+    destroy_secure_app(secure_app);
+    ck_assert_int_eq(remove_file(tmp_file), 0);
+}
+END_TEST
+
+void test_template(void) {
+    addtest(test_template_compile);
+    addtest(test_template_reload);
+}
@@ -22,6 +22,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -89,9 +90,66 @@ START_TEST(test_remove_file) {
 }
 END_TEST
 
+START_TEST(test_set_label) {
+    char tmp_file[SEC_LSM_MANAGER_MAX_SIZE_PATH] = {'\0'};
+    label_stats_t before, after;
+    create_tmp_file(tmp_file);
+
+    get_label_stats(&before);
+    ck_assert_int_eq(set_label(tmp_file, "user.sec-lsm-manager", "Label"), 0);
+    ck_assert_int_eq(compare_xattr(tmp_file, "user.sec-lsm-manager", "Label"), true);
+
+    // same label not written again, longer or shorter labels written
+    ck_assert_int_eq(set_label(tmp_file, "user.sec-lsm-manager", "Label"), 0);
+    int fd = open(tmp_file, O_RDONLY);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(set_label_fd(fd, "user.sec-lsm-manager", "Label"), 0);
+    ck_assert_int_eq(set_label_fd(fd, "user.sec-lsm-manager", "Label2"), 0);
+    ck_assert_int_eq(compare_xattr(tmp_file, "user.sec-lsm-manager", "Label2"), true);
+    ck_assert_int_eq(set_label(tmp_file, "user.sec-lsm-manager", "Lab"), 0);
+    ck_assert_int_eq(compare_xattr(tmp_file, "user.sec-lsm-manager", "Lab"), true);
+    close(fd);
+
+    get_label_stats(&after);
+    ck_assert_int_eq((int)(after.written - before.written), 3);
+    ck_assert_int_eq((int)(after.skipped - before.skipped), 2);
+    ck_assert_int_eq(remove_file(tmp_file), 0);
+}
+END_TEST
+
+START_TEST(test_write_file) {
+    char tmp_dir[SEC_LSM_MANAGER_MAX_SIZE_DIR] = {'\0'};
+    char path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    char long_path[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    struct stat st;
+    create_tmp_dir(tmp_dir);
+
+    snprintf(path, sizeof(path), "%s/file", tmp_dir);
+    ck_assert_int_eq(write_file(path, "first", 5), 0);
+    ck_assert_int_eq(write_file(path, "second", 6), 0);
+    char *content = read_file(path);
+    ck_assert_str_eq(content, "second");
+    free(content);
+    ck_assert_int_eq(stat(path, &st), 0);
+    ck_assert_int_eq((int)(st.st_mode & 0777), 0644);
+
+    // no room for the suffix of the temporary file
+    memset(long_path, 'x', sizeof(long_path) - 1);
+    long_path[0] = '/';
+    long_path[sizeof(long_path) - 1] = '\0';
+    ck_assert_int_eq(write_file(long_path, "data", 4), -ENAMETOOLONG);
+
+    // only the file is left in the directory
+    ck_assert_int_eq(remove_file(path), 0);
+    ck_assert_int_eq(rmdir(tmp_dir), 0);
+}
+END_TEST
+
 void test_utils(void) {
     addtest(test_check_file_exists);
     addtest(test_check_dir);
     addtest(test_check_executable);
     addtest(test_remove_file);
+    addtest(test_set_label);
+    addtest(test_write_file);
 }
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020-2023 IoT.bzh Company
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/epoll.h>
+
+#include "../pollitem.c"
+#include "../worker.c"
+#include "setup-tests.h"
+
+/** state shared by the jobs of the tests */
+static struct {
+    pthread_mutex_t mutex;
+    int running;
+    int max_running;
+    int done;
+    int order[8];
+} wstate = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static int job_sleep(void *closure) {
+    pthread_mutex_lock(&wstate.mutex);
+    if (++wstate.running > wstate.max_running)
+        wstate.max_running = wstate.running;
+    pthread_mutex_unlock(&wstate.mutex);
+    usleep(20000);
+    pthread_mutex_lock(&wstate.mutex);
+    wstate.running--;
+    pthread_mutex_unlock(&wstate.mutex);
+    return -(int)(intptr_t)closure;
+}
+
+static void job_done(void *closure, int status) {
+    ck_assert_int_eq(status, -(int)(intptr_t)closure);
+    wstate.order[wstate.done++] = (int)(intptr_t)closure;
+}
+
+static void wait_jobs(int pollfd, int count) {
+    while (wstate.done < count) ck_assert_int_ge(pollitem_wait_dispatch(pollfd, 5000), 1);
+}
+
+START_TEST(test_worker_pool_create) {
+    worker_pool_t *pool = NULL;
+    int pollfd = epoll_create1(EPOLL_CLOEXEC);
+    ck_assert_int_ge(pollfd, 0);
+    ck_assert_int_eq(worker_pool_create(&pool, 0, pollfd), -EINVAL);
+    ck_assert_int_eq(worker_pool_create(&pool, 2, pollfd), 0);
+    ck_assert_ptr_ne(pool, NULL);
+    worker_pool_destroy(pool);
+    close(pollfd);
+}
+END_TEST
+
+START_TEST(test_worker_pool_parallel) {
+    worker_pool_t *pool = NULL;
+    int pollfd = epoll_create1(EPOLL_CLOEXEC);
+    memset(wstate.order, 0, sizeof(wstate.order));
+    wstate.max_running = wstate.done = 0;
+    ck_assert_int_eq(worker_pool_create(&pool, 3, pollfd), 0);
+    ck_assert_int_eq(worker_pool_submit(pool, "app-a", job_sleep, job_done, (void *)1), 0);
+    ck_assert_int_eq(worker_pool_submit(pool, "app-b", job_sleep, job_done, (void *)2), 0);
+    ck_assert_int_eq(worker_pool_submit(pool, "app-c", job_sleep, job_done, (void *)3), 0);
+    wait_jobs(pollfd, 3);
+    ck_assert_int_gt(wstate.max_running, 1);
+    worker_pool_destroy(pool);
+    close(pollfd);
+}
+END_TEST
+
+START_TEST(test_worker_pool_same_key) {
+    worker_pool_t *pool = NULL;
+    int pollfd = epoll_create1(EPOLL_CLOEXEC);
+    memset(wstate.order, 0, sizeof(wstate.order));
+    wstate.max_running = wstate.done = 0;
+    ck_assert_int_eq(worker_pool_create(&pool, 3, pollfd), 0);
+    ck_assert_int_eq(worker_pool_submit(pool, "app", job_sleep, job_done, (void *)1), 0);
+    ck_assert_int_eq(worker_pool_submit(pool, "app", job_sleep, job_done, (void *)2), 0);
+    ck_assert_int_eq(worker_pool_submit(pool, "app", job_sleep, job_done, (void *)3), 0);
+    wait_jobs(pollfd, 3);
+    ck_assert_int_eq(wstate.max_running, 1);
+    ck_assert_int_eq(wstate.order[0], 1);
+    ck_assert_int_eq(wstate.order[1], 2);
+    ck_assert_int_eq(wstate.order[2], 3);
+    worker_pool_destroy(pool);
+    close(pollfd);
+}
+END_TEST
+
+static void job_cancelled(void *closure, int status) {
+    (void)closure;
+    ck_assert_int_eq(status, -ECANCELED);
+    wstate.done++;
+}
+
+START_TEST(test_worker_pool_destroy) {
+    worker_pool_t *pool = NULL;
+    int pollfd = epoll_create1(EPOLL_CLOEXEC);
+    wstate.max_running = wstate.done = 0;
+    ck_assert_int_eq(worker_pool_create(&pool, 1, pollfd), 0);
+    // the first job runs, the second waits for the key, both are completed
+    ck_assert_int_eq(worker_pool_submit(pool, "app", job_sleep, job_done, (void *)1), 0);
+    ck_assert_int_eq(worker_pool_submit(pool, "app", job_sleep, job_cancelled, (void *)2), 0);
+    usleep(5000);
+    worker_pool_destroy(pool);
+    ck_assert_int_eq(wstate.done, 2);
+    close(pollfd);
+}
+END_TEST
+
+void test_worker(void) {
+    addtest(test_worker_pool_create);
+    addtest(test_worker_pool_parallel);
+    addtest(test_worker_pool_same_key);
+    addtest(test_worker_pool_destroy);
+}
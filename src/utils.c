@@ -38,6 +38,41 @@
 
 static const size_t BLOCKSIZE = 8192;
 
+/**
+ * Counters of the labels, updated atomically
+ * (this file is also part of the client library, which doesn't use pthread)
+ */
+static label_stats_t label_stats = {.written = 0, .skipped = 0};
+
+/***********************/
+/*** PRIVATE METHODS ***/
+/***********************/
+
+/**
+ * @brief Check if the read value of a label is 'value'
+ * Some filesystems return the label with its terminating zero.
+ *
+ * @param[in] current the value read
+ * @param[in] length the length read or a negative value
+ * @param[in] value the expected value
+ * @param[in] size the length of the expected value
+ * @return true if the label is already 'value'
+ */
+__nonnull() __wur static bool same_label(const char *current, ssize_t length, const char *value, size_t size) {
+    if (length == (ssize_t)size + 1 && current[size] == '\0')
+        length--;
+    return length == (ssize_t)size && !memcmp(current, value, size);
+}
+
+/**
+ * @brief Count a label written or skipped
+ *
+ * @param[in] written true if the label was written
+ */
+static void count_label(bool written) {
+    __atomic_fetch_add(written ? &label_stats.written : &label_stats.skipped, 1, __ATOMIC_RELAXED);
+}
+
 /**********************/
 /*** PUBLIC METHODS ***/
 /**********************/
@@ -67,9 +102,30 @@ bool valid_label(const char *s) {
     return true;
 }
 
+/* see utils.h */
+size_t hash_string(const char *s, size_t len, bool ignore_case) {
+    size_t hash = (size_t)14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)(ignore_case ? tolower((unsigned char)s[i]) : s[i]);
+        hash *= (size_t)1099511628211ULL;
+    }
+
+    return hash;
+}
+
 /* see utils.h */
 int set_label(const char *path, const char *xattr, const char *value) {
-    int rc = lsetxattr(path, xattr, value, strlen(value), 0);
+    char current[SEC_LSM_MANAGER_MAX_SIZE_LABEL + 8];
+    size_t size = strlen(value);
+
+    // don't dirty the inode when the label is already set
+    if (size < sizeof(current) && same_label(current, lgetxattr(path, xattr, current, size + 1), value, size)) {
+        count_label(false);
+        return 0;
+    }
+
+    int rc = lsetxattr(path, xattr, value, size, 0);
     if (rc < 0) {
         rc = -errno;
         ERROR("lsetxattr('%s','%s','%s',%ld,%d) : %d %s", path, xattr, value, strlen(value), 0, -rc, strerror(-rc));
@@ -77,10 +133,39 @@ int set_label(const char *path, const char *xattr, const char *value) {
     }
 
     DEBUG("set %s=%s on %s", xattr, value, path);
+    count_label(true);
+
+    return 0;
+}
+
+/* see utils.h */
+int set_label_fd(int fd, const char *xattr, const char *value) {
+    char current[SEC_LSM_MANAGER_MAX_SIZE_LABEL + 8];
+    size_t size = strlen(value);
+
+    // don't dirty the inode when the label is already set
+    if (size < sizeof(current) && same_label(current, fgetxattr(fd, xattr, current, size + 1), value, size)) {
+        count_label(false);
+        return 0;
+    }
+
+    int rc = fsetxattr(fd, xattr, value, size, 0);
+    if (rc < 0) {
+        rc = -errno;
+        ERROR("fsetxattr(%d,'%s','%s',%ld,%d) : %d %s", fd, xattr, value, size, 0, -rc, strerror(-rc));
+        return rc;
+    }
 
+    count_label(true);
     return 0;
 }
 
+/* see utils.h */
+void get_label_stats(label_stats_t *stats) {
+    stats->written = __atomic_load_n(&label_stats.written, __ATOMIC_RELAXED);
+    stats->skipped = __atomic_load_n(&label_stats.skipped, __ATOMIC_RELAXED);
+}
+
 void get_file_informations(const char *path, bool *exists, bool *is_exec, bool *is_dir) {
     struct stat s;
     memset(&s, 0, sizeof(s));
@@ -128,6 +213,97 @@ int remove_file(const char *path) {
     return 0;
 }
 
+/**
+ * @brief Flush to the disk the entry of a file in its directory
+ *
+ * @param[in] path The path of the file
+ * @return 0 in case of success or a negative -errno value
+ */
+__nonnull() __wur static int sync_parent_dir(const char *path) {
+    char dir[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+    int rc = 0;
+
+    secure_strncpy(dir, path, sizeof(dir));
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL)
+        strcpy(dir, ".");
+    else if (slash == dir)
+        dir[1] = '\0';
+    else
+        *slash = '\0';
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) < 0) {
+        rc = -errno;
+        ERROR("fsync %s : %d %s", dir, -rc, strerror(-rc));
+    }
+    if (fd >= 0)
+        close(fd);
+    return rc;
+}
+
+/* see utils.h */
+int write_file(const char *path, const char *data, size_t size) {
+    int rc = 0;
+    int fd;
+    ssize_t len;
+    size_t pos = 0;
+    char tmp[SEC_LSM_MANAGER_MAX_SIZE_PATH];
+
+    // a unique name in the directory of the file: the writers don't collide
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp)) {
+        ERROR("path too long : %s", path);
+        return -ENAMETOOLONG;
+    }
+    fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0) {
+        rc = -errno;
+        ERROR("mkostemp %s : %d %s", tmp, -rc, strerror(-rc));
+        return rc;
+    }
+
+    if (fchmod(fd, 0644) < 0) {
+        rc = -errno;
+        ERROR("fchmod %s : %d %s", tmp, -rc, strerror(-rc));
+    }
+
+    while (rc == 0 && pos < size) {
+        len = write(fd, data + pos, size - pos);
+        if (len < 0 && errno != EINTR) {
+            rc = -errno;
+            ERROR("write %s : %d %s", tmp, -rc, strerror(-rc));
+            break;
+        }
+        if (len > 0) {
+            pos += (size_t)len;
+        }
+    }
+
+    // the content must be on the disk before the rename replaces the old file
+    if (rc == 0 && fsync(fd) < 0) {
+        rc = -errno;
+        ERROR("fsync %s : %d %s", tmp, -rc, strerror(-rc));
+    }
+
+    if (close(fd) < 0 && rc == 0) {
+        rc = -errno;
+        ERROR("close %s : %d %s", tmp, -rc, strerror(-rc));
+    }
+
+    if (rc == 0 && rename(tmp, path) < 0) {
+        rc = -errno;
+        ERROR("rename %s : %d %s", tmp, -rc, strerror(-rc));
+    }
+
+    if (rc < 0) {
+        unlink(tmp);
+        return rc;
+    }
+
+    // and the rename is durable once the directory is on the disk
+    return sync_parent_dir(path);
+}
+
 /* see utils.h */
 char *read_file(const char *filename) {
     int f;
@@ -30,6 +30,14 @@
 
 #include "limits.h"
 
+/**
+ * @brief Counters of the labels set
+ */
+typedef struct label_stats {
+    unsigned long written; /* labels written */
+    unsigned long skipped; /* labels already set, not written again */
+} label_stats_t;
+
 extern char *secure_strncpy(char *dest, const char *src, size_t n) __nonnull((1, 2));
 
 /**
@@ -39,8 +47,19 @@ extern char *secure_strncpy(char *dest, const char *src, size_t n) __nonnull((1,
  */
 extern bool valid_label(const char *s) __wur __nonnull();
 
+/**
+ * @brief Hash the 'len' first characters of a string (FNV-1a)
+ *
+ * @param[in] s String to hash
+ * @param[in] len Count of characters to hash
+ * @param[in] ignore_case Hash the lower case of the characters
+ * @return the hash value
+ */
+extern size_t hash_string(const char *s, size_t len, bool ignore_case) __wur __nonnull();
+
 /**
  * @brief Set label attr on file
+ * The label is written only if the file doesn't already have it.
  *
  * @param[in] path the path of the file
  * @param[in] xattr name of the extended attribute
@@ -49,6 +68,24 @@ extern bool valid_label(const char *s) __wur __nonnull();
  */
 extern int set_label(const char *path, const char *xattr, const char *value) __wur __nonnull();
 
+/**
+ * @brief Set label attr on an open file
+ * The label is written only if the file doesn't already have it.
+ *
+ * @param[in] fd the descriptor of the file
+ * @param[in] xattr name of the extended attribute
+ * @param[in] value value of the extended attribute
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int set_label_fd(int fd, const char *xattr, const char *value) __wur __nonnull();
+
+/**
+ * @brief Get the counters of the labels written and skipped
+ *
+ * @param[out] stats the counters
+ */
+extern void get_label_stats(label_stats_t *stats) __nonnull();
+
 /**
  * @brief Check if file exists
  *
@@ -83,4 +120,17 @@ extern int remove_file(const char *path) __wur __nonnull();
  */
 extern char *read_file(const char *path);
 
+/**
+ * @brief Write a whole file atomically
+ * The content is written in a temporary file of unique name, flushed to
+ * the disk and renamed over 'path', then the directory is flushed too.
+ * The file gets the mode 0644.
+ *
+ * @param[in] path The path of the file
+ * @param[in] data The content of the file
+ * @param[in] size The size of the content
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int write_file(const char *path, const char *data, size_t size) __wur __nonnull();
+
 #endif
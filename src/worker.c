@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+/******************************************************************************/
+/******************************************************************************/
+/* IMPLEMENTATION OF A POOL OF WORKER THREADS                                 */
+/******************************************************************************/
+/******************************************************************************/
+#include "worker.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "pollitem.h"
+
+typedef struct worker_job worker_job_t;
+
+/** structure of a submitted job */
+struct worker_job {
+    /** next job of the list */
+    worker_job_t *next;
+
+    /** function run by the worker */
+    worker_job_cb_t job;
+
+    /** function called on completion */
+    worker_done_cb_t done;
+
+    /** closure of job and done */
+    void *closure;
+
+    /** returned status of job */
+    int status;
+
+    /** key of the job */
+    char key[];
+};
+
+/** structure of the pool */
+struct worker_pool {
+    /** protects the lists and the flag stopping */
+    pthread_mutex_t mutex;
+
+    /** signals a change of the lists or of the flag stopping */
+    pthread_cond_t cond;
+
+    /** jobs waiting for a worker */
+    worker_job_t *pending;
+
+    /** jobs being run */
+    worker_job_t *running;
+
+    /** jobs completed, waiting for the dispatch of their completion */
+    worker_job_t *completed;
+
+    /** is the pool stopping? */
+    bool stopping;
+
+    /** count of threads */
+    unsigned count;
+
+    /** the threads */
+    pthread_t *threads;
+
+    /** the epoll of the completions */
+    int pollfd;
+
+    /** the eventfd signaling the completions */
+    pollitem_t pollitem;
+};
+
+/**
+ * @brief Append 'job' at the end of the list 'list'
+ *
+ * @param[in] list the list
+ * @param[in] job the job to append
+ */
+__nonnull() static void append_job(worker_job_t **list, worker_job_t *job) {
+    while (*list != NULL)
+        list = &(*list)->next;
+    job->next = NULL;
+    *list = job;
+}
+
+/**
+ * @brief Call the completion of the jobs of the list 'list' and free them
+ *
+ * @param[in] list the list
+ * @param[in] cancel if true, the status given to 'done' is -ECANCELED
+ */
+static void complete_jobs(worker_job_t *list, bool cancel) {
+    worker_job_t *job;
+
+    while (list != NULL) {
+        job = list;
+        list = job->next;
+        job->done(job->closure, cancel ? -ECANCELED : job->status);
+        free(job);
+    }
+}
+
+/**
+ * @brief Is a job of key 'key' running?
+ *
+ * @param[in] pool the pool
+ * @param[in] key the key to check
+ * @return true if a job of the key is running
+ */
+__nonnull() __wur static bool is_key_running(worker_pool_t *pool, const char *key) {
+    worker_job_t *job;
+
+    for (job = pool->running; job != NULL; job = job->next)
+        if (!strcmp(job->key, key))
+            return true;
+    return false;
+}
+
+/**
+ * @brief Unlink the first pending job whose key is not running
+ *
+ * @param[in] pool the pool
+ * @return the job or NULL if no job can be started
+ */
+__nonnull() __wur static worker_job_t *take_runnable_job(worker_pool_t *pool) {
+    worker_job_t **prev, *job;
+
+    for (prev = &pool->pending; (job = *prev) != NULL; prev = &job->next) {
+        if (!is_key_running(pool, job->key)) {
+            *prev = job->next;
+            return job;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Unlink 'job' of the list 'list'
+ *
+ * @param[in] list the list
+ * @param[in] job the job to unlink
+ */
+__nonnull() static void unlink_job(worker_job_t **list, worker_job_t *job) {
+    while (*list != job)
+        list = &(*list)->next;
+    *list = job->next;
+}
+
+/**
+ * @brief Main of the worker threads
+ *
+ * @param[in] arg the pool
+ * @return NULL
+ */
+static void *worker_main(void *arg) {
+    worker_pool_t *pool = arg;
+    worker_job_t *job;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stopping) {
+        job = take_runnable_job(pool);
+        if (job == NULL) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+            continue;
+        }
+
+        /* run the job unlocked */
+        job->next = pool->running;
+        pool->running = job;
+        pthread_mutex_unlock(&pool->mutex);
+        job->status = job->job(job->closure);
+        pthread_mutex_lock(&pool->mutex);
+
+        /* record its completion */
+        unlink_job(&pool->running, job);
+        append_job(&pool->completed, job);
+        if (write(pool->pollitem.fd, &one, sizeof one) < 0)
+            ERROR("can't signal completion : %d %s", errno, strerror(errno));
+
+        /* a job of the same key may be startable now */
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/**
+ * @brief Dispatch the completed jobs
+ *
+ * @param[in] pollitem pollitem of the eventfd
+ * @param[in] events events receive
+ * @param[in] pollfd pollfd of the pool
+ */
+static void on_completion_event(pollitem_t *pollitem, uint32_t events, int pollfd) {
+    worker_pool_t *pool = pollitem->closure;
+    worker_job_t *list;
+    uint64_t value;
+
+    (void)events;
+    (void)pollfd;
+
+    if (read(pollitem->fd, &value, sizeof value) < 0 && errno != EAGAIN)
+        ERROR("can't read completions : %d %s", errno, strerror(errno));
+
+    pthread_mutex_lock(&pool->mutex);
+    list = pool->completed;
+    pool->completed = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+
+    complete_jobs(list, false);
+}
+
+/**********************/
+/*** PUBLIC METHODS ***/
+/**********************/
+
+/* see worker.h */
+int worker_pool_create(worker_pool_t **pool, unsigned count, int pollfd) {
+    int rc;
+    worker_pool_t *p;
+
+    if (count == 0) {
+        ERROR("no worker");
+        return -EINVAL;
+    }
+
+    p = calloc(1, sizeof(*p));
+    if (p == NULL) {
+        ERROR("calloc worker_pool_t");
+        return -ENOMEM;
+    }
+    p->threads = calloc(count, sizeof(*p->threads));
+    if (p->threads == NULL) {
+        ERROR("calloc threads");
+        rc = -ENOMEM;
+        goto error;
+    }
+
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    p->pollfd = pollfd;
+
+    /* create the completion signal */
+    p->pollitem.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (p->pollitem.fd < 0) {
+        rc = -errno;
+        ERROR("eventfd : %d %s", -rc, strerror(-rc));
+        goto error2;
+    }
+    p->pollitem.handler = on_completion_event;
+    p->pollitem.closure = p;
+    rc = pollitem_add(&p->pollitem, EPOLLIN, pollfd);
+    if (rc < 0) {
+        rc = -errno;
+        ERROR("pollitem_add eventfd : %d %s", -rc, strerror(-rc));
+        goto error3;
+    }
+
+    /* start the threads */
+    for (p->count = 0; p->count < count; p->count++) {
+        rc = -pthread_create(&p->threads[p->count], NULL, worker_main, p);
+        if (rc < 0) {
+            ERROR("pthread_create : %d %s", -rc, strerror(-rc));
+            worker_pool_destroy(p);
+            return rc;
+        }
+    }
+
+    *pool = p;
+    return 0;
+
+error3:
+    close(p->pollitem.fd);
+error2:
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    free(p->threads);
+error:
+    free(p);
+    return rc;
+}
+
+/* see worker.h */
+void worker_pool_destroy(worker_pool_t *pool) {
+    worker_job_t *pending, *completed;
+    unsigned i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pollitem_del(&pool->pollitem, pool->pollfd);
+    close(pool->pollitem.fd);
+
+    /* no job waits forever for its completion */
+    pthread_mutex_lock(&pool->mutex);
+    pending = pool->pending;
+    completed = pool->completed;
+    pool->pending = pool->completed = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+    complete_jobs(completed, false);
+    complete_jobs(pending, true);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->threads);
+    free(pool);
+}
+
+/* see worker.h */
+int worker_pool_submit(worker_pool_t *pool, const char *key, worker_job_cb_t job, worker_done_cb_t done,
+                       void *closure) {
+    size_t len = strlen(key);
+    worker_job_t *item = malloc(sizeof(*item) + len + 1);
+
+    if (item == NULL) {
+        ERROR("malloc worker_job_t");
+        return -ENOMEM;
+    }
+    item->job = job;
+    item->done = done;
+    item->closure = closure;
+    item->status = 0;
+    memcpy(item->key, key, len + 1);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->mutex);
+        free(item);
+        return -ECANCELED;
+    }
+    append_job(&pool->pending, item);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
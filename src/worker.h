@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018-2023 IoT.bzh Company
+ *
+ * $RP_BEGIN_LICENSE$
+ * Commercial License Usage
+ *  Licensees holding valid commercial IoT.bzh licenses may use this file in
+ *  accordance with the commercial license agreement provided with the
+ *  Software or, alternatively, in accordance with the terms contained in
+ *  a written agreement between you and The IoT.bzh Company. For licensing terms
+ *  and conditions see https://www.iot.bzh/terms-conditions. For further
+ *  information use the contact form at https://www.iot.bzh/contact.
+ *
+ * GNU General Public License Usage
+ *  Alternatively, this file may be used under the terms of the GNU General
+ *  Public license version 3. This license is as published by the Free Software
+ *  Foundation and appearing in the file LICENSE.GPLv3 included in the packaging
+ *  of this file. Please review the following information to ensure the GNU
+ *  General Public License requirements will be met
+ *  https://www.gnu.org/licenses/gpl-3.0.html.
+ * $RP_END_LICENSE$
+ */
+
+#ifndef SEC_LSM_MANAGER_WORKER_H
+#define SEC_LSM_MANAGER_WORKER_H
+
+/******************************************************************************/
+/******************************************************************************/
+/* IMPLEMENTATION OF A POOL OF WORKER THREADS                                 */
+/******************************************************************************/
+/******************************************************************************/
+
+#include <sys/cdefs.h>
+
+typedef struct worker_pool worker_pool_t;
+
+/**
+ * @brief Function run by a worker thread
+ *
+ * @param[in] closure the closure given at submission
+ * @return 0 in case of success or a negative -errno value
+ */
+typedef int (*worker_job_cb_t)(void *closure);
+
+/**
+ * @brief Function called by the thread of the poll when a job completed
+ *
+ * @param[in] closure the closure given at submission
+ * @param[in] status the value returned by the job
+ */
+typedef void (*worker_done_cb_t)(void *closure, int status);
+
+/**
+ * @brief Create a pool of worker threads
+ * The completions of the jobs are signaled through an eventfd added
+ * to the epoll 'pollfd' and are dispatched by pollitem_wait_dispatch.
+ *
+ * @param[out] pool where to store the handler of the created pool
+ * @param[in] count count of worker threads (at least 1)
+ * @param[in] pollfd the file descriptor for epoll
+ * @return 0 in case of success or a negative -errno value
+ */
+extern int worker_pool_create(worker_pool_t **pool, unsigned count, int pollfd) __wur __nonnull();
+
+/**
+ * @brief Stop the worker threads and release the pool
+ * The running jobs are awaited. Then 'done' is called for the completions
+ * not yet dispatched, with their status, and for the jobs not yet started,
+ * with the status -ECANCELED. Jobs submitted meanwhile are refused.
+ *
+ * @param[in] pool the pool to destroy
+ */
+extern void worker_pool_destroy(worker_pool_t *pool) __nonnull();
+
+/**
+ * @brief Submit a job to the pool
+ * Jobs are started in order of submission, except that two jobs with the
+ * same key never run at the same time: a job waits until the running job
+ * of the same key completes.
+ *
+ * @param[in] pool the pool
+ * @param[in] key the key of the job (copied)
+ * @param[in] job the function to run in a worker thread
+ * @param[in] done the function called in the thread of the poll with the result
+ * @param[in] closure the closure of job and done
+ * @return 0 in case of success or a negative -errno value (-ECANCELED when
+ *         the pool is being destroyed)
+ */
+extern int worker_pool_submit(worker_pool_t *pool, const char *key, worker_job_cb_t job, worker_done_cb_t done,
+                              void *closure) __wur __nonnull((1, 2, 3, 4));
+
+#endif